@@ -875,6 +875,7 @@ static int pipe_to_sg(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 	} else {
 		/* Failback to copying a page */
 		struct page *page = alloc_page(GFP_KERNEL);
+		unsigned int src_offset = offset_in_page(buf->offset);
 		char *src;
 
 		if (!page)
@@ -882,12 +883,15 @@ static int pipe_to_sg(struct pipe_inode_info *pipe, struct pipe_buffer *buf,
 
 		offset = sd->pos & ~PAGE_MASK;
 
+		/* Pipe buffers may span several pages, copy one at a time */
 		len = sd->len;
 		if (len + offset > PAGE_SIZE)
 			len = PAGE_SIZE - offset;
+		if (len + src_offset > PAGE_SIZE)
+			len = PAGE_SIZE - src_offset;
 
-		src = kmap_atomic(buf->page);
-		memcpy(page_address(page) + offset, src + buf->offset, len);
+		src = kmap_atomic(nth_page(buf->page, buf->offset >> PAGE_SHIFT));
+		memcpy(page_address(page) + offset, src + src_offset, len);
 		kunmap_atomic(src);
 
 		sg_set_page(&(sgl->sg[sgl->n]), page, len, offset);
@@ -406,6 +406,33 @@ static unsigned long elf_map(struct file *filep, unsigned long addr,
 	return(map_addr);
 }
 
+/*
+ * PR_SET_EXEC_TEXT_PREFAULT: start reading in all of a text segment mapped
+ * at @addr by elf_map(), rather than leaving it to thousands of page faults.
+ * If the mapping and the file offset are PMD aligned, the segment is also
+ * marked MADV_HUGEPAGE and read into PMD sized folios, so that each fault
+ * can map a whole PMD.
+ */
+static void elf_prefault_text(struct file *filep, unsigned long addr,
+		const struct elf_phdr *eppnt)
+{
+	unsigned long size = eppnt->p_filesz + ELF_PAGEOFFSET(eppnt->p_vaddr);
+	unsigned long off = eppnt->p_offset - ELF_PAGEOFFSET(eppnt->p_vaddr);
+	unsigned int order = 0;
+
+	addr = ELF_PAGESTART(addr);
+	size = ELF_PAGEALIGN(size);
+	if (!size)
+		return;
+
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (size >= HPAGE_PMD_SIZE && IS_ALIGNED(addr - off, HPAGE_PMD_SIZE) &&
+	    !do_madvise(current->mm, addr, size, MADV_HUGEPAGE))
+		order = HPAGE_PMD_ORDER;
+#endif
+	page_cache_ra_range(filep, off >> PAGE_SHIFT, size >> PAGE_SHIFT, order);
+}
+
 static unsigned long total_mapping_size(const struct elf_phdr *phdr, int nr)
 {
 	elf_addr_t min_addr = -1;
@@ -1179,6 +1206,9 @@ out_free_interp:
 			}
 		}
 
+		if ((elf_ppnt->p_flags & PF_X) && task_exec_text_prefault(current))
+			elf_prefault_text(bprm->file, load_bias + vaddr, elf_ppnt);
+
 		/*
 		 * Figure out which segment in the file contains the Program
 		 * Header table, and map to the associated memory address.
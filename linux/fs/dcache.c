@@ -121,12 +121,23 @@ struct dentry_stat_t {
 	long age_limit;		/* age in seconds */
 	long want_pages;	/* pages requested by system */
 	long nr_negative;	/* # of unused negative dentries */
-	long dummy;		/* Reserved for future use */
+	long nr_negative_dropped; /* # of negatives not cached due to the limit */
 };
 
 static DEFINE_PER_CPU(long, nr_dentry);
 static DEFINE_PER_CPU(long, nr_dentry_unused);
 static DEFINE_PER_CPU(long, nr_dentry_negative);
+static DEFINE_PER_CPU(long, nr_dentry_negative_dropped);
+
+/*
+ * Upper bound on the number of unused negative dentries a single superblock
+ * keeps on its LRU, 0 means no limit.  Once a superblock is at the limit,
+ * dput() makes room for a new negative dentry by trimming the oldest unused
+ * negatives of that superblock, so a process probing lots of nonexistent
+ * names cannot flush the rest of the dcache.  Positive dentries are left
+ * alone.
+ */
+static unsigned long sysctl_negative_dentry_limit __read_mostly;
 
 #if defined(CONFIG_SYSCTL) && defined(CONFIG_PROC_FS)
 /* Statistics gathering. */
@@ -174,12 +185,23 @@ static long get_nr_dentry_negative(void)
 	return sum < 0 ? 0 : sum;
 }
 
+static long get_nr_dentry_negative_dropped(void)
+{
+	int i;
+	long sum = 0;
+
+	for_each_possible_cpu(i)
+		sum += per_cpu(nr_dentry_negative_dropped, i);
+	return sum;
+}
+
 static int proc_nr_dentry(struct ctl_table *table, int write, void *buffer,
 			  size_t *lenp, loff_t *ppos)
 {
 	dentry_stat.nr_dentry = get_nr_dentry();
 	dentry_stat.nr_unused = get_nr_dentry_unused();
 	dentry_stat.nr_negative = get_nr_dentry_negative();
+	dentry_stat.nr_negative_dropped = get_nr_dentry_negative_dropped();
 	return proc_doulongvec_minmax(table, write, buffer, lenp, ppos);
 }
 
@@ -191,6 +213,13 @@ static struct ctl_table fs_dcache_sysctls[] = {
 		.mode		= 0444,
 		.proc_handler	= proc_nr_dentry,
 	},
+	{
+		.procname	= "negative-dentry-limit",
+		.data		= &sysctl_negative_dentry_limit,
+		.maxlen		= sizeof(sysctl_negative_dentry_limit),
+		.mode		= 0644,
+		.proc_handler	= proc_doulongvec_minmax,
+	},
 	{ }
 };
 
@@ -349,6 +378,22 @@ static inline void __d_set_inode_and_type(struct dentry *dentry,
 	smp_store_release(&dentry->d_flags, flags);
 }
 
+/*
+ * Negative dentries on the LRU are counted both globally, for dentry-state,
+ * and per superblock, for negative-dentry-limit.
+ */
+static inline void d_negative_inc(struct dentry *dentry)
+{
+	this_cpu_inc(nr_dentry_negative);
+	percpu_counter_inc(&dentry->d_sb->s_nr_dentry_negative);
+}
+
+static inline void d_negative_dec(struct dentry *dentry)
+{
+	this_cpu_dec(nr_dentry_negative);
+	percpu_counter_dec(&dentry->d_sb->s_nr_dentry_negative);
+}
+
 static inline void __d_clear_type_and_inode(struct dentry *dentry)
 {
 	unsigned flags = READ_ONCE(dentry->d_flags);
@@ -361,7 +406,7 @@ static inline void __d_clear_type_and_inode(struct dentry *dentry)
 	 * d_lru is on another list.
 	 */
 	if ((flags & (DCACHE_LRU_LIST|DCACHE_SHRINK_LIST)) == DCACHE_LRU_LIST)
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 }
 
 static void dentry_free(struct dentry *dentry)
@@ -431,7 +476,7 @@ static void d_lru_add(struct dentry *dentry)
 	dentry->d_flags |= DCACHE_LRU_LIST;
 	this_cpu_inc(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_inc(nr_dentry_negative);
+		d_negative_inc(dentry);
 	WARN_ON_ONCE(!list_lru_add(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -441,7 +486,7 @@ static void d_lru_del(struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	WARN_ON_ONCE(!list_lru_del(&dentry->d_sb->s_dentry_lru, &dentry->d_lru));
 }
 
@@ -473,7 +518,7 @@ static void d_lru_isolate(struct list_lru_one *lru, struct dentry *dentry)
 	dentry->d_flags &= ~DCACHE_LRU_LIST;
 	this_cpu_dec(nr_dentry_unused);
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate(lru, &dentry->d_lru);
 }
 
@@ -483,7 +528,7 @@ static void d_lru_shrink_move(struct list_lru_one *lru, struct dentry *dentry,
 	D_FLAG_VERIFY(dentry, DCACHE_LRU_LIST);
 	dentry->d_flags |= DCACHE_SHRINK_LIST;
 	if (d_is_negative(dentry))
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	list_lru_isolate_move(lru, &dentry->d_lru, list);
 }
 
@@ -664,7 +709,28 @@ static inline struct dentry *lock_parent(struct dentry *dentry)
 	return __lock_parent(dentry);
 }
 
-static inline bool retain_dentry(struct dentry *dentry)
+/*
+ * The per-superblock counter is only read approximately; overshooting the
+ * limit by a per-cpu batch is fine for what is a memory bound.
+ */
+static inline bool d_negative_over_limit(struct dentry *dentry)
+{
+	unsigned long limit = READ_ONCE(sysctl_negative_dentry_limit);
+
+	if (likely(!limit))
+		return false;
+	return percpu_counter_read_positive(&dentry->d_sb->s_nr_dentry_negative) >= limit;
+}
+
+static bool d_trim_negatives(struct super_block *sb, struct list_head *dispose);
+
+/*
+ * @dispose collects the negatives trimmed to make room for @dentry, see
+ * negative-dentry-limit.  Without it, a new negative over the limit is not
+ * cached.
+ */
+static inline bool retain_dentry(struct dentry *dentry,
+				 struct list_head *dispose)
 {
 	WARN_ON(d_in_lookup(dentry));
 
@@ -683,6 +749,18 @@ static inline bool retain_dentry(struct dentry *dentry)
 	if (unlikely(dentry->d_flags & DCACHE_DONTCACHE))
 		return false;
 
+	/*
+	 * A new negative on an LRU that already holds too many replaces the
+	 * oldest ones.  If none can be trimmed, it is not cached either.
+	 */
+	if (unlikely(d_is_negative(dentry) &&
+		     !(dentry->d_flags & DCACHE_LRU_LIST) &&
+		     d_negative_over_limit(dentry) &&
+		     (!dispose || !d_trim_negatives(dentry->d_sb, dispose)))) {
+		this_cpu_inc(nr_dentry_negative_dropped);
+		return false;
+	}
+
 	/* retain; LRU fodder */
 	dentry->d_lockref.count--;
 	if (unlikely(!(dentry->d_flags & DCACHE_LRU_LIST)))
@@ -745,7 +823,7 @@ slow_positive:
 got_locks:
 	if (unlikely(dentry->d_lockref.count != 1)) {
 		dentry->d_lockref.count--;
-	} else if (likely(!retain_dentry(dentry))) {
+	} else if (likely(!retain_dentry(dentry, NULL))) {
 		__dentry_kill(dentry);
 		return parent;
 	}
@@ -898,6 +976,8 @@ locked:
  */
 void dput(struct dentry *dentry)
 {
+	LIST_HEAD(dispose);
+
 	while (dentry) {
 		might_sleep();
 
@@ -910,8 +990,10 @@ void dput(struct dentry *dentry)
 		/* Slow case: now with the dentry lock held */
 		rcu_read_unlock();
 
-		if (likely(retain_dentry(dentry))) {
+		if (likely(retain_dentry(dentry, &dispose))) {
 			spin_unlock(&dentry->d_lock);
+			if (unlikely(!list_empty(&dispose)))
+				shrink_dentry_list(&dispose);
 			return;
 		}
 
@@ -942,7 +1024,7 @@ void dput_to_list(struct dentry *dentry, struct list_head *list)
 		return;
 	}
 	rcu_read_unlock();
-	if (!retain_dentry(dentry))
+	if (!retain_dentry(dentry, list))
 		__dput_to_list(dentry, list);
 	spin_unlock(&dentry->d_lock);
 }
@@ -1265,6 +1347,35 @@ static enum lru_status dentry_lru_isolate(struct list_head *item,
 	return LRU_REMOVED;
 }
 
+/*
+ * Negative dentries are trimmed in small batches, each looking at no more
+ * than this many LRU entries from the oldest end.
+ */
+#define NEGATIVE_TRIM_WALK	64
+
+static enum lru_status dentry_lru_isolate_negative(struct list_head *item,
+		struct list_lru_one *lru, spinlock_t *lru_lock, void *arg)
+{
+	struct dentry *dentry = container_of(item, struct dentry, d_lru);
+
+	/* Positive dentries keep their place on the LRU */
+	if (!d_is_negative(dentry))
+		return LRU_SKIP;
+	return dentry_lru_isolate(item, lru, lru_lock, arg);
+}
+
+/*
+ * Move the oldest unused negative dentries of @sb to @dispose, returns
+ * false if there were none among the first NEGATIVE_TRIM_WALK entries of
+ * its LRU.  The caller holds the lock of one of its dentries, which keeps
+ * @sb alive; the dentries on @dispose keep it alive after that.
+ */
+static bool d_trim_negatives(struct super_block *sb, struct list_head *dispose)
+{
+	return list_lru_walk(&sb->s_dentry_lru, dentry_lru_isolate_negative,
+			     dispose, NEGATIVE_TRIM_WALK) > 0;
+}
+
 /**
  * prune_dcache_sb - shrink the dcache
  * @sb: superblock
@@ -2009,7 +2120,7 @@ static void __d_instantiate(struct dentry *dentry, struct inode *inode)
 	 */
 	if ((dentry->d_flags &
 	     (DCACHE_LRU_LIST|DCACHE_SHRINK_LIST)) == DCACHE_LRU_LIST)
-		this_cpu_dec(nr_dentry_negative);
+		d_negative_dec(dentry);
 	hlist_add_head(&dentry->d_u.d_alias, &inode->i_dentry);
 	raw_write_seqcount_begin(&dentry->d_seq);
 	__d_set_inode_and_type(dentry, inode, add_flags);
@@ -139,7 +139,8 @@ struct epitem {
 	struct list_head rdllink;
 
 	/*
-	 * Works together "struct eventpoll"->ovflist in keeping the
+	 * Works together "struct eventpoll"->ovflist, or with the per-CPU
+	 * ready sublists of "struct eventpoll"->pcpu_ready, in keeping the
 	 * single linked chain of items.
 	 */
 	struct epitem *next;
@@ -206,6 +207,14 @@ struct eventpoll {
 	 */
 	struct epitem *ovflist;
 
+	/*
+	 * Per-CPU ready sublists, only allocated for EPOLL_PERCPU_READY.
+	 * The poll callback pushes items here through epi->next without
+	 * touching ->lock, and they are spliced into ->rdllist by
+	 * ep_pcpu_ready_splice(). ->ovflist is then unused.
+	 */
+	struct epitem * __percpu *pcpu_ready;
+
 	/* wakeup_source used when ep_scan_ready_list is running */
 	struct wakeup_source *ws;
 
@@ -218,6 +227,12 @@ struct eventpoll {
 	u64 gen;
 	struct hlist_head refs;
 
+	/*
+	 * Number of items removed because their file went away, lets cached
+	 * poll(2) notice closed descriptors. See eventpoll_private_create().
+	 */
+	unsigned int released;
+
 	/*
 	 * usage count, used together with epitem->dying to
 	 * orchestrate the disposal of this struct
@@ -373,6 +388,21 @@ static inline struct epitem *ep_item_from_wait(wait_queue_entry_t *p)
 	return container_of(p, struct eppoll_entry, wait)->base;
 }
 
+/* Tells us if some per-CPU ready sublist still has items to be spliced */
+static bool ep_pcpu_ready_pending(struct eventpoll *ep)
+{
+	int cpu;
+
+	if (!ep->pcpu_ready)
+		return false;
+
+	for_each_possible_cpu(cpu) {
+		if (READ_ONCE(*per_cpu_ptr(ep->pcpu_ready, cpu)))
+			return true;
+	}
+	return false;
+}
+
 /**
  * ep_events_available - Checks if ready events might be available.
  *
@@ -384,7 +414,8 @@ static inline struct epitem *ep_item_from_wait(wait_queue_entry_t *p)
 static inline int ep_events_available(struct eventpoll *ep)
 {
 	return !list_empty_careful(&ep->rdllist) ||
-		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR;
+		READ_ONCE(ep->ovflist) != EP_UNACTIVE_PTR ||
+		ep_pcpu_ready_pending(ep);
 }
 
 #ifdef CONFIG_NET_RX_BUSY_POLL
@@ -609,6 +640,42 @@ static inline void ep_pm_stay_awake_rcu(struct epitem *epi)
 }
 
 
+/*
+ * Moves everything queued on the per-CPU ready sublists to ->rdllist.
+ * Must be called with "mtx" and the write side of ->lock held, which
+ * keeps ep_send_events() and epoll_ctl() away from ->rdllist; the poll
+ * callback can keep pushing concurrently since each sublist is detached
+ * atomically before being walked.
+ */
+static void ep_pcpu_ready_splice(struct eventpoll *ep)
+{
+	struct epitem *epi, *nepi;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct epitem **head = per_cpu_ptr(ep->pcpu_ready, cpu);
+		LIST_HEAD(batch);
+
+		if (!READ_ONCE(*head))
+			continue;
+
+		for (nepi = xchg(head, NULL); (epi = nepi) != NULL;) {
+			nepi = epi->next;
+			/*
+			 * The item might already sit on ->rdllist, or on the
+			 * txlist of the scan that is completing. Sublists are
+			 * LIFO, so add at the head of the batch to restore
+			 * FIFO order.
+			 */
+			if (!ep_is_linked(epi))
+				list_add(&epi->rdllink, &batch);
+			/* Pairs with the cmpxchg() in ep_pcpu_ready_add() */
+			smp_store_release(&epi->next, EP_UNACTIVE_PTR);
+		}
+		list_splice_tail(&batch, &ep->rdllist);
+	}
+}
+
 /*
  * ep->mutex needs to be held because we could be hit by
  * eventpoll_release_file() and epoll_ctl().
@@ -625,8 +692,18 @@ static void ep_start_scan(struct eventpoll *ep, struct list_head *txlist)
 	 */
 	lockdep_assert_irqs_enabled();
 	write_lock_irq(&ep->lock);
-	list_splice_init(&ep->rdllist, txlist);
-	WRITE_ONCE(ep->ovflist, NULL);
+	if (ep->pcpu_ready) {
+		/*
+		 * The poll callback never touches ->rdllist in this mode,
+		 * events happening during the scan simply stay on the per-CPU
+		 * sublists until the next splice, so ->ovflist is not needed.
+		 */
+		ep_pcpu_ready_splice(ep);
+		list_splice_init(&ep->rdllist, txlist);
+	} else {
+		list_splice_init(&ep->rdllist, txlist);
+		WRITE_ONCE(ep->ovflist, NULL);
+	}
 	write_unlock_irq(&ep->lock);
 }
 
@@ -639,9 +716,12 @@ static void ep_done_scan(struct eventpoll *ep,
 	/*
 	 * During the time we spent inside the "sproc" callback, some
 	 * other events might have been queued by the poll callback.
-	 * We re-insert them inside the main ready-list here.
+	 * We re-insert them inside the main ready-list here. With per-CPU
+	 * ready sublists ->ovflist was never activated, so there is nothing
+	 * to walk.
 	 */
-	for (nepi = READ_ONCE(ep->ovflist); (epi = nepi) != NULL;
+	for (nepi = ep->pcpu_ready ? NULL : READ_ONCE(ep->ovflist);
+	     (epi = nepi) != NULL;
 	     nepi = epi->next, epi->next = EP_UNACTIVE_PTR) {
 		/*
 		 * We need to check if the item is already in the list.
@@ -663,7 +743,8 @@ static void ep_done_scan(struct eventpoll *ep,
 	 * releasing the lock, events will be queued in the normal way inside
 	 * ep->rdllist.
 	 */
-	WRITE_ONCE(ep->ovflist, EP_UNACTIVE_PTR);
+	if (!ep->pcpu_ready)
+		WRITE_ONCE(ep->ovflist, EP_UNACTIVE_PTR);
 
 	/*
 	 * Quickly re-inject items left on "txlist".
@@ -704,6 +785,7 @@ static bool ep_refcount_dec_and_test(struct eventpoll *ep)
 
 static void ep_free(struct eventpoll *ep)
 {
+	free_percpu(ep->pcpu_ready);
 	mutex_destroy(&ep->mtx);
 	free_uid(ep->user);
 	wakeup_source_unregister(ep->ws);
@@ -756,6 +838,12 @@ static bool __ep_remove(struct eventpoll *ep, struct epitem *epi, bool force)
 	rb_erase_cached(&epi->rbn, &ep->rbr);
 
 	write_lock_irq(&ep->lock);
+	/*
+	 * The pollwait hooks are gone, so nothing can chain the item anymore,
+	 * but it may still be sitting on a per-CPU ready sublist.
+	 */
+	if (ep->pcpu_ready && READ_ONCE(epi->next) != EP_UNACTIVE_PTR)
+		ep_pcpu_ready_splice(ep);
 	if (ep_is_linked(epi))
 		list_del_init(&epi->rdllink);
 	write_unlock_irq(&ep->lock);
@@ -999,6 +1087,7 @@ again:
 		 */
 		ep = epi->ep;
 		mutex_lock(&ep->mtx);
+		WRITE_ONCE(ep->released, ep->released + 1);
 		dispose = __ep_remove(ep, epi, true);
 		mutex_unlock(&ep->mtx);
 
@@ -1009,7 +1098,7 @@ again:
 	spin_unlock(&file->f_lock);
 }
 
-static int ep_alloc(struct eventpoll **pep)
+static int ep_alloc(struct eventpoll **pep, int flags)
 {
 	struct eventpoll *ep;
 
@@ -1017,6 +1106,14 @@ static int ep_alloc(struct eventpoll **pep)
 	if (unlikely(!ep))
 		return -ENOMEM;
 
+	if (flags & EPOLL_PERCPU_READY) {
+		ep->pcpu_ready = alloc_percpu(struct epitem *);
+		if (unlikely(!ep->pcpu_ready)) {
+			kfree(ep);
+			return -ENOMEM;
+		}
+	}
+
 	mutex_init(&ep->mtx);
 	rwlock_init(&ep->lock);
 	init_waitqueue_head(&ep->wq);
@@ -1182,6 +1279,117 @@ static inline bool chain_epi_lockless(struct epitem *epi)
 	return true;
 }
 
+/*
+ * Pushes @epi onto the ready sublist of the local CPU, without taking
+ * ep->lock, i.e. multiple CPUs are allowed to call this function
+ * concurrently. epi->next is claimed with cmpxchg() exactly as in
+ * chain_epi_lockless(), but it is set before the item is published so
+ * that ep_pcpu_ready_splice() can walk a detached sublist while other
+ * items are still being pushed.
+ *
+ * Return: %false if epi element has been already chained, %true otherwise.
+ * *@first is set when the sublist was empty, i.e. when nobody pushed
+ * since the last splice and a wakeup is due.
+ */
+static inline bool ep_pcpu_ready_add(struct epitem *epi, bool *first)
+{
+	struct epitem **head = this_cpu_ptr(epi->ep->pcpu_ready);
+	struct epitem *old;
+
+	*first = false;
+
+	/* Fast preliminary check */
+	if (READ_ONCE(epi->next) != EP_UNACTIVE_PTR)
+		return false;
+
+	/* Check that the same epi has not been just chained from another CPU */
+	if (cmpxchg(&epi->next, EP_UNACTIVE_PTR, NULL) != EP_UNACTIVE_PTR)
+		return false;
+
+	old = READ_ONCE(*head);
+	do {
+		WRITE_ONCE(epi->next, old);
+	} while (!try_cmpxchg(head, &old, epi));
+
+	*first = !old;
+	return true;
+}
+
+/*
+ * Tells if waking up an EPOLLEXCLUSIVE waiter on behalf of @epi consumes
+ * the wakeup, see ep_poll_callback().
+ */
+static inline int ep_exclusive_ewake(struct epitem *epi, __poll_t pollflags)
+{
+	if (!(epi->event.events & EPOLLEXCLUSIVE) || (pollflags & POLLFREE))
+		return 0;
+
+	switch (pollflags & EPOLLINOUT_BITS) {
+	case EPOLLIN:
+		return !!(epi->event.events & EPOLLIN);
+	case EPOLLOUT:
+		return !!(epi->event.events & EPOLLOUT);
+	case 0:
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * ep_poll_callback() flavour for EPOLL_PERCPU_READY instances. The item
+ * goes on the ready sublist of the local CPU, so no shared list head is
+ * written from the wakeup path, and ep->lock is only taken when there is
+ * somebody to wake up.
+ *
+ * Wakeups are batched: only the push that makes a sublist non-empty
+ * wakes the waiters, later ones find a waiter either already woken by
+ * that push, or about to see the pending sublist in ep_poll() before it
+ * goes to sleep.
+ */
+static int ep_poll_callback_pcpu(struct epitem *epi, __poll_t pollflags)
+{
+	struct eventpoll *ep = epi->ep;
+	int pwake = 0, ewake = 0;
+	unsigned long flags;
+	bool first;
+
+	ep_set_busy_poll_napi_id(epi);
+
+	/* See ep_poll_callback() for both checks */
+	if (!(epi->event.events & ~EP_PRIVATE_BITS))
+		return 0;
+	if (pollflags && !(pollflags & epi->event.events))
+		return 0;
+
+	if (ep_pcpu_ready_add(epi, &first))
+		ep_pm_stay_awake_rcu(epi);
+
+	/*
+	 * The successful cmpxchg() in ep_pcpu_ready_add() is fully ordered,
+	 * pairing with the smp_mb() between queueing and the final
+	 * ep_pcpu_ready_pending() check in ep_poll(): either we see the
+	 * waiter here, or it sees our item. ep_poll() manipulates ep->wq
+	 * under the write side of ep->lock, hence the read lock around the
+	 * wakeup itself, as in ep_poll_callback().
+	 */
+	if (first && (waitqueue_active(&ep->wq) ||
+		      waitqueue_active(&ep->poll_wait))) {
+		read_lock_irqsave(&ep->lock, flags);
+		if (waitqueue_active(&ep->wq)) {
+			ewake = ep_exclusive_ewake(epi, pollflags);
+			wake_up(&ep->wq);
+		}
+		if (waitqueue_active(&ep->poll_wait))
+			pwake++;
+		read_unlock_irqrestore(&ep->lock, flags);
+	}
+
+	if (pwake)
+		ep_poll_safewake(ep, epi, pollflags & EPOLL_URING_WAKE);
+
+	return ewake;
+}
+
 /*
  * This is the callback that is passed to the wait queue wakeup
  * mechanism. It is called by the stored file descriptors when they
@@ -1209,6 +1417,11 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	unsigned long flags;
 	int ewake = 0;
 
+	if (ep->pcpu_ready) {
+		ewake = ep_poll_callback_pcpu(epi, pollflags);
+		goto out_ewake;
+	}
+
 	read_lock_irqsave(&ep->lock, flags);
 
 	ep_set_busy_poll_napi_id(epi);
@@ -1251,22 +1464,7 @@ static int ep_poll_callback(wait_queue_entry_t *wait, unsigned mode, int sync, v
 	 * wait list.
 	 */
 	if (waitqueue_active(&ep->wq)) {
-		if ((epi->event.events & EPOLLEXCLUSIVE) &&
-					!(pollflags & POLLFREE)) {
-			switch (pollflags & EPOLLINOUT_BITS) {
-			case EPOLLIN:
-				if (epi->event.events & EPOLLIN)
-					ewake = 1;
-				break;
-			case EPOLLOUT:
-				if (epi->event.events & EPOLLOUT)
-					ewake = 1;
-				break;
-			case 0:
-				ewake = 1;
-				break;
-			}
-		}
+		ewake = ep_exclusive_ewake(epi, pollflags);
 		wake_up(&ep->wq);
 	}
 	if (waitqueue_active(&ep->poll_wait))
@@ -1279,6 +1477,7 @@ out_unlock:
 	if (pwake)
 		ep_poll_safewake(ep, epi, pollflags & EPOLL_URING_WAKE);
 
+out_ewake:
 	if (!(epi->event.events & EPOLLEXCLUSIVE))
 		ewake = 1;
 
@@ -1709,8 +1908,13 @@ static int ep_modify(struct eventpoll *ep, struct epitem *epi,
 	return 0;
 }
 
+/*
+ * Events go to the user buffer @events, or to the kernel buffer @kevents if
+ * that is given.
+ */
 static int ep_send_events(struct eventpoll *ep,
-			  struct epoll_event __user *events, int maxevents)
+			  struct epoll_event __user *events,
+			  struct epoll_event *kevents, int maxevents)
 {
 	struct epitem *epi, *tmp;
 	LIST_HEAD(txlist);
@@ -1768,13 +1972,19 @@ static int ep_send_events(struct eventpoll *ep,
 		if (!revents)
 			continue;
 
-		events = epoll_put_uevent(revents, epi->event.data, events);
-		if (!events) {
-			list_add(&epi->rdllink, &txlist);
-			ep_pm_stay_awake(epi);
-			if (!res)
-				res = -EFAULT;
-			break;
+		if (kevents) {
+			kevents[res].events = revents;
+			kevents[res].data = epi->event.data;
+		} else {
+			events = epoll_put_uevent(revents, epi->event.data,
+						  events);
+			if (!events) {
+				list_add(&epi->rdllink, &txlist);
+				ep_pm_stay_awake(epi);
+				if (!res)
+					res = -EFAULT;
+				break;
+			}
 		}
 		res++;
 		if (epi->event.events & EPOLLONESHOT)
@@ -1848,6 +2058,7 @@ static int ep_autoremove_wake_function(struct wait_queue_entry *wq_entry,
  * @ep: Pointer to the eventpoll context.
  * @events: Pointer to the userspace buffer where the ready events should be
  *          stored.
+ * @kevents: Kernel buffer to store the events in instead of @events, or NULL.
  * @maxevents: Size (in terms of number of events) of the caller event buffer.
  * @timeout: Maximum timeout for the ready events fetch operation, in
  *           timespec. If the timeout is zero, the function will not block,
@@ -1859,7 +2070,8 @@ static int ep_autoremove_wake_function(struct wait_queue_entry *wq_entry,
  *          error code, in case of error.
  */
 static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
-		   int maxevents, struct timespec64 *timeout)
+		   struct epoll_event *kevents, int maxevents,
+		   struct timespec64 *timeout)
 {
 	int res, eavail, timed_out = 0;
 	u64 slack = 0;
@@ -1897,7 +2109,7 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 			 * 0 events and there's still timeout left over, we go
 			 * trying again in search of more luck.
 			 */
-			res = ep_send_events(ep, events, maxevents);
+			res = ep_send_events(ep, events, kevents, maxevents);
 			if (res)
 				return res;
 		}
@@ -1948,8 +2160,20 @@ static int ep_poll(struct eventpoll *ep, struct epoll_event __user *events,
 		 * important.
 		 */
 		eavail = ep_events_available(ep);
-		if (!eavail)
+		if (!eavail) {
 			__add_wait_queue_exclusive(&ep->wq, &wait);
+			/*
+			 * The per-CPU ready sublists are fed without ep->lock,
+			 * so queue first and look again after a full barrier,
+			 * pairing with ep_poll_callback_pcpu().
+			 */
+			if (ep->pcpu_ready) {
+				smp_mb();
+				eavail = ep_pcpu_ready_pending(ep);
+				if (eavail)
+					__remove_wait_queue(&ep->wq, &wait);
+			}
+		}
 
 		write_unlock_irq(&ep->lock);
 
@@ -2072,12 +2296,12 @@ static int do_epoll_create(int flags)
 	/* Check the EPOLL_* constant for consistency.  */
 	BUILD_BUG_ON(EPOLL_CLOEXEC != O_CLOEXEC);
 
-	if (flags & ~EPOLL_CLOEXEC)
+	if (flags & ~(EPOLL_CLOEXEC | EPOLL_PERCPU_READY))
 		return -EINVAL;
 	/*
 	 * Create the internal data structure ("struct eventpoll").
 	 */
-	error = ep_alloc(&ep);
+	error = ep_alloc(&ep, flags);
 	if (error < 0)
 		return error;
 	/*
@@ -2295,6 +2519,99 @@ error_return:
 	return error;
 }
 
+/*
+ * Private eventpoll instances, without a file descriptor, that keep the wait
+ * queue registrations of poll(2) alive across calls. See do_poll_cached().
+ * Nobody else can reach them, so they are never nested in or watching other
+ * eventpoll files and need none of the loop checks.
+ */
+struct file *eventpoll_private_create(void)
+{
+	struct eventpoll *ep;
+	struct file *file;
+	int error;
+
+	error = ep_alloc(&ep, 0);
+	if (error < 0)
+		return ERR_PTR(error);
+
+	file = anon_inode_getfile("[eventpoll]", &eventpoll_fops, ep, O_RDWR);
+	if (IS_ERR(file)) {
+		ep_clear_and_put(ep);
+		return file;
+	}
+	ep->file = file;
+	return file;
+}
+
+/*
+ * Watch @tfile, open as @fd, for @events and report it with @data, adding
+ * it to the private eventpoll @file or updating its entry.  Returns -EEXIST
+ * if it is already watched with other @data.
+ */
+int eventpoll_private_ctl(struct file *file, struct file *tfile, int fd,
+			  __poll_t events, u64 data)
+{
+	struct eventpoll *ep = file->private_data;
+	struct epoll_event epds = {
+		.events = events | EPOLLERR | EPOLLHUP,
+		.data	= data,
+	};
+	struct epitem *epi;
+	int error;
+
+	if (!file_can_poll(tfile) || is_file_epoll(tfile))
+		return -EPERM;
+
+	mutex_lock(&ep->mtx);
+	epi = ep_find(ep, tfile, fd);
+	if (!epi)
+		error = ep_insert(ep, &epds, tfile, fd, 0);
+	else if (epi->event.data != epds.data)
+		error = -EEXIST;
+	else if (epi->event.events != epds.events)
+		error = ep_modify(ep, epi, &epds);
+	else
+		error = 0;
+	mutex_unlock(&ep->mtx);
+
+	return error;
+}
+
+/*
+ * Stop watching @tfile as @fd.  @tfile is only compared against, it may
+ * already have been released.
+ */
+void eventpoll_private_del(struct file *file, struct file *tfile, int fd)
+{
+	struct eventpoll *ep = file->private_data;
+	struct epitem *epi;
+
+	mutex_lock(&ep->mtx);
+	epi = ep_find(ep, tfile, fd);
+	if (epi)
+		ep_remove_safe(ep, epi);
+	mutex_unlock(&ep->mtx);
+}
+
+/* Number of entries dropped so far because their file was released */
+unsigned int eventpoll_private_released(struct file *file)
+{
+	struct eventpoll *ep = file->private_data;
+
+	return READ_ONCE(ep->released);
+}
+
+/*
+ * epoll_wait() on a private eventpoll, into the kernel buffer @events.
+ * @timeout is absolute as for ep_poll().
+ */
+int eventpoll_private_wait(struct file *file, struct epoll_event *events,
+			   int maxevents, struct timespec64 *timeout)
+{
+	return ep_poll(file->private_data, NULL, events, maxevents, timeout);
+}
+
 /*
  * The following function implements the controller interface for
  * the eventpoll file that enables the insertion/removal/change of
@@ -2351,7 +2668,7 @@ static int do_epoll_wait(int epfd, struct epoll_event __user *events,
 	ep = f.file->private_data;
 
 	/* Time to fish for events ... */
-	error = ep_poll(ep, events, maxevents, to);
+	error = ep_poll(ep, events, NULL, maxevents, to);
 
 error_fput:
 	fdput(f);
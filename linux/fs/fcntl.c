@@ -407,6 +407,8 @@ static long do_fcntl(int fd, unsigned int cmd, unsigned long arg,
 		break;
 	case F_SETPIPE_SZ:
 	case F_GETPIPE_SZ:
+	case F_SETPIPE_BUF_SZ:
+	case F_GETPIPE_BUF_SZ:
 		err = pipe_fcntl(filp, cmd, argi);
 		break;
 	case F_ADD_SEALS:
@@ -20,6 +20,8 @@
 #include <linux/spinlock.h>
 #include <linux/rcupdate.h>
 #include <linux/close_range.h>
+#include <linux/prctl.h>
+#include <linux/poll.h>
 #include <net/sock.h>
 
 #include "internal.h"
@@ -329,8 +331,10 @@ struct files_struct *dup_fd(struct files_struct *oldf, unsigned int max_fds, int
 
 	spin_lock_init(&newf->file_lock);
 	newf->resize_in_progress = false;
+	newf->any_fd = READ_ONCE(oldf->any_fd);
 	init_waitqueue_head(&newf->resize_wait);
 	newf->next_fd = 0;
+	INIT_LIST_HEAD(&newf->fd_caches);
 	new_fdt = &newf->fdtab;
 	new_fdt->max_fds = NR_OPEN_DEFAULT;
 	new_fdt->close_on_exec = newf->close_on_exec_init;
@@ -453,11 +457,16 @@ void put_files_struct(struct files_struct *files)
 	}
 }
 
+static void fd_cache_release(struct task_struct *tsk);
+
 void exit_files(struct task_struct *tsk)
 {
 	struct files_struct * files = tsk->files;
 
 	if (files) {
+		exit_poll_cache(tsk);
+		if (tsk->fd_cache)
+			fd_cache_release(tsk);
 		task_lock(tsk);
 		tsk->files = NULL;
 		task_unlock(tsk);
@@ -477,6 +486,7 @@ struct files_struct init_files = {
 	},
 	.file_lock	= __SPIN_LOCK_UNLOCKED(init_files.file_lock),
 	.resize_wait	= __WAIT_QUEUE_HEAD_INITIALIZER(init_files.resize_wait),
+	.fd_caches	= LIST_HEAD_INIT(init_files.fd_caches),
 };
 
 static unsigned int find_next_fd(struct fdtable *fdt, unsigned int start)
@@ -494,16 +504,16 @@ static unsigned int find_next_fd(struct fdtable *fdt, unsigned int start)
 }
 
 /*
- * allocate a file descriptor, mark it busy.
+ * allocate a file descriptor, mark it busy.  Called with files->file_lock
+ * held, which expand_files() may drop and retake.
  */
-static int alloc_fd(unsigned start, unsigned end, unsigned flags)
+static int __alloc_fd(struct files_struct *files,
+		      unsigned start, unsigned end, unsigned flags)
 {
-	struct files_struct *files = current->files;
 	unsigned int fd;
 	int error;
 	struct fdtable *fdt;
 
-	spin_lock(&files->file_lock);
 repeat:
 	fdt = files_fdtable(files);
 	fd = start;
@@ -550,15 +560,238 @@ repeat:
 #endif
 
 out:
-	spin_unlock(&files->file_lock);
 	return error;
 }
 
+static int alloc_fd(unsigned start, unsigned end, unsigned flags)
+{
+	struct files_struct *files = current->files;
+	int fd;
+
+	spin_lock(&files->file_lock);
+	fd = __alloc_fd(files, start, end, flags);
+	spin_unlock(&files->file_lock);
+	return fd;
+}
+
+/*
+ * Threads of a process that asked for PR_FD_ALLOC_ANY reserve descriptors in
+ * batches.  A reserved descriptor is marked in open_fds with no file installed,
+ * like one between get_unused_fd_flags() and fd_install(), so nobody else can
+ * allocate it while its thread hands it out without file_lock.
+ *
+ * Unlike such a descriptor, a reservation can be taken back.  Every cache is
+ * on files->fd_caches, and whoever holds file_lock may claim any entry with
+ * cmpxchg(): dup2() onto a reserved descriptor, and the switch back to
+ * PR_FD_ALLOC_LOWEST, which returns every reservation to the table.  The
+ * owning thread claims its entries with xchg() and skips the ones that are
+ * gone.  Only the owner changes ->next and ->nr, ->nr only under file_lock.
+ *
+ * A cache only ever refers to the current ->files of its task: every place
+ * that replaces ->files (exit, unshare and exec) flushes it first.
+ */
+#define FD_CACHE_SIZE	8
+#define FD_CACHE_EMPTY	UINT_MAX
+
+/* Reserved descriptors that share one close_on_exec state */
+struct fd_cache_slots {
+	unsigned int next, nr;
+	unsigned int fds[FD_CACHE_SIZE];
+};
+
+struct fd_cache {
+	struct files_struct *files;
+	struct list_head list;		/* on files->fd_caches */
+	/* indexed by O_CLOEXEC, so mixed opens do not drain each other */
+	struct fd_cache_slots slots[2];
+};
+
+static void __fd_cache_drain(struct files_struct *files,
+			     struct fd_cache_slots *slots)
+{
+	unsigned int i, fd;
+
+	lockdep_assert_held(&files->file_lock);
+	for (i = 0; i < FD_CACHE_SIZE; i++) {
+		fd = xchg(&slots->fds[i], FD_CACHE_EMPTY);
+		if (fd != FD_CACHE_EMPTY)
+			__put_unused_fd(files, fd);
+	}
+}
+
+/* Return every descriptor reserved by any thread to the table */
+static void __fd_caches_drain_all(struct files_struct *files)
+{
+	struct fd_cache *cache;
+
+	list_for_each_entry(cache, &files->fd_caches, list) {
+		__fd_cache_drain(files, &cache->slots[0]);
+		__fd_cache_drain(files, &cache->slots[1]);
+	}
+}
+
+/* Take back @fd from the thread that reserved it, false if none did */
+static bool fd_cache_steal(struct files_struct *files, unsigned int fd)
+{
+	struct fd_cache *cache;
+	unsigned int i, j;
+
+	lockdep_assert_held(&files->file_lock);
+	list_for_each_entry(cache, &files->fd_caches, list) {
+		for (i = 0; i < ARRAY_SIZE(cache->slots); i++) {
+			unsigned int *fds = cache->slots[i].fds;
+
+			for (j = 0; j < FD_CACHE_SIZE; j++)
+				if (READ_ONCE(fds[j]) == fd &&
+				    cmpxchg(&fds[j], fd, FD_CACHE_EMPTY) == fd)
+					return true;
+		}
+	}
+	return false;
+}
+
+/* Hand out a reserved descriptor below @end, -1 if there is none */
+static int fd_cache_take(struct fd_cache_slots *slots, unsigned int end)
+{
+	unsigned int fd;
+
+	while (slots->next < slots->nr) {
+		fd = READ_ONCE(slots->fds[slots->next]);
+		if (fd != FD_CACHE_EMPTY && fd >= end)
+			return -1;
+		fd = xchg(&slots->fds[slots->next++], FD_CACHE_EMPTY);
+		if (fd != FD_CACHE_EMPTY)
+			return fd;
+	}
+	return -1;
+}
+
+static void fd_cache_release(struct task_struct *tsk)
+{
+	struct fd_cache *cache = tsk->fd_cache;
+	struct files_struct *files = cache->files;
+
+	spin_lock(&files->file_lock);
+	__fd_cache_drain(files, &cache->slots[0]);
+	__fd_cache_drain(files, &cache->slots[1]);
+	list_del(&cache->list);
+	spin_unlock(&files->file_lock);
+	tsk->fd_cache = NULL;
+	kfree(cache);
+}
+
+void fd_cache_flush(void)
+{
+	if (current->fd_cache)
+		fd_cache_release(current);
+}
+
+static int alloc_fd_cached(unsigned end, unsigned flags)
+{
+	struct files_struct *files = current->files;
+	struct fd_cache *cache = current->fd_cache;
+	bool cloexec = flags & O_CLOEXEC;
+	struct fd_cache_slots *slots;
+	struct fdtable *fdt;
+	unsigned int i;
+	int fd;
+
+	if (cache) {
+		fd = fd_cache_take(&cache->slots[cloexec], end);
+		if (fd >= 0)
+			return fd;
+	}
+
+	/* Another thread went back to PR_FD_ALLOC_LOWEST */
+	if (!READ_ONCE(files->any_fd)) {
+		fd_cache_flush();
+		return alloc_fd(0, end, flags);
+	}
+
+	if (!cache) {
+		cache = kmalloc(sizeof(*cache), GFP_KERNEL);
+		if (!cache)
+			return alloc_fd(0, end, flags);
+		for (i = 0; i < ARRAY_SIZE(cache->slots); i++) {
+			cache->slots[i].next = cache->slots[i].nr = 0;
+			memset(cache->slots[i].fds, 0xff,
+			       sizeof(cache->slots[i].fds));
+		}
+		cache->files = files;
+		spin_lock(&files->file_lock);
+		list_add(&cache->list, &files->fd_caches);
+		spin_unlock(&files->file_lock);
+		current->fd_cache = cache;
+	}
+
+	slots = &cache->slots[cloexec];
+	spin_lock(&files->file_lock);
+	__fd_cache_drain(files, slots);
+	slots->next = slots->nr = 0;
+	fd = __alloc_fd(files, 0, end, flags);
+	if (fd < 0 || !files->any_fd)
+		goto out;
+
+	/*
+	 * Reserve the next free descriptors too, but only those that fit in
+	 * the current table: refilling the cache never expands it.
+	 */
+	fdt = files_fdtable(files);
+	end = min(end, fdt->max_fds);
+	while (slots->nr < FD_CACHE_SIZE) {
+		unsigned int next = find_next_fd(fdt, files->next_fd);
+
+		if (next >= end)
+			break;
+		__set_open_fd(next, fdt);
+		if (cloexec)
+			__set_close_on_exec(next, fdt);
+		else
+			__clear_close_on_exec(next, fdt);
+		files->next_fd = next + 1;
+		WRITE_ONCE(slots->fds[slots->nr++], next);
+	}
+out:
+	spin_unlock(&files->file_lock);
+	return fd;
+}
+
 int __get_unused_fd_flags(unsigned flags, unsigned long nofile)
 {
+	if (unlikely(current->fd_cache || READ_ONCE(current->files->any_fd)))
+		return alloc_fd_cached(nofile, flags);
 	return alloc_fd(0, nofile, flags);
 }
 
+int set_fd_alloc_mode(unsigned long mode)
+{
+	struct files_struct *files = current->files;
+
+	if (mode != PR_FD_ALLOC_LOWEST && mode != PR_FD_ALLOC_ANY)
+		return -EINVAL;
+
+	spin_lock(&files->file_lock);
+	WRITE_ONCE(files->any_fd, mode == PR_FD_ALLOC_ANY);
+	/*
+	 * Lowest-fd allocation has to see every free descriptor, so take
+	 * back what all threads reserved.  They free their emptied caches
+	 * on their next allocation.
+	 */
+	if (mode == PR_FD_ALLOC_LOWEST)
+		__fd_caches_drain_all(files);
+	spin_unlock(&files->file_lock);
+
+	if (mode == PR_FD_ALLOC_LOWEST)
+		fd_cache_flush();
+	return 0;
+}
+
+int get_fd_alloc_mode(void)
+{
+	return READ_ONCE(current->files->any_fd) ? PR_FD_ALLOC_ANY :
+						   PR_FD_ALLOC_LOWEST;
+}
+
 int get_unused_fd_flags(unsigned flags)
 {
 	return __get_unused_fd_flags(flags, rlimit(RLIMIT_NOFILE));
@@ -823,7 +1056,12 @@ void do_close_on_exec(struct files_struct *files)
 	struct fdtable *fdt;
 
 	/* exec unshares first */
+	fd_cache_flush();
+	task_clear_poll_cache(current);
+	poll_cache_flush();
 	spin_lock(&files->file_lock);
+	/* The new program gets POSIX lowest-fd allocation back */
+	WRITE_ONCE(files->any_fd, false);
 	for (i = 0; ; i++) {
 		unsigned long set;
 		unsigned fd = i * BITS_PER_LONG;
@@ -1122,10 +1360,13 @@ __releases(&files->file_lock)
 	 * deadlocks in rather amusing ways, AFAICS.  All of that is out of
 	 * scope of POSIX or SUS, since neither considers shared descriptor
 	 * tables and this condition does not arise without those.
+	 *
+	 * A descriptor some thread only reserved under PR_FD_ALLOC_ANY is
+	 * not busy: nobody has seen it yet, so take it away from the cache.
 	 */
 	fdt = files_fdtable(files);
 	tofree = fdt->fd[fd];
-	if (!tofree && fd_is_open(fd, fdt))
+	if (!tofree && fd_is_open(fd, fdt) && !fd_cache_steal(files, fd))
 		goto Ebusy;
 	get_file(file);
 	rcu_assign_pointer(fdt->fd[fd], file);
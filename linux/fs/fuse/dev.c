@@ -744,13 +744,18 @@ static int fuse_copy_fill(struct fuse_copy_state *cs)
 	return lock_request(cs->req);
 }
 
-/* Do as much copy to/from userspace buffer as we can */
+/*
+ * Do as much copy to/from userspace buffer as we can.  Pipe buffers may
+ * span several pages, so copy up to the end of the current one only.
+ */
 static int fuse_copy_do(struct fuse_copy_state *cs, void **val, unsigned *size)
 {
-	unsigned ncpy = min(*size, cs->len);
+	unsigned offset = offset_in_page(cs->offset);
+	unsigned ncpy = min3(*size, cs->len, (unsigned)PAGE_SIZE - offset);
 	if (val) {
-		void *pgaddr = kmap_local_page(cs->pg);
-		void *buf = pgaddr + cs->offset;
+		void *pgaddr = kmap_local_page(nth_page(cs->pg,
+						cs->offset >> PAGE_SHIFT));
+		void *buf = pgaddr + offset;
 
 		if (cs->write)
 			memcpy(buf, *val, ncpy);
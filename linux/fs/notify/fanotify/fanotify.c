@@ -16,6 +16,7 @@
 #include <linux/statfs.h>
 #include <linux/stringhash.h>
 
+#include "../fsnotify.h"
 #include "fanotify.h"
 
 static bool fanotify_path_equal(const struct path *p1, const struct path *p2)
@@ -284,6 +285,60 @@ out:
 	return ret;
 }
 
+/*
+ * Return the union of the effective ignore masks of the FAN_MARK_IGNORE_SUBTREE
+ * marks of @group on the event victim and its ancestors.
+ *
+ * Called under fsnotify_mark_srcu, which keeps the connectors and marks seen
+ * during the walk alive.  The walk up ->d_parent is lockless and may race with
+ * rename, so events on objects moved in or out of an ignored subtree at the
+ * same time may or may not be filtered.
+ */
+static u32 fanotify_subtree_ignore_mask(struct fsnotify_group *group,
+					const void *data, int data_type,
+					struct inode *dir, bool ondir)
+{
+	struct dentry *dentry = fsnotify_data_dentry(data, data_type);
+	struct fsnotify_mark_connector *conn;
+	struct fsnotify_mark *mark;
+	struct dentry *d, *parent, *alias = NULL;
+	u32 ignore_mask = 0;
+
+	/* Events that only carry an inode are matched from their parent dir */
+	if (!dentry && dir)
+		dentry = alias = d_find_any_alias(dir);
+	if (!dentry)
+		return 0;
+
+	rcu_read_lock();
+	for (d = dentry; ; d = parent) {
+		struct inode *inode = d_inode_rcu(d);
+
+		conn = inode ? srcu_dereference(inode->i_fsnotify_marks,
+						&fsnotify_mark_srcu) : NULL;
+		if (conn) {
+			hlist_for_each_entry_srcu(mark, &conn->list, obj_list,
+					srcu_read_lock_held(&fsnotify_mark_srcu)) {
+				if (mark->group != group)
+					continue;
+				if (READ_ONCE(mark->flags) &
+				    FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE)
+					ignore_mask |= fsnotify_effective_ignore_mask(
+						mark, ondir, FSNOTIFY_ITER_TYPE_INODE);
+				break;
+			}
+		}
+
+		parent = READ_ONCE(d->d_parent);
+		if (parent == d)
+			break;
+	}
+	rcu_read_unlock();
+	dput(alias);
+
+	return ignore_mask;
+}
+
 /*
  * This function returns a mask for an event that only contains the flags
  * that have been specifically requested by the user. Flags that may have
@@ -342,6 +397,12 @@ static u32 fanotify_group_event_mask(struct fsnotify_group *group,
 
 	test_mask = event_mask & marks_mask & ~marks_ignore_mask;
 
+	if ((test_mask & ALL_FSNOTIFY_EVENTS) &&
+	    atomic_read(&group->fanotify_data.subtree_marks))
+		test_mask &= ~fanotify_subtree_ignore_mask(group, data,
+							   data_type, dir,
+							   ondir);
+
 	/*
 	 * For dirent modification events (create/delete/move) that do not carry
 	 * the child entry name information, we report FAN_ONDIR for mkdir/rmdir
@@ -1062,6 +1123,8 @@ static void fanotify_free_event(struct fsnotify_group *group,
 static void fanotify_freeing_mark(struct fsnotify_mark *mark,
 				  struct fsnotify_group *group)
 {
+	if (mark->flags & FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE)
+		atomic_dec(&group->fanotify_data.subtree_marks);
 	if (!FAN_GROUP_FLAG(group, FAN_UNLIMITED_MARKS))
 		dec_ucount(group->fanotify_data.ucounts, UCOUNT_FANOTIFY_MARKS);
 }
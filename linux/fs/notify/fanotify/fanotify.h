@@ -499,6 +499,8 @@ static inline unsigned int fanotify_mark_user_flags(struct fsnotify_mark *mark)
 		mflags |= FAN_MARK_EVICTABLE;
 	if (mark->flags & FSNOTIFY_MARK_FLAG_HAS_IGNORE_FLAGS)
 		mflags |= FAN_MARK_IGNORE;
+	if (mark->flags & FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE)
+		mflags |= FAN_MARK_IGNORE_SUBTREE;
 
 	return mflags;
 }
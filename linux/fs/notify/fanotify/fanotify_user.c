@@ -31,6 +31,8 @@
 #define FANOTIFY_OLD_DEFAULT_MAX_MARKS	8192
 #define FANOTIFY_DEFAULT_MAX_GROUPS	128
 #define FANOTIFY_DEFAULT_FEE_POOL_SIZE	32
+/* Max events dequeued per notification_lock round trip in fanotify_read() */
+#define FANOTIFY_READ_BATCH		32
 
 /*
  * Legacy fanotify marks limits (8192) is per group and we introduced a tunable
@@ -249,6 +251,47 @@ out:
 	return event;
 }
 
+/*
+ * Dequeue up to FANOTIFY_READ_BATCH events that together fit in "count" with
+ * a single acquisition of notification_lock.  Only used for groups reporting
+ * fids, which have no permission events and never create event fds, so the
+ * dequeued events can only fail to be copied on a bad user buffer.  Return the
+ * number of events dequeued, or -EINVAL if the first one does not fit.
+ */
+static int get_event_batch(struct fsnotify_group *group, size_t count,
+			   struct fanotify_event **batch)
+{
+	unsigned int info_mode = FAN_GROUP_FLAG(group, FANOTIFY_INFO_MODES);
+	struct fsnotify_event *fsn_event;
+	struct fanotify_event *event;
+	size_t event_size;
+	int nr = 0;
+
+	spin_lock(&group->notification_lock);
+	while (nr < FANOTIFY_READ_BATCH) {
+		fsn_event = fsnotify_peek_first_event(group);
+		if (!fsn_event)
+			break;
+
+		event = FANOTIFY_E(fsn_event);
+		event_size = fanotify_event_len(info_mode, event);
+		if (event_size > count) {
+			if (!nr)
+				nr = -EINVAL;
+			break;
+		}
+
+		fsnotify_remove_first_event(group);
+		if (fanotify_is_hashed_event(event->mask))
+			fanotify_unhash_event(group, event);
+		batch[nr++] = event;
+		count -= event_size;
+	}
+	spin_unlock(&group->notification_lock);
+
+	return nr;
+}
+
 static int create_fd(struct fsnotify_group *group, const struct path *path,
 		     struct file **file)
 {
@@ -770,6 +813,42 @@ out_close_fd:
 	return ret;
 }
 
+/*
+ * Copy a batch of events of a group reporting fids.  Return the number of
+ * bytes copied, 0 if there are no events.  An error is left in @errp: it
+ * ends the read, but the events copied before it still count.
+ */
+static ssize_t copy_event_batch_to_user(struct fsnotify_group *group,
+					char __user *buf, size_t count,
+					int *errp)
+{
+	struct fanotify_event *batch[FANOTIFY_READ_BATCH];
+	ssize_t ret, copied = 0;
+	int i, nr;
+
+	*errp = 0;
+	nr = get_event_batch(group, count, batch);
+	if (nr < 0) {
+		*errp = nr;
+		return 0;
+	}
+
+	for (i = 0; i < nr; i++) {
+		/* After a fault the rest of the batch is dropped like the event */
+		if (!*errp) {
+			ret = copy_event_to_user(group, batch[i], buf + copied,
+						 count - copied);
+			if (ret < 0)
+				*errp = ret;
+			else
+				copied += ret;
+		}
+		fsnotify_destroy_event(group, &batch[i]->fse);
+	}
+
+	return copied;
+}
+
 /* intofiy userspace file descriptor functions */
 static __poll_t fanotify_poll(struct file *file, poll_table *wait)
 {
@@ -791,11 +870,19 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 	struct fsnotify_group *group;
 	struct fanotify_event *event;
 	char __user *start;
-	int ret;
+	bool batch;
+	int ret, err;
 	DEFINE_WAIT_FUNC(wait, woken_wake_function);
 
 	start = buf;
 	group = file->private_data;
+	/*
+	 * Events of fid groups are dequeued in batches.  Not with
+	 * FAN_REPORT_PIDFD: every event then installs a pidfd, which costs
+	 * more than the notification_lock round trips batching saves.
+	 */
+	batch = FAN_GROUP_FLAG(group, FANOTIFY_FID_BITS) &&
+		!FAN_GROUP_FLAG(group, FAN_REPORT_PIDFD);
 
 	pr_debug("%s: group=%p\n", __func__, group);
 
@@ -806,10 +893,24 @@ static ssize_t fanotify_read(struct file *file, char __user *buf,
 		 * in case there are lots of available events.
 		 */
 		cond_resched();
-		event = get_one_event(group, count);
-		if (IS_ERR(event)) {
-			ret = PTR_ERR(event);
-			break;
+		if (batch) {
+			ret = copy_event_batch_to_user(group, buf, count, &err);
+			buf += ret;
+			count -= ret;
+			if (err) {
+				/* Even a fault returns what was copied before it */
+				ret = start != buf ? buf - start : err;
+				break;
+			}
+			if (ret > 0)
+				continue;
+			event = NULL;
+		} else {
+			event = get_one_event(group, count);
+			if (IS_ERR(event)) {
+				ret = PTR_ERR(event);
+				break;
+			}
 		}
 
 		if (!event) {
@@ -1146,6 +1247,17 @@ static bool fanotify_mark_update_flags(struct fsnotify_mark *fsn_mark,
 	if (ignore == FAN_MARK_IGNORE)
 		fsn_mark->flags |= FSNOTIFY_MARK_FLAG_HAS_IGNORE_FLAGS;
 
+	/*
+	 * Once set, the ignore mask of the mark applies to the whole subtree
+	 * for as long as the mark exists.  fanotify_handle_event() only walks
+	 * the ancestors of a victim when the group has such marks.
+	 */
+	if (fan_flags & FAN_MARK_IGNORE_SUBTREE &&
+	    !(fsn_mark->flags & FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE)) {
+		fsn_mark->flags |= FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE;
+		atomic_inc(&fsn_mark->group->fanotify_data.subtree_marks);
+	}
+
 	/*
 	 * Setting FAN_MARK_IGNORED_SURV_MODIFY for the first time may lead to
 	 * the removal of the FS_MODIFY bit in calculated mask if it was set
@@ -1732,6 +1844,16 @@ static int do_fanotify_mark(int fanotify_fd, unsigned int flags, __u64 mask,
 		umask = FANOTIFY_EVENT_FLAGS;
 	}
 
+	/*
+	 * FAN_MARK_IGNORE_SUBTREE extends the new style ignore mask of a
+	 * directory inode mark.  An evictable mark could silently disappear
+	 * along with the filter it implements.
+	 */
+	if (flags & FAN_MARK_IGNORE_SUBTREE &&
+	    (mark_cmd != FAN_MARK_ADD || mark_type != FAN_MARK_INODE ||
+	     ignore != FAN_MARK_IGNORE || flags & FAN_MARK_EVICTABLE))
+		return -EINVAL;
+
 	f = fdget(fanotify_fd);
 	if (unlikely(!f.file))
 		return -EBADF;
@@ -1834,6 +1956,10 @@ static int do_fanotify_mark(int fanotify_fd, unsigned int flags, __u64 mask,
 	else
 		mnt = path.mnt;
 
+	ret = -ENOTDIR;
+	if (flags & FAN_MARK_IGNORE_SUBTREE && !S_ISDIR(inode->i_mode))
+		goto path_put_and_out;
+
 	ret = mnt ? -EINVAL : -EISDIR;
 	/* FAN_MARK_IGNORE requires SURV_MODIFY for sb/mount/dir marks */
 	if (mark_cmd == FAN_MARK_ADD && ignore == FAN_MARK_IGNORE &&
@@ -1933,7 +2059,7 @@ static int __init fanotify_user_setup(void)
 
 	BUILD_BUG_ON(FANOTIFY_INIT_FLAGS & FANOTIFY_INTERNAL_GROUP_FLAGS);
 	BUILD_BUG_ON(HWEIGHT32(FANOTIFY_INIT_FLAGS) != 12);
-	BUILD_BUG_ON(HWEIGHT32(FANOTIFY_MARK_FLAGS) != 11);
+	BUILD_BUG_ON(HWEIGHT32(FANOTIFY_MARK_FLAGS) != 12);
 
 	fanotify_mark_cache = KMEM_CACHE(fsnotify_mark,
 					 SLAB_PANIC|SLAB_ACCOUNT);
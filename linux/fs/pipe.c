@@ -47,6 +47,13 @@
  */
 #define PIPE_MIN_DEF_BUFFERS 2
 
+/*
+ * Largest buffer size F_SETPIPE_BUF_SZ accepts. Bigger buffers mean fewer
+ * ring slots, lock round trips and wakeups per byte moved, but they have to
+ * come from high-order allocations.
+ */
+#define PIPE_MAX_BUF_SIZE SZ_64K
+
 /*
  * The max size that a non-root user is allowed to grow the pipe. Can
  * be set by root in /proc/sys/fs/pipe-max-size
@@ -131,8 +138,10 @@ static void anon_pipe_buf_release(struct pipe_inode_info *pipe,
 	 * If nobody else uses this page, and we don't already have a
 	 * temporary page, let's keep track of it as a one-deep
 	 * allocation cache. (Otherwise just release our reference to it)
+	 * Only keep pages of the size pipe_write() currently fills.
 	 */
-	if (page_count(page) == 1 && !pipe->tmp_page)
+	if (page_count(page) == 1 && !pipe->tmp_page &&
+	    compound_order(page) == pipe->buf_order)
 		pipe->tmp_page = page;
 	else
 		put_page(page);
@@ -143,7 +152,8 @@ static bool anon_pipe_buf_try_steal(struct pipe_inode_info *pipe,
 {
 	struct page *page = buf->page;
 
-	if (page_count(page) != 1)
+	/* Large write() buffers cannot be handed out as a single page */
+	if (page_count(page) != 1 || PageCompound(page))
 		return false;
 	memcg_kmem_uncharge_page(page, 0);
 	__SetPageLocked(page);
@@ -413,6 +423,23 @@ static inline bool pipe_writable(const struct pipe_inode_info *pipe)
 		!READ_ONCE(pipe->readers);
 }
 
+/*
+ * Buffers bigger than a page are only an optimisation, so don't reclaim or
+ * compact for them; fall back to a single page instead.
+ */
+static struct page *anon_pipe_alloc_page(struct pipe_inode_info *pipe)
+{
+	struct page *page;
+
+	if (pipe->buf_order) {
+		page = alloc_pages(GFP_USER | __GFP_ACCOUNT | __GFP_COMP |
+				   __GFP_NORETRY | __GFP_NOWARN, pipe->buf_order);
+		if (page)
+			return page;
+	}
+	return alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+}
+
 static ssize_t
 pipe_write(struct kiocb *iocb, struct iov_iter *from)
 {
@@ -459,14 +486,14 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 	 */
 	head = pipe->head;
 	was_empty = pipe_empty(head, pipe->tail);
-	chars = total_len & (PAGE_SIZE-1);
+	chars = total_len & (pipe_buf_size(pipe) - 1);
 	if (chars && !was_empty) {
 		unsigned int mask = pipe->ring_size - 1;
 		struct pipe_buffer *buf = &pipe->bufs[(head - 1) & mask];
 		int offset = buf->offset + buf->len;
 
 		if ((buf->flags & PIPE_BUF_FLAG_CAN_MERGE) &&
-		    offset + chars <= PAGE_SIZE) {
+		    offset + chars <= page_size(buf->page)) {
 			ret = pipe_buf_confirm(pipe, buf);
 			if (ret)
 				goto out;
@@ -499,7 +526,7 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 			int copied;
 
 			if (!page) {
-				page = alloc_page(GFP_HIGHUSER | __GFP_ACCOUNT);
+				page = anon_pipe_alloc_page(pipe);
 				if (unlikely(!page)) {
 					ret = ret ? : -ENOMEM;
 					break;
@@ -535,8 +562,8 @@ pipe_write(struct kiocb *iocb, struct iov_iter *from)
 				buf->flags = PIPE_BUF_FLAG_CAN_MERGE;
 			pipe->tmp_page = NULL;
 
-			copied = copy_page_from_iter(page, 0, PAGE_SIZE, from);
-			if (unlikely(copied < PAGE_SIZE && iov_iter_count(from))) {
+			copied = copy_page_from_iter(page, 0, page_size(page), from);
+			if (unlikely(copied < page_size(page) && iov_iter_count(from))) {
 				if (!ret)
 					ret = -EFAULT;
 				break;
@@ -854,7 +881,7 @@ void free_pipe_info(struct pipe_inode_info *pipe)
 		put_watch_queue(pipe->watch_queue);
 #endif
 	if (pipe->tmp_page)
-		__free_page(pipe->tmp_page);
+		put_page(pipe->tmp_page);
 	kfree(pipe->bufs);
 	kfree(pipe);
 }
@@ -1314,7 +1341,7 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 
 	if (!pipe_has_watch_queue(pipe)) {
 		pipe->max_usage = nr_slots;
-		pipe->nr_accounted = nr_slots;
+		pipe->nr_accounted = nr_slots << pipe->buf_order;
 	}
 
 	spin_unlock_irq(&pipe->rd_wait.lock);
@@ -1331,18 +1358,21 @@ int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots)
 static long pipe_set_size(struct pipe_inode_info *pipe, unsigned int arg)
 {
 	unsigned long user_bufs;
-	unsigned int nr_slots, size;
+	unsigned int nr_slots, nr_pages, size;
 	long ret = 0;
 
 	if (pipe_has_watch_queue(pipe))
 		return -EBUSY;
 
 	size = round_pipe_size(arg);
-	nr_slots = size >> PAGE_SHIFT;
-
-	if (!nr_slots)
+	if (!size)
 		return -EINVAL;
 
+	/* The pipe has to hold at least one of its write() buffers */
+	size = max_t(unsigned int, size, pipe_buf_size(pipe));
+	nr_slots = size >> (PAGE_SHIFT + pipe->buf_order);
+	nr_pages = size >> PAGE_SHIFT;
+
 	/*
 	 * If trying to increase the pipe capacity, check that an
 	 * unprivileged user is not trying to exceed various limits
@@ -1354,7 +1384,7 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned int arg)
 			size > pipe_max_size && !capable(CAP_SYS_RESOURCE))
 		return -EPERM;
 
-	user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted, nr_slots);
+	user_bufs = account_pipe_buffers(pipe->user, pipe->nr_accounted, nr_pages);
 
 	if (nr_slots > pipe->max_usage &&
 			(too_many_pipe_buffers_hard(user_bufs) ||
@@ -1368,13 +1398,59 @@ static long pipe_set_size(struct pipe_inode_info *pipe, unsigned int arg)
 	if (ret < 0)
 		goto out_revert_acct;
 
-	return pipe->max_usage * PAGE_SIZE;
+	return pipe->max_usage * pipe_buf_size(pipe);
 
 out_revert_acct:
-	(void) account_pipe_buffers(pipe->user, nr_slots, pipe->nr_accounted);
+	(void) account_pipe_buffers(pipe->user, nr_pages, pipe->nr_accounted);
 	return ret;
 }
 
+/*
+ * Change the size of the buffers pipe_write() fills. The byte capacity of
+ * the pipe stays the same, so the ring is resized to hold fewer, larger
+ * slots and the user's page accounting is unchanged. Buffers already in the
+ * pipe are left alone. Returns the buffer size if successful, or -ERROR.
+ */
+static long pipe_set_buf_size(struct pipe_inode_info *pipe, unsigned int arg)
+{
+	unsigned int order, old_order, nr_slots;
+	long ret;
+
+	if (pipe_has_watch_queue(pipe))
+		return -EBUSY;
+
+	if (arg < PAGE_SIZE || !is_power_of_2(arg) ||
+	    arg > max_t(unsigned long, PIPE_MAX_BUF_SIZE, PAGE_SIZE))
+		return -EINVAL;
+
+	order = ilog2(arg) - PAGE_SHIFT;
+	if (order == pipe->buf_order)
+		return arg;
+
+	/*
+	 * Keep the two slots a non-empty pipe needs to accept a write without
+	 * blocking; see PIPE_MIN_DEF_BUFFERS. Grow the pipe first if needed.
+	 */
+	nr_slots = pipe->nr_accounted >> order;
+	if (nr_slots < PIPE_MIN_DEF_BUFFERS)
+		return -EINVAL;
+
+	old_order = pipe->buf_order;
+	pipe->buf_order = order;
+	ret = pipe_resize_ring(pipe, nr_slots);
+	if (ret < 0) {
+		pipe->buf_order = old_order;
+		return ret;
+	}
+
+	/* The cached page has the old size */
+	if (pipe->tmp_page) {
+		put_page(pipe->tmp_page);
+		pipe->tmp_page = NULL;
+	}
+	return arg;
+}
+
 /*
  * Note that i_pipe and i_cdev share the same location, so checking ->i_pipe is
  * not enough to verify that this is a pipe.
@@ -1406,7 +1482,13 @@ long pipe_fcntl(struct file *file, unsigned int cmd, unsigned int arg)
 		ret = pipe_set_size(pipe, arg);
 		break;
 	case F_GETPIPE_SZ:
-		ret = pipe->max_usage * PAGE_SIZE;
+		ret = pipe->max_usage * pipe_buf_size(pipe);
+		break;
+	case F_SETPIPE_BUF_SZ:
+		ret = pipe_set_buf_size(pipe, arg);
+		break;
+	case F_GETPIPE_BUF_SZ:
+		ret = pipe_buf_size(pipe);
 		break;
 	default:
 		ret = -EINVAL;
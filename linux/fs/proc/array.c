@@ -92,6 +92,7 @@
 #include <linux/fs_struct.h>
 #include <linux/kthread.h>
 #include <linux/mmu_context.h>
+#include <linux/seq_bin.h>
 
 #include <asm/processor.h>
 #include "internal.h"
@@ -465,7 +466,8 @@ int proc_pid_status(struct seq_file *m, struct pid_namespace *ns,
 }
 
 static int do_task_stat(struct seq_file *m, struct pid_namespace *ns,
-			struct pid *pid, struct task_struct *task, int whole)
+			struct pid *pid, struct task_struct *task, int whole,
+			bool bin)
 {
 	unsigned long vsize, eip, esp, wchan = 0;
 	int priority, nice;
@@ -575,9 +577,70 @@ static int do_task_stat(struct seq_file *m, struct pid_namespace *ns,
 	priority = task_prio(task);
 	nice = task_nice(task);
 
-	/* apply timens offset for boottime and convert nsec -> ticks */
-	start_time =
-		nsec_to_clock_t(timens_add_boottime_ns(task->start_boottime));
+	/* apply timens offset for boottime, text output converts to ticks */
+	start_time = timens_add_boottime_ns(task->start_boottime);
+
+	if (bin) {
+		struct proc_pid_stat_bin st = {
+			.pid		= pid_nr_ns(pid, ns),
+			.ppid		= ppid,
+			.pgrp		= pgid,
+			.session	= sid,
+			.tty_nr		= tty_nr,
+			.tpgid		= tty_pgrp,
+			.flags		= task->flags,
+			.state		= state,
+			.priority	= priority,
+			.nice		= nice,
+			.num_threads	= num_threads,
+			.exit_signal	= task->exit_signal,
+			.processor	= task_cpu(task),
+			.rt_priority	= task->rt_priority,
+			.policy		= task->policy,
+			.exit_code	= permitted ? exit_code : 0,
+			.minflt		= min_flt,
+			.cminflt	= cmin_flt,
+			.majflt		= maj_flt,
+			.cmajflt	= cmaj_flt,
+			.utime		= utime,
+			.stime		= stime,
+			.cutime		= cutime,
+			.cstime		= cstime,
+			.start_time	= start_time,
+			.vsize		= vsize,
+			.rss		= mm ? get_mm_rss(mm) : 0,
+			.rsslim		= rsslim,
+			.startcode	= mm ? (permitted ? mm->start_code : 1) : 0,
+			.endcode	= mm ? (permitted ? mm->end_code : 1) : 0,
+			.startstack	= (permitted && mm) ? mm->start_stack : 0,
+			.kstkesp	= esp,
+			.kstkeip	= eip,
+			.signal		= task->pending.signal.sig[0],
+			.blocked	= task->blocked.sig[0],
+			.sigignore	= sigign.sig[0],
+			.sigcatch	= sigcatch.sig[0],
+			.wchan		= wchan,
+			.delayacct_blkio_ticks = delayacct_blkio_ticks(task),
+			.guest_time	= gtime,
+			.cguest_time	= cgtime,
+		};
+
+		get_task_comm(st.comm, task);
+		if (mm && permitted) {
+			st.start_data	= mm->start_data;
+			st.end_data	= mm->end_data;
+			st.start_brk	= mm->start_brk;
+			st.arg_start	= mm->arg_start;
+			st.arg_end	= mm->arg_end;
+			st.env_start	= mm->env_start;
+			st.env_end	= mm->env_end;
+		}
+
+		seq_bin_header(m, SEQ_BIN_TYPE_PID_STAT,
+			       PROC_PID_STAT_BIN_VERSION, sizeof(st));
+		seq_write(m, &st, sizeof(st));
+		goto out;
+	}
 
 	seq_put_decimal_ull(m, "", pid_nr_ns(pid, ns));
 	seq_puts(m, " (");
@@ -602,7 +665,7 @@ static int do_task_stat(struct seq_file *m, struct pid_namespace *ns,
 	seq_put_decimal_ll(m, " ", nice);
 	seq_put_decimal_ll(m, " ", num_threads);
 	seq_put_decimal_ull(m, " ", 0);
-	seq_put_decimal_ull(m, " ", start_time);
+	seq_put_decimal_ull(m, " ", nsec_to_clock_t(start_time));
 	seq_put_decimal_ull(m, " ", vsize);
 	seq_put_decimal_ull(m, " ", mm ? get_mm_rss(mm) : 0);
 	seq_put_decimal_ull(m, " ", rsslim);
@@ -656,6 +719,7 @@ static int do_task_stat(struct seq_file *m, struct pid_namespace *ns,
 		seq_puts(m, " 0");
 
 	seq_putc(m, '\n');
+out:
 	if (mm)
 		mmput(mm);
 	return 0;
@@ -664,13 +728,25 @@ static int do_task_stat(struct seq_file *m, struct pid_namespace *ns,
 int proc_tid_stat(struct seq_file *m, struct pid_namespace *ns,
 			struct pid *pid, struct task_struct *task)
 {
-	return do_task_stat(m, ns, pid, task, 0);
+	return do_task_stat(m, ns, pid, task, 0, false);
 }
 
 int proc_tgid_stat(struct seq_file *m, struct pid_namespace *ns,
 			struct pid *pid, struct task_struct *task)
 {
-	return do_task_stat(m, ns, pid, task, 1);
+	return do_task_stat(m, ns, pid, task, 1, false);
+}
+
+int proc_tid_stat_bin(struct seq_file *m, struct pid_namespace *ns,
+			struct pid *pid, struct task_struct *task)
+{
+	return do_task_stat(m, ns, pid, task, 0, true);
+}
+
+int proc_tgid_stat_bin(struct seq_file *m, struct pid_namespace *ns,
+			struct pid *pid, struct task_struct *task)
+{
+	return do_task_stat(m, ns, pid, task, 1, true);
 }
 
 int proc_pid_statm(struct seq_file *m, struct pid_namespace *ns,
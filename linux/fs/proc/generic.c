@@ -589,10 +589,15 @@ EXPORT_SYMBOL(proc_create);
 static int proc_seq_open(struct inode *inode, struct file *file)
 {
 	struct proc_dir_entry *de = PDE(inode);
+	int ret;
 
 	if (de->state_size)
-		return seq_open_private(file, de->seq_ops, de->state_size);
-	return seq_open(file, de->seq_ops);
+		ret = seq_open_private(file, de->seq_ops, de->state_size);
+	else
+		ret = seq_open(file, de->seq_ops);
+	if (!ret && (de->flags & PROC_ENTRY_SEQ_SNAPSHOT))
+		seq_set_snapshot(file->private_data);
+	return ret;
 }
 
 static int proc_seq_release(struct inode *inode, struct file *file)
@@ -671,6 +676,12 @@ void proc_set_user(struct proc_dir_entry *de, kuid_t uid, kgid_t gid)
 }
 EXPORT_SYMBOL(proc_set_user);
 
+void proc_set_seq_snapshot(struct proc_dir_entry *de)
+{
+	de->flags |= PROC_ENTRY_SEQ_SNAPSHOT;
+}
+EXPORT_SYMBOL(proc_set_seq_snapshot);
+
 void pde_put(struct proc_dir_entry *pde)
 {
 	if (refcount_dec_and_test(&pde->refcnt)) {
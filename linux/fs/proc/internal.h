@@ -153,6 +153,10 @@ extern int proc_tid_stat(struct seq_file *, struct pid_namespace *,
 			 struct pid *, struct task_struct *);
 extern int proc_tgid_stat(struct seq_file *, struct pid_namespace *,
 			  struct pid *, struct task_struct *);
+extern int proc_tid_stat_bin(struct seq_file *, struct pid_namespace *,
+			     struct pid *, struct task_struct *);
+extern int proc_tgid_stat_bin(struct seq_file *, struct pid_namespace *,
+			      struct pid *, struct task_struct *);
 extern int proc_pid_status(struct seq_file *, struct pid_namespace *,
 			   struct pid *, struct task_struct *);
 extern int proc_pid_statm(struct seq_file *, struct pid_namespace *,
@@ -56,6 +56,8 @@ static int seq_open_net(struct inode *inode, struct file *file)
 		put_net(net);
 		return -ENOMEM;
 	}
+	if (PDE(inode)->flags & PROC_ENTRY_SEQ_SNAPSHOT)
+		seq_set_snapshot(file->private_data);
 #ifdef CONFIG_NET_NS
 	p->net = net;
 	netns_tracker_alloc(net, &p->ns_tracker, GFP_KERNEL);
@@ -20,6 +20,7 @@
 #include <linux/shmem_fs.h>
 #include <linux/uaccess.h>
 #include <linux/pkeys.h>
+#include <linux/buildid.h>
 
 #include <asm/elf.h>
 #include <asm/tlb.h>
@@ -257,6 +258,65 @@ static void show_vma_header_prefix(struct seq_file *m,
 	seq_putc(m, ' ');
 }
 
+static void get_vma_name(struct vm_area_struct *vma,
+			 struct anon_vma_name *anon_name,
+			 const struct path **path,
+			 const char **name,
+			 const char **name_fmt)
+{
+	*name = NULL;
+	*path = NULL;
+	*name_fmt = NULL;
+
+	/*
+	 * Print the dentry name for named mappings, and a
+	 * special [heap] marker for the heap:
+	 */
+	if (vma->vm_file) {
+		/*
+		 * If user named this anon shared memory via
+		 * prctl(PR_SET_VMA ..., use the provided name.
+		 */
+		if (anon_name) {
+			*name_fmt = "[anon_shmem:%s]";
+			*name = anon_name->name;
+		} else {
+			*path = &vma->vm_file->f_path;
+		}
+		return;
+	}
+
+	if (vma->vm_ops && vma->vm_ops->name) {
+		*name = vma->vm_ops->name(vma);
+		if (*name)
+			return;
+	}
+
+	*name = arch_vma_name(vma);
+	if (*name)
+		return;
+
+	if (!vma->vm_mm) {
+		*name = "[vdso]";
+		return;
+	}
+
+	if (vma_is_initial_heap(vma)) {
+		*name = "[heap]";
+		return;
+	}
+
+	if (vma_is_initial_stack(vma)) {
+		*name = "[stack]";
+		return;
+	}
+
+	if (anon_name) {
+		*name_fmt = "[anon:%s]";
+		*name = anon_name->name;
+	}
+}
+
 static void
 show_map_vma(struct seq_file *m, struct vm_area_struct *vma)
 {
@@ -268,7 +328,8 @@ show_map_vma(struct seq_file *m, struct vm_area_struct *vma)
 	unsigned long long pgoff = 0;
 	unsigned long start, end;
 	dev_t dev = 0;
-	const char *name = NULL;
+	const struct path *path;
+	const char *name_fmt, *name;
 
 	if (file) {
 		struct inode *inode = file_inode(vma->vm_file);
@@ -283,54 +344,14 @@ show_map_vma(struct seq_file *m, struct vm_area_struct *vma)
 	if (mm)
 		anon_name = anon_vma_name(vma);
 
-	/*
-	 * Print the dentry name for named mappings, and a
-	 * special [heap] marker for the heap:
-	 */
-	if (file) {
+	get_vma_name(vma, anon_name, &path, &name, &name_fmt);
+	if (path) {
 		seq_pad(m, ' ');
-		/*
-		 * If user named this anon shared memory via
-		 * prctl(PR_SET_VMA ..., use the provided name.
-		 */
-		if (anon_name)
-			seq_printf(m, "[anon_shmem:%s]", anon_name->name);
-		else
-			seq_file_path(m, file, "\n");
-		goto done;
-	}
-
-	if (vma->vm_ops && vma->vm_ops->name) {
-		name = vma->vm_ops->name(vma);
-		if (name)
-			goto done;
-	}
-
-	name = arch_vma_name(vma);
-	if (!name) {
-		if (!mm) {
-			name = "[vdso]";
-			goto done;
-		}
-
-		if (vma_is_initial_heap(vma)) {
-			name = "[heap]";
-			goto done;
-		}
-
-		if (vma_is_initial_stack(vma)) {
-			name = "[stack]";
-			goto done;
-		}
-
-		if (anon_name) {
-			seq_pad(m, ' ');
-			seq_printf(m, "[anon:%s]", anon_name->name);
-		}
-	}
-
-done:
-	if (name) {
+		seq_path(m, path, "\n");
+	} else if (name_fmt) {
+		seq_pad(m, ' ');
+		seq_printf(m, name_fmt, name);
+	} else if (name) {
 		seq_pad(m, ' ');
 		seq_puts(m, name);
 	}
@@ -355,11 +376,299 @@ static int pid_maps_open(struct inode *inode, struct file *file)
 	return do_maps_open(inode, file, &proc_pid_maps_op);
 }
 
+#define PROCMAP_QUERY_VMA_FLAGS (				\
+		PROCMAP_QUERY_VMA_READABLE |			\
+		PROCMAP_QUERY_VMA_WRITABLE |			\
+		PROCMAP_QUERY_VMA_EXECUTABLE |			\
+		PROCMAP_QUERY_VMA_SHARED			\
+)
+
+#define PROCMAP_QUERY_VALID_FLAGS_MASK (			\
+		PROCMAP_QUERY_COVERING_OR_NEXT_VMA |		\
+		PROCMAP_QUERY_FILE_BACKED_VMA |			\
+		PROCMAP_QUERY_VMA_FLAGS				\
+)
+
+static u64 procmap_vma_flags(struct vm_area_struct *vma)
+{
+	u64 flags = 0;
+
+	if (vma->vm_flags & VM_READ)
+		flags |= PROCMAP_QUERY_VMA_READABLE;
+	if (vma->vm_flags & VM_WRITE)
+		flags |= PROCMAP_QUERY_VMA_WRITABLE;
+	if (vma->vm_flags & VM_EXEC)
+		flags |= PROCMAP_QUERY_VMA_EXECUTABLE;
+	if (vma->vm_flags & VM_MAYSHARE)
+		flags |= PROCMAP_QUERY_VMA_SHARED;
+
+	return flags;
+}
+
+static bool procmap_vma_matches(struct vm_area_struct *vma, u64 query_flags)
+{
+	u64 want = query_flags & PROCMAP_QUERY_VMA_FLAGS;
+
+	if ((query_flags & PROCMAP_QUERY_FILE_BACKED_VMA) && !vma->vm_file)
+		return false;
+
+	return (procmap_vma_flags(vma) & want) == want;
+}
+
+/*
+ * Copy in an extensible ioctl argument whose first member is its own size.
+ * @min_size is the smallest layout the kernel has ever accepted.
+ */
+static int procmap_copy_arg(void *karg, size_t ksize, size_t min_size,
+			    void __user *uarg, u64 *usize)
+{
+	if (copy_from_user(usize, uarg, sizeof(*usize)))
+		return -EFAULT;
+	/* argument struct can never be that large, reject abuse */
+	if (*usize > PAGE_SIZE)
+		return -E2BIG;
+	if (*usize < min_size)
+		return -EINVAL;
+
+	return copy_struct_from_user(karg, ksize, uarg, *usize);
+}
+
+/*
+ * Find and lock the VMA matching a PROCMAP_QUERY request.
+ *
+ * A plain "which VMA covers this address" lookup only needs that VMA to
+ * stay stable, so try the per-VMA read lock first and leave mmap_lock to
+ * page faults and writers. Falling through to the next VMA, or a failed
+ * per-VMA attempt, takes mmap_lock for read instead. *@mmap_locked tells
+ * the caller which of the two has to be dropped.
+ */
+static struct vm_area_struct *query_matching_vma(struct mm_struct *mm,
+						 unsigned long addr,
+						 u64 flags, bool *mmap_locked)
+{
+	struct vm_area_struct *vma;
+	int err;
+
+#ifdef CONFIG_PER_VMA_LOCK
+	if (!(flags & PROCMAP_QUERY_COVERING_OR_NEXT_VMA)) {
+		vma = lock_vma_under_rcu(mm, addr);
+		if (vma) {
+			*mmap_locked = false;
+			if (procmap_vma_matches(vma, flags))
+				return vma;
+			vma_end_read(vma);
+			return ERR_PTR(-ENOENT);
+		}
+	}
+#endif
+
+	err = mmap_read_lock_killable(mm);
+	if (err)
+		return ERR_PTR(err);
+	*mmap_locked = true;
+
+	for (;;) {
+		vma = find_vma(mm, addr);
+		if (!vma)
+			break;
+		/* find_vma() may return a VMA above addr, not covering it */
+		if (vma->vm_start > addr &&
+		    !(flags & PROCMAP_QUERY_COVERING_OR_NEXT_VMA))
+			break;
+		if (procmap_vma_matches(vma, flags))
+			return vma;
+		if (!(flags & PROCMAP_QUERY_COVERING_OR_NEXT_VMA))
+			break;
+		addr = vma->vm_end;
+	}
+
+	mmap_read_unlock(mm);
+	return ERR_PTR(-ENOENT);
+}
+
+static void query_vma_unlock(struct mm_struct *mm, struct vm_area_struct *vma,
+			     bool mmap_locked)
+{
+	if (mmap_locked)
+		mmap_read_unlock(mm);
+	else
+		vma_end_read(vma);
+}
+
+/*
+ * anon_vma_name() insists on mmap_lock, but the name is only replaced
+ * after vma_start_write(), so the per-VMA read lock keeps it stable too.
+ */
+static struct anon_vma_name *query_anon_vma_name(struct vm_area_struct *vma,
+						 bool mmap_locked)
+{
+	if (!vma->vm_mm)
+		return NULL;
+	if (mmap_locked)
+		return anon_vma_name(vma);
+#ifdef CONFIG_ANON_VMA_NAME
+	return vma->anon_name;
+#else
+	return NULL;
+#endif
+}
+
+static int do_procmap_query(struct proc_maps_private *priv, void __user *uarg)
+{
+	struct procmap_query karg;
+	struct vm_area_struct *vma;
+	struct mm_struct *mm;
+	const char *name = NULL;
+	char build_id_buf[BUILD_ID_SIZE_MAX], *name_buf = NULL;
+	bool mmap_locked;
+	u64 usize;
+	int err;
+
+	err = procmap_copy_arg(&karg, sizeof(karg),
+			       offsetofend(struct procmap_query, query_addr),
+			       uarg, &usize);
+	if (err)
+		return err;
+	/* reject unknown flags */
+	if (karg.query_flags & ~PROCMAP_QUERY_VALID_FLAGS_MASK)
+		return -EINVAL;
+	/* either both buffer address and size are set, or both should be zero */
+	if (!!karg.vma_name_size != !!karg.vma_name_addr)
+		return -EINVAL;
+	if (!!karg.build_id_size != !!karg.build_id_addr)
+		return -EINVAL;
+
+	mm = priv->mm;
+	if (!mm || !mmget_not_zero(mm))
+		return -ESRCH;
+
+	vma = query_matching_vma(mm, karg.query_addr, karg.query_flags,
+				 &mmap_locked);
+	if (IS_ERR(vma)) {
+		err = PTR_ERR(vma);
+		goto out_mm;
+	}
+
+	karg.vma_start = vma->vm_start;
+	karg.vma_end = vma->vm_end;
+	karg.vma_flags = procmap_vma_flags(vma);
+	karg.vma_page_size = vma_kernel_pagesize(vma);
+
+	if (vma->vm_file) {
+		const struct inode *inode = file_inode(vma->vm_file);
+
+		karg.vma_offset = ((__u64)vma->vm_pgoff) << PAGE_SHIFT;
+		karg.dev_major = MAJOR(inode->i_sb->s_dev);
+		karg.dev_minor = MINOR(inode->i_sb->s_dev);
+		karg.inode = inode->i_ino;
+	} else {
+		karg.vma_offset = 0;
+		karg.dev_major = 0;
+		karg.dev_minor = 0;
+		karg.inode = 0;
+	}
+
+	if (karg.build_id_size) {
+		__u32 build_id_sz;
+
+		if (build_id_parse(vma, build_id_buf, &build_id_sz)) {
+			karg.build_id_size = 0;
+		} else if (karg.build_id_size < build_id_sz) {
+			err = -E2BIG;
+			goto out;
+		} else {
+			karg.build_id_size = build_id_sz;
+		}
+	}
+
+	if (karg.vma_name_size) {
+		size_t name_buf_sz = min_t(size_t, PATH_MAX, karg.vma_name_size);
+		const struct path *path;
+		const char *name_fmt;
+		size_t name_sz = 0;
+
+		get_vma_name(vma, query_anon_vma_name(vma, mmap_locked),
+			     &path, &name, &name_fmt);
+
+		if (path || name_fmt || name) {
+			name_buf = kmalloc(name_buf_sz, GFP_KERNEL);
+			if (!name_buf) {
+				err = -ENOMEM;
+				goto out;
+			}
+		}
+		if (path) {
+			name = d_path(path, name_buf, name_buf_sz);
+			if (IS_ERR(name)) {
+				err = PTR_ERR(name);
+				if (err == -ENAMETOOLONG)
+					err = -E2BIG;
+				goto out;
+			}
+			name_sz = name_buf + name_buf_sz - name;
+		} else if (name || name_fmt) {
+			name_sz = 1 + snprintf(name_buf, name_buf_sz,
+					       name_fmt ?: "%s", name);
+			name = name_buf;
+		}
+		if (name_sz > name_buf_sz) {
+			err = -E2BIG;
+			goto out;
+		}
+		karg.vma_name_size = name_sz;
+	}
+
+	/* unlock and put mm_struct before copying data to user */
+	query_vma_unlock(mm, vma, mmap_locked);
+	mmput(mm);
+
+	if (karg.vma_name_size &&
+	    copy_to_user(u64_to_user_ptr(karg.vma_name_addr),
+			 name, karg.vma_name_size)) {
+		kfree(name_buf);
+		return -EFAULT;
+	}
+	kfree(name_buf);
+
+	if (karg.build_id_size &&
+	    copy_to_user(u64_to_user_ptr(karg.build_id_addr),
+			 build_id_buf, karg.build_id_size))
+		return -EFAULT;
+
+	if (copy_to_user(uarg, &karg, min_t(size_t, sizeof(karg), usize)))
+		return -EFAULT;
+
+	return 0;
+
+out:
+	query_vma_unlock(mm, vma, mmap_locked);
+out_mm:
+	mmput(mm);
+	kfree(name_buf);
+	return err;
+}
+
+static long procfs_procmap_ioctl(struct file *file, unsigned int cmd,
+				 unsigned long arg)
+{
+	struct seq_file *seq = file->private_data;
+	struct proc_maps_private *priv = seq->private;
+
+	switch (cmd) {
+	case PROCMAP_QUERY:
+		return do_procmap_query(priv, (void __user *)arg);
+	default:
+		return -ENOIOCTLCMD;
+	}
+}
+
 const struct file_operations proc_pid_maps_operations = {
 	.open		= pid_maps_open,
 	.read		= seq_read,
 	.llseek		= seq_lseek,
 	.release	= proc_map_release,
+	.unlocked_ioctl = procfs_procmap_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 
 /*
@@ -999,6 +1308,155 @@ out_put_task:
 }
 #undef SEQ_PUT_DEC
 
+/* Records gathered per mmap_lock hold in PROCMAP_SMAPS_SCAN */
+#define PROCMAP_SMAPS_BATCH	16
+
+static void smaps_fill_rec(struct procmap_smaps_rec *rec,
+			   struct vm_area_struct *vma,
+			   const struct mem_size_stats *mss)
+{
+	rec->vma_start = vma->vm_start;
+	rec->vma_end = vma->vm_end;
+	rec->vma_flags = procmap_vma_flags(vma);
+	rec->rss = mss->resident;
+	rec->pss = mss->pss >> PSS_SHIFT;
+	rec->pss_dirty = mss->pss_dirty >> PSS_SHIFT;
+	rec->shared_clean = mss->shared_clean;
+	rec->shared_dirty = mss->shared_dirty;
+	rec->private_clean = mss->private_clean;
+	rec->private_dirty = mss->private_dirty;
+	rec->referenced = mss->referenced;
+	rec->anonymous = mss->anonymous;
+	rec->anon_huge = mss->anonymous_thp;
+	rec->swap = mss->swap;
+	rec->swap_pss = mss->swap_pss >> PSS_SHIFT;
+	rec->locked = mss->pss_locked >> PSS_SHIFT;
+}
+
+/*
+ * Binary counterpart of reading /proc/pid/smaps: gather the smaps counters
+ * of every VMA in a range into struct procmap_smaps_rec records.
+ *
+ * The page walk needs mmap_lock, so records are gathered in small batches
+ * into a kernel buffer and copied out with the lock dropped. A batch is
+ * also cut short as soon as someone waits for the lock, so a scan of a
+ * process with many VMAs never stalls its page faults for long.
+ */
+static long procmap_smaps_scan(struct proc_maps_private *priv, void __user *uarg)
+{
+	struct procmap_smaps_scan karg;
+	struct procmap_smaps_rec *recs;
+	struct mm_struct *mm = priv->mm;
+	unsigned long addr, end;
+	void __user *vec;
+	size_t vec_bytes;
+	long done = 0;
+	u64 usize;
+	int err;
+
+	err = procmap_copy_arg(&karg, sizeof(karg),
+			       offsetofend(struct procmap_smaps_scan, walk_end),
+			       uarg, &usize);
+	if (err)
+		return err;
+	if (karg.flags)
+		return -EINVAL;
+	if (karg.rec_size < sizeof(struct procmap_smaps_rec))
+		return -EINVAL;
+	if (karg.start > karg.end || karg.end > ULONG_MAX)
+		return -EINVAL;
+	if (check_mul_overflow(karg.vec_len, karg.rec_size, &vec_bytes))
+		return -EINVAL;
+
+	recs = kmalloc_array(PROCMAP_SMAPS_BATCH, sizeof(*recs), GFP_KERNEL);
+	if (!recs)
+		return -ENOMEM;
+
+	if (!mm || !mmget_not_zero(mm)) {
+		err = -ESRCH;
+		goto out_free;
+	}
+
+	addr = karg.start;
+	end = karg.end;
+	vec = u64_to_user_ptr(karg.vec);
+	while (addr < end && done < karg.vec_len) {
+		int i, nr = 0, batch;
+		struct vm_area_struct *vma;
+		VMA_ITERATOR(vmi, mm, addr);
+
+		batch = min_t(u64, PROCMAP_SMAPS_BATCH, karg.vec_len - done);
+
+		err = mmap_read_lock_killable(mm);
+		if (err)
+			break;
+
+		while (nr < batch) {
+			struct mem_size_stats mss;
+
+			vma = vma_find(&vmi, end);
+			if (!vma) {
+				addr = end;
+				break;
+			}
+
+			memset(&mss, 0, sizeof(mss));
+			smap_gather_stats(vma, &mss,
+					  addr > vma->vm_start ? addr : 0);
+			smaps_fill_rec(&recs[nr++], vma, &mss);
+			addr = vma->vm_end;
+
+			if (mmap_lock_is_contended(mm))
+				break;
+		}
+		mmap_read_unlock(mm);
+
+		for (i = 0; i < nr; i++) {
+			void __user *dst = vec + (done + i) * karg.rec_size;
+
+			if (copy_to_user(dst, &recs[i], sizeof(recs[i])) ||
+			    clear_user(dst + sizeof(recs[i]),
+				       karg.rec_size - sizeof(recs[i]))) {
+				err = -EFAULT;
+				break;
+			}
+		}
+		done += i;
+		if (err)
+			break;
+
+		if (fatal_signal_pending(current)) {
+			err = -EINTR;
+			break;
+		}
+		cond_resched();
+	}
+	mmput(mm);
+
+	karg.walk_end = min(addr, end);
+	if (copy_to_user(uarg + offsetof(struct procmap_smaps_scan, walk_end),
+			 &karg.walk_end, sizeof(karg.walk_end)))
+		err = -EFAULT;
+
+out_free:
+	kfree(recs);
+	return done ? done : err;
+}
+
+static long procfs_smaps_ioctl(struct file *file, unsigned int cmd,
+			       unsigned long arg)
+{
+	struct seq_file *seq = file->private_data;
+	struct proc_maps_private *priv = seq->private;
+
+	switch (cmd) {
+	case PROCMAP_SMAPS_SCAN:
+		return procmap_smaps_scan(priv, (void __user *)arg);
+	default:
+		return procfs_procmap_ioctl(file, cmd, arg);
+	}
+}
+
 static const struct seq_operations proc_pid_smaps_op = {
 	.start	= m_start,
 	.next	= m_next,
@@ -1057,6 +1515,8 @@ const struct file_operations proc_pid_smaps_operations = {
 	.read		= seq_read,
 	.llseek		= seq_lseek,
 	.release	= proc_map_release,
+	.unlocked_ioctl = procfs_smaps_ioctl,
+	.compat_ioctl	= compat_ptr_ioctl,
 };
 
 const struct file_operations proc_pid_smaps_rollup_operations = {
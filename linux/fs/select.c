@@ -27,6 +27,8 @@
 #include <linux/file.h>
 #include <linux/fdtable.h>
 #include <linux/fs.h>
+#include <linux/eventpoll.h>
+#include <linux/prctl.h>
 #include <linux/rcupdate.h>
 #include <linux/hrtimer.h>
 #include <linux/freezer.h>
@@ -968,6 +970,354 @@ static int do_poll(struct poll_list *list, struct poll_wqueues *wait,
 	return count;
 }
 
+#ifdef CONFIG_EPOLL
+/*
+ * Cached poll(2), see PR_SET_POLL_CACHE.
+ *
+ * A thread that polls the same large set over and over would otherwise add
+ * and remove a wait queue entry per descriptor on every call.  Instead, the
+ * registrations are kept in a private eventpoll instance across calls and
+ * each call only compares its pollfd array with the previous one.  Entries
+ * are updated where the descriptor, the file behind it or the events differ.
+ * Level-triggered epoll re-checks ready files on every wait, so the results
+ * are those of a plain poll().
+ *
+ * Files are not pinned by the cache: eventpoll drops the entry of a file
+ * that goes away, and counts it, so that the next call can rebuild the
+ * cache rather than trust a file pointer that may have been reused.  Arrays
+ * naming the same descriptor twice are left to do_poll(), for the next
+ * POLL_CACHE_RETRY calls with the same array, as its contents may change.
+ */
+#define POLL_CACHE_RETRY	64
+
+struct poll_cache_entry {
+	struct file *file;	/* only compared against, no reference held */
+	int fd;
+	short events;
+	short revents;		/* fixed result if not watched */
+	bool watched;		/* registered with the eventpoll */
+};
+
+struct poll_cache {
+	struct file *ep;
+	struct files_struct *files;
+	unsigned int released;
+	unsigned int nfds;	/* entries valid in ent[] */
+	unsigned int size;	/* entries allocated */
+	struct poll_cache_entry *ent;
+	struct pollfd *kfds;
+	struct epoll_event *events;
+	/* last array that could not be cached, e.g. with duplicate fds */
+	struct pollfd __user *bad_ufds;
+	unsigned int bad_nfds;
+	unsigned int bad_skips;	/* calls left before it is tried again */
+};
+
+static void poll_cache_free_arrays(struct poll_cache *pc)
+{
+	kvfree(pc->ent);
+	kvfree(pc->kfds);
+	kvfree(pc->events);
+	pc->ent = NULL;
+	pc->kfds = NULL;
+	pc->events = NULL;
+	pc->size = 0;
+}
+
+/* Forget all registrations by starting over with a new eventpoll */
+static int poll_cache_reset(struct poll_cache *pc)
+{
+	struct file *ep;
+
+	ep = eventpoll_private_create();
+	if (IS_ERR(ep))
+		return PTR_ERR(ep);
+	if (pc->ep)
+		fput(pc->ep);
+	pc->ep = ep;
+	pc->files = current->files;
+	pc->released = eventpoll_private_released(ep);
+	pc->nfds = 0;
+	return 0;
+}
+
+static int poll_cache_grow(struct poll_cache *pc, unsigned int nfds)
+{
+	struct poll_cache_entry *ent;
+	struct epoll_event *events;
+	struct pollfd *kfds;
+
+	if (nfds <= pc->size)
+		return 0;
+
+	ent = kvcalloc(nfds, sizeof(*ent), GFP_KERNEL);
+	kfds = kvmalloc_array(nfds, sizeof(*kfds), GFP_KERNEL);
+	events = kvmalloc_array(nfds, sizeof(*events), GFP_KERNEL);
+	if (!ent || !kfds || !events) {
+		kvfree(ent);
+		kvfree(kfds);
+		kvfree(events);
+		return -ENOMEM;
+	}
+
+	if (pc->ent)
+		memcpy(ent, pc->ent, pc->nfds * sizeof(*ent));
+	poll_cache_free_arrays(pc);
+	pc->ent = ent;
+	pc->kfds = kfds;
+	pc->events = events;
+	pc->size = nfds;
+	return 0;
+}
+
+static void poll_cache_release(struct task_struct *tsk)
+{
+	struct poll_cache *pc = tsk->poll_cache;
+
+	tsk->poll_cache = NULL;
+	if (pc->ep)
+		fput(pc->ep);
+	poll_cache_free_arrays(pc);
+	kfree(pc);
+}
+
+void poll_cache_flush(void)
+{
+	if (current->poll_cache)
+		poll_cache_release(current);
+}
+
+void exit_poll_cache(struct task_struct *tsk)
+{
+	if (tsk->poll_cache)
+		poll_cache_release(tsk);
+}
+
+/* Bring entry @i of the cache in line with @pfd */
+static int poll_cache_update(struct poll_cache *pc, unsigned int i,
+			     const struct pollfd *pfd)
+{
+	struct poll_cache_entry *e = &pc->ent[i];
+	__poll_t filter;
+	struct fd f;
+	int err = 0;
+
+	if (i < pc->nfds && e->watched)
+		eventpoll_private_del(pc->ep, e->file, e->fd);
+
+	*e = (struct poll_cache_entry) {
+		.fd	= pfd->fd,
+		.events	= pfd->events,
+	};
+	if (pfd->fd < 0)
+		return 0;
+
+	f = fdget(pfd->fd);
+	if (!f.file) {
+		e->revents = mangle_poll(EPOLLNVAL);
+		return 0;
+	}
+	e->file = f.file;
+
+	/* same as vfs_poll() for files that can't be polled */
+	filter = demangle_poll(pfd->events);
+	if (!file_can_poll(f.file)) {
+		e->revents = mangle_poll(DEFAULT_POLLMASK &
+					 (filter | EPOLLERR | EPOLLHUP));
+	} else {
+		err = eventpoll_private_ctl(pc->ep, f.file, pfd->fd, filter, i);
+		e->watched = !err;
+	}
+	fdput(f);
+	return err;
+}
+
+/*
+ * Update the cache to the pollfd array in pc->kfds.  Returns the number of
+ * entries watched through the eventpoll and those with a fixed result in
+ * *nr_fixed, or a negative error if the array can't be cached.
+ */
+static int poll_cache_sync(struct poll_cache *pc, unsigned int nfds,
+			   unsigned int *nr_fixed)
+{
+	struct files_struct *files = current->files;
+	bool fresh = !pc->nfds;
+	unsigned int i, nr_watched;
+	int err;
+
+again:
+	/* entries past the end of the new array */
+	for (i = nfds; i < pc->nfds; i++) {
+		if (pc->ent[i].watched)
+			eventpoll_private_del(pc->ep, pc->ent[i].file,
+					      pc->ent[i].fd);
+	}
+	if (pc->nfds > nfds)
+		pc->nfds = nfds;
+
+	nr_watched = 0;
+	*nr_fixed = 0;
+	for (i = 0; i < nfds; i++) {
+		const struct pollfd *pfd = &pc->kfds[i];
+		struct poll_cache_entry *e = &pc->ent[i];
+		struct file *file = NULL;
+
+		if (pfd->fd >= 0) {
+			rcu_read_lock();
+			file = files_lookup_fd_rcu(files, pfd->fd);
+			rcu_read_unlock();
+		}
+
+		/*
+		 * Entries with a fixed result hold no reference on their
+		 * file, nor are they told when it goes away, so look at them
+		 * again every time.
+		 */
+		if (i >= pc->nfds || !e->watched || e->fd != pfd->fd ||
+		    e->events != pfd->events || e->file != file) {
+			err = poll_cache_update(pc, i, pfd);
+			if (i >= pc->nfds)
+				pc->nfds = i + 1;
+			/*
+			 * The file is already watched at another index.  Could
+			 * be a reordered array, so start over once before
+			 * deciding that the array has duplicates.
+			 */
+			if (err == -EEXIST && !fresh) {
+				err = poll_cache_reset(pc);
+				if (err)
+					return err;
+				fresh = true;
+				goto again;
+			}
+			if (err)
+				return err;
+		}
+
+		if (e->watched)
+			nr_watched++;
+		else if (e->revents)
+			(*nr_fixed)++;
+	}
+	return nr_watched;
+}
+
+/*
+ * poll() through the cache.  Returns false if the call has to take the
+ * regular path instead, otherwise the result is in *ret.
+ */
+static bool do_poll_cached(struct pollfd __user *ufds, unsigned int nfds,
+			   struct timespec64 *end_time, int *ret)
+{
+	struct poll_cache *pc = current->poll_cache;
+	struct timespec64 zero = {}, *to = end_time;
+	unsigned int i, nr_fixed;
+	int nr_watched, n;
+
+	if (!nfds)
+		return false;
+
+	if (!pc) {
+		pc = kzalloc(sizeof(*pc), GFP_KERNEL);
+		if (!pc)
+			return false;
+		current->poll_cache = pc;
+	}
+	if (pc->bad_ufds == ufds && pc->bad_nfds == nfds && pc->bad_skips) {
+		pc->bad_skips--;
+		return false;
+	}
+
+	if (!pc->ep || pc->files != current->files ||
+	    eventpoll_private_released(pc->ep) != pc->released) {
+		if (poll_cache_reset(pc))
+			return false;
+	}
+	if (poll_cache_grow(pc, nfds))
+		return false;
+
+	if (copy_from_user(pc->kfds, ufds, nfds * sizeof(*ufds))) {
+		*ret = -EFAULT;
+		return true;
+	}
+
+	nr_watched = poll_cache_sync(pc, nfds, &nr_fixed);
+	if (nr_watched <= 0) {
+		/* nothing to wait for, or not cacheable: leave it to do_poll() */
+		if (nr_watched < 0) {
+			pc->bad_ufds = ufds;
+			pc->bad_nfds = nfds;
+			pc->bad_skips = POLL_CACHE_RETRY;
+			poll_cache_reset(pc);
+		}
+		return false;
+	}
+	pc->bad_ufds = NULL;
+
+	/* don't sleep if there is a result already */
+	if (nr_fixed)
+		to = &zero;
+
+	n = eventpoll_private_wait(pc->ep, pc->events, nr_watched, to);
+	if (n < 0) {
+		*ret = n == -EINTR ? -ERESTARTNOHAND : n;
+		return true;
+	}
+
+	for (i = 0; i < nfds; i++)
+		pc->kfds[i].revents = pc->ent[i].revents;
+	for (i = 0; i < n; i++)
+		pc->kfds[pc->events[i].data].revents =
+			mangle_poll(pc->events[i].events);
+
+	if (!user_write_access_begin(ufds, nfds * sizeof(*ufds))) {
+		*ret = -EFAULT;
+		return true;
+	}
+	for (i = 0; i < nfds; i++)
+		unsafe_put_user(pc->kfds[i].revents, &ufds[i].revents, Efault);
+	user_write_access_end();
+
+	*ret = nr_fixed + n;
+	return true;
+
+Efault:
+	user_write_access_end();
+	*ret = -EFAULT;
+	return true;
+}
+
+int set_poll_cache_mode(unsigned long mode)
+{
+	if (mode != PR_POLL_CACHE_OFF && mode != PR_POLL_CACHE_ON)
+		return -EINVAL;
+
+	if (mode == PR_POLL_CACHE_ON) {
+		task_set_poll_cache(current);
+	} else {
+		task_clear_poll_cache(current);
+		poll_cache_flush();
+	}
+	return 0;
+}
+#else
+static inline bool do_poll_cached(struct pollfd __user *ufds, unsigned int nfds,
+				  struct timespec64 *end_time, int *ret)
+{
+	return false;
+}
+
+int set_poll_cache_mode(unsigned long mode)
+{
+	return mode == PR_POLL_CACHE_OFF ? 0 : -EINVAL;
+}
+#endif /* CONFIG_EPOLL */
+
+int get_poll_cache_mode(void)
+{
+	return task_poll_cache(current) ? PR_POLL_CACHE_ON : PR_POLL_CACHE_OFF;
+}
+
 #define N_STACK_PPS ((sizeof(stack_pps) - sizeof(struct poll_list))  / \
 			sizeof(struct pollfd))
 
@@ -987,6 +1337,9 @@ static int do_sys_poll(struct pollfd __user *ufds, unsigned int nfds,
 	if (nfds > rlimit(RLIMIT_NOFILE))
 		return -EINVAL;
 
+	if (task_poll_cache(current) && do_poll_cached(ufds, nfds, end_time, &err))
+		return err;
+
 	len = min_t(unsigned int, nfds, N_STACK_PPS);
 	for (;;) {
 		walk->next = NULL;
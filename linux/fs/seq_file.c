@@ -19,6 +19,8 @@
 #include <linux/printk.h>
 #include <linux/string_helpers.h>
 #include <linux/uio.h>
+#include <linux/log2.h>
+#include <linux/seq_bin.h>
 
 #include <linux/uaccess.h>
 #include <asm/page.h>
@@ -38,6 +40,26 @@ static void *seq_buf_alloc(unsigned long size)
 	return kvmalloc(size, GFP_KERNEL_ACCOUNT);
 }
 
+/*
+ * Grow the buffer of a snapshot file to cover a read of @want bytes.  If
+ * that fails we just carry on with the smaller buffer.
+ */
+static void seq_snapshot_grow(struct seq_file *m, size_t want)
+{
+	void *buf;
+
+	want = min(roundup_pow_of_two(want), SEQ_SNAPSHOT_MAX_SIZE);
+	if (want <= m->size)
+		return;
+
+	buf = seq_buf_alloc(want);
+	if (!buf)
+		return;
+	kvfree(m->buf);
+	m->buf = buf;
+	m->size = want;
+}
+
 /**
  *	seq_open -	initialize sequential file
  *	@file: file we initialize
@@ -220,6 +242,9 @@ ssize_t seq_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 		if (m->count)	// hadn't managed to copy everything
 			goto Done;
 	}
+	// snapshot files try to produce the whole read in one pass
+	if (m->snapshot && iov_iter_count(iter) > m->size)
+		seq_snapshot_grow(m, iov_iter_count(iter));
 	// get a non-empty record in the buffer
 	m->from = 0;
 	p = m->op->start(m, &m->index);
@@ -839,6 +864,30 @@ int seq_write(struct seq_file *seq, const void *data, size_t len)
 }
 EXPORT_SYMBOL(seq_write);
 
+/**
+ * seq_bin_header - start a binary table
+ * @m: the seq_file handle
+ * @type: SEQ_BIN_TYPE_* of the table
+ * @version: version of the record layout
+ * @record_size: size of each record that follows
+ *
+ * Emits the struct seq_bin_header that binary tables start with; the
+ * records themselves are written with seq_write().
+ */
+void seq_bin_header(struct seq_file *m, u16 type, u16 version, u32 record_size)
+{
+	struct seq_bin_header h = {
+		.magic		= SEQ_BIN_MAGIC,
+		.type		= type,
+		.version	= version,
+		.header_size	= sizeof(h),
+		.record_size	= record_size,
+	};
+
+	seq_write(m, &h, sizeof(h));
+}
+EXPORT_SYMBOL(seq_bin_header);
+
 /**
  * seq_pad - write padding spaces to buffer
  * @m: seq_file identifying the buffer to which data should be written
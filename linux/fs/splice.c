@@ -971,9 +971,16 @@ long vfs_splice_read(struct file *in, loff_t *ppos,
 	if (!len)
 		return 0;
 
-	/* Don't try to read more the pipe has space for. */
+	/*
+	 * Don't try to read more the pipe has space for.  A pipe taking folio
+	 * sized buffers is only bounded by its number of slots, which
+	 * ->splice_read() checks as it fills them.
+	 */
 	p_space = pipe->max_usage - pipe_occupancy(pipe->head, pipe->tail);
-	len = min_t(size_t, len, p_space << PAGE_SHIFT);
+	if (!pipe->folio_bufs)
+		len = min_t(size_t, len, p_space << PAGE_SHIFT);
+	else if (!p_space)
+		len = 0;
 
 	ret = rw_verify_area(READ, in, ppos, len);
 	if (unlikely(ret < 0))
@@ -994,6 +1001,24 @@ long vfs_splice_read(struct file *in, loff_t *ppos,
 }
 EXPORT_SYMBOL_GPL(vfs_splice_read);
 
+static int direct_splice_actor(struct pipe_inode_info *pipe,
+			       struct splice_desc *sd);
+
+/*
+ * Whether ->splice_write() of @out passes pipe buffers on as bio_vecs, which
+ * may cover any number of pages of a folio, rather than one page at a time.
+ */
+static bool splice_write_takes_folios(struct file *out)
+{
+	if (out->f_op->splice_write == iter_file_splice_write)
+		return true;
+#ifdef CONFIG_NET
+	if (out->f_op->splice_write == splice_to_socket)
+		return true;
+#endif
+	return false;
+}
+
 /**
  * splice_direct_to_actor - splices data directly between two non-pipes
  * @in:		file to splice from
@@ -1043,6 +1068,14 @@ ssize_t splice_direct_to_actor(struct file *in, struct splice_desc *sd,
 		current->splice_pipe = pipe;
 	}
 
+	/*
+	 * Nobody but the actor sees this pipe, so let the page cache hand over
+	 * whole large folios if the actor is known to cope with buffers that
+	 * span several pages.
+	 */
+	pipe->folio_bufs = actor == direct_splice_actor &&
+			   splice_write_takes_folios(sd->u.file);
+
 	/*
 	 * Do the splice.
 	 */
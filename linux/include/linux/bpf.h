@@ -166,6 +166,8 @@ struct bpf_map_ops {
 				     void *callback_ctx, u64 flags);
 
 	u64 (*map_mem_usage)(const struct bpf_map *map);
+	/* Map type specific lines of /proc/<pid>/fdinfo/<fd> */
+	void (*map_show_fdinfo)(const struct bpf_map *map, struct seq_file *m);
 
 	/* BTF id of struct allocated by map_alloc */
 	int *map_btf_id;
@@ -2095,6 +2097,9 @@ void bpf_map_init_from_attr(struct bpf_map *map, union bpf_attr *attr);
 int  generic_map_lookup_batch(struct bpf_map *map,
 			      const union bpf_attr *attr,
 			      union bpf_attr __user *uattr);
+int  generic_map_lookup_and_delete_batch(struct bpf_map *map,
+					 const union bpf_attr *attr,
+					 union bpf_attr __user *uattr);
 int  generic_map_update_batch(struct bpf_map *map, struct file *map_file,
 			      const union bpf_attr *attr,
 			      union bpf_attr __user *uattr);
@@ -2110,6 +2115,7 @@ void *bpf_map_kmalloc_node(const struct bpf_map *map, size_t size, gfp_t flags,
 void *bpf_map_kzalloc(const struct bpf_map *map, size_t size, gfp_t flags);
 void *bpf_map_kvcalloc(struct bpf_map *map, size_t n, size_t size,
 		       gfp_t flags);
+void *bpf_map_area_alloc_charged(const struct bpf_map *map, u64 size);
 void __percpu *bpf_map_alloc_percpu(const struct bpf_map *map, size_t size,
 				    size_t align, gfp_t flags);
 #else
@@ -2132,6 +2138,12 @@ bpf_map_kvcalloc(struct bpf_map *map, size_t n, size_t size, gfp_t flags)
 	return kvcalloc(n, size, flags);
 }
 
+static inline void *
+bpf_map_area_alloc_charged(const struct bpf_map *map, u64 size)
+{
+	return bpf_map_area_alloc(size, map->numa_node);
+}
+
 static inline void __percpu *
 bpf_map_alloc_percpu(const struct bpf_map *map, size_t size, size_t align,
 		     gfp_t flags)
@@ -450,6 +450,10 @@ struct bpf_verifier_state_list {
 	struct bpf_verifier_state state;
 	struct bpf_verifier_state_list *next;
 	int miss_cnt, hit_cnt;
+	/* hash of the parts of 'state' that states_equal() requires to match */
+	u32 shape;
+	/* bytes allocated for 'state', see state_mem_size() */
+	u32 mem_size;
 };
 
 struct bpf_loop_inline_state {
@@ -591,6 +595,8 @@ struct bpf_id_pair {
 
 struct bpf_idmap {
 	u32 tmp_id_gen;
+	/* number of pairs in use, the rest of map[] is stale */
+	u32 cnt;
 	struct bpf_id_pair map[BPF_ID_MAP_SIZE];
 };
 
@@ -648,6 +654,15 @@ struct bpf_verifier_env {
 	u32 prev_jmps_processed, jmps_processed;
 	/* total verification time */
 	u64 verification_time;
+	/* time spent in the setup, check and rewrite phases of bpf_check(),
+	 * and in is_state_visited() within the check phase.  The latter is
+	 * only measured with BPF_LOG_STATS.
+	 */
+	u64 setup_time, check_time, prune_time, rewrite_time;
+	/* states_equal() calls, and candidates skipped on a shape mismatch */
+	u32 states_compared, shape_misses;
+	/* bytes held by explored states, and their peak */
+	u64 states_mem, peak_states_mem;
 	/* maximum number of verifier states kept in 'branching' instructions */
 	u32 max_states_per_insn;
 	/* total number of allocated verifier states */
@@ -14,6 +14,7 @@
 
 /* Forward declarations to avoid compiler errors */
 struct file;
+struct timespec64;
 
 
 #ifdef CONFIG_EPOLL
@@ -56,6 +57,15 @@ static inline void eventpoll_release(struct file *file)
 int do_epoll_ctl(int epfd, int op, int fd, struct epoll_event *epds,
 		 bool nonblock);
 
+/* Private eventpoll instances for cached poll(2) */
+struct file *eventpoll_private_create(void);
+int eventpoll_private_ctl(struct file *file, struct file *tfile, int fd,
+			  __poll_t events, u64 data);
+void eventpoll_private_del(struct file *file, struct file *tfile, int fd);
+unsigned int eventpoll_private_released(struct file *file);
+int eventpoll_private_wait(struct file *file, struct epoll_event *events,
+			   int maxevents, struct timespec64 *timeout);
+
 /* Tells if the epoll_ctl(2) operation needs an event copy from userspace */
 static inline int ep_op_has_event(int op)
 {
@@ -52,6 +52,7 @@ struct files_struct {
    */
 	atomic_t count;
 	bool resize_in_progress;
+	bool any_fd;		/* PR_FD_ALLOC_ANY: no lowest-fd guarantee */
 	wait_queue_head_t resize_wait;
 
 	struct fdtable __rcu *fdt;
@@ -61,6 +62,7 @@ struct files_struct {
    */
 	spinlock_t file_lock ____cacheline_aligned_in_smp;
 	unsigned int next_fd;
+	struct list_head fd_caches;	/* per-thread reservations, see fs/file.c */
 	unsigned long close_on_exec_init[1];
 	unsigned long open_fds_init[1];
 	unsigned long full_fds_bits_init[1];
@@ -128,6 +130,9 @@ extern int __close_range(unsigned int fd, unsigned int max_fd, unsigned int flag
 extern struct file *close_fd_get_file(unsigned int fd);
 extern int unshare_fd(unsigned long unshare_flags, unsigned int max_fds,
 		      struct files_struct **new_fdp);
+extern void fd_cache_flush(void);
+extern int set_fd_alloc_mode(unsigned long mode);
+extern int get_fd_alloc_mode(void);
 
 extern struct kmem_cache *files_cachep;
 
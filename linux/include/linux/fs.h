@@ -31,6 +31,7 @@
 #include <linux/uidgid.h>
 #include <linux/lockdep.h>
 #include <linux/percpu-rwsem.h>
+#include <linux/percpu_counter.h>
 #include <linux/workqueue.h>
 #include <linux/delayed_call.h>
 #include <linux/uuid.h>
@@ -1302,6 +1303,8 @@ struct super_block {
 	 */
 	struct list_lru		s_dentry_lru;
 	struct list_lru		s_inode_lru;
+	/* unused negative dentries on s_dentry_lru */
+	struct percpu_counter	s_nr_dentry_negative;
 	struct rcu_head		rcu;
 	struct work_struct	destroy_work;
 
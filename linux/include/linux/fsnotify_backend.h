@@ -250,6 +250,8 @@ struct fsnotify_group {
 			wait_queue_head_t access_waitq;
 			int flags;           /* flags from fanotify_init() */
 			int f_flags; /* event_f_flags from fanotify_init() */
+			/* number of FAN_MARK_IGNORE_SUBTREE marks */
+			atomic_t subtree_marks;
 			struct ucounts *ucounts;
 			mempool_t error_events_pool;
 		} fanotify_data;
@@ -530,6 +532,7 @@ struct fsnotify_mark {
 #define FSNOTIFY_MARK_FLAG_IGNORED_SURV_MODIFY	0x0100
 #define FSNOTIFY_MARK_FLAG_NO_IREF		0x0200
 #define FSNOTIFY_MARK_FLAG_HAS_IGNORE_FLAGS	0x0400
+#define FSNOTIFY_MARK_FLAG_IGNORE_SUBTREE	0x0800
 	unsigned int flags;		/* flags [mark->lock] */
 };
 
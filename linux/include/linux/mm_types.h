@@ -11,6 +11,7 @@
 #include <linux/rbtree.h>
 #include <linux/maple_tree.h>
 #include <linux/rwsem.h>
+#include <linux/mutex.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -670,6 +671,7 @@ struct mm_cid {
 #endif
 
 struct kioctx_table;
+struct futex_private_hash;
 struct mm_struct {
 	struct {
 		/*
@@ -784,6 +786,15 @@ struct mm_struct {
 		 */
 		int mm_lock_seq;
 #endif
+#ifdef CONFIG_BPF_SYSCALL
+		/*
+		 * Bumped whenever mappings are unmapped, before their files
+		 * are released.  BPF caches build IDs per VMA and checks this
+		 * to tell a stale entry.  Each mm_struct starts at its own
+		 * multiple of 2^32, so a recycled one does not repeat values.
+		 */
+		atomic64_t bpf_vma_gen;
+#endif
 
 
 		unsigned long hiwater_rss; /* High-watermark of RSS usage */
@@ -873,6 +884,11 @@ struct mm_struct {
 		atomic_t tlb_flush_batched;
 #endif
 		struct uprobes_state uprobes_state;
+#ifdef CONFIG_FUTEX
+		/* process-private futex hash, see PR_FUTEX_HASH */
+		struct futex_private_hash *futex_phash;
+		struct mutex futex_hash_lock;
+#endif
 #ifdef CONFIG_PREEMPT_RT
 		struct rcu_head delayed_drop;
 #endif
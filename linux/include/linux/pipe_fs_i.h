@@ -41,7 +41,8 @@ struct pipe_buffer {
  *	@note_loss: The next read() should insert a data-lost message
  *	@max_usage: The maximum number of slots that may be used in the ring
  *	@ring_size: total number of buffers (should be a power of 2)
- *	@nr_accounted: The amount this pipe accounts for in user->pipe_bufs
+ *	@nr_accounted: The amount this pipe accounts for in user->pipe_bufs, in pages
+ *	@buf_order: allocation order of the buffers filled by write()
  *	@tmp_page: cached released page
  *	@readers: number of current readers of this pipe
  *	@writers: number of current writers of this pipe
@@ -49,6 +50,7 @@ struct pipe_buffer {
  *	@r_counter: reader counter
  *	@w_counter: writer counter
  *	@poll_usage: is this pipe used for epoll, which has crazy wakeups?
+ *	@folio_bufs: page cache splice may put a whole folio range in one buffer
  *	@fasync_readers: reader side fasync
  *	@fasync_writers: writer side fasync
  *	@bufs: the circular array of pipe buffers
@@ -66,12 +68,14 @@ struct pipe_inode_info {
 	bool note_loss;
 #endif
 	unsigned int nr_accounted;
+	unsigned int buf_order;
 	unsigned int readers;
 	unsigned int writers;
 	unsigned int files;
 	unsigned int r_counter;
 	unsigned int w_counter;
 	bool poll_usage;
+	bool folio_bufs;
 	struct page *tmp_page;
 	struct fasync_struct *fasync_readers;
 	struct fasync_struct *fasync_writers;
@@ -172,6 +176,15 @@ static inline bool pipe_full(unsigned int head, unsigned int tail,
 	return pipe_occupancy(head, tail) >= limit;
 }
 
+/**
+ * pipe_buf_size - Return the size of the buffers write() fills
+ * @pipe: The pipe to access
+ */
+static inline unsigned long pipe_buf_size(const struct pipe_inode_info *pipe)
+{
+	return PAGE_SIZE << pipe->buf_order;
+}
+
 /**
  * pipe_buf - Return the pipe buffer for the specified slot in the pipe ring
  * @pipe: The pipe to access
@@ -283,7 +296,7 @@ bool too_many_pipe_buffers_soft(unsigned long user_bufs);
 bool too_many_pipe_buffers_hard(unsigned long user_bufs);
 bool pipe_is_unprivileged_user(void);
 
-/* for F_SETPIPE_SZ and F_GETPIPE_SZ */
+/* for F_{SET,GET}PIPE_SZ and F_{SET,GET}PIPE_BUF_SZ */
 int pipe_resize_ring(struct pipe_inode_info *pipe, unsigned int nr_slots);
 long pipe_fcntl(struct file *, unsigned int, unsigned int arg);
 struct pipe_inode_info *get_pipe_info(struct file *file, bool for_splice);
@@ -116,6 +116,16 @@ extern int core_sys_select(int n, fd_set __user *inp, fd_set __user *outp,
 extern int poll_select_set_timeout(struct timespec64 *to, time64_t sec,
 				   long nsec);
 
+extern int set_poll_cache_mode(unsigned long mode);
+extern int get_poll_cache_mode(void);
+#ifdef CONFIG_EPOLL
+extern void poll_cache_flush(void);
+extern void exit_poll_cache(struct task_struct *tsk);
+#else
+static inline void poll_cache_flush(void) { }
+static inline void exit_poll_cache(struct task_struct *tsk) { }
+#endif
+
 #define __MAP(v, from, to) \
 	(from < to ? (v & from) * (to/from) : (v & from) / (from/to))
 
@@ -24,6 +24,13 @@ enum {
 #else
 	PROC_ENTRY_PERMANENT = 1U << 0,
 #endif
+
+	/*
+	 * seq_file entry opened in snapshot mode, see seq_set_snapshot().
+	 * Per entry rather than per ->proc_ops; set with
+	 * proc_set_seq_snapshot().
+	 */
+	PROC_ENTRY_SEQ_SNAPSHOT = 1U << 1,
 };
 
 struct proc_ops {
@@ -110,6 +117,7 @@ extern struct proc_dir_entry *proc_create_data(const char *, umode_t,
 struct proc_dir_entry *proc_create(const char *name, umode_t mode, struct proc_dir_entry *parent, const struct proc_ops *proc_ops);
 extern void proc_set_size(struct proc_dir_entry *, loff_t);
 extern void proc_set_user(struct proc_dir_entry *, kuid_t, kgid_t);
+extern void proc_set_seq_snapshot(struct proc_dir_entry *);
 
 /*
  * Obtain the private data passed by user through proc_create_data() or
@@ -203,6 +211,7 @@ proc_create_data(const char *name, umode_t mode, struct proc_dir_entry *parent,
 
 static inline void proc_set_size(struct proc_dir_entry *de, loff_t size) {}
 static inline void proc_set_user(struct proc_dir_entry *de, kuid_t uid, kgid_t gid) {}
+static inline void proc_set_seq_snapshot(struct proc_dir_entry *de) {}
 static inline void *pde_data(const struct inode *inode) {BUG(); return NULL;}
 static inline void *proc_get_parent_data(const struct inode *inode) { BUG(); return NULL; }
 
@@ -47,6 +47,8 @@ struct bpf_local_storage;
 struct bpf_run_ctx;
 struct capture_control;
 struct cfs_rq;
+struct fd_cache;
+struct poll_cache;
 struct fs_struct;
 struct futex_pi_state;
 struct io_context;
@@ -1092,6 +1094,10 @@ struct task_struct {
 
 	/* Open file information: */
 	struct files_struct		*files;
+	/* Descriptors reserved for this thread, see PR_SET_FD_ALLOC: */
+	struct fd_cache			*fd_cache;
+	/* Registrations kept across poll() calls, see PR_SET_POLL_CACHE: */
+	struct poll_cache		*poll_cache;
 
 #ifdef CONFIG_IO_URING
 	struct io_uring_task		*io_uring;
@@ -1804,6 +1810,8 @@ static __always_inline bool is_percpu_thread(void)
 #define PFA_SPEC_IB_DISABLE		5	/* Indirect branch speculation restricted */
 #define PFA_SPEC_IB_FORCE_DISABLE	6	/* Indirect branch speculation permanently restricted */
 #define PFA_SPEC_SSB_NOEXEC		7	/* Speculative Store Bypass clear on execve() */
+#define PFA_EXEC_TEXT_PREFAULT		8	/* Read ahead text at execve(), see PR_SET_EXEC_TEXT_PREFAULT */
+#define PFA_POLL_CACHE			9	/* Keep poll() registrations, see PR_SET_POLL_CACHE */
 
 #define TASK_PFA_TEST(name, func)					\
 	static inline bool task_##func(struct task_struct *p)		\
@@ -1846,6 +1854,14 @@ TASK_PFA_CLEAR(SPEC_IB_DISABLE, spec_ib_disable)
 TASK_PFA_TEST(SPEC_IB_FORCE_DISABLE, spec_ib_force_disable)
 TASK_PFA_SET(SPEC_IB_FORCE_DISABLE, spec_ib_force_disable)
 
+TASK_PFA_TEST(EXEC_TEXT_PREFAULT, exec_text_prefault)
+TASK_PFA_SET(EXEC_TEXT_PREFAULT, exec_text_prefault)
+TASK_PFA_CLEAR(EXEC_TEXT_PREFAULT, exec_text_prefault)
+
+TASK_PFA_TEST(POLL_CACHE, poll_cache)
+TASK_PFA_SET(POLL_CACHE, poll_cache)
+TASK_PFA_CLEAR(POLL_CACHE, poll_cache)
+
 static inline void
 current_restore_flags(unsigned long orig_flags, unsigned long flags)
 {
@@ -25,6 +25,7 @@ struct seq_file {
 	struct mutex lock;
 	const struct seq_operations *op;
 	int poll_event;
+	bool snapshot;
 	const struct file *file;
 	void *private;
 };
@@ -105,6 +106,21 @@ static inline void seq_setwidth(struct seq_file *m, size_t size)
 }
 void seq_pad(struct seq_file *m, char c);
 
+/*
+ * A read() of a snapshot file is served by a buffer as large as the read
+ * (up to SEQ_SNAPSHOT_MAX_SIZE), so that a big enough read() sees
+ * the whole table from a single ->start()/->stop() pass instead of one pass
+ * per page.  Meant for tables that monitoring tools read in one go.
+ */
+#define SEQ_SNAPSHOT_MAX_SIZE	(4UL << 20)
+
+static inline void seq_set_snapshot(struct seq_file *m)
+{
+	m->snapshot = true;
+}
+
+void seq_bin_header(struct seq_file *m, u16 type, u16 version, u32 record_size);
+
 char *mangle_path(char *s, const char *p, const char *esc);
 int seq_open(struct file *, const struct seq_operations *);
 ssize_t seq_read(struct file *, char __user *, size_t, loff_t *);
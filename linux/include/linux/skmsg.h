@@ -76,6 +76,17 @@ struct sk_psock_work_state {
 	u32				off;
 };
 
+/* Redirect path counters, summed over a sockmap's sockets in its fdinfo */
+struct sk_psock_stats {
+	/* skbs redirected straight onto the ingress queue, in softirq */
+	atomic_long_t			redir_direct;
+	/* skbs queued for the backlog work, and runs of it */
+	atomic_long_t			backlog_skbs;
+	atomic_long_t			backlog_runs;
+	/* time from queueing onto an empty backlog until the work ran */
+	atomic_long_t			backlog_wait_ns;
+};
+
 struct sk_psock {
 	struct sock			*sk;
 	struct sock			*sk_redir;
@@ -106,6 +117,8 @@ struct sk_psock {
 	struct mutex			work_mutex;
 	struct sk_psock_work_state	work_state;
 	struct delayed_work		work;
+	u64				backlog_queued_ns;
+	struct sk_psock_stats		stats;
 	struct sock			*sk_pair;
 	struct rcu_work			rwork;
 };
@@ -21,6 +21,11 @@
 
 /* Flags for epoll_create1.  */
 #define EPOLL_CLOEXEC O_CLOEXEC
+/*
+ * Queue ready events on per-CPU lists, for instances fed by many CPUs at
+ * once. Wakeups are batched per list.
+ */
+#define EPOLL_PERCPU_READY 0x00000001
 
 /* Valid opcodes to issue to sys_epoll_ctl() */
 #define EPOLL_CTL_ADD 1
@@ -85,6 +85,8 @@
 #define FAN_MARK_EVICTABLE	0x00000200
 /* This bit is mutually exclusive with FAN_MARK_IGNORED_MASK bit */
 #define FAN_MARK_IGNORE		0x00000400
+/* Apply the ignore mask of a directory mark to its whole subtree */
+#define FAN_MARK_IGNORE_SUBTREE	0x00000800
 
 /* These are NOT bitwise flags.  Both bits can be used togther.  */
 #define FAN_MARK_INODE		0x00000000
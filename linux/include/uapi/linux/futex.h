@@ -22,6 +22,7 @@
 #define FUTEX_WAIT_REQUEUE_PI	11
 #define FUTEX_CMP_REQUEUE_PI	12
 #define FUTEX_LOCK_PI2		13
+#define FUTEX_WAKEV		14
 
 #define FUTEX_PRIVATE_FLAG	128
 #define FUTEX_CLOCK_REALTIME	256
@@ -49,6 +50,14 @@
  */
 #define FUTEX_32		2
 
+/*
+ * The futex word is followed by a u32 naming the NUMA node whose hash the
+ * futex goes into, so that it can be placed next to its users. A node of
+ * -1 is set to the node of the first caller. The pair must be 8 byte
+ * aligned, and all waiters and wakers of the futex must pass the flag.
+ */
+#define FUTEX2_NUMA		4
+
 /*
  * Max numbers of elements in a futex_waitv array
  */
@@ -306,4 +306,34 @@ struct prctl_mm_map {
 # define PR_RISCV_V_VSTATE_CTRL_NEXT_MASK	0xc
 # define PR_RISCV_V_VSTATE_CTRL_MASK		0x1f
 
+/*
+ * Hash the private futexes of this process into a table of its own instead
+ * of the global one.  A slot count of 0 sizes the table by thread count.
+ */
+#define PR_FUTEX_HASH			78
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
+/* File descriptor allocation policy */
+#define PR_SET_FD_ALLOC			100
+#define PR_GET_FD_ALLOC			101
+# define PR_FD_ALLOC_LOWEST		0	/* POSIX lowest available fd */
+# define PR_FD_ALLOC_ANY		1	/* any available fd, per-thread caches */
+
+/*
+ * Read executable ELF segments ahead at execve() and map them with large
+ * folios where aligned.  Inherited across fork() and execve().
+ */
+#define PR_SET_EXEC_TEXT_PREFAULT	102
+#define PR_GET_EXEC_TEXT_PREFAULT	103
+
+/*
+ * Keep the wait queue registrations of poll() across calls for threads that
+ * poll the same large set repeatedly.  Cleared at execve().
+ */
+#define PR_SET_POLL_CACHE		104
+#define PR_GET_POLL_CACHE		105
+# define PR_POLL_CACHE_OFF		0
+# define PR_POLL_CACHE_ON		1
+
 #endif /* _LINUX_PRCTL_H */
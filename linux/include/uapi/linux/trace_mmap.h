@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _TRACE_MMAP_H_
+#define _TRACE_MMAP_H_
+
+#include <linux/types.h>
+
+/**
+ * struct trace_buffer_meta - Ring-buffer Meta-page description
+ * @meta_page_size:	Size of this meta-page.
+ * @meta_struct_len:	Size of this structure.
+ * @subbuf_size:	Size of each sub-buffer.
+ * @nr_subbufs:		Number of sub-buffers in the ring-buffer, including the reader.
+ * @reader.lost_events:	Number of events lost before the reader sub-buffer,
+ *			as of the last TRACE_MMAP_IOCTL_GET_READER.
+ * @reader.id:		subbuf ID of the current reader. ID range [0 : @nr_subbufs - 1]
+ * @reader.read:	End of the data of the reader sub-buffer handed over so
+ *			far. A reader owns the data between the previous value
+ *			(or 0 if @reader.id changed) and this one.
+ * @flags:		Flags for the meta-page.
+ * @entries:		Number of entries in the ring-buffer.
+ * @overrun:		Number of entries lost in the ring-buffer.
+ * @read:		Number of entries that have been read.
+ * @Reserved1:		Internal use only.
+ * @Reserved2:		Internal use only.
+ *
+ * The meta-page is the first page of the mapping of a per-CPU
+ * trace_pipe_raw file. It is followed by the @nr_subbufs sub-buffers,
+ * in the order of their IDs: the sub-buffer with ID n starts at offset
+ * @meta_page_size + n * @subbuf_size of the mapping.
+ */
+struct trace_buffer_meta {
+	__u32		meta_page_size;
+	__u32		meta_struct_len;
+
+	__u32		subbuf_size;
+	__u32		nr_subbufs;
+
+	struct {
+		__u64	lost_events;
+		__u32	id;
+		__u32	read;
+	} reader;
+
+	__u64	flags;
+
+	__u64	entries;
+	__u64	overrun;
+	__u64	read;
+
+	__u64	Reserved1;
+	__u64	Reserved2;
+};
+
+/*
+ * Hand the data written since the last call over to the reader, swapping
+ * in a new reader sub-buffer once the current one has been fully handed
+ * over, and update the meta-page. Blocks until there is data to read
+ * unless the file was opened with O_NONBLOCK.
+ */
+#define TRACE_MMAP_IOCTL_GET_READER		_IO('R', 0x20)
+
+#endif /* _TRACE_MMAP_H_ */
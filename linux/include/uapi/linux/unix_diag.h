@@ -58,4 +58,22 @@ struct unix_diag_rqlen {
 	__u32	udiag_wqueue;
 };
 
+/*
+ * Records of /proc/net/unix_bin, see <linux/seq_bin.h>.  path holds the raw
+ * sun_path bytes; an abstract name starts with a NUL byte.
+ */
+struct unix_seq_bin {
+	__u64	ino;
+	__u32	refcnt;
+	__u32	flags;		/* __SO_ACCEPTCON for listening sockets */
+	__u16	type;		/* SOCK_* */
+	__u8	state;		/* SS_* */
+	__u8	path_len;	/* 0 if unbound */
+	__u32	pad;
+	char	path[108];
+	__u32	reserved;
+};
+
+#define UNIX_SEQ_BIN_VERSION	1
+
 #endif
@@ -306,6 +306,117 @@ static int array_map_get_next_key(struct bpf_map *map, void *key, void *next_key
 	return 0;
 }
 
+/* Values of a batch lookup are gathered in a buffer of up to this size and
+ * copied out with one copy_to_user() per chunk, not one per element.
+ */
+#define ARRAY_BATCH_BUF_SIZE	(64 * 1024)
+
+static void array_map_copy_batch(struct bpf_map *map, u32 index, u32 n,
+				 u32 *keys, void *values, u64 elem_flags)
+{
+	struct bpf_array *array = container_of(map, struct bpf_array, map);
+	u32 value_size = bpf_map_value_size(map);
+	void *ptr;
+	u32 i;
+
+	for (i = 0; i < n; i++, index++, values += value_size) {
+		keys[i] = index;
+		if (map->map_type == BPF_MAP_TYPE_PERCPU_ARRAY) {
+			bpf_percpu_array_copy(map, &index, values);
+			continue;
+		}
+		ptr = array->value + (u64)array->elem_size * index;
+		if (elem_flags & BPF_F_LOCK)
+			copy_map_value_locked(map, values, ptr, true);
+		else
+			copy_map_value(map, values, ptr);
+		check_and_init_map_value(map, values);
+	}
+}
+
+/* Called from syscall.  Same as generic_map_lookup_batch(), walking the
+ * indexes directly instead of through map_get_next_key().
+ */
+static int array_map_lookup_batch(struct bpf_map *map,
+				  const union bpf_attr *attr,
+				  union bpf_attr __user *uattr)
+{
+	void __user *uobatch = u64_to_user_ptr(attr->batch.out_batch);
+	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
+	void __user *values = u64_to_user_ptr(attr->batch.values);
+	void __user *keys = u64_to_user_ptr(attr->batch.keys);
+	u64 elem_flags = attr->batch.elem_flags;
+	u32 value_size, max_count, chunk, index = 0, cp = 0, n;
+	void *vbuf = NULL;
+	u32 *kbuf;
+	int err = 0;
+
+	if (elem_flags & ~BPF_F_LOCK)
+		return -EINVAL;
+
+	if ((elem_flags & BPF_F_LOCK) &&
+	    !btf_record_has_field(map->record, BPF_SPIN_LOCK))
+		return -EINVAL;
+
+	value_size = bpf_map_value_size(map);
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	/* in_batch is the last index returned, as in array_map_get_next_key() */
+	if (ubatch) {
+		if (copy_from_user(&index, ubatch, sizeof(index)))
+			return -EFAULT;
+		index = index < map->max_entries ? index + 1 : 0;
+	}
+
+	chunk = max_t(u32, ARRAY_BATCH_BUF_SIZE / value_size, 1);
+	chunk = min(chunk, max_count);
+	kbuf = kvmalloc_array(chunk, sizeof(*kbuf), GFP_USER | __GFP_NOWARN);
+	if (!kbuf)
+		return -ENOMEM;
+	vbuf = kvmalloc_array(chunk, value_size, GFP_USER | __GFP_NOWARN);
+	if (!vbuf) {
+		err = -ENOMEM;
+		goto free_buf;
+	}
+
+	while (cp < max_count && index < map->max_entries) {
+		n = min3(chunk, max_count - cp, map->max_entries - index);
+
+		bpf_disable_instrumentation();
+		array_map_copy_batch(map, index, n, kbuf, vbuf, elem_flags);
+		bpf_enable_instrumentation();
+
+		if (copy_to_user(keys + cp * sizeof(u32), kbuf, n * sizeof(u32)) ||
+		    copy_to_user(values + cp * value_size, vbuf, n * value_size)) {
+			err = -EFAULT;
+			goto free_buf;
+		}
+		cp += n;
+		index += n;
+		cond_resched();
+	}
+
+	if (index >= map->max_entries)
+		err = -ENOENT;
+
+	/* the last index returned */
+	index--;
+	if (copy_to_user(&uattr->batch.count, &cp, sizeof(cp)) ||
+	    (cp && copy_to_user(uobatch, &index, sizeof(index))))
+		err = -EFAULT;
+
+free_buf:
+	kvfree(vbuf);
+	kvfree(kbuf);
+	return err;
+}
+
 /* Called from syscall or from eBPF program */
 static long array_map_update_elem(struct bpf_map *map, void *key, void *value,
 				  u64 map_flags)
@@ -760,7 +871,7 @@ const struct bpf_map_ops array_map_ops = {
 	.map_mmap = array_map_mmap,
 	.map_seq_show_elem = array_map_seq_show_elem,
 	.map_check_btf = array_map_check_btf,
-	.map_lookup_batch = generic_map_lookup_batch,
+	.map_lookup_batch = array_map_lookup_batch,
 	.map_update_batch = generic_map_update_batch,
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_array_elem,
@@ -781,7 +892,7 @@ const struct bpf_map_ops percpu_array_map_ops = {
 	.map_lookup_percpu_elem = percpu_array_map_lookup_percpu_elem,
 	.map_seq_show_elem = percpu_array_map_seq_show_elem,
 	.map_check_btf = array_map_check_btf,
-	.map_lookup_batch = generic_map_lookup_batch,
+	.map_lookup_batch = array_map_lookup_batch,
 	.map_update_batch = generic_map_update_batch,
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_array_elem,
@@ -8,16 +8,39 @@
 #include <linux/jhash.h>
 #include <linux/random.h>
 #include <linux/btf_ids.h>
+#include <linux/xxhash.h>
 
 #define BLOOM_CREATE_FLAG_MASK \
-	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK)
+	(BPF_F_NUMA_NODE | BPF_F_ZERO_SEED | BPF_F_ACCESS_MASK | \
+	 BPF_F_BLOOM_BLOCKED)
+
+/* A BPF_F_BLOOM_BLOCKED filter hashes a value once into 64 bits. The high
+ * half picks the block, hash function i picks the bit in it by multiplying
+ * the low half with salt i and keeping the top bits.
+ */
+#define BLOOM_BLOCK_BYTES	64
+#define BLOOM_BLOCK_SHIFT	9
+#define BLOOM_BLOCK_BITS	(1U << BLOOM_BLOCK_SHIFT)
+#define BLOOM_BLOCK_MAX		(BIT_ULL(32) / BLOOM_BLOCK_BITS)
+
+/* Batches of bpf_bloom_map_peek_batch() are reported in a u64 */
+#define BLOOM_PEEK_BATCH_MAX	64
+
+static const u32 bloom_block_salt[16] = {
+	0x47b6137b, 0x44974d91, 0x8824ad5b, 0xa2b7289d,
+	0x705495c7, 0x2df1424b, 0x9efc4947, 0x5c6bfb31,
+	0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f,
+	0x165667b1, 0xd3a2646d, 0xfd7046c5, 0xb55a4f09,
+};
 
 struct bpf_bloom_filter {
 	struct bpf_map map;
 	u32 bitset_mask;
 	u32 hash_seed;
 	u32 nr_hash_funcs;
-	unsigned long bitset[];
+	/* only set for BPF_F_BLOOM_BLOCKED */
+	u32 nr_blocks;
+	unsigned long bitset[] __aligned(BLOOM_BLOCK_BYTES);
 };
 
 static u32 hash(struct bpf_bloom_filter *bloom, void *value,
@@ -33,12 +56,62 @@ static u32 hash(struct bpf_bloom_filter *bloom, void *value,
 	return h & bloom->bitset_mask;
 }
 
+/* First bit of the block of @value, with the hash for the bits inside it in
+ * @block_hash
+ */
+static u64 block_hash(struct bpf_bloom_filter *bloom, void *value,
+		      u32 value_size, u32 *block_hash)
+{
+	u64 h = xxh64(value, value_size, bloom->hash_seed);
+
+	*block_hash = lower_32_bits(h);
+	return (u64)reciprocal_scale(upper_32_bits(h), bloom->nr_blocks) *
+	       BLOOM_BLOCK_BITS;
+}
+
+static inline u32 block_bit(u32 block_hash, u32 i)
+{
+	return (block_hash * bloom_block_salt[i]) >> (32 - BLOOM_BLOCK_SHIFT);
+}
+
+static bool bloom_block_test(struct bpf_bloom_filter *bloom, void *value,
+			     u32 value_size)
+{
+	u32 i, bh;
+	u64 base;
+
+	base = block_hash(bloom, value, value_size, &bh);
+	for (i = 0; i < bloom->nr_hash_funcs; i++)
+		if (!test_bit(base + block_bit(bh, i), bloom->bitset))
+			return false;
+
+	return true;
+}
+
+static void bloom_block_set(struct bpf_bloom_filter *bloom, void *value,
+			    u32 value_size)
+{
+	u32 i, bh;
+	u64 base;
+
+	base = block_hash(bloom, value, value_size, &bh);
+	for (i = 0; i < bloom->nr_hash_funcs; i++) {
+		/* don't dirty the line for values that are already in */
+		if (!test_bit(base + block_bit(bh, i), bloom->bitset))
+			set_bit(base + block_bit(bh, i), bloom->bitset);
+	}
+}
+
 static long bloom_map_peek_elem(struct bpf_map *map, void *value)
 {
 	struct bpf_bloom_filter *bloom =
 		container_of(map, struct bpf_bloom_filter, map);
 	u32 i, h;
 
+	if (bloom->nr_blocks)
+		return bloom_block_test(bloom, value, map->value_size) ?
+		       0 : -ENOENT;
+
 	for (i = 0; i < bloom->nr_hash_funcs; i++) {
 		h = hash(bloom, value, map->value_size, i);
 		if (!test_bit(h, bloom->bitset))
@@ -57,6 +130,11 @@ static long bloom_map_push_elem(struct bpf_map *map, void *value, u64 flags)
 	if (flags != BPF_ANY)
 		return -EINVAL;
 
+	if (bloom->nr_blocks) {
+		bloom_block_set(bloom, value, map->value_size);
+		return 0;
+	}
+
 	for (i = 0; i < bloom->nr_hash_funcs; i++) {
 		h = hash(bloom, value, map->value_size, i);
 		set_bit(h, bloom->bitset);
@@ -94,7 +172,7 @@ static int bloom_map_alloc_check(union bpf_attr *attr)
 
 static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 {
-	u32 bitset_bytes, bitset_mask, nr_hash_funcs, nr_bits;
+	u32 bitset_bytes, bitset_mask, nr_hash_funcs, nr_bits, nr_blocks = 0;
 	int numa_node = bpf_map_attr_numa_node(attr);
 	struct bpf_bloom_filter *bloom;
 
@@ -133,6 +211,12 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 		 */
 		bitset_bytes = BITS_TO_BYTES(U32_MAX);
 		bitset_mask = U32_MAX;
+		nr_blocks = BLOOM_BLOCK_MAX;
+	} else if (attr->map_flags & BPF_F_BLOOM_BLOCKED) {
+		/* Blocks are picked by scaling rather than masking the hash,
+		 * so there is no need to round up to a power of two.
+		 */
+		nr_blocks = DIV_ROUND_UP(nr_bits, BLOOM_BLOCK_BITS);
 	} else {
 		if (nr_bits <= BITS_PER_LONG)
 			nr_bits = BITS_PER_LONG;
@@ -142,6 +226,13 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 		bitset_mask = nr_bits - 1;
 	}
 
+	if (attr->map_flags & BPF_F_BLOOM_BLOCKED) {
+		bitset_bytes = nr_blocks * BLOOM_BLOCK_BYTES;
+		bitset_mask = 0;
+	} else {
+		nr_blocks = 0;
+	}
+
 	bitset_bytes = roundup(bitset_bytes, sizeof(unsigned long));
 	bloom = bpf_map_area_alloc(sizeof(*bloom) + bitset_bytes, numa_node);
 
@@ -152,6 +243,7 @@ static struct bpf_map *bloom_map_alloc(union bpf_attr *attr)
 
 	bloom->nr_hash_funcs = nr_hash_funcs;
 	bloom->bitset_mask = bitset_mask;
+	bloom->nr_blocks = nr_blocks;
 
 	if (!(attr->map_flags & BPF_F_ZERO_SEED))
 		bloom->hash_seed = get_random_u32();
@@ -195,6 +287,8 @@ static u64 bloom_map_mem_usage(const struct bpf_map *map)
 	u64 bitset_bytes;
 
 	bloom = container_of(map, struct bpf_bloom_filter, map);
+	if (bloom->nr_blocks)
+		return sizeof(*bloom) + (u64)bloom->nr_blocks * BLOOM_BLOCK_BYTES;
 	bitset_bytes = BITS_TO_BYTES((u64)bloom->bitset_mask + 1);
 	bitset_bytes = roundup(bitset_bytes, sizeof(unsigned long));
 	return sizeof(*bloom) + bitset_bytes;
@@ -217,3 +311,60 @@ const struct bpf_map_ops bloom_filter_map_ops = {
 	.map_mem_usage = bloom_map_mem_usage,
 	.map_btf_id = &bpf_bloom_map_btf_ids[0],
 };
+
+__diag_push();
+__diag_ignore_all("-Wmissing-prototypes",
+		  "Global functions as their definitions will be in vmlinux BTF");
+
+/**
+ * bpf_bloom_map_peek_batch() - Test a batch of values against a bloom filter
+ * @map: BPF_MAP_TYPE_BLOOM_FILTER map
+ * @values: values to test, one after the other
+ * @values__sz: size of @values, a multiple of the value size of @map
+ * @hits: bit i is set if value i may be in the filter, cleared if not
+ *
+ * Return: number of values that may be in the filter, -EINVAL if @map is
+ * not a bloom filter, or @values does not hold between 1 and 64 values.
+ */
+__bpf_kfunc int bpf_bloom_map_peek_batch(struct bpf_map *map,
+					 const void *values, u32 values__sz,
+					 u64 *hits)
+{
+	u32 i, n, size, hit = 0;
+	void *value;
+
+	if (map->map_type != BPF_MAP_TYPE_BLOOM_FILTER)
+		return -EINVAL;
+	size = map->value_size;
+	n = values__sz / size;
+	if (!n || n > BLOOM_PEEK_BATCH_MAX || values__sz % size)
+		return -EINVAL;
+
+	*hits = 0;
+	for (i = 0, value = (void *)values; i < n; i++, value += size) {
+		if (bloom_map_peek_elem(map, value))
+			continue;
+		*hits |= BIT_ULL(i);
+		hit++;
+	}
+
+	return hit;
+}
+
+__diag_pop();
+
+BTF_SET8_START(bloom_filter_kfunc_ids)
+BTF_ID_FLAGS(func, bpf_bloom_map_peek_batch)
+BTF_SET8_END(bloom_filter_kfunc_ids)
+
+static const struct btf_kfunc_id_set bloom_filter_kfunc_set = {
+	.owner = THIS_MODULE,
+	.set   = &bloom_filter_kfunc_ids,
+};
+
+static int __init bloom_filter_kfunc_init(void)
+{
+	return register_btf_kfunc_id_set(BPF_PROG_TYPE_UNSPEC,
+					 &bloom_filter_kfunc_set);
+}
+late_initcall(bloom_filter_kfunc_init);
@@ -13,6 +13,10 @@
 #define PERCPU_FREE_TARGET		(4)
 #define PERCPU_NR_SCANS			PERCPU_FREE_TARGET
 
+#define CLOCK_FREE_TARGET		(32)
+#define CLOCK_STEAL_TARGET		CLOCK_FREE_TARGET
+#define CLOCK_NR_SCANS			(128)
+
 /* Helpers to get the local list index */
 #define LOCAL_LIST_IDX(t)	((t) - BPF_LOCAL_LIST_T_OFFSET)
 #define LOCAL_FREE_LIST_IDX	LOCAL_LIST_IDX(BPF_LRU_LOCAL_LIST_T_FREE)
@@ -496,9 +500,176 @@ static struct bpf_lru_node *bpf_common_lru_pop_free(struct bpf_lru *lru,
 	return node;
 }
 
+/* Advance the hand of @c over at most nr_scans nodes.  A referenced node
+ * gets its ref bit cleared and another round on the ring, an unreferenced
+ * one is removed from the htab and moved to @free_list.  If a whole sweep
+ * frees nothing, sweep once more ignoring the ref bit.
+ */
+static unsigned int __bpf_lru_clock_sweep(struct bpf_lru *lru,
+					  struct bpf_lru_clock *c,
+					  unsigned int tgt_nfree,
+					  struct list_head *free_list)
+{
+	struct bpf_lru_node *node;
+	unsigned int nfree = 0;
+	bool force = false;
+	unsigned int i;
+
+again:
+	for (i = 0; i < lru->nr_scans && !list_empty(&c->ring); i++) {
+		node = list_last_entry(&c->ring, struct bpf_lru_node, list);
+		if (!force && bpf_lru_node_is_ref(node)) {
+			bpf_lru_node_clear_ref(node);
+			list_move(&node->list, &c->ring);
+		} else if (lru->del_from_htab(lru->del_arg, node)) {
+			node->type = BPF_LRU_LIST_T_FREE;
+			list_move(&node->list, free_list);
+			c->evictions++;
+			if (++nfree == tgt_nfree)
+				break;
+		} else {
+			/* Not in the htab yet or its bucket is busy */
+			list_move(&node->list, &c->ring);
+		}
+	}
+
+	if (!nfree && !force && !list_empty(&c->ring)) {
+		force = true;
+		goto again;
+	}
+
+	return nfree;
+}
+
+static void __bpf_lru_clock_add(struct bpf_lru *lru, struct bpf_lru_clock *c,
+				int cpu, struct bpf_lru_node *node, u32 hash)
+{
+	*(u32 *)((void *)node + lru->hash_offset) = hash;
+	node->cpu = cpu;
+	node->type = BPF_LRU_LIST_T_ACTIVE;
+	bpf_lru_node_clear_ref(node);
+	list_move(&node->list, &c->ring);
+}
+
+/* Take up to CLOCK_STEAL_TARGET nodes from the first remote CPU, in RR
+ * starting with c->next_steal, that has free nodes or can evict some.
+ * Only one clock lock is held at a time.
+ */
+static unsigned int bpf_lru_clock_steal(struct bpf_lru *lru,
+					struct bpf_lru_clock *c, int cpu,
+					struct list_head *stolen)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	struct bpf_lru_clock *steal_c;
+	unsigned int nstolen = 0;
+	int steal, first_steal;
+	unsigned long flags;
+
+	first_steal = c->next_steal;
+	steal = first_steal;
+	do {
+		if (steal == cpu)
+			goto next;
+
+		steal_c = per_cpu_ptr(lru->clock_lru.clock, steal);
+
+		raw_spin_lock_irqsave(&steal_c->lock, flags);
+
+		list_for_each_entry_safe(node, tmp_node, &steal_c->free, list) {
+			list_move(&node->list, stolen);
+			if (++nstolen == CLOCK_STEAL_TARGET)
+				break;
+		}
+		if (nstolen < CLOCK_STEAL_TARGET)
+			nstolen += __bpf_lru_clock_sweep(lru, steal_c,
+							 CLOCK_STEAL_TARGET - nstolen,
+							 stolen);
+
+		raw_spin_unlock_irqrestore(&steal_c->lock, flags);
+next:
+		steal = get_next_cpu(steal);
+	} while (!nstolen && steal != first_steal);
+
+	c->next_steal = steal;
+
+	return nstolen;
+}
+
+/* Move up to CLOCK_FREE_TARGET never used nodes to the free list of @c */
+static void bpf_lru_clock_pop_free_to_local(struct bpf_clock_lru *clru,
+					    struct bpf_lru_clock *c)
+{
+	struct bpf_lru_node *node, *tmp_node;
+	unsigned int nfree = 0;
+
+	raw_spin_lock(&clru->lock);
+
+	list_for_each_entry_safe(node, tmp_node, &clru->free, list) {
+		list_move(&node->list, &c->free);
+		if (++nfree == CLOCK_FREE_TARGET)
+			break;
+	}
+
+	raw_spin_unlock(&clru->lock);
+}
+
+static struct bpf_lru_node *bpf_clock_lru_pop_free(struct bpf_lru *lru,
+						   u32 hash)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	struct bpf_lru_node *node;
+	struct bpf_lru_clock *c;
+	unsigned int nstolen;
+	unsigned long flags;
+	LIST_HEAD(stolen);
+	int cpu = raw_smp_processor_id();
+
+	c = per_cpu_ptr(clru->clock, cpu);
+
+	raw_spin_lock_irqsave(&c->lock, flags);
+
+	/* The shared pool only has nodes until the map first fills up,
+	 * after that it is not locked anymore.
+	 */
+	if (list_empty(&c->free) && !data_race(list_empty(&clru->free)))
+		bpf_lru_clock_pop_free_to_local(clru, c);
+
+	if (list_empty(&c->free))
+		__bpf_lru_clock_sweep(lru, c, CLOCK_FREE_TARGET, &c->free);
+
+	node = list_first_entry_or_null(&c->free, struct bpf_lru_node, list);
+	if (node)
+		__bpf_lru_clock_add(lru, c, cpu, node, hash);
+
+	raw_spin_unlock_irqrestore(&c->lock, flags);
+
+	if (node)
+		return node;
+
+	/* This CPU has nothing left to evict, e.g. because the others
+	 * inserted most of the elements.  Refill it from a remote CPU.
+	 */
+	nstolen = bpf_lru_clock_steal(lru, c, cpu, &stolen);
+	if (!nstolen)
+		return NULL;
+
+	raw_spin_lock_irqsave(&c->lock, flags);
+
+	list_splice(&stolen, &c->free);
+	c->steals += nstolen;
+	node = list_first_entry(&c->free, struct bpf_lru_node, list);
+	__bpf_lru_clock_add(lru, c, cpu, node, hash);
+
+	raw_spin_unlock_irqrestore(&c->lock, flags);
+
+	return node;
+}
+
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		return bpf_clock_lru_pop_free(lru, hash);
+	else if (lru->percpu)
 		return bpf_percpu_lru_pop_free(lru, hash);
 	else
 		return bpf_common_lru_pop_free(lru, hash);
@@ -553,9 +724,33 @@ static void bpf_percpu_lru_push_free(struct bpf_lru *lru,
 	raw_spin_unlock_irqrestore(&l->lock, flags);
 }
 
+/* node->cpu cannot change under us: a node on a ring only moves to
+ * another CPU after the htab gave it up, and then it is not pushed here.
+ */
+static void bpf_clock_lru_push_free(struct bpf_lru *lru,
+				    struct bpf_lru_node *node)
+{
+	struct bpf_lru_clock *c;
+	unsigned long flags;
+
+	c = per_cpu_ptr(lru->clock_lru.clock, node->cpu);
+
+	raw_spin_lock_irqsave(&c->lock, flags);
+
+	if (!WARN_ON_ONCE(node->type != BPF_LRU_LIST_T_ACTIVE)) {
+		node->type = BPF_LRU_LIST_T_FREE;
+		bpf_lru_node_clear_ref(node);
+		list_move(&node->list, &c->free);
+	}
+
+	raw_spin_unlock_irqrestore(&c->lock, flags);
+}
+
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_push_free(lru, node);
+	else if (lru->percpu)
 		bpf_percpu_lru_push_free(lru, node);
 	else
 		bpf_common_lru_push_free(lru, node);
@@ -610,10 +805,31 @@ again:
 	}
 }
 
+static void bpf_clock_lru_populate(struct bpf_lru *lru, void *buf,
+				   u32 node_offset, u32 elem_size,
+				   u32 nr_elems)
+{
+	struct bpf_clock_lru *clru = &lru->clock_lru;
+	u32 i;
+
+	for (i = 0; i < nr_elems; i++) {
+		struct bpf_lru_node *node;
+
+		node = (struct bpf_lru_node *)(buf + node_offset);
+		node->type = BPF_LRU_LIST_T_FREE;
+		bpf_lru_node_clear_ref(node);
+		list_add(&node->list, &clru->free);
+		buf += elem_size;
+	}
+}
+
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		bpf_clock_lru_populate(lru, buf, node_offset, elem_size,
+				       nr_elems);
+	else if (lru->percpu)
 		bpf_percpu_lru_populate(lru, buf, node_offset, elem_size,
 					nr_elems);
 	else
@@ -648,12 +864,35 @@ static void bpf_lru_list_init(struct bpf_lru_list *l)
 	raw_spin_lock_init(&l->lock);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+static void bpf_lru_clock_init(struct bpf_lru_clock *c, int cpu)
+{
+	INIT_LIST_HEAD(&c->ring);
+	INIT_LIST_HEAD(&c->free);
+	c->next_steal = cpu;
+	c->evictions = 0;
+	c->steals = 0;
+	raw_spin_lock_init(&c->lock);
+}
+
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *del_arg)
 {
 	int cpu;
 
-	if (percpu) {
+	if (clock) {
+		struct bpf_clock_lru *clru = &lru->clock_lru;
+
+		clru->clock = alloc_percpu(struct bpf_lru_clock);
+		if (!clru->clock)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu)
+			bpf_lru_clock_init(per_cpu_ptr(clru->clock, cpu), cpu);
+
+		INIT_LIST_HEAD(&clru->free);
+		raw_spin_lock_init(&clru->lock);
+		lru->nr_scans = CLOCK_NR_SCANS;
+	} else if (percpu) {
 		lru->percpu_lru = alloc_percpu(struct bpf_lru_list);
 		if (!lru->percpu_lru)
 			return -ENOMEM;
@@ -684,6 +923,7 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 	}
 
 	lru->percpu = percpu;
+	lru->clock = clock;
 	lru->del_from_htab = del_from_htab;
 	lru->del_arg = del_arg;
 	lru->hash_offset = hash_offset;
@@ -693,8 +933,28 @@ int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
 
 void bpf_lru_destroy(struct bpf_lru *lru)
 {
-	if (lru->percpu)
+	if (lru->clock)
+		free_percpu(lru->clock_lru.clock);
+	else if (lru->percpu)
 		free_percpu(lru->percpu_lru);
 	else
 		free_percpu(lru->common_lru.local_list);
 }
+
+/* Evictions done by the sweeps and nodes moved between CPUs by steals */
+void bpf_lru_clock_stats(struct bpf_lru *lru, u64 *evictions, u64 *steals)
+{
+	int cpu;
+
+	*evictions = 0;
+	*steals = 0;
+	if (!lru->clock)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct bpf_lru_clock *c = per_cpu_ptr(lru->clock_lru.clock, cpu);
+
+		*evictions += READ_ONCE(c->evictions);
+		*steals += READ_ONCE(c->steals);
+	}
+}
@@ -48,18 +48,41 @@ struct bpf_common_lru {
 	struct bpf_lru_locallist __percpu *local_list;
 };
 
+/* BPF_F_LRU_CLOCK: each CPU keeps the nodes it handed out on a ring and
+ * evicts from it with a second-chance sweep.  Free nodes come from the
+ * shared pool of struct bpf_clock_lru until it runs dry, and are stolen
+ * from other CPUs in batches when a CPU has nothing left to evict.  Nodes
+ * on a ring are BPF_LRU_LIST_T_ACTIVE, free ones BPF_LRU_LIST_T_FREE.
+ */
+struct bpf_lru_clock {
+	struct list_head ring;	/* the hand is at the tail */
+	struct list_head free;
+	u16 next_steal;
+	u64 evictions;
+	u64 steals;
+	raw_spinlock_t lock;
+};
+
+struct bpf_clock_lru {
+	struct list_head free;	/* not handed to any CPU yet */
+	raw_spinlock_t lock;
+	struct bpf_lru_clock __percpu *clock;
+};
+
 typedef bool (*del_from_htab_func)(void *arg, struct bpf_lru_node *node);
 
 struct bpf_lru {
 	union {
 		struct bpf_common_lru common_lru;
 		struct bpf_lru_list __percpu *percpu_lru;
+		struct bpf_clock_lru clock_lru;
 	};
 	del_from_htab_func del_from_htab;
 	void *del_arg;
 	unsigned int hash_offset;
 	unsigned int nr_scans;
 	bool percpu;
+	bool clock;
 };
 
 static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
@@ -68,12 +91,13 @@ static inline void bpf_lru_node_set_ref(struct bpf_lru_node *node)
 		WRITE_ONCE(node->ref, 1);
 }
 
-int bpf_lru_init(struct bpf_lru *lru, bool percpu, u32 hash_offset,
+int bpf_lru_init(struct bpf_lru *lru, bool percpu, bool clock, u32 hash_offset,
 		 del_from_htab_func del_from_htab, void *delete_arg);
 void bpf_lru_populate(struct bpf_lru *lru, void *buf, u32 node_offset,
 		      u32 elem_size, u32 nr_elems);
 void bpf_lru_destroy(struct bpf_lru *lru);
 struct bpf_lru_node *bpf_lru_pop_free(struct bpf_lru *lru, u32 hash);
 void bpf_lru_push_free(struct bpf_lru *lru, struct bpf_lru_node *node);
+void bpf_lru_clock_stats(struct bpf_lru *lru, u64 *evictions, u64 *steals);
 
 #endif
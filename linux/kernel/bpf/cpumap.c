@@ -26,6 +26,7 @@
 #include <net/xdp.h>
 
 #include <linux/sched.h>
+#include <linux/sched/clock.h>
 #include <linux/workqueue.h>
 #include <linux/kthread.h>
 #include <linux/completion.h>
@@ -233,7 +234,17 @@ static int cpu_map_bpf_prog_run_xdp(struct bpf_cpu_map_entry *rcpu,
 	return nframes;
 }
 
-#define CPUMAP_BATCH 8
+/* Frames the kthread takes off its ptr_ring per round.  The batch doubles
+ * while rounds drain a full batch, i.e. while the ring fills up faster than
+ * it is emptied, and halves again once rounds come back less than half full.
+ */
+#define CPUMAP_BATCH_MIN 8
+#define CPUMAP_BATCH_MAX 64
+
+/* After a round with frames, the kthread polls the empty ring this long
+ * before going to sleep, which saves the wakeup when traffic is steady.
+ */
+#define CPUMAP_BUSY_POLL_NS (20 * NSEC_PER_USEC)
 
 static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu, void **frames,
 				int xdp_n, struct xdp_cpumap_stats *stats,
@@ -259,10 +270,26 @@ static int cpu_map_bpf_prog_run(struct bpf_cpu_map_entry *rcpu, void **frames,
 	return nframes;
 }
 
+/* Returns true if frames showed up before the poll time ran out */
+static bool cpu_map_busy_poll(struct bpf_cpu_map_entry *rcpu)
+{
+	u64 end = local_clock() + CPUMAP_BUSY_POLL_NS;
+
+	while (__ptr_ring_empty(rcpu->queue)) {
+		if (need_resched() || kthread_should_stop() ||
+		    local_clock() > end)
+			return false;
+		cpu_relax();
+	}
+	return true;
+}
+
 static int cpu_map_kthread_run(void *data)
 {
 	struct bpf_cpu_map_entry *rcpu = data;
+	unsigned int batch = CPUMAP_BATCH_MIN;
 	unsigned long last_qs = jiffies;
+	bool busy = false;
 
 	complete(&rcpu->kthread_running);
 	set_current_state(TASK_INTERRUPTIBLE);
@@ -277,12 +304,13 @@ static int cpu_map_kthread_run(void *data)
 		unsigned int kmem_alloc_drops = 0, sched = 0;
 		gfp_t gfp = __GFP_ZERO | GFP_ATOMIC;
 		int i, n, m, nframes, xdp_n;
-		void *frames[CPUMAP_BATCH];
-		void *skbs[CPUMAP_BATCH];
+		void *frames[CPUMAP_BATCH_MAX];
+		void *skbs[CPUMAP_BATCH_MAX];
 		LIST_HEAD(list);
 
 		/* Release CPU reschedule checks */
-		if (__ptr_ring_empty(rcpu->queue)) {
+		if (__ptr_ring_empty(rcpu->queue) &&
+		    !(busy && cpu_map_busy_poll(rcpu))) {
 			set_current_state(TASK_INTERRUPTIBLE);
 			/* Recheck to avoid lost wake-up */
 			if (__ptr_ring_empty(rcpu->queue)) {
@@ -302,8 +330,13 @@ static int cpu_map_kthread_run(void *data)
 		 * kthread CPU pinned. Lockless access to ptr_ring
 		 * consume side valid as no-resize allowed of queue.
 		 */
-		n = __ptr_ring_consume_batched(rcpu->queue, frames,
-					       CPUMAP_BATCH);
+		n = __ptr_ring_consume_batched(rcpu->queue, frames, batch);
+		busy = n > 0;
+		if (n == batch)
+			batch = min_t(unsigned int, batch * 2, CPUMAP_BATCH_MAX);
+		else if (n < batch / 2)
+			batch = max_t(unsigned int, batch / 2, CPUMAP_BATCH_MIN);
+
 		for (i = 0, xdp_n = 0; i < n; i++) {
 			void *f = frames[i];
 			struct page *page;
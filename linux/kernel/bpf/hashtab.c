@@ -11,6 +11,8 @@
 #include <uapi/linux/btf.h>
 #include <linux/rcupdate_trace.h>
 #include <linux/btf_ids.h>
+#include <linux/irq_work.h>
+#include <linux/bitrev.h>
 #include "percpu_freelist.h"
 #include "bpf_lru_list.h"
 #include "map_in_map.h"
@@ -18,7 +20,8 @@
 
 #define HTAB_CREATE_FLAG_MASK						\
 	(BPF_F_NO_PREALLOC | BPF_F_NO_COMMON_LRU | BPF_F_NUMA_NODE |	\
-	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED)
+	 BPF_F_ACCESS_MASK | BPF_F_ZERO_SEED | BPF_F_RESIZABLE |	\
+	 BPF_F_LRU_CLOCK)
 
 #define BATCH_OPS(_name)			\
 	.map_lookup_batch =			\
@@ -83,11 +86,39 @@ struct bucket {
 #define HASHTAB_MAP_LOCK_COUNT 8
 #define HASHTAB_MAP_LOCK_MASK (HASHTAB_MAP_LOCK_COUNT - 1)
 
+/* A BPF_F_RESIZABLE map starts out with HTAB_MIN_BUCKETS buckets and
+ * doubles or halves its table to keep the load factor between 3/10 and
+ * 3/4.  The bucket index and the two markers below have to fit the 31 bits
+ * of a nulls value.
+ */
+#define HTAB_MIN_BUCKETS	16
+#define HTAB_MAX_BUCKETS	(1U << 28)
+#define HTAB_NULLS_ODD		(1U << 29)
+#define HTAB_NULLS_MOVED	(1U << 30)
+#define HTAB_MOVED		((struct hlist_nulls_node *)NULLS_MARKER(HTAB_NULLS_MOVED))
+
+/* The bucket array.  It never changes unless the map is BPF_F_RESIZABLE.
+ * A resize allocates the future table and moves the old table into it one
+ * bucket at a time.  Readers search the old table and then the future one;
+ * writers use the old bucket until it has been moved, and the future bucket
+ * after that.  The chains of consecutive tables end in nulls values of
+ * different parity, so that a reader that was carried from one table into
+ * the other by a moved or reused element notices it and restarts.
+ */
+struct htab_table {
+	struct htab_table __rcu *future;
+	atomic_t nr_moved;	/* buckets moved into future */
+	u32 n_buckets;		/* number of hash buckets */
+	u32 nulls_base;		/* 0 or HTAB_NULLS_ODD */
+	bool resizable;
+	struct bucket buckets[];
+};
+
 struct bpf_htab {
 	struct bpf_map map;
 	struct bpf_mem_alloc ma;
 	struct bpf_mem_alloc pcpu_ma;
-	struct bucket *buckets;
+	struct htab_table __rcu *tbl;
 	void *elems;
 	union {
 		struct pcpu_freelist freelist;
@@ -100,9 +131,17 @@ struct bpf_htab {
 	struct percpu_counter pcount;
 	atomic_t count;
 	bool use_percpu_counter;
-	u32 n_buckets;	/* number of hash buckets */
 	u32 elem_size;	/* size of each element in bytes */
 	u32 hashrnd;
+	u32 lock_mask;	/* map_locked[] index mask, fits the smallest table */
+	u32 min_buckets;
+	u32 max_buckets;
+	atomic_t resize_pending;
+	struct irq_work resize_irq_work;
+	struct work_struct resize_work;
+	/* held by the resize work, which does nothing while resize_blocked */
+	struct mutex resize_mutex;
+	u32 resize_blocked;
 	struct lock_class_key lockdep_key;
 	int __percpu *map_locked[HASHTAB_MAP_LOCK_COUNT];
 };
@@ -133,26 +172,64 @@ static inline bool htab_is_prealloc(const struct bpf_htab *htab)
 	return !(htab->map.map_flags & BPF_F_NO_PREALLOC);
 }
 
-static void htab_init_buckets(struct bpf_htab *htab)
+static inline bool htab_is_resizable(const struct bpf_htab *htab)
+{
+	return htab->map.map_flags & BPF_F_RESIZABLE;
+}
+
+static void htab_init_table(struct bpf_htab *htab, struct htab_table *tbl,
+			    u32 n_buckets, u32 nulls_base)
 {
 	unsigned int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		INIT_HLIST_NULLS_HEAD(&htab->buckets[i].head, i);
-		raw_spin_lock_init(&htab->buckets[i].raw_lock);
-		lockdep_set_class(&htab->buckets[i].raw_lock,
+	tbl->n_buckets = n_buckets;
+	tbl->nulls_base = nulls_base;
+	tbl->resizable = htab_is_resizable(htab);
+	for (i = 0; i < n_buckets; i++) {
+		INIT_HLIST_NULLS_HEAD(&tbl->buckets[i].head, i | nulls_base);
+		raw_spin_lock_init(&tbl->buckets[i].raw_lock);
+		lockdep_set_class(&tbl->buckets[i].raw_lock,
 					  &htab->lockdep_key);
 		cond_resched();
 	}
 }
 
+/* Callers hold rcu_read_lock(), rcu_read_lock_bh() or
+ * rcu_read_lock_trace(), or own the map.
+ */
+static inline struct htab_table *htab_table(const struct bpf_htab *htab)
+{
+	return rcu_dereference_raw(htab->tbl);
+}
+
+static inline struct bucket *__select_bucket(struct htab_table *tbl, u32 hash)
+{
+	return &tbl->buckets[hash & (tbl->n_buckets - 1)];
+}
+
+static inline struct hlist_nulls_head *select_bucket(struct htab_table *tbl, u32 hash)
+{
+	return &__select_bucket(tbl, hash)->head;
+}
+
+static inline unsigned long htab_nulls(const struct htab_table *tbl, u32 hash)
+{
+	return (hash & (tbl->n_buckets - 1)) | tbl->nulls_base;
+}
+
+/* Only stable with the bucket lock held */
+static inline bool htab_bucket_moved(const struct bucket *b)
+{
+	return b->head.first == HTAB_MOVED;
+}
+
 static inline int htab_lock_bucket(const struct bpf_htab *htab,
 				   struct bucket *b, u32 hash,
 				   unsigned long *pflags)
 {
 	unsigned long flags;
 
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 
 	preempt_disable();
 	local_irq_save(flags);
@@ -173,13 +250,36 @@ static inline void htab_unlock_bucket(const struct bpf_htab *htab,
 				      struct bucket *b, u32 hash,
 				      unsigned long flags)
 {
-	hash = hash & min_t(u32, HASHTAB_MAP_LOCK_MASK, htab->n_buckets - 1);
+	hash = hash & htab->lock_mask;
 	raw_spin_unlock(&b->raw_lock);
 	__this_cpu_dec(*(htab->map_locked[hash]));
 	local_irq_restore(flags);
 	preempt_enable();
 }
 
+/* Lock the bucket an element with @hash belongs in.  That is the bucket of
+ * the current table, unless a resize has already moved it into the future
+ * table.
+ */
+static struct bucket *htab_lock_hash(const struct bpf_htab *htab, u32 hash,
+				     unsigned long *pflags)
+{
+	struct htab_table *tbl = htab_table(htab);
+	struct bucket *b;
+	int ret;
+
+	for (;;) {
+		b = __select_bucket(tbl, hash);
+		ret = htab_lock_bucket(htab, b, hash, pflags);
+		if (ret)
+			return ERR_PTR(ret);
+		if (likely(!htab_bucket_moved(b)))
+			return b;
+		htab_unlock_bucket(htab, b, hash, *pflags);
+		tbl = rcu_dereference_raw(tbl->future);
+	}
+}
+
 static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node);
 
 static bool htab_is_lru(const struct bpf_htab *htab)
@@ -347,6 +447,7 @@ skip_percpu_elems:
 	if (htab_is_lru(htab))
 		err = bpf_lru_init(&htab->lru,
 				   htab->map.map_flags & BPF_F_NO_COMMON_LRU,
+				   htab->map.map_flags & BPF_F_LRU_CLOCK,
 				   offsetof(struct htab_elem, hash) -
 				   offsetof(struct htab_elem, lru_node),
 				   htab_lru_map_delete_node,
@@ -406,6 +507,278 @@ static int alloc_extra_elems(struct bpf_htab *htab)
 	return 0;
 }
 
+/* Move bucket @i of @tbl into @future.  Elements are taken off the tail of
+ * the chain and linked into the future table before they are unlinked, so
+ * a lockless reader finds each of them in one table or the other.  A reader
+ * that was walking the old chain follows the moved tail into a future chain
+ * and restarts on its nulls value.  The emptied bucket is marked moved.
+ *
+ * All map_locked counters of this CPU are taken, which keeps BPF programs
+ * nested on this CPU off both tables.  Fails only when called nested in
+ * such a program, see htab_rehash_finish().
+ */
+static bool htab_rehash_bucket(struct bpf_htab *htab, struct htab_table *tbl,
+			       struct htab_table *future, u32 i)
+{
+	struct bucket *b = &tbl->buckets[i], *fb;
+	struct hlist_nulls_node *n, **pprev;
+	unsigned long flags;
+	struct htab_elem *l;
+	int j;
+
+	preempt_disable();
+	local_irq_save(flags);
+	for (j = 0; j < HASHTAB_MAP_LOCK_COUNT; j++) {
+		if (unlikely(__this_cpu_inc_return(*(htab->map_locked[j])) != 1)) {
+			do {
+				__this_cpu_dec(*(htab->map_locked[j]));
+			} while (j--);
+			local_irq_restore(flags);
+			preempt_enable();
+			return false;
+		}
+	}
+
+	raw_spin_lock(&b->raw_lock);
+	if (htab_bucket_moved(b))
+		goto unlock;
+
+	while (!hlist_nulls_empty(&b->head)) {
+		for (n = b->head.first; !is_a_nulls(n->next); n = n->next)
+			;
+		l = hlist_nulls_entry(n, struct htab_elem, hash_node);
+		pprev = n->pprev;
+
+		fb = __select_bucket(future, l->hash);
+		raw_spin_lock_nested(&fb->raw_lock, SINGLE_DEPTH_NESTING);
+		hlist_nulls_add_head_rcu(n, &fb->head);
+		raw_spin_unlock(&fb->raw_lock);
+
+		/* pairs with smp_rmb() in lookup_nulls_elem_raw() */
+		smp_store_release(pprev, (struct hlist_nulls_node *)
+				  NULLS_MARKER(i | tbl->nulls_base));
+	}
+	smp_store_release(&b->head.first, HTAB_MOVED);
+	smp_mb__before_atomic();
+	atomic_inc(&tbl->nr_moved);
+unlock:
+	raw_spin_unlock(&b->raw_lock);
+	for (j = 0; j < HASHTAB_MAP_LOCK_COUNT; j++)
+		__this_cpu_dec(*(htab->map_locked[j]));
+	local_irq_restore(flags);
+	preempt_enable();
+	return true;
+}
+
+/* Move whatever the resize of @tbl has not moved yet.  Returns the table
+ * that holds all elements, which is @tbl unless it is being resized, or
+ * NULL when the resize cannot be finished in this context.
+ */
+static struct htab_table *htab_rehash_finish(struct bpf_htab *htab,
+					     struct htab_table *tbl)
+{
+	struct htab_table *future = rcu_dereference_raw(tbl->future);
+	u32 i;
+
+	if (likely(!future))
+		return tbl;
+
+	for (i = 0; i < tbl->n_buckets; i++) {
+		if (atomic_read_acquire(&tbl->nr_moved) == tbl->n_buckets)
+			break;
+		if (!htab_rehash_bucket(htab, tbl, future, i))
+			return NULL;
+	}
+	return future;
+}
+
+/* Iterators walk a single table and help a resize in progress to finish
+ * first.  That cannot fail from process context.
+ */
+static struct htab_table *htab_iter_table(struct bpf_htab *htab)
+{
+	struct htab_table *tbl = htab_table(htab);
+
+	return htab_rehash_finish(htab, tbl) ?: tbl;
+}
+
+/* Cursors kept by user space across syscalls, get_next_key and batch ops,
+ * must not depend on the size of the table of a resizable map.  Those
+ * follow the order of the bit-reversed hash instead: the buckets of a
+ * table of 2^n buckets, taken in the order of their bit-reversed index,
+ * hold consecutive ranges of it whatever n is.  A batch cursor is a
+ * position in that order, HTAB_ORDER_BITS wide so that the end fits.
+ */
+#define HTAB_ORDER_BITS		31
+#define HTAB_ORDER_END		(1U << HTAB_ORDER_BITS)
+
+static inline u32 htab_elem_order(u32 hash)
+{
+	return bitrev32(hash) >> (32 - HTAB_ORDER_BITS);
+}
+
+/* Bucket of @tbl that holds position @pos */
+static inline u32 htab_order_bucket(const struct htab_table *tbl, u32 pos)
+{
+	u32 bits = ilog2(tbl->n_buckets);
+
+	return bitrev32(pos >> (HTAB_ORDER_BITS - bits)) >> (32 - bits);
+}
+
+/* First position after the bucket of @tbl that holds @pos */
+static inline u32 htab_order_next(const struct htab_table *tbl, u32 pos)
+{
+	u32 shift = HTAB_ORDER_BITS - ilog2(tbl->n_buckets);
+
+	return ((pos >> shift) + 1) << shift;
+}
+
+/* Bucket to resume a batch at, tbl->n_buckets once all were visited.  Batch
+ * cursors of other maps are bucket indexes.
+ */
+static u32 htab_batch_bucket(const struct bpf_htab *htab,
+			     const struct htab_table *tbl, u32 batch)
+{
+	if (!htab_is_resizable(htab))
+		return min(batch, tbl->n_buckets);
+	if (batch >= HTAB_ORDER_END)
+		return tbl->n_buckets;
+	return htab_order_bucket(tbl, batch);
+}
+
+static u32 htab_batch_next(const struct bpf_htab *htab,
+			   const struct htab_table *tbl, u32 batch)
+{
+	if (!htab_is_resizable(htab))
+		return batch + 1;
+	return htab_order_next(tbl, batch);
+}
+
+/* After a shrink, a cursor can point into the middle of a bucket */
+static bool htab_batch_skip(const struct bpf_htab *htab, u32 batch,
+			    const struct htab_elem *l)
+{
+	return htab_is_resizable(htab) && htab_elem_order(l->hash) < batch;
+}
+
+/* Keep the table of @htab as it is, for an iterator that walks it one
+ * element at a time across read() calls.  Waits for a resize in progress.
+ */
+static void htab_resize_block(struct bpf_htab *htab)
+{
+	mutex_lock(&htab->resize_mutex);
+	htab->resize_blocked++;
+	mutex_unlock(&htab->resize_mutex);
+}
+
+static void htab_resize_unblock(struct bpf_htab *htab)
+{
+	mutex_lock(&htab->resize_mutex);
+	htab->resize_blocked--;
+	mutex_unlock(&htab->resize_mutex);
+	/* run a resize that was held off */
+	if (atomic_read(&htab->resize_pending))
+		queue_work(system_unbound_wq, &htab->resize_work);
+}
+
+static u64 htab_elem_count(struct bpf_htab *htab, bool exact)
+{
+	if (!htab->use_percpu_counter)
+		return atomic_read(&htab->count);
+	if (exact)
+		return max_t(s64, percpu_counter_sum(&htab->pcount), 0);
+	return max_t(s64, percpu_counter_read(&htab->pcount), 0);
+}
+
+static bool htab_needs_resize(struct bpf_htab *htab, u32 n_buckets, bool exact)
+{
+	u64 count = htab_elem_count(htab, exact);
+
+	if (count * 4 > (u64)n_buckets * 3)
+		return n_buckets < htab->max_buckets;
+	if (count * 10 < (u64)n_buckets * 3)
+		return n_buckets > htab->min_buckets;
+	return false;
+}
+
+/* Called on every insertion and deletion of a resizable map */
+static void htab_check_resize(struct bpf_htab *htab)
+{
+	if (atomic_read(&htab->resize_pending) ||
+	    !htab_needs_resize(htab, htab_table(htab)->n_buckets, false))
+		return;
+	/* the irq_work takes it to process context from anywhere, NMI included */
+	if (!atomic_xchg(&htab->resize_pending, 1))
+		irq_work_queue(&htab->resize_irq_work);
+}
+
+static void htab_resize_irq_work(struct irq_work *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_irq_work);
+
+	queue_work(system_unbound_wq, &htab->resize_work);
+}
+
+static void htab_resize_work(struct work_struct *work)
+{
+	struct bpf_htab *htab = container_of(work, struct bpf_htab,
+					     resize_work);
+	struct htab_table *tbl, *future;
+	u32 i, n_buckets;
+	u64 want;
+
+	mutex_lock(&htab->resize_mutex);
+	/* resize_pending stays set, htab_resize_unblock() requeues us */
+	if (htab->resize_blocked)
+		goto unlock;
+
+	/* insertions and deletions from here on may queue another round */
+	atomic_set(&htab->resize_pending, 0);
+
+	/* only this work replaces the table */
+	tbl = rcu_dereference_protected(htab->tbl, true);
+	if (!htab_needs_resize(htab, tbl->n_buckets, true))
+		goto unlock;
+
+	/* aim for a load factor of about 2/3 */
+	want = min_t(u64, htab_elem_count(htab, true) * 3 / 2 + 1,
+		     htab->max_buckets);
+	n_buckets = max_t(u32, roundup_pow_of_two((u32)want), htab->min_buckets);
+	if (n_buckets == tbl->n_buckets)
+		goto unlock;
+
+	future = bpf_map_area_alloc_charged(&htab->map,
+					    struct_size(future, buckets, n_buckets));
+	if (!future)
+		/* keep the current table, the next update will retry */
+		goto unlock;
+	htab_init_table(htab, future, n_buckets,
+			tbl->nulls_base ^ HTAB_NULLS_ODD);
+	rcu_assign_pointer(tbl->future, future);
+
+	i = 0;
+	while (i < tbl->n_buckets) {
+		/* cannot fail here, nothing nests below a kworker */
+		if (!WARN_ON_ONCE(!htab_rehash_bucket(htab, tbl, future, i)))
+			i++;
+		cond_resched();
+	}
+
+	rcu_assign_pointer(htab->tbl, future);
+	mutex_unlock(&htab->resize_mutex);
+
+	/* sleepable programs walk the table under rcu_read_lock_trace() */
+	synchronize_rcu_tasks_trace();
+	if (!rcu_trace_implies_rcu_gp())
+		synchronize_rcu();
+	bpf_map_area_free(tbl);
+	return;
+
+unlock:
+	mutex_unlock(&htab->resize_mutex);
+}
+
 /* Called from syscall */
 static int htab_map_alloc_check(union bpf_attr *attr)
 {
@@ -421,6 +794,8 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
 	bool zero_seed = (attr->map_flags & BPF_F_ZERO_SEED);
+	bool resizable = (attr->map_flags & BPF_F_RESIZABLE);
+	bool clock = (attr->map_flags & BPF_F_LRU_CLOCK);
 	int numa_node = bpf_map_attr_numa_node(attr);
 
 	BUILD_BUG_ON(offsetof(struct htab_elem, fnode.next) !=
@@ -437,9 +812,17 @@ static int htab_map_alloc_check(union bpf_attr *attr)
 	if (!lru && percpu_lru)
 		return -EINVAL;
 
+	/* the clock already keeps a list per CPU */
+	if (clock && (!lru || percpu_lru))
+		return -EINVAL;
+
 	if (lru && !prealloc)
 		return -ENOTSUPP;
 
+	/* a preallocated map has already paid for max_entries elements */
+	if (resizable && (lru || prealloc))
+		return -EINVAL;
+
 	if (numa_node != NUMA_NO_NODE && (percpu || percpu_lru))
 		return -EINVAL;
 
@@ -475,7 +858,9 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	 */
 	bool percpu_lru = (attr->map_flags & BPF_F_NO_COMMON_LRU);
 	bool prealloc = !(attr->map_flags & BPF_F_NO_PREALLOC);
+	struct htab_table *tbl;
 	struct bpf_htab *htab;
+	u32 n_buckets;
 	int err, i;
 
 	htab = bpf_map_area_alloc(sizeof(*htab), NUMA_NO_NODE);
@@ -505,7 +890,15 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	if (htab->map.max_entries > 1UL << 31)
 		goto free_htab;
 
-	htab->n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	n_buckets = roundup_pow_of_two(htab->map.max_entries);
+	htab->min_buckets = n_buckets;
+	htab->max_buckets = n_buckets;
+	if (htab_is_resizable(htab)) {
+		htab->min_buckets = min_t(u32, n_buckets, HTAB_MIN_BUCKETS);
+		htab->max_buckets = min_t(u32, n_buckets, HTAB_MAX_BUCKETS);
+		n_buckets = htab->min_buckets;
+	}
+	htab->lock_mask = min_t(u32, HASHTAB_MAP_LOCK_MASK, n_buckets - 1);
 
 	htab->elem_size = sizeof(struct htab_elem) +
 			  round_up(htab->map.key_size, 8);
@@ -515,7 +908,7 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		htab->elem_size += round_up(htab->map.value_size, 8);
 
 	/* check for u32 overflow */
-	if (htab->n_buckets > U32_MAX / sizeof(struct bucket))
+	if (n_buckets > (U32_MAX - sizeof(*tbl)) / sizeof(struct bucket))
 		goto free_htab;
 
 	err = bpf_map_init_elem_count(&htab->map);
@@ -523,11 +916,11 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 		goto free_htab;
 
 	err = -ENOMEM;
-	htab->buckets = bpf_map_area_alloc(htab->n_buckets *
-					   sizeof(struct bucket),
-					   htab->map.numa_node);
-	if (!htab->buckets)
+	tbl = bpf_map_area_alloc(struct_size(tbl, buckets, n_buckets),
+				 htab->map.numa_node);
+	if (!tbl)
 		goto free_elem_count;
+	RCU_INIT_POINTER(htab->tbl, tbl);
 
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++) {
 		htab->map_locked[i] = bpf_map_alloc_percpu(&htab->map,
@@ -543,7 +936,10 @@ static struct bpf_map *htab_map_alloc(union bpf_attr *attr)
 	else
 		htab->hashrnd = get_random_u32();
 
-	htab_init_buckets(htab);
+	htab_init_table(htab, tbl, n_buckets, 0);
+	init_irq_work(&htab->resize_irq_work, htab_resize_irq_work);
+	INIT_WORK(&htab->resize_work, htab_resize_work);
+	mutex_init(&htab->resize_mutex);
 
 /* compute_batch_value() computes batch value as num_online_cpus() * 2
  * and __percpu_counter_compare() needs
@@ -602,7 +998,7 @@ free_map_locked:
 		percpu_counter_destroy(&htab->pcount);
 	for (i = 0; i < HASHTAB_MAP_LOCK_COUNT; i++)
 		free_percpu(htab->map_locked[i]);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(tbl);
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 free_elem_count:
@@ -620,16 +1016,6 @@ static inline u32 htab_map_hash(const void *key, u32 key_len, u32 hashrnd)
 	return jhash(key, key_len, hashrnd);
 }
 
-static inline struct bucket *__select_bucket(struct bpf_htab *htab, u32 hash)
-{
-	return &htab->buckets[hash & (htab->n_buckets - 1)];
-}
-
-static inline struct hlist_nulls_head *select_bucket(struct bpf_htab *htab, u32 hash)
-{
-	return &__select_bucket(htab, hash)->head;
-}
-
 /* this lookup function can only be called with bucket lock taken */
 static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash,
 					 void *key, u32 key_size)
@@ -646,21 +1032,37 @@ static struct htab_elem *lookup_elem_raw(struct hlist_nulls_head *head, u32 hash
 
 /* can be called without bucket lock. it will repeat the loop in
  * the unlikely event when elements moved from one bucket into another
- * while link list is being walked
+ * while link list is being walked. while the table is being resized,
+ * the element may already be in the future table, which is searched
+ * after the current one.
  */
-static struct htab_elem *lookup_nulls_elem_raw(struct hlist_nulls_head *head,
+static struct htab_elem *lookup_nulls_elem_raw(struct htab_table *tbl,
 					       u32 hash, void *key,
-					       u32 key_size, u32 n_buckets)
+					       u32 key_size)
 {
+	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
 	struct htab_elem *l;
+	unsigned long nulls;
 
 again:
+	head = select_bucket(tbl, hash);
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
 		if (l->hash == hash && !memcmp(&l->key, key, key_size))
 			return l;
 
-	if (unlikely(get_nulls_value(n) != (hash & (n_buckets - 1))))
+	nulls = get_nulls_value(n);
+	if (unlikely(nulls != htab_nulls(tbl, hash)) &&
+	    !(tbl->resizable && nulls == HTAB_NULLS_MOVED))
+		goto again;
+
+	if (likely(!tbl->resizable))
+		return NULL;
+
+	/* pairs with smp_store_release() in htab_rehash_bucket() */
+	smp_rmb();
+	tbl = rcu_dereference_raw(tbl->future);
+	if (tbl)
 		goto again;
 
 	return NULL;
@@ -674,7 +1076,6 @@ again:
 static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
-	struct hlist_nulls_head *head;
 	struct htab_elem *l;
 	u32 hash, key_size;
 
@@ -685,9 +1086,7 @@ static void *__htab_map_lookup_elem(struct bpf_map *map, void *key)
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(htab_table(htab), hash, key, key_size);
 
 	return l;
 }
@@ -804,15 +1203,12 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	struct hlist_nulls_node *n;
 	unsigned long flags;
 	struct bucket *b;
-	int ret;
 
 	tgt_l = container_of(node, struct htab_elem, lru_node);
-	b = __select_bucket(htab, tgt_l->hash);
-	head = &b->head;
-
-	ret = htab_lock_bucket(htab, b, tgt_l->hash, &flags);
-	if (ret)
+	b = htab_lock_hash(htab, tgt_l->hash, &flags);
+	if (IS_ERR(b))
 		return false;
+	head = &b->head;
 
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
 		if (l == tgt_l) {
@@ -827,28 +1223,77 @@ static bool htab_lru_map_delete_node(void *arg, struct bpf_lru_node *node)
 	return l == tgt_l;
 }
 
+/* The element after @key in the order of (bit-reversed hash, key), which a
+ * resize does not change.  Unlike with other maps, a @key that was deleted
+ * meanwhile still tells where to go on.
+ */
+static int htab_map_get_next_key_ordered(struct bpf_htab *htab, void *key,
+					 void *next_key)
+{
+	u32 key_size = htab->map.key_size, pos = 0, l_pos, best_pos = 0;
+	struct hlist_nulls_node *n;
+	struct htab_elem *l, *best;
+	struct htab_table *tbl;
+	u32 i, r, bits;
+
+	if (key)
+		pos = bitrev32(htab_map_hash(key, key_size, htab->hashrnd));
+again:
+	tbl = htab_iter_table(htab);
+	bits = ilog2(tbl->n_buckets);
+	for (r = pos >> (32 - bits); r < tbl->n_buckets; r++) {
+		i = bitrev32(r) >> (32 - bits);
+		best = NULL;
+		hlist_nulls_for_each_entry_rcu(l, n, select_bucket(tbl, i),
+					       hash_node) {
+			l_pos = bitrev32(l->hash);
+			if (key && (l_pos < pos || (l_pos == pos &&
+			    memcmp(l->key, key, key_size) <= 0)))
+				continue;
+			if (!best || l_pos < best_pos || (l_pos == best_pos &&
+			    memcmp(l->key, best->key, key_size) < 0)) {
+				best = l;
+				best_pos = l_pos;
+			}
+		}
+		/* a resize started meanwhile, finish it and see its table */
+		smp_rmb();
+		if (unlikely(get_nulls_value(n) != htab_nulls(tbl, i) ||
+			     rcu_access_pointer(tbl->future)))
+			goto again;
+		if (best) {
+			memcpy(next_key, best->key, key_size);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
 /* Called from syscall */
 static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
 	struct hlist_nulls_head *head;
 	struct htab_elem *l, *next_l;
+	struct htab_table *tbl;
 	u32 hash, key_size;
 	int i = 0;
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
+	if (htab_is_resizable(htab))
+		return htab_map_get_next_key_ordered(htab, key, next_key);
+
 	key_size = map->key_size;
+	tbl = htab_iter_table(htab);
 
 	if (!key)
 		goto find_first_elem;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	head = select_bucket(htab, hash);
-
 	/* lookup the key */
-	l = lookup_nulls_elem_raw(head, hash, key, key_size, htab->n_buckets);
+	l = lookup_nulls_elem_raw(tbl, hash, key, key_size);
 
 	if (!l)
 		goto find_first_elem;
@@ -864,13 +1309,13 @@ static int htab_map_get_next_key(struct bpf_map *map, void *key, void *next_key)
 	}
 
 	/* no more elements in this hash list, go to the next bucket */
-	i = hash & (htab->n_buckets - 1);
+	i = hash & (tbl->n_buckets - 1);
 	i++;
 
 find_first_elem:
 	/* iterate over buckets */
-	for (; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		/* pick first element in the bucket */
 		next_l = hlist_nulls_entry_safe(rcu_dereference_raw(hlist_nulls_first_rcu(head)),
@@ -921,6 +1366,9 @@ static void inc_elem_count(struct bpf_htab *htab)
 		percpu_counter_add_batch(&htab->pcount, 1, PERCPU_COUNTER_BATCH);
 	else
 		atomic_inc(&htab->count);
+
+	if (htab_is_resizable(htab))
+		htab_check_resize(htab);
 }
 
 static void dec_elem_count(struct bpf_htab *htab)
@@ -931,6 +1379,9 @@ static void dec_elem_count(struct bpf_htab *htab)
 		percpu_counter_add_batch(&htab->pcount, -1, PERCPU_COUNTER_BATCH);
 	else
 		atomic_dec(&htab->count);
+
+	if (htab_is_resizable(htab))
+		htab_check_resize(htab);
 }
 
 
@@ -1112,15 +1563,12 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	if (unlikely(map_flags & BPF_F_LOCK)) {
 		if (unlikely(!btf_record_has_field(map->record, BPF_SPIN_LOCK)))
 			return -EINVAL;
 		/* find an element without taking the bucket lock */
-		l_old = lookup_nulls_elem_raw(head, hash, key, key_size,
-					      htab->n_buckets);
+		l_old = lookup_nulls_elem_raw(htab_table(htab), hash, key,
+					      key_size);
 		ret = check_flags(htab, l_old, map_flags);
 		if (ret)
 			return ret;
@@ -1137,9 +1585,10 @@ static long htab_map_update_elem(struct bpf_map *map, void *key, void *value,
 		 */
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
-		return ret;
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b))
+		return PTR_ERR(b);
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1215,9 +1664,6 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because getting free nodes from LRU may need
 	 * to remove older elements from htab and this removal
@@ -1229,9 +1675,12 @@ static long htab_lru_map_update_elem(struct bpf_map *map, void *key, void *value
 	copy_map_value(&htab->map,
 		       l_new->key + round_up(map->key_size, 8), value);
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b)) {
+		ret = PTR_ERR(b);
 		goto err_lock_bucket;
+	}
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1284,13 +1733,11 @@ static long __htab_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b))
+		return PTR_ERR(b);
 	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
-		return ret;
-
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
 	ret = check_flags(htab, l_old, map_flags);
@@ -1339,9 +1786,6 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
 
-	b = __select_bucket(htab, hash);
-	head = &b->head;
-
 	/* For LRU, we need to alloc before taking bucket's
 	 * spinlock because LRU's elem alloc may need
 	 * to remove older elem from htab and this removal
@@ -1353,9 +1797,12 @@ static long __htab_lru_percpu_map_update_elem(struct bpf_map *map, void *key,
 			return -ENOMEM;
 	}
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b)) {
+		ret = PTR_ERR(b);
 		goto err_lock_bucket;
+	}
+	head = &b->head;
 
 	l_old = lookup_elem_raw(head, hash, key, key_size);
 
@@ -1408,7 +1855,7 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	struct htab_elem *l;
 	unsigned long flags;
 	u32 hash, key_size;
-	int ret;
+	int ret = 0;
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held() &&
 		     !rcu_read_lock_bh_held());
@@ -1416,13 +1863,11 @@ static long htab_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b))
+		return PTR_ERR(b);
 	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
-		return ret;
-
 	l = lookup_elem_raw(head, hash, key, key_size);
 
 	if (l) {
@@ -1444,7 +1889,7 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	struct htab_elem *l;
 	unsigned long flags;
 	u32 hash, key_size;
-	int ret;
+	int ret = 0;
 
 	WARN_ON_ONCE(!rcu_read_lock_held() && !rcu_read_lock_trace_held() &&
 		     !rcu_read_lock_bh_held());
@@ -1452,13 +1897,11 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
+	b = htab_lock_hash(htab, hash, &flags);
+	if (IS_ERR(b))
+		return PTR_ERR(b);
 	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &flags);
-	if (ret)
-		return ret;
-
 	l = lookup_elem_raw(head, hash, key, key_size);
 
 	if (l)
@@ -1474,14 +1917,15 @@ static long htab_lru_map_delete_elem(struct bpf_map *map, void *key)
 
 static void delete_all_elements(struct bpf_htab *htab)
 {
+	struct htab_table *tbl = rcu_dereference_protected(htab->tbl, true);
 	int i;
 
 	/* It's called from a worker thread, so disable migration here,
 	 * since bpf_mem_cache_free() relies on that.
 	 */
 	migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1495,11 +1939,13 @@ static void delete_all_elements(struct bpf_htab *htab)
 
 static void htab_free_malloced_timers(struct bpf_htab *htab)
 {
+	struct htab_table *tbl;
 	int i;
 
 	rcu_read_lock();
-	for (i = 0; i < htab->n_buckets; i++) {
-		struct hlist_nulls_head *head = select_bucket(htab, i);
+	tbl = htab_iter_table(htab);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		struct hlist_nulls_head *head = select_bucket(tbl, i);
 		struct hlist_nulls_node *n;
 		struct htab_elem *l;
 
@@ -1508,6 +1954,8 @@ static void htab_free_malloced_timers(struct bpf_htab *htab)
 			bpf_obj_free_timer(htab->map.record, l->key + round_up(htab->map.key_size, 8));
 		}
 		cond_resched_rcu();
+		/* a resize may have replaced the table meanwhile */
+		tbl = htab_iter_table(htab);
 	}
 	rcu_read_unlock();
 }
@@ -1540,6 +1988,11 @@ static void htab_map_free(struct bpf_map *map)
 	 * underneath and is reponsible for waiting for callbacks to finish
 	 * during bpf_mem_alloc_destroy().
 	 */
+	if (htab_is_resizable(htab)) {
+		irq_work_sync(&htab->resize_irq_work);
+		cancel_work_sync(&htab->resize_work);
+	}
+
 	if (!htab_is_prealloc(htab)) {
 		delete_all_elements(htab);
 	} else {
@@ -1549,7 +2002,7 @@ static void htab_map_free(struct bpf_map *map)
 
 	bpf_map_free_elem_count(map);
 	free_percpu(htab->extra_elems);
-	bpf_map_area_free(htab->buckets);
+	bpf_map_area_free(rcu_dereference_protected(htab->tbl, true));
 	bpf_mem_alloc_destroy(&htab->pcpu_ma);
 	bpf_mem_alloc_destroy(&htab->ma);
 	if (htab->use_percpu_counter)
@@ -1591,18 +2044,16 @@ static int __htab_map_lookup_and_delete_elem(struct bpf_map *map, void *key,
 	struct htab_elem *l;
 	u32 hash, key_size;
 	struct bucket *b;
-	int ret;
+	int ret = 0;
 
 	key_size = map->key_size;
 
 	hash = htab_map_hash(key, key_size, htab->hashrnd);
-	b = __select_bucket(htab, hash);
+	b = htab_lock_hash(htab, hash, &bflags);
+	if (IS_ERR(b))
+		return PTR_ERR(b);
 	head = &b->head;
 
-	ret = htab_lock_bucket(htab, b, hash, &bflags);
-	if (ret)
-		return ret;
-
 	l = lookup_elem_raw(head, hash, key, key_size);
 	if (!l) {
 		ret = -ENOENT;
@@ -1688,11 +2139,12 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	void __user *uvalues = u64_to_user_ptr(attr->batch.values);
 	void __user *ukeys = u64_to_user_ptr(attr->batch.keys);
 	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
-	u32 batch, max_count, size, bucket_size, map_id;
+	u32 batch, next, i, max_count, size, bucket_size, map_id;
 	struct htab_elem *node_to_free = NULL;
 	u64 elem_map_flags, map_flags;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
+	struct htab_table *tbl;
 	unsigned long flags = 0;
 	bool locked = false;
 	struct htab_elem *l;
@@ -1719,9 +2171,6 @@ __htab_map_lookup_and_delete_batch(struct bpf_map *map,
 	if (ubatch && copy_from_user(&batch, ubatch, sizeof(batch)))
 		return -EFAULT;
 
-	if (batch >= htab->n_buckets)
-		return -ENOENT;
-
 	key_size = htab->map.key_size;
 	roundup_key_size = round_up(htab->map.key_size, 8);
 	value_size = htab->map.value_size;
@@ -1748,14 +2197,23 @@ alloc:
 again:
 	bpf_disable_instrumentation();
 	rcu_read_lock();
+	/* the table may have been resized since the last bucket */
+	tbl = htab_iter_table(htab);
+	i = htab_batch_bucket(htab, tbl, batch);
+	if (i >= tbl->n_buckets) {
+		ret = -ENOENT;
+		rcu_read_unlock();
+		bpf_enable_instrumentation();
+		goto after_loop;
+	}
 again_nocopy:
 	dst_key = keys;
 	dst_val = values;
-	b = &htab->buckets[batch];
+	b = &tbl->buckets[i];
 	head = &b->head;
 	/* do not grab the lock unless need it (bucket_cnt > 0). */
 	if (locked) {
-		ret = htab_lock_bucket(htab, b, batch, &flags);
+		ret = htab_lock_bucket(htab, b, i, &flags);
 		if (ret) {
 			rcu_read_unlock();
 			bpf_enable_instrumentation();
@@ -1765,7 +2223,24 @@ again_nocopy:
 
 	bucket_cnt = 0;
 	hlist_nulls_for_each_entry_rcu(l, n, head, hash_node)
-		bucket_cnt++;
+		if (!htab_batch_skip(htab, batch, l))
+			bucket_cnt++;
+
+	/* A resize started meanwhile and may have moved this bucket.
+	 * Finish it and go on in its table.
+	 */
+	if (tbl->resizable) {
+		/* pairs with smp_store_release() in htab_rehash_bucket() */
+		smp_rmb();
+		if (unlikely(rcu_access_pointer(tbl->future))) {
+			if (locked)
+				htab_unlock_bucket(htab, b, i, flags);
+			locked = false;
+			rcu_read_unlock();
+			bpf_enable_instrumentation();
+			goto again;
+		}
+	}
 
 	if (bucket_cnt && !locked) {
 		locked = true;
@@ -1778,7 +2253,7 @@ again_nocopy:
 		/* Note that since bucket_cnt > 0 here, it is implicit
 		 * that the locked was grabbed, so release it.
 		 */
-		htab_unlock_bucket(htab, b, batch, flags);
+		htab_unlock_bucket(htab, b, i, flags);
 		rcu_read_unlock();
 		bpf_enable_instrumentation();
 		goto after_loop;
@@ -1789,7 +2264,7 @@ again_nocopy:
 		/* Note that since bucket_cnt > 0 here, it is implicit
 		 * that the locked was grabbed, so release it.
 		 */
-		htab_unlock_bucket(htab, b, batch, flags);
+		htab_unlock_bucket(htab, b, i, flags);
 		rcu_read_unlock();
 		bpf_enable_instrumentation();
 		kvfree(keys);
@@ -1802,6 +2277,8 @@ again_nocopy:
 		goto next_batch;
 
 	hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
+		if (htab_batch_skip(htab, batch, l))
+			continue;
 		memcpy(dst_key, l->key, key_size);
 
 		if (is_percpu) {
@@ -1851,7 +2328,7 @@ again_nocopy:
 		dst_val += value_size;
 	}
 
-	htab_unlock_bucket(htab, b, batch, flags);
+	htab_unlock_bucket(htab, b, i, flags);
 	locked = false;
 
 	while (node_to_free) {
@@ -1864,9 +2341,13 @@ next_batch:
 	/* If we are not copying data, we can go to next bucket and avoid
 	 * unlocking the rcu.
 	 */
-	if (!bucket_cnt && (batch + 1 < htab->n_buckets)) {
-		batch++;
-		goto again_nocopy;
+	next = htab_batch_next(htab, tbl, batch);
+	if (!bucket_cnt) {
+		i = htab_batch_bucket(htab, tbl, next);
+		if (i < tbl->n_buckets) {
+			batch = next;
+			goto again_nocopy;
+		}
 	}
 
 	rcu_read_unlock();
@@ -1880,11 +2361,7 @@ next_batch:
 	}
 
 	total += bucket_cnt;
-	batch++;
-	if (batch >= htab->n_buckets) {
-		ret = -ENOENT;
-		goto after_loop;
-	}
+	batch = next;
 	goto again;
 
 after_loop:
@@ -1984,18 +2461,15 @@ static struct htab_elem *
 bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			   struct htab_elem *prev_elem)
 {
-	const struct bpf_htab *htab = info->htab;
+	struct bpf_htab *htab = info->htab;
 	u32 skip_elems = info->skip_elems;
 	u32 bucket_id = info->bucket_id;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
+	struct htab_table *tbl;
 	struct htab_elem *elem;
-	struct bucket *b;
 	u32 i, count;
 
-	if (bucket_id >= htab->n_buckets)
-		return NULL;
-
 	/* try to find next elem in the same bucket */
 	if (prev_elem) {
 		/* no update/deletion on this bucket, prev_elem should be still valid
@@ -2007,17 +2481,22 @@ bpf_hash_map_seq_find_next(struct bpf_iter_seq_hash_map_info *info,
 			return elem;
 
 		/* not found, unlock and go to the next bucket */
-		b = &htab->buckets[bucket_id++];
+		bucket_id++;
 		rcu_read_unlock();
 		skip_elems = 0;
 	}
 
-	for (i = bucket_id; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	for (i = bucket_id; ; i++) {
 		rcu_read_lock();
+		/* a resize may replace the table while the rcu lock is dropped */
+		tbl = htab_iter_table(htab);
+		if (i >= tbl->n_buckets) {
+			rcu_read_unlock();
+			break;
+		}
 
 		count = 0;
-		head = &b->head;
+		head = select_bucket(tbl, i);
 		hlist_nulls_for_each_entry_rcu(elem, n, head, hash_node) {
 			if (count >= skip_elems) {
 				info->bucket_id = i;
@@ -2132,6 +2611,9 @@ static int bpf_iter_init_hash_map(void *priv_data,
 	bpf_map_inc_with_uref(map);
 	seq_info->map = map;
 	seq_info->htab = container_of(map, struct bpf_htab, map);
+	/* the iterator resumes at a bucket index and an offset in its chain */
+	if (htab_is_resizable(seq_info->htab))
+		htab_resize_block(seq_info->htab);
 	return 0;
 }
 
@@ -2139,6 +2621,8 @@ static void bpf_iter_fini_hash_map(void *priv_data)
 {
 	struct bpf_iter_seq_hash_map_info *seq_info = priv_data;
 
+	if (htab_is_resizable(seq_info->htab))
+		htab_resize_unblock(seq_info->htab);
 	bpf_map_put_with_uref(seq_info->map);
 	kfree(seq_info->percpu_value_buf);
 }
@@ -2161,6 +2645,7 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 				   void *callback_ctx, u64 flags)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_table *tbl, *all, *next = NULL;
 	struct hlist_nulls_head *head;
 	struct hlist_nulls_node *n;
 	struct htab_elem *elem;
@@ -2183,8 +2668,19 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 	 */
 	if (is_percpu)
 		migrate_disable();
-	for (i = 0; i < htab->n_buckets; i++) {
-		b = &htab->buckets[i];
+	/* The caller holds the rcu lock of its program type.  When nested in
+	 * an update of this map, a resize in progress cannot be finished here,
+	 * walk both tables then: an element moved meanwhile may be seen twice.
+	 */
+	tbl = htab_table(htab);
+	all = htab_rehash_finish(htab, tbl);
+	if (all)
+		tbl = all;
+	else
+		next = rcu_dereference_raw(tbl->future);
+again:
+	for (i = 0; i < tbl->n_buckets; i++) {
+		b = &tbl->buckets[i];
 		rcu_read_lock();
 		head = &b->head;
 		hlist_nulls_for_each_entry_rcu(elem, n, head, hash_node) {
@@ -2207,12 +2703,31 @@ static long bpf_for_each_hash_elem(struct bpf_map *map, bpf_callback_t callback_
 		}
 		rcu_read_unlock();
 	}
+	if (next) {
+		tbl = next;
+		next = NULL;
+		goto again;
+	}
 out:
 	if (is_percpu)
 		migrate_enable();
 	return num_elems;
 }
 
+static void htab_lru_map_show_fdinfo(const struct bpf_map *map,
+				     struct seq_file *m)
+{
+	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	u64 evictions, steals;
+
+	if (!(map->map_flags & BPF_F_LRU_CLOCK))
+		return;
+
+	bpf_lru_clock_stats(&htab->lru, &evictions, &steals);
+	seq_printf(m, "lru_evictions:\t%llu\n", evictions);
+	seq_printf(m, "lru_steals:\t%llu\n", steals);
+}
+
 static u64 htab_map_mem_usage(const struct bpf_map *map)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
@@ -2222,8 +2737,15 @@ static u64 htab_map_mem_usage(const struct bpf_map *map)
 	bool lru = htab_is_lru(htab);
 	u64 num_entries;
 	u64 usage = sizeof(struct bpf_htab);
+	struct htab_table *tbl, *future;
 
-	usage += sizeof(struct bucket) * htab->n_buckets;
+	rcu_read_lock();
+	tbl = rcu_dereference(htab->tbl);
+	usage += struct_size(tbl, buckets, tbl->n_buckets);
+	future = rcu_dereference(tbl->future);
+	if (future)
+		usage += struct_size(future, buckets, future->n_buckets);
+	rcu_read_unlock();
 	usage += sizeof(int) * num_possible_cpus() * HASHTAB_MAP_LOCK_COUNT;
 	if (prealloc) {
 		num_entries = map->max_entries;
@@ -2290,6 +2812,7 @@ const struct bpf_map_ops htab_lru_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_lru_map_show_fdinfo,
 	BATCH_OPS(htab_lru),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2462,6 +2985,7 @@ const struct bpf_map_ops htab_lru_percpu_map_ops = {
 	.map_set_for_each_callback_args = map_set_for_each_callback_args,
 	.map_for_each_callback = bpf_for_each_hash_elem,
 	.map_mem_usage = htab_map_mem_usage,
+	.map_show_fdinfo = htab_lru_map_show_fdinfo,
 	BATCH_OPS(htab_lru_percpu),
 	.map_btf_id = &htab_map_btf_ids[0],
 	.iter_seq_info = &iter_seq_info,
@@ -2471,19 +2995,22 @@ static int fd_htab_map_alloc_check(union bpf_attr *attr)
 {
 	if (attr->value_size != sizeof(u32))
 		return -EINVAL;
+	if (attr->map_flags & BPF_F_RESIZABLE)
+		return -EINVAL;
 	return htab_map_alloc_check(attr);
 }
 
 static void fd_htab_map_free(struct bpf_map *map)
 {
 	struct bpf_htab *htab = container_of(map, struct bpf_htab, map);
+	struct htab_table *tbl = rcu_dereference_protected(htab->tbl, true);
 	struct hlist_nulls_node *n;
 	struct hlist_nulls_head *head;
 	struct htab_elem *l;
 	int i;
 
-	for (i = 0; i < htab->n_buckets; i++) {
-		head = select_bucket(htab, i);
+	for (i = 0; i < tbl->n_buckets; i++) {
+		head = select_bucket(tbl, i);
 
 		hlist_nulls_for_each_entry_safe(l, n, head, hash_node) {
 			void *ptr = fd_htab_map_get_ptr(map, l);
@@ -0,0 +1,746 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Multibit longest prefix match trie
+ *
+ * BPF_MAP_TYPE_LPM_MULTIBIT takes the same keys and values as
+ * BPF_MAP_TYPE_LPM_TRIE, but where the latter tests one bit of the key per
+ * node and may need a node per bit of the prefix length, this trie consumes
+ * a whole byte of the key per level.
+ *
+ * A node at depth d holds the prefixes of length 8d+1 to 8d+8 that share the
+ * d leading bytes of the key which lead to it.  Each of them is expanded to
+ * the slots, one per value of byte d, that it covers, and each slot resolves
+ * to the longest of those prefixes, or to none.  A slot may also have a child
+ * node for the longer prefixes below it.  Prefixes of length 0 are kept
+ * aside, as the match of last resort.
+ *
+ * A lookup takes the slot of the next key byte in each node, remembers its
+ * prefix if it has one and moves on to its child until there is none, so it
+ * visits at most one node per byte of the key: four for IPv4 and sixteen for
+ * IPv6 addresses, regardless of how the prefixes are laid out.
+ *
+ * Nodes are compressed as in Poptrie: of the 256 slots, a bitmap marks those
+ * with a child and another one where a run of slots resolving to the same
+ * prefix starts.  The children and the prefixes of the runs are packed in
+ * one array and a slot finds its entries by counting the bits set below it.
+ * The prefixes stored at the node itself come last, for updates and for
+ * get_next_key().
+ *
+ * A published node is never modified, except for switching a child pointer
+ * in place.  Updates build a new copy of the node holding the prefix, and of
+ * its parent when a child has to be added or removed, and publish them with
+ * a single pointer store, so that lookups only need RCU.
+ */
+
+#include <linux/bpf.h>
+#include <linux/btf.h>
+#include <linux/err.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/bitmap.h>
+#include <uapi/linux/btf.h>
+#include <linux/btf_ids.h>
+
+#define LPM_MB_STRIDE		8
+#define LPM_MB_SLOTS		(1 << LPM_MB_STRIDE)
+/* prefixes of a node by heap index: (1 << len) + top len bits, len 1..8 */
+#define LPM_MB_PFX_BITS		(2 * LPM_MB_SLOTS)
+
+struct lpm_mb_leaf {
+	struct rcu_head			rcu;
+	u32				prefixlen;
+	u8				data[];	/* key data, then value */
+};
+
+union lpm_mb_slot {
+	struct lpm_mb_node __rcu	*child;
+	struct lpm_mb_leaf		*leaf;
+};
+
+struct lpm_mb_node {
+	struct rcu_head			rcu;
+	DECLARE_BITMAP(child_map, LPM_MB_SLOTS);
+	DECLARE_BITMAP(run_map, LPM_MB_SLOTS);
+	DECLARE_BITMAP(pfx_map, LPM_MB_PFX_BITS);
+	u16				nr_children;
+	u16				nr_runs;
+	u16				nr_pfx;
+	/* children, then the prefix of each run (or NULL), then prefixes */
+	union lpm_mb_slot		slots[];
+};
+
+/* Unpacked node, for updates */
+struct lpm_mb_scratch {
+	struct lpm_mb_node		*child[LPM_MB_SLOTS];
+	struct lpm_mb_leaf		*pfx[LPM_MB_PFX_BITS];
+	struct lpm_mb_leaf		*slot[LPM_MB_SLOTS];
+};
+
+struct lpm_mb_trie {
+	struct bpf_map			map;
+	struct lpm_mb_node __rcu	*root;
+	struct lpm_mb_leaf __rcu	*dflt;	/* prefix length 0 */
+	size_t				n_entries;
+	size_t				max_prefixlen;
+	size_t				data_size;
+	u64				mem;	/* bytes of nodes and leaves */
+	spinlock_t			lock;
+	/* writer state, under lock */
+	struct lpm_mb_scratch		*scratch;
+	struct lpm_mb_node		**path;
+	struct lpm_mb_node		**built;
+};
+
+/* Number of bits set in @map below @bit */
+static inline unsigned int lpm_mb_rank(const unsigned long *map,
+				       unsigned int bit)
+{
+	return bitmap_weight(map, bit);
+}
+
+static inline unsigned int lpm_mb_pfx_idx(unsigned int len, u8 byte)
+{
+	return (1U << len) + (byte >> (LPM_MB_STRIDE - len));
+}
+
+static struct lpm_mb_node *lpm_mb_child(const struct lpm_mb_node *node, u8 b)
+{
+	if (!test_bit(b, node->child_map))
+		return NULL;
+	return rcu_dereference_check(node->slots[lpm_mb_rank(node->child_map, b)].child,
+				     rcu_read_lock_bh_held());
+}
+
+/* Longest prefix of @node that covers slot @b */
+static struct lpm_mb_leaf *lpm_mb_slot_leaf(const struct lpm_mb_node *node,
+					    u8 b)
+{
+	unsigned int run = lpm_mb_rank(node->run_map, b + 1) - 1;
+
+	return node->slots[node->nr_children + run].leaf;
+}
+
+static struct lpm_mb_leaf *lpm_mb_pfx(const struct lpm_mb_node *node,
+				      unsigned int idx)
+{
+	unsigned int i;
+
+	if (!test_bit(idx, node->pfx_map))
+		return NULL;
+	i = node->nr_children + node->nr_runs + lpm_mb_rank(node->pfx_map, idx);
+	return node->slots[i].leaf;
+}
+
+/* Longest prefix of @node not longer than @len that covers slot @b */
+static struct lpm_mb_leaf *lpm_mb_slot_leaf_upto(const struct lpm_mb_node *node,
+						 u8 b, unsigned int len)
+{
+	struct lpm_mb_leaf *leaf;
+
+	for (; len; len--) {
+		leaf = lpm_mb_pfx(node, lpm_mb_pfx_idx(len, b));
+		if (leaf)
+			return leaf;
+	}
+	return NULL;
+}
+
+/* Called from syscall or from eBPF program */
+static void *lpm_mb_lookup_elem(struct bpf_map *map, void *_key)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_mb_leaf *found, *leaf;
+	struct lpm_mb_node *node;
+	unsigned int d, base;
+
+	if (key->prefixlen > trie->max_prefixlen)
+		return NULL;
+
+	found = rcu_dereference_check(trie->dflt, rcu_read_lock_bh_held());
+	node = rcu_dereference_check(trie->root, rcu_read_lock_bh_held());
+
+	for (d = 0, base = 0; node; d++, base += LPM_MB_STRIDE) {
+		u8 b = key->data[d];
+
+		/* keys shorter than the trie only match shorter prefixes */
+		if (key->prefixlen < base + LPM_MB_STRIDE) {
+			if (key->prefixlen > base) {
+				leaf = lpm_mb_slot_leaf_upto(node, b,
+							     key->prefixlen - base);
+				if (leaf)
+					found = leaf;
+			}
+			break;
+		}
+
+		leaf = lpm_mb_slot_leaf(node, b);
+		if (leaf)
+			found = leaf;
+		node = lpm_mb_child(node, b);
+	}
+
+	if (!found)
+		return NULL;
+
+	return found->data + trie->data_size;
+}
+
+static size_t lpm_mb_node_size(unsigned int nr_slots)
+{
+	return sizeof(struct lpm_mb_node) + nr_slots * sizeof(union lpm_mb_slot);
+}
+
+static size_t lpm_mb_leaf_size(const struct lpm_mb_trie *trie)
+{
+	return sizeof(struct lpm_mb_leaf) + trie->data_size + trie->map.value_size;
+}
+
+static void lpm_mb_node_unpack(const struct lpm_mb_node *node,
+			       struct lpm_mb_scratch *s)
+{
+	unsigned int bit, i;
+
+	memset(s->child, 0, sizeof(s->child));
+	memset(s->pfx, 0, sizeof(s->pfx));
+	if (!node)
+		return;
+
+	i = 0;
+	for_each_set_bit(bit, node->child_map, LPM_MB_SLOTS)
+		s->child[bit] = rcu_dereference_protected(node->slots[i++].child, 1);
+	i = node->nr_children + node->nr_runs;
+	for_each_set_bit(bit, node->pfx_map, LPM_MB_PFX_BITS)
+		s->pfx[bit] = node->slots[i++].leaf;
+}
+
+/*
+ * Build a node from the unpacked one.  Returns NULL if it would be empty,
+ * and an error pointer if it can't be allocated.
+ */
+static struct lpm_mb_node *lpm_mb_node_pack(struct lpm_mb_trie *trie,
+					    struct lpm_mb_scratch *s)
+{
+	unsigned int nr_children = 0, nr_runs = 0, nr_pfx = 0;
+	unsigned int b, len, idx, i;
+	struct lpm_mb_node *node;
+	size_t size;
+
+	/* expand the prefixes to the slots they cover */
+	for (b = 0; b < LPM_MB_SLOTS; b++) {
+		s->slot[b] = NULL;
+		for (len = LPM_MB_STRIDE; len; len--) {
+			idx = lpm_mb_pfx_idx(len, b);
+			if (s->pfx[idx]) {
+				s->slot[b] = s->pfx[idx];
+				break;
+			}
+		}
+		if (s->child[b])
+			nr_children++;
+		if (!b || s->slot[b] != s->slot[b - 1])
+			nr_runs++;
+	}
+	for (idx = 2; idx < LPM_MB_PFX_BITS; idx++) {
+		if (s->pfx[idx])
+			nr_pfx++;
+	}
+	if (!nr_children && !nr_pfx)
+		return NULL;
+
+	size = lpm_mb_node_size(nr_children + nr_runs + nr_pfx);
+	node = bpf_map_kmalloc_node(&trie->map, size,
+				    GFP_NOWAIT | __GFP_NOWARN | __GFP_ZERO,
+				    trie->map.numa_node);
+	if (!node)
+		return ERR_PTR(-ENOMEM);
+
+	node->nr_children = nr_children;
+	node->nr_runs = nr_runs;
+	node->nr_pfx = nr_pfx;
+
+	i = 0;
+	for (b = 0; b < LPM_MB_SLOTS; b++) {
+		if (!s->child[b])
+			continue;
+		__set_bit(b, node->child_map);
+		RCU_INIT_POINTER(node->slots[i++].child, s->child[b]);
+	}
+	for (b = 0; b < LPM_MB_SLOTS; b++) {
+		if (b && s->slot[b] == s->slot[b - 1])
+			continue;
+		__set_bit(b, node->run_map);
+		node->slots[i++].leaf = s->slot[b];
+	}
+	for (idx = 2; idx < LPM_MB_PFX_BITS; idx++) {
+		if (!s->pfx[idx])
+			continue;
+		__set_bit(idx, node->pfx_map);
+		node->slots[i++].leaf = s->pfx[idx];
+	}
+
+	trie->mem += size;
+	return node;
+}
+
+static void lpm_mb_node_free_rcu(struct lpm_mb_trie *trie,
+				 struct lpm_mb_node *node)
+{
+	trie->mem -= lpm_mb_node_size(node->nr_children + node->nr_runs +
+				      node->nr_pfx);
+	kfree_rcu(node, rcu);
+}
+
+/*
+ * Put @leaf, or nothing if NULL, in place of the prefix of @key, which must
+ * be at least one bit long.  *@old is set to the prefix replaced.  Nothing
+ * is changed unless 0 is returned.
+ */
+static int lpm_mb_set(struct lpm_mb_trie *trie,
+		      const struct bpf_lpm_trie_key *key,
+		      struct lpm_mb_leaf *leaf, u64 flags,
+		      struct lpm_mb_leaf **old)
+{
+	struct lpm_mb_scratch *s = trie->scratch;
+	struct lpm_mb_node **path = trie->path;
+	struct lpm_mb_node **built = trie->built;
+	struct lpm_mb_node *node, *new;
+	unsigned int depth, idx, d, nr_built = 0;
+	union lpm_mb_slot *slot;
+
+	depth = (key->prefixlen - 1) / LPM_MB_STRIDE;
+	idx = lpm_mb_pfx_idx(key->prefixlen - depth * LPM_MB_STRIDE,
+			     key->data[depth]);
+
+	node = rcu_dereference_protected(trie->root, lockdep_is_held(&trie->lock));
+	for (d = 0; d < depth; d++) {
+		path[d] = node;
+		if (node)
+			node = lpm_mb_child(node, key->data[d]);
+	}
+	path[depth] = node;
+
+	*old = node ? lpm_mb_pfx(node, idx) : NULL;
+	if (leaf) {
+		if (*old && flags == BPF_NOEXIST)
+			return -EEXIST;
+		if (!*old && flags == BPF_EXIST)
+			return -ENOENT;
+		if (!*old && trie->n_entries == trie->map.max_entries)
+			return -ENOSPC;
+	} else if (!*old) {
+		return -ENOENT;
+	}
+
+	lpm_mb_node_unpack(node, s);
+	s->pfx[idx] = leaf;
+	new = lpm_mb_node_pack(trie, s);
+
+	/* Rebuild upwards as long as a child appears or goes away */
+	for (d = depth; ; d--) {
+		if (IS_ERR(new))
+			goto err_free;
+		if (new)
+			built[nr_built++] = new;
+
+		if (!d) {
+			rcu_assign_pointer(trie->root, new);
+			break;
+		}
+		if (path[d] && new) {
+			/* same shape, switch the child in place */
+			node = path[d - 1];
+			slot = &node->slots[lpm_mb_rank(node->child_map,
+							key->data[d - 1])];
+			rcu_assign_pointer(slot->child, new);
+			break;
+		}
+
+		lpm_mb_node_unpack(path[d - 1], s);
+		s->child[key->data[d - 1]] = new;
+		new = lpm_mb_node_pack(trie, s);
+	}
+
+	/* everything rebuilt replaces its old version */
+	for (; d <= depth; d++) {
+		if (path[d])
+			lpm_mb_node_free_rcu(trie, path[d]);
+	}
+	return 0;
+
+err_free:
+	while (nr_built--) {
+		new = built[nr_built];
+		trie->mem -= lpm_mb_node_size(new->nr_children + new->nr_runs +
+					      new->nr_pfx);
+		kfree(new);
+	}
+	return -ENOMEM;
+}
+
+static struct lpm_mb_leaf *lpm_mb_leaf_alloc(struct lpm_mb_trie *trie,
+					     const struct bpf_lpm_trie_key *key,
+					     const void *value)
+{
+	struct lpm_mb_leaf *leaf;
+
+	leaf = bpf_map_kmalloc_node(&trie->map, lpm_mb_leaf_size(trie),
+				    GFP_NOWAIT | __GFP_NOWARN,
+				    trie->map.numa_node);
+	if (!leaf)
+		return NULL;
+
+	leaf->prefixlen = key->prefixlen;
+	memcpy(leaf->data, key->data, trie->data_size);
+	memcpy(leaf->data + trie->data_size, value, trie->map.value_size);
+	return leaf;
+}
+
+/* Called from syscall or from eBPF program */
+static long lpm_mb_update_elem(struct bpf_map *map, void *_key, void *value,
+			       u64 flags)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_mb_leaf *leaf, *old;
+	unsigned long irq_flags;
+	int ret;
+
+	if (unlikely(flags > BPF_EXIST))
+		return -EINVAL;
+
+	if (key->prefixlen > trie->max_prefixlen)
+		return -EINVAL;
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+
+	leaf = lpm_mb_leaf_alloc(trie, key, value);
+	if (!leaf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	if (!key->prefixlen) {
+		old = rcu_dereference_protected(trie->dflt,
+						lockdep_is_held(&trie->lock));
+		if (old && flags == BPF_NOEXIST)
+			ret = -EEXIST;
+		else if (!old && flags == BPF_EXIST)
+			ret = -ENOENT;
+		else if (!old && trie->n_entries == trie->map.max_entries)
+			ret = -ENOSPC;
+		else
+			ret = 0;
+		if (!ret)
+			rcu_assign_pointer(trie->dflt, leaf);
+	} else {
+		ret = lpm_mb_set(trie, key, leaf, flags, &old);
+	}
+
+	if (ret) {
+		kfree(leaf);
+		goto out;
+	}
+
+	trie->mem += lpm_mb_leaf_size(trie);
+	if (old) {
+		trie->mem -= lpm_mb_leaf_size(trie);
+		kfree_rcu(old, rcu);
+	} else {
+		trie->n_entries++;
+	}
+
+out:
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	return ret;
+}
+
+/*
+ * Called from syscall or from eBPF program.  Unlike with LPM_TRIE, deleting
+ * needs memory, for the new copy of the node that held the prefix.
+ */
+static long lpm_mb_delete_elem(struct bpf_map *map, void *_key)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+	struct bpf_lpm_trie_key *key = _key;
+	struct lpm_mb_leaf *old;
+	unsigned long irq_flags;
+	int ret = 0;
+
+	if (key->prefixlen > trie->max_prefixlen)
+		return -EINVAL;
+
+	spin_lock_irqsave(&trie->lock, irq_flags);
+
+	if (!key->prefixlen) {
+		old = rcu_dereference_protected(trie->dflt,
+						lockdep_is_held(&trie->lock));
+		if (old)
+			RCU_INIT_POINTER(trie->dflt, NULL);
+		else
+			ret = -ENOENT;
+	} else {
+		ret = lpm_mb_set(trie, key, NULL, BPF_ANY, &old);
+	}
+
+	if (!ret) {
+		trie->n_entries--;
+		trie->mem -= lpm_mb_leaf_size(trie);
+		kfree_rcu(old, rcu);
+	}
+
+	spin_unlock_irqrestore(&trie->lock, irq_flags);
+
+	return ret;
+}
+
+#define LPM_DATA_SIZE_MAX	256
+#define LPM_DATA_SIZE_MIN	1
+
+#define LPM_VAL_SIZE_MAX	(KMALLOC_MAX_SIZE - LPM_DATA_SIZE_MAX - \
+				 sizeof(struct lpm_mb_leaf))
+#define LPM_VAL_SIZE_MIN	1
+
+#define LPM_KEY_SIZE(X)		(sizeof(struct bpf_lpm_trie_key) + (X))
+#define LPM_KEY_SIZE_MAX	LPM_KEY_SIZE(LPM_DATA_SIZE_MAX)
+#define LPM_KEY_SIZE_MIN	LPM_KEY_SIZE(LPM_DATA_SIZE_MIN)
+
+#define LPM_CREATE_FLAG_MASK	(BPF_F_NO_PREALLOC | BPF_F_NUMA_NODE |	\
+				 BPF_F_ACCESS_MASK)
+
+static void lpm_mb_free_writer_state(struct lpm_mb_trie *trie)
+{
+	kfree(trie->scratch);
+	kfree(trie->path);
+	kfree(trie->built);
+}
+
+static struct bpf_map *lpm_mb_alloc(union bpf_attr *attr)
+{
+	struct lpm_mb_trie *trie;
+	size_t depth;
+
+	/* check sanity of attributes */
+	if (attr->max_entries == 0 ||
+	    !(attr->map_flags & BPF_F_NO_PREALLOC) ||
+	    attr->map_flags & ~LPM_CREATE_FLAG_MASK ||
+	    !bpf_map_flags_access_ok(attr->map_flags) ||
+	    attr->key_size < LPM_KEY_SIZE_MIN ||
+	    attr->key_size > LPM_KEY_SIZE_MAX ||
+	    attr->value_size < LPM_VAL_SIZE_MIN ||
+	    attr->value_size > LPM_VAL_SIZE_MAX)
+		return ERR_PTR(-EINVAL);
+
+	trie = bpf_map_area_alloc(sizeof(*trie), NUMA_NO_NODE);
+	if (!trie)
+		return ERR_PTR(-ENOMEM);
+
+	/* copy mandatory map attributes */
+	bpf_map_init_from_attr(&trie->map, attr);
+	trie->data_size = attr->key_size -
+			  offsetof(struct bpf_lpm_trie_key, data);
+	trie->max_prefixlen = trie->data_size * 8;
+
+	/* one node per key byte at most */
+	depth = trie->data_size;
+	trie->scratch = kmalloc(sizeof(*trie->scratch), GFP_KERNEL_ACCOUNT);
+	trie->path = kcalloc(depth, sizeof(*trie->path), GFP_KERNEL_ACCOUNT);
+	trie->built = kcalloc(depth, sizeof(*trie->built), GFP_KERNEL_ACCOUNT);
+	if (!trie->scratch || !trie->path || !trie->built) {
+		lpm_mb_free_writer_state(trie);
+		bpf_map_area_free(trie);
+		return ERR_PTR(-ENOMEM);
+	}
+
+	spin_lock_init(&trie->lock);
+
+	return &trie->map;
+}
+
+static void lpm_mb_free(struct bpf_map *map)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+	struct lpm_mb_node __rcu **slot;
+	struct lpm_mb_node *node;
+	unsigned int i, end;
+
+	/* Always start at the root and walk down to a node whose children
+	 * are all gone. Then free that node, nullify its reference in the
+	 * parent and start over.
+	 */
+	for (;;) {
+		slot = &trie->root;
+
+		for (;;) {
+			node = rcu_dereference_protected(*slot, 1);
+			if (!node)
+				goto out;
+
+			for (i = 0; i < node->nr_children; i++) {
+				if (rcu_access_pointer(node->slots[i].child))
+					break;
+			}
+			if (i < node->nr_children) {
+				slot = &node->slots[i].child;
+				continue;
+			}
+
+			end = node->nr_children + node->nr_runs + node->nr_pfx;
+			for (i = node->nr_children + node->nr_runs; i < end; i++)
+				kfree(node->slots[i].leaf);
+			kfree(node);
+			RCU_INIT_POINTER(*slot, NULL);
+			break;
+		}
+	}
+
+out:
+	kfree(rcu_dereference_protected(trie->dflt, 1));
+	lpm_mb_free_writer_state(trie);
+	bpf_map_area_free(trie);
+}
+
+struct lpm_mb_iter {
+	struct lpm_mb_node *node;
+	u8 b;		/* slot of the child taken */
+};
+
+/*
+ * get_next_key() walks the nodes in preorder, and within a node the
+ * prefixes by length, then value.  The prefix of length 0 comes last.
+ */
+static int lpm_mb_get_next_key(struct bpf_map *map, void *_key, void *_next_key)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+	struct bpf_lpm_trie_key *key = _key, *next_key = _next_key;
+	struct lpm_mb_leaf *leaf = NULL;
+	struct lpm_mb_iter *stack;
+	struct lpm_mb_node *node;
+	unsigned int depth, d, idx, from;
+	int err = 0;
+
+	stack = kmalloc_array(trie->data_size, sizeof(*stack),
+			      GFP_ATOMIC | __GFP_NOWARN);
+	if (!stack)
+		return -ENOMEM;
+
+	node = rcu_dereference(trie->root);
+	d = 0;
+
+	if (!key || key->prefixlen > trie->max_prefixlen)
+		goto first;
+
+	if (!key->prefixlen) {
+		/* the last one, unless it doesn't exist */
+		if (rcu_access_pointer(trie->dflt)) {
+			err = -ENOENT;
+			goto out;
+		}
+		goto first;
+	}
+
+	depth = (key->prefixlen - 1) / LPM_MB_STRIDE;
+	idx = lpm_mb_pfx_idx(key->prefixlen - depth * LPM_MB_STRIDE,
+			     key->data[depth]);
+	for (d = 0; d < depth && node; d++) {
+		stack[d].node = node;
+		stack[d].b = key->data[d];
+		node = lpm_mb_child(node, key->data[d]);
+	}
+	if (!node || !test_bit(idx, node->pfx_map)) {
+		node = rcu_dereference(trie->root);
+		d = 0;
+		goto first;
+	}
+
+	/* the next prefix in the same node */
+	idx = find_next_bit(node->pfx_map, LPM_MB_PFX_BITS, idx + 1);
+	if (idx < LPM_MB_PFX_BITS) {
+		leaf = lpm_mb_pfx(node, idx);
+		goto found;
+	}
+	from = 0;
+	goto next_node;
+
+first:
+	if (!node)
+		goto dflt;
+	idx = find_first_bit(node->pfx_map, LPM_MB_PFX_BITS);
+	if (idx < LPM_MB_PFX_BITS) {
+		leaf = lpm_mb_pfx(node, idx);
+		goto found;
+	}
+	from = 0;
+
+next_node:
+	/* first child from slot @from on, or back up to the parent */
+	for (;;) {
+		unsigned int b = find_next_bit(node->child_map, LPM_MB_SLOTS, from);
+
+		if (b < LPM_MB_SLOTS) {
+			stack[d].node = node;
+			stack[d].b = b;
+			d++;
+			node = lpm_mb_child(node, b);
+			goto first;
+		}
+		if (!d)
+			break;
+		d--;
+		node = stack[d].node;
+		from = stack[d].b + 1;
+	}
+
+dflt:
+	leaf = rcu_dereference(trie->dflt);
+	if (!leaf) {
+		err = -ENOENT;
+		goto out;
+	}
+
+found:
+	next_key->prefixlen = leaf->prefixlen;
+	memcpy((void *)next_key + offsetof(struct bpf_lpm_trie_key, data),
+	       leaf->data, trie->data_size);
+out:
+	kfree(stack);
+	return err;
+}
+
+static int lpm_mb_check_btf(const struct bpf_map *map,
+			    const struct btf *btf,
+			    const struct btf_type *key_type,
+			    const struct btf_type *value_type)
+{
+	/* Keys must have struct bpf_lpm_trie_key embedded. */
+	return BTF_INFO_KIND(key_type->info) != BTF_KIND_STRUCT ?
+	       -EINVAL : 0;
+}
+
+static u64 lpm_mb_mem_usage(const struct bpf_map *map)
+{
+	struct lpm_mb_trie *trie = container_of(map, struct lpm_mb_trie, map);
+
+	return sizeof(*trie) + sizeof(*trie->scratch) +
+	       2 * trie->data_size * sizeof(*trie->path) +
+	       READ_ONCE(trie->mem);
+}
+
+BTF_ID_LIST_SINGLE(lpm_mb_map_btf_ids, struct, lpm_mb_trie)
+const struct bpf_map_ops lpm_multibit_map_ops = {
+	.map_meta_equal = bpf_map_meta_equal,
+	.map_alloc = lpm_mb_alloc,
+	.map_free = lpm_mb_free,
+	.map_get_next_key = lpm_mb_get_next_key,
+	.map_lookup_elem = lpm_mb_lookup_elem,
+	.map_update_elem = lpm_mb_update_elem,
+	.map_delete_elem = lpm_mb_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_lookup_and_delete_batch = generic_map_lookup_and_delete_batch,
+	.map_update_batch = generic_map_update_batch,
+	.map_delete_batch = generic_map_delete_batch,
+	.map_check_btf = lpm_mb_check_btf,
+	.map_mem_usage = lpm_mb_mem_usage,
+	.map_btf_id = &lpm_mb_map_btf_ids[0],
+};
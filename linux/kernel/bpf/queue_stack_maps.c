@@ -8,6 +8,7 @@
 #include <linux/list.h>
 #include <linux/slab.h>
 #include <linux/btf_ids.h>
+#include <linux/uaccess.h>
 #include "percpu_freelist.h"
 
 #define QUEUE_STACK_CREATE_FLAG_MASK \
@@ -257,6 +258,82 @@ static int queue_stack_map_get_next_key(struct bpf_map *map, void *key,
 	return -EINVAL;
 }
 
+/* Pops up to @n elements into @buf, returns how many there were */
+static u32 queue_stack_map_pop_many(struct bpf_map *map, void *buf, u32 n)
+{
+	struct bpf_queue_stack *qs = bpf_queue_stack(map);
+	bool queue = map->map_type == BPF_MAP_TYPE_QUEUE;
+	unsigned long flags;
+	u32 i, index;
+
+	raw_spin_lock_irqsave(&qs->lock, flags);
+	for (i = 0; i < n && !queue_stack_map_is_empty(qs); i++) {
+		if (queue) {
+			index = qs->tail;
+			if (unlikely(++qs->tail >= qs->size))
+				qs->tail = 0;
+		} else {
+			index = qs->head - 1;
+			if (unlikely(index >= qs->size))
+				index = qs->size - 1;
+			qs->head = index;
+		}
+		memcpy(buf + i * map->value_size,
+		       &qs->elements[index * map->value_size], map->value_size);
+	}
+	raw_spin_unlock_irqrestore(&qs->lock, flags);
+	return i;
+}
+
+/* Called from syscall.  There are no keys, pop up to batch.count values in
+ * the order BPF_MAP_LOOKUP_AND_DELETE_ELEM would, a page at a time.
+ */
+static int queue_stack_map_lookup_and_delete_batch(struct bpf_map *map,
+						   const union bpf_attr *attr,
+						   union bpf_attr __user *uattr)
+{
+	void __user *values = u64_to_user_ptr(attr->batch.values);
+	u32 value_size = map->value_size, max_count, chunk, cp = 0, want, n;
+	int err = 0;
+	void *buf;
+
+	if (attr->batch.elem_flags || attr->batch.in_batch)
+		return -EINVAL;
+
+	max_count = attr->batch.count;
+	if (!max_count)
+		return 0;
+
+	if (put_user(0, &uattr->batch.count))
+		return -EFAULT;
+
+	chunk = min_t(u32, max_count, max_t(u32, PAGE_SIZE / value_size, 1));
+	buf = kvmalloc_array(chunk, value_size, GFP_USER | __GFP_NOWARN);
+	if (!buf)
+		return -ENOMEM;
+
+	while (cp < max_count) {
+		want = min_t(u32, chunk, max_count - cp);
+		n = queue_stack_map_pop_many(map, buf, want);
+		if (copy_to_user(values + cp * value_size, buf, n * value_size)) {
+			err = -EFAULT;
+			goto free_buf;
+		}
+		cp += n;
+		if (n < want) {
+			err = -ENOENT;
+			break;
+		}
+		cond_resched();
+	}
+
+	if (copy_to_user(&uattr->batch.count, &cp, sizeof(cp)))
+		err = -EFAULT;
+free_buf:
+	kvfree(buf);
+	return err;
+}
+
 static u64 queue_stack_map_mem_usage(const struct bpf_map *map)
 {
 	u64 usage = sizeof(struct bpf_queue_stack);
@@ -278,6 +355,7 @@ const struct bpf_map_ops queue_map_ops = {
 	.map_pop_elem = queue_map_pop_elem,
 	.map_peek_elem = queue_map_peek_elem,
 	.map_get_next_key = queue_stack_map_get_next_key,
+	.map_lookup_and_delete_batch = queue_stack_map_lookup_and_delete_batch,
 	.map_mem_usage = queue_stack_map_mem_usage,
 	.map_btf_id = &queue_map_btf_ids[0],
 };
@@ -294,6 +372,7 @@ const struct bpf_map_ops stack_map_ops = {
 	.map_pop_elem = stack_map_pop_elem,
 	.map_peek_elem = stack_map_peek_elem,
 	.map_get_next_key = queue_stack_map_get_next_key,
+	.map_lookup_and_delete_batch = queue_stack_map_lookup_and_delete_batch,
 	.map_mem_usage = queue_stack_map_mem_usage,
 	.map_btf_id = &queue_map_btf_ids[0],
 };
@@ -12,7 +12,7 @@
 #include <uapi/linux/btf.h>
 #include <linux/btf_ids.h>
 
-#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE)
+#define RINGBUF_CREATE_FLAG_MASK (BPF_F_NUMA_NODE | BPF_F_PERCPU_RINGBUF)
 
 /* non-mmap()'able part of bpf_ringbuf (everything up to consumer page) */
 #define RINGBUF_PGOFF \
@@ -25,8 +25,12 @@
 
 struct bpf_ringbuf {
 	wait_queue_head_t waitq;
+	/* &waitq, or the shared one of a BPF_F_PERCPU_RINGBUF map */
+	wait_queue_head_t *notify_wq;
 	struct irq_work work;
 	u64 mask;
+	/* offset of the header within a record, past the timestamp if any */
+	u32 hdr_off;
 	struct page **pages;
 	int nr_pages;
 	spinlock_t spinlock ____cacheline_aligned_in_smp;
@@ -78,6 +82,9 @@ struct bpf_ringbuf {
 struct bpf_ringbuf_map {
 	struct bpf_map map;
 	struct bpf_ringbuf *rb;
+	/* BPF_F_PERCPU_RINGBUF: one ring per possible CPU, and rb is NULL */
+	struct bpf_ringbuf **cpu_rb;
+	wait_queue_head_t waitq;
 };
 
 /* 8-byte ring buffer record header structure */
@@ -151,7 +158,7 @@ static void bpf_ringbuf_notify(struct irq_work *work)
 {
 	struct bpf_ringbuf *rb = container_of(work, struct bpf_ringbuf, work);
 
-	wake_up_all(&rb->waitq);
+	wake_up_all(rb->notify_wq);
 }
 
 /* Maximum size of ring buffer area is limited by 32-bit page offset within
@@ -176,9 +183,11 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	spin_lock_init(&rb->spinlock);
 	atomic_set(&rb->busy, 0);
 	init_waitqueue_head(&rb->waitq);
+	rb->notify_wq = &rb->waitq;
 	init_irq_work(&rb->work, bpf_ringbuf_notify);
 
 	rb->mask = data_sz - 1;
+	rb->hdr_off = 0;
 	rb->consumer_pos = 0;
 	rb->producer_pos = 0;
 	rb->pending_pos = 0;
@@ -186,13 +195,70 @@ static struct bpf_ringbuf *bpf_ringbuf_alloc(size_t data_sz, int numa_node)
 	return rb;
 }
 
+static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
+{
+	/* copy pages pointer and nr_pages to local variable, as we are going
+	 * to unmap rb itself with vunmap() below
+	 */
+	struct page **pages = rb->pages;
+	int i, nr_pages = rb->nr_pages;
+
+	vunmap(rb);
+	for (i = 0; i < nr_pages; i++)
+		__free_page(pages[i]);
+	bpf_map_area_free(pages);
+}
+
+static void ringbuf_map_free_percpu(struct bpf_ringbuf_map *rb_map)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		if (rb_map->cpu_rb[cpu])
+			bpf_ringbuf_free(rb_map->cpu_rb[cpu]);
+	}
+	bpf_map_area_free(rb_map->cpu_rb);
+}
+
+/* Allocate the ring of each CPU on its node, all notifying the map's waitq */
+static int ringbuf_map_alloc_percpu(struct bpf_ringbuf_map *rb_map)
+{
+	struct bpf_ringbuf *rb;
+	int cpu;
+
+	rb_map->cpu_rb = bpf_map_area_alloc(nr_cpu_ids * sizeof(*rb_map->cpu_rb),
+					    NUMA_NO_NODE);
+	if (!rb_map->cpu_rb)
+		return -ENOMEM;
+	init_waitqueue_head(&rb_map->waitq);
+
+	for_each_possible_cpu(cpu) {
+		rb = bpf_ringbuf_alloc(rb_map->map.max_entries, cpu_to_node(cpu));
+		if (!rb) {
+			ringbuf_map_free_percpu(rb_map);
+			return -ENOMEM;
+		}
+		rb->notify_wq = &rb_map->waitq;
+		rb->hdr_off = BPF_RINGBUF_TS_SZ;
+		rb_map->cpu_rb[cpu] = rb;
+	}
+	return 0;
+}
+
 static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 {
 	struct bpf_ringbuf_map *rb_map;
+	int err;
 
 	if (attr->map_flags & ~RINGBUF_CREATE_FLAG_MASK)
 		return ERR_PTR(-EINVAL);
 
+	/* per-CPU rings are placed on the node of their CPU */
+	if ((attr->map_flags & BPF_F_PERCPU_RINGBUF) &&
+	    (attr->map_type != BPF_MAP_TYPE_RINGBUF ||
+	     (attr->map_flags & BPF_F_NUMA_NODE)))
+		return ERR_PTR(-EINVAL);
+
 	if (attr->key_size || attr->value_size ||
 	    !is_power_of_2(attr->max_entries) ||
 	    !PAGE_ALIGNED(attr->max_entries))
@@ -204,6 +270,15 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 
 	bpf_map_init_from_attr(&rb_map->map, attr);
 
+	if (attr->map_flags & BPF_F_PERCPU_RINGBUF) {
+		err = ringbuf_map_alloc_percpu(rb_map);
+		if (err) {
+			bpf_map_area_free(rb_map);
+			return ERR_PTR(err);
+		}
+		return &rb_map->map;
+	}
+
 	rb_map->rb = bpf_ringbuf_alloc(attr->max_entries, rb_map->map.numa_node);
 	if (!rb_map->rb) {
 		bpf_map_area_free(rb_map);
@@ -213,26 +288,15 @@ static struct bpf_map *ringbuf_map_alloc(union bpf_attr *attr)
 	return &rb_map->map;
 }
 
-static void bpf_ringbuf_free(struct bpf_ringbuf *rb)
-{
-	/* copy pages pointer and nr_pages to local variable, as we are going
-	 * to unmap rb itself with vunmap() below
-	 */
-	struct page **pages = rb->pages;
-	int i, nr_pages = rb->nr_pages;
-
-	vunmap(rb);
-	for (i = 0; i < nr_pages; i++)
-		__free_page(pages[i]);
-	bpf_map_area_free(pages);
-}
-
 static void ringbuf_map_free(struct bpf_map *map)
 {
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	bpf_ringbuf_free(rb_map->rb);
+	if (rb_map->cpu_rb)
+		ringbuf_map_free_percpu(rb_map);
+	else
+		bpf_ringbuf_free(rb_map->rb);
 	bpf_map_area_free(rb_map);
 }
 
@@ -258,11 +322,41 @@ static int ringbuf_map_get_next_key(struct bpf_map *map, void *key,
 	return -ENOTSUPP;
 }
 
+/* Pages each ring of a BPF_F_PERCPU_RINGBUF map takes in the mmap() space */
+static unsigned long ringbuf_cpu_mmap_pages(const struct bpf_map *map)
+{
+	return RINGBUF_POS_PAGES + 2 * (map->max_entries >> PAGE_SHIFT);
+}
+
+static int ringbuf_map_mmap_percpu(struct bpf_ringbuf_map *rb_map,
+				   struct vm_area_struct *vma)
+{
+	unsigned long stride = ringbuf_cpu_mmap_pages(&rb_map->map);
+	unsigned long cpu = vma->vm_pgoff / stride;
+	unsigned long pgoff = vma->vm_pgoff % stride;
+
+	/* a mapping can't span the rings of two CPUs */
+	if (cpu >= nr_cpu_ids || !cpu_possible(cpu) ||
+	    vma_pages(vma) > stride - pgoff)
+		return -EINVAL;
+
+	if (vma->vm_flags & VM_WRITE) {
+		if (pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE)
+			return -EPERM;
+	} else {
+		vm_flags_clear(vma, VM_MAYWRITE);
+	}
+	return remap_vmalloc_range(vma, rb_map->cpu_rb[cpu],
+				   pgoff + RINGBUF_PGOFF);
+}
+
 static int ringbuf_map_mmap_kern(struct bpf_map *map, struct vm_area_struct *vma)
 {
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->cpu_rb)
+		return ringbuf_map_mmap_percpu(rb_map, vma);
 
 	if (vma->vm_flags & VM_WRITE) {
 		/* allow writable mapping for the consumer_pos only */
@@ -316,6 +410,17 @@ static __poll_t ringbuf_map_poll_kern(struct bpf_map *map, struct file *filp,
 	struct bpf_ringbuf_map *rb_map;
 
 	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->cpu_rb) {
+		int cpu;
+
+		poll_wait(filp, &rb_map->waitq, pts);
+		for_each_possible_cpu(cpu) {
+			if (ringbuf_avail_data_sz(rb_map->cpu_rb[cpu]))
+				return EPOLLIN | EPOLLRDNORM;
+		}
+		return 0;
+	}
+
 	poll_wait(filp, &rb_map->rb->waitq, pts);
 
 	if (ringbuf_avail_data_sz(rb_map->rb))
@@ -338,16 +443,21 @@ static __poll_t ringbuf_map_poll_user(struct bpf_map *map, struct file *filp,
 
 static u64 ringbuf_map_mem_usage(const struct bpf_map *map)
 {
-	struct bpf_ringbuf *rb;
+	struct bpf_ringbuf_map *rb_map;
 	int nr_data_pages;
 	int nr_meta_pages;
 	u64 usage = sizeof(struct bpf_ringbuf_map);
+	u64 nr_rings = 1;
 
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
-	usage += (u64)rb->nr_pages << PAGE_SHIFT;
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->cpu_rb) {
+		nr_rings = num_possible_cpus();
+		usage += nr_cpu_ids * sizeof(*rb_map->cpu_rb);
+	}
 	nr_meta_pages = RINGBUF_NR_META_PAGES;
 	nr_data_pages = map->max_entries >> PAGE_SHIFT;
-	usage += (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
+	usage += nr_rings * ((u64)(nr_meta_pages + nr_data_pages) << PAGE_SHIFT);
+	usage += nr_rings * (nr_meta_pages + 2 * nr_data_pages) * sizeof(struct page *);
 	return usage;
 }
 
@@ -405,6 +515,17 @@ bpf_ringbuf_restore_from_rec(struct bpf_ringbuf_hdr *hdr)
 	return (void*)((addr & PAGE_MASK) - off);
 }
 
+/* Ring that BPF programs running on this CPU produce into */
+static struct bpf_ringbuf *ringbuf_map_prod_rb(struct bpf_map *map)
+{
+	struct bpf_ringbuf_map *rb_map;
+
+	rb_map = container_of(map, struct bpf_ringbuf_map, map);
+	if (rb_map->cpu_rb)
+		return rb_map->cpu_rb[smp_processor_id()];
+	return rb_map->rb;
+}
+
 static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 {
 	unsigned long cons_pos, prod_pos, new_prod_pos, pend_pos, flags;
@@ -414,7 +535,7 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	if (unlikely(size > RINGBUF_MAX_RECORD_SZ))
 		return NULL;
 
-	len = round_up(size + BPF_RINGBUF_HDR_SZ, 8);
+	len = round_up(size + BPF_RINGBUF_HDR_SZ + rb->hdr_off, 8);
 	if (len > ringbuf_total_data_sz(rb))
 		return NULL;
 
@@ -432,12 +553,12 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 	new_prod_pos = prod_pos + len;
 
 	while (pend_pos < prod_pos) {
-		hdr = (void *)rb->data + (pend_pos & rb->mask);
+		hdr = (void *)rb->data + (pend_pos & rb->mask) + rb->hdr_off;
 		hdr_len = READ_ONCE(hdr->len);
 		if (hdr_len & BPF_RINGBUF_BUSY_BIT)
 			break;
 		tmp_size = hdr_len & ~BPF_RINGBUF_DISCARD_BIT;
-		tmp_size = round_up(tmp_size + BPF_RINGBUF_HDR_SZ, 8);
+		tmp_size = round_up(tmp_size + BPF_RINGBUF_HDR_SZ + rb->hdr_off, 8);
 		pend_pos += tmp_size;
 	}
 	rb->pending_pos = pend_pos;
@@ -454,7 +575,15 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 		return NULL;
 	}
 
+	/* data pages are mapped twice, so the record is contiguous even
+	 * when the timestamp and the header straddle the end of the ring
+	 */
 	hdr = (void *)rb->data + (prod_pos & rb->mask);
+	if (rb->hdr_off) {
+		/* taken under the lock, so ordered like the ring itself */
+		*(u64 *)hdr = ktime_get_mono_fast_ns();
+		hdr = (void *)hdr + rb->hdr_off;
+	}
 	pg_off = bpf_ringbuf_rec_pg_off(rb, hdr);
 	hdr->len = size | BPF_RINGBUF_BUSY_BIT;
 	hdr->pg_off = pg_off;
@@ -469,13 +598,10 @@ static void *__bpf_ringbuf_reserve(struct bpf_ringbuf *rb, u64 size)
 
 BPF_CALL_3(bpf_ringbuf_reserve, struct bpf_map *, map, u64, size, u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
-
 	if (unlikely(flags))
 		return 0;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	return (unsigned long)__bpf_ringbuf_reserve(rb_map->rb, size);
+	return (unsigned long)__bpf_ringbuf_reserve(ringbuf_map_prod_rb(map), size);
 }
 
 const struct bpf_func_proto bpf_ringbuf_reserve_proto = {
@@ -505,7 +631,7 @@ static void bpf_ringbuf_commit(void *sample, u64 flags, bool discard)
 	/* if consumer caught up and is waiting for our record, notify about
 	 * new data availability
 	 */
-	rec_pos = (void *)hdr - (void *)rb->data;
+	rec_pos = (void *)hdr - (void *)rb->data - rb->hdr_off;
 	cons_pos = smp_load_acquire(&rb->consumer_pos) & rb->mask;
 
 	if (flags & BPF_RB_FORCE_WAKEUP)
@@ -543,14 +669,12 @@ const struct bpf_func_proto bpf_ringbuf_discard_proto = {
 BPF_CALL_4(bpf_ringbuf_output, struct bpf_map *, map, void *, data, u64, size,
 	   u64, flags)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *rec;
 
 	if (unlikely(flags & ~(BPF_RB_NO_WAKEUP | BPF_RB_FORCE_WAKEUP)))
 		return -EINVAL;
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-	rec = __bpf_ringbuf_reserve(rb_map->rb, size);
+	rec = __bpf_ringbuf_reserve(ringbuf_map_prod_rb(map), size);
 	if (!rec)
 		return -EAGAIN;
 
@@ -570,9 +694,7 @@ const struct bpf_func_proto bpf_ringbuf_output_proto = {
 
 BPF_CALL_2(bpf_ringbuf_query, struct bpf_map *, map, u64, flags)
 {
-	struct bpf_ringbuf *rb;
-
-	rb = container_of(map, struct bpf_ringbuf_map, map)->rb;
+	struct bpf_ringbuf *rb = ringbuf_map_prod_rb(map);
 
 	switch (flags) {
 	case BPF_RB_AVAIL_DATA:
@@ -598,7 +720,6 @@ const struct bpf_func_proto bpf_ringbuf_query_proto = {
 BPF_CALL_4(bpf_ringbuf_reserve_dynptr, struct bpf_map *, map, u32, size, u64, flags,
 	   struct bpf_dynptr_kern *, ptr)
 {
-	struct bpf_ringbuf_map *rb_map;
 	void *sample;
 	int err;
 
@@ -613,9 +734,7 @@ BPF_CALL_4(bpf_ringbuf_reserve_dynptr, struct bpf_map *, map, u32, size, u64, fl
 		return err;
 	}
 
-	rb_map = container_of(map, struct bpf_ringbuf_map, map);
-
-	sample = __bpf_ringbuf_reserve(rb_map->rb, size);
+	sample = __bpf_ringbuf_reserve(ringbuf_map_prod_rb(map), size);
 	if (!sample) {
 		bpf_dynptr_set_null(ptr);
 		return -EINVAL;
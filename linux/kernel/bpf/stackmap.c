@@ -9,12 +9,21 @@
 #include <linux/perf_event.h>
 #include <linux/btf_ids.h>
 #include <linux/buildid.h>
+#include <linux/hash.h>
 #include "percpu_freelist.h"
 #include "mmap_unlock_work.h"
 
 #define STACK_CREATE_FLAG_MASK					\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY |	\
-	 BPF_F_STACK_BUILD_ID)
+	 BPF_F_STACK_BUILD_ID | BPF_F_STACK_DEDUP)
+
+/* BPF_F_STACK_DEDUP: stack id slots tried before a stack collides, and
+ * frame table slots tried before the table counts as full.
+ */
+#define STACK_MAP_PROBES	8
+#define STACK_FRAME_PROBES	32
+/* Link of a frame table slot that is being filled in */
+#define STACK_FRAME_BUSY	U32_MAX
 
 struct stack_map_bucket {
 	struct pcpu_freelist_node fnode;
@@ -23,19 +32,71 @@ struct stack_map_bucket {
 	u64 data[];
 };
 
+/* A frame of a BPF_F_STACK_DEDUP map.  The upper half of the tag is the
+ * generation the frame was added in, the lower half links to the caller:
+ * its index + 1, or 0 for an outermost frame.  A stack is the chain from
+ * its innermost frame, so stacks with the same callers share frames.
+ */
+struct stack_map_frame {
+	atomic64_t tag;
+	u64 ip;
+};
+
+struct stack_map_stats {
+	u64 collisions;
+	u64 build_id_hits;
+	u64 build_id_misses;
+};
+
 struct bpf_stack_map {
 	struct bpf_map map;
 	void *elems;
 	struct pcpu_freelist freelist;
 	u32 n_buckets;
+	struct stack_map_stats __percpu *stats;
+	/* BPF_F_STACK_DEDUP only */
+	u32 n_frames;
+	struct stack_map_frame *frames;
+	/* generation << 32 | link to the innermost frame, per stack id */
+	atomic64_t *slots;
+	/* current generation << 32 | number of stack ids in use */
+	atomic64_t state;
 	struct stack_map_bucket *buckets[];
 };
 
+/* Build IDs of recently sampled VMAs, per CPU.  An entry is only valid for
+ * the generation of mm->bpf_vma_gen it was filled in, so any munmap() of
+ * the mm, which could release the file, invalidates it.
+ */
+#define BUILD_ID_CACHE_BITS	6
+
+struct build_id_cache_entry {
+	struct mm_struct *mm;
+	u64 vma_gen;
+	unsigned long vm_start;
+	unsigned long vm_end;
+	unsigned long vm_pgoff;
+	struct file *file;
+	unsigned char build_id[BUILD_ID_SIZE_MAX];
+};
+
+struct build_id_cache {
+	int busy;
+	struct build_id_cache_entry entries[1 << BUILD_ID_CACHE_BITS];
+};
+
+static DEFINE_PER_CPU(struct build_id_cache, build_id_cache);
+
 static inline bool stack_map_use_build_id(struct bpf_map *map)
 {
 	return (map->map_flags & BPF_F_STACK_BUILD_ID);
 }
 
+static inline bool stack_map_use_dedup(struct bpf_map *map)
+{
+	return (map->map_flags & BPF_F_STACK_DEDUP);
+}
+
 static inline int stack_map_data_size(struct bpf_map *map)
 {
 	return stack_map_use_build_id(map) ?
@@ -66,6 +127,35 @@ free_elems:
 	return err;
 }
 
+static int prealloc_frames_and_slots(struct bpf_stack_map *smap)
+{
+	u64 n_frames;
+
+	/* half the frames the stacks would take stored one by one */
+	n_frames = (u64)smap->map.max_entries * (smap->map.value_size / 8) / 2;
+	n_frames = max_t(u64, n_frames, STACK_FRAME_PROBES);
+	if (n_frames > 1UL << 30)
+		return -E2BIG;
+	smap->n_frames = roundup_pow_of_two(n_frames);
+
+	smap->frames = bpf_map_area_alloc(smap->n_frames *
+					  sizeof(struct stack_map_frame),
+					  smap->map.numa_node);
+	if (!smap->frames)
+		return -ENOMEM;
+
+	smap->slots = bpf_map_area_alloc(smap->n_buckets *
+					 sizeof(*smap->slots),
+					 smap->map.numa_node);
+	if (!smap->slots) {
+		bpf_map_area_free(smap->frames);
+		return -ENOMEM;
+	}
+
+	atomic64_set(&smap->state, 1ULL << 32);
+	return 0;
+}
+
 /* Called from syscall */
 static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 {
@@ -83,6 +173,9 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 		return ERR_PTR(-EINVAL);
 
 	BUILD_BUG_ON(sizeof(struct bpf_stack_build_id) % sizeof(u64));
+	if ((attr->map_flags & BPF_F_STACK_BUILD_ID) &&
+	    (attr->map_flags & BPF_F_STACK_DEDUP))
+		return ERR_PTR(-EINVAL);
 	if (attr->map_flags & BPF_F_STACK_BUILD_ID) {
 		if (value_size % sizeof(struct bpf_stack_build_id) ||
 		    value_size / sizeof(struct bpf_stack_build_id)
@@ -99,7 +192,9 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 
 	n_buckets = roundup_pow_of_two(attr->max_entries);
 
-	cost = n_buckets * sizeof(struct stack_map_bucket *) + sizeof(*smap);
+	cost = sizeof(*smap);
+	if (!(attr->map_flags & BPF_F_STACK_DEDUP))
+		cost += n_buckets * sizeof(struct stack_map_bucket *);
 	smap = bpf_map_area_alloc(cost, bpf_map_attr_numa_node(attr));
 	if (!smap)
 		return ERR_PTR(-ENOMEM);
@@ -107,11 +202,23 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 	bpf_map_init_from_attr(&smap->map, attr);
 	smap->n_buckets = n_buckets;
 
+	smap->stats = bpf_map_alloc_percpu(&smap->map,
+					   sizeof(struct stack_map_stats),
+					   __alignof__(u64),
+					   GFP_USER | __GFP_NOWARN);
+	if (!smap->stats) {
+		err = -ENOMEM;
+		goto free_smap;
+	}
+
 	err = get_callchain_buffers(sysctl_perf_event_max_stack);
 	if (err)
-		goto free_smap;
+		goto free_stats;
 
-	err = prealloc_elems_and_freelist(smap);
+	if (stack_map_use_dedup(&smap->map))
+		err = prealloc_frames_and_slots(smap);
+	else
+		err = prealloc_elems_and_freelist(smap);
 	if (err)
 		goto put_buffers;
 
@@ -119,12 +226,70 @@ static struct bpf_map *stack_map_alloc(union bpf_attr *attr)
 
 put_buffers:
 	put_callchain_buffers();
+free_stats:
+	free_percpu(smap->stats);
 free_smap:
 	bpf_map_area_free(smap);
 	return ERR_PTR(err);
 }
 
-static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
+/* build_id_parse() through the per-CPU cache.  Called with the mmap_lock
+ * of vma->vm_mm held, @vma_gen read after taking it.
+ */
+static int stack_map_parse_build_id(struct bpf_stack_map *smap,
+				    struct vm_area_struct *vma, u64 vma_gen,
+				    unsigned char *build_id)
+{
+	struct build_id_cache_entry *e;
+	struct build_id_cache *cache;
+	bool hit = false;
+	int err = 0;
+
+	if (!vma->vm_file)
+		return -EINVAL;
+
+	cache = get_cpu_ptr(&build_id_cache);
+	/* this CPU was interrupted in the middle of an update */
+	if (cache->busy++)
+		goto parse;
+
+	e = &cache->entries[hash_long((unsigned long)vma->vm_mm ^ vma->vm_start,
+				      BUILD_ID_CACHE_BITS)];
+	if (e->mm == vma->vm_mm && e->vma_gen == vma_gen &&
+	    e->vm_start == vma->vm_start && e->vm_end == vma->vm_end &&
+	    e->vm_pgoff == vma->vm_pgoff && e->file == vma->vm_file) {
+		memcpy(build_id, e->build_id, BUILD_ID_SIZE_MAX);
+		hit = true;
+		goto out;
+	}
+
+	err = build_id_parse(vma, build_id, NULL);
+	if (!err) {
+		e->mm = vma->vm_mm;
+		e->vma_gen = vma_gen;
+		e->vm_start = vma->vm_start;
+		e->vm_end = vma->vm_end;
+		e->vm_pgoff = vma->vm_pgoff;
+		e->file = vma->vm_file;
+		memcpy(e->build_id, build_id, BUILD_ID_SIZE_MAX);
+	}
+	goto out;
+
+parse:
+	err = build_id_parse(vma, build_id, NULL);
+out:
+	cache->busy--;
+	put_cpu_ptr(cache);
+
+	if (smap && hit)
+		this_cpu_inc(smap->stats->build_id_hits);
+	else if (smap)
+		this_cpu_inc(smap->stats->build_id_misses);
+	return err;
+}
+
+static void stack_map_get_build_id_offset(struct bpf_stack_map *smap,
+					  struct bpf_stack_build_id *id_offs,
 					  u64 *ips, u32 trace_nr, bool user)
 {
 	int i;
@@ -132,6 +297,7 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 	bool irq_work_busy = bpf_mmap_unlock_get_irq_work(&work);
 	struct vm_area_struct *vma, *prev_vma = NULL;
 	const char *prev_build_id;
+	u64 vma_gen;
 
 	/* If the irq_work is in use, fall back to report ips. Same
 	 * fallback is used for kernel stack (!user) on a stackmap with
@@ -148,6 +314,7 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 		return;
 	}
 
+	vma_gen = atomic64_read(&current->mm->bpf_vma_gen);
 	for (i = 0; i < trace_nr; i++) {
 		if (range_in_vma(prev_vma, ips[i], ips[i])) {
 			vma = prev_vma;
@@ -156,7 +323,8 @@ static void stack_map_get_build_id_offset(struct bpf_stack_build_id *id_offs,
 			goto build_id_valid;
 		}
 		vma = find_vma(current->mm, ips[i]);
-		if (!vma || build_id_parse(vma, id_offs[i].build_id, NULL)) {
+		if (!vma || stack_map_parse_build_id(smap, vma, vma_gen,
+						     id_offs[i].build_id)) {
 			/* per entry fall back to ips */
 			id_offs[i].status = BPF_STACK_BUILD_ID_IP;
 			id_offs[i].ip = ips[i];
@@ -210,6 +378,130 @@ get_callchain_entry_for_task(struct task_struct *task, u32 max_depth)
 #endif
 }
 
+static inline u32 stack_map_gen(u64 tag)
+{
+	return tag >> 32;
+}
+
+static bool stack_map_add_stack(struct bpf_stack_map *smap, u32 gen)
+{
+	u64 state = atomic64_read(&smap->state);
+
+	do {
+		if (stack_map_gen(state) != gen)
+			return false;
+	} while (!atomic64_try_cmpxchg(&smap->state, &state, state + 1));
+	return true;
+}
+
+/* Once the last stack id is deleted, every frame and slot of the current
+ * generation is garbage: moving to the next one frees them all.
+ */
+static void stack_map_del_stack(struct bpf_stack_map *smap)
+{
+	u64 state = atomic64_read(&smap->state), new;
+	u32 gen;
+
+	do {
+		/* never borrow from the generation */
+		if (WARN_ON_ONCE(!(u32)state))
+			return;
+		new = state - 1;
+		if (!(u32)new) {
+			gen = stack_map_gen(state) + 1;
+			new = (u64)(gen ?: 1) << 32;
+		}
+	} while (!atomic64_try_cmpxchg(&smap->state, &state, new));
+}
+
+/* Link to the frame for @ip called from @link, adding it if needed */
+static int stack_frame_get(struct bpf_stack_map *smap, u32 gen, u32 link,
+			   u64 ip)
+{
+	u64 want = (u64)gen << 32 | link, busy = (u64)gen << 32 | STACK_FRAME_BUSY;
+	u32 hash = jhash_3words((u32)ip, ip >> 32, link, 0);
+	struct stack_map_frame *frame;
+	u32 i, idx;
+	s64 tag;
+
+	for (i = 0; i < STACK_FRAME_PROBES; i++) {
+		idx = (hash + i) & (smap->n_frames - 1);
+		frame = &smap->frames[idx];
+		tag = atomic64_read_acquire(&frame->tag);
+		if (tag == want && READ_ONCE(frame->ip) == ip)
+			return idx + 1;
+		/* in use, or being filled in, in this generation */
+		if (stack_map_gen(tag) == gen)
+			continue;
+		if (!atomic64_try_cmpxchg(&frame->tag, &tag, busy))
+			continue;
+		WRITE_ONCE(frame->ip, ip);
+		atomic64_set_release(&frame->tag, want);
+		return idx + 1;
+	}
+	return -ENOMEM;
+}
+
+static long stack_map_get_stackid_dedup(struct bpf_stack_map *smap,
+					u64 *ips, u32 trace_nr, u64 flags)
+{
+	u64 state = atomic64_read(&smap->state), val;
+	u32 gen = stack_map_gen(state), link = 0, hash, id;
+	u32 free_id = U32_MAX;
+	int i, ret;
+	s64 old;
+
+	/* keep the innermost frames of a perf callchain deeper than the map */
+	trace_nr = min_t(u32, trace_nr, smap->map.value_size / sizeof(u64));
+	/* outermost frame first, so stacks with the same callers share them */
+	for (i = trace_nr - 1; i >= 0; i--) {
+		ret = stack_frame_get(smap, gen, link, ips[i]);
+		if (ret < 0)
+			return ret;
+		link = ret;
+	}
+
+	val = (u64)gen << 32 | link;
+	hash = jhash_1word(link, 0);
+	for (i = 0; i < STACK_MAP_PROBES; i++) {
+		id = (hash + i) & (smap->n_buckets - 1);
+		old = atomic64_read(&smap->slots[id]);
+		if (old == val)
+			return id;
+		if (free_id == U32_MAX && (!old || stack_map_gen(old) != gen))
+			free_id = id;
+	}
+
+	/* Count the new stack before its id can be seen, and so deleted.
+	 * Fails if all stacks were deleted meanwhile, leaving ours stale.
+	 */
+	if (free_id != U32_MAX) {
+		if (!stack_map_add_stack(smap, gen))
+			return -EBUSY;
+		old = atomic64_read(&smap->slots[free_id]);
+		if ((!old || stack_map_gen(old) != gen) &&
+		    atomic64_try_cmpxchg(&smap->slots[free_id], &old, val))
+			return free_id;
+		stack_map_del_stack(smap);
+		/* somebody else got there first, maybe with this stack */
+		if (old == val)
+			return free_id;
+	}
+
+	this_cpu_inc(smap->stats->collisions);
+	if (!(flags & BPF_F_REUSE_STACKID))
+		return -EEXIST;
+
+	free_id = hash & (smap->n_buckets - 1);
+	if (!stack_map_add_stack(smap, gen))
+		return -EBUSY;
+	old = atomic64_xchg(&smap->slots[free_id], val);
+	/* replaced a live stack, whose count is now ours */
+	if (old && stack_map_gen(old) == gen)
+		stack_map_del_stack(smap);
+	return free_id;
+}
+
 static long __bpf_get_stackid(struct bpf_map *map,
 			      struct perf_callchain_entry *trace, u64 flags)
 {
@@ -228,6 +520,9 @@ static long __bpf_get_stackid(struct bpf_map *map,
 	trace_nr = trace->nr - skip;
 	trace_len = trace_nr * sizeof(u64);
 	ips = trace->ip + skip;
+	if (stack_map_use_dedup(map))
+		return stack_map_get_stackid_dedup(smap, ips, trace_nr, flags);
+
 	hash = jhash2((u32 *)ips, trace_len / sizeof(u32), 0);
 	id = hash & (smap->n_buckets - 1);
 	bucket = READ_ONCE(smap->buckets[id]);
@@ -244,7 +539,7 @@ static long __bpf_get_stackid(struct bpf_map *map,
 		if (unlikely(!new_bucket))
 			return -ENOMEM;
 		new_bucket->nr = trace_nr;
-		stack_map_get_build_id_offset(
+		stack_map_get_build_id_offset(smap,
 			(struct bpf_stack_build_id *)new_bucket->data,
 			ips, trace_nr, user);
 		trace_len = trace_nr * sizeof(struct bpf_stack_build_id);
@@ -253,16 +548,23 @@ static long __bpf_get_stackid(struct bpf_map *map,
 			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
 			return id;
 		}
-		if (bucket && !(flags & BPF_F_REUSE_STACKID)) {
-			pcpu_freelist_push(&smap->freelist, &new_bucket->fnode);
-			return -EEXIST;
+		if (bucket) {
+			this_cpu_inc(smap->stats->collisions);
+			if (!(flags & BPF_F_REUSE_STACKID)) {
+				pcpu_freelist_push(&smap->freelist,
+						   &new_bucket->fnode);
+				return -EEXIST;
+			}
 		}
 	} else {
 		if (hash_matches && bucket->nr == trace_nr &&
 		    memcmp(bucket->data, ips, trace_len) == 0)
 			return id;
-		if (bucket && !(flags & BPF_F_REUSE_STACKID))
-			return -EEXIST;
+		if (bucket) {
+			this_cpu_inc(smap->stats->collisions);
+			if (!(flags & BPF_F_REUSE_STACKID))
+				return -EEXIST;
+		}
 
 		new_bucket = (struct stack_map_bucket *)
 			pcpu_freelist_pop(&smap->freelist);
@@ -446,7 +748,7 @@ static long __bpf_get_stack(struct pt_regs *regs, struct task_struct *task,
 
 	ips = trace->ip + skip;
 	if (user && user_build_id)
-		stack_map_get_build_id_offset(buf, ips, trace_nr, user);
+		stack_map_get_build_id_offset(NULL, buf, ips, trace_nr, user);
 	else
 		memcpy(buf, ips, copy_len);
 
@@ -574,6 +876,48 @@ static void *stack_map_lookup_elem(struct bpf_map *map, void *key)
 	return ERR_PTR(-EOPNOTSUPP);
 }
 
+static bool stack_map_slot_live(struct bpf_stack_map *smap, u32 id)
+{
+	u64 val = atomic64_read(&smap->slots[id]);
+
+	return val && stack_map_gen(val) ==
+		      stack_map_gen(atomic64_read(&smap->state));
+}
+
+/* Rebuild the stack of @id from its innermost frame */
+static int stack_map_copy_dedup(struct bpf_stack_map *smap, u32 id,
+				u64 *value)
+{
+	u32 depth = smap->map.value_size / sizeof(u64), nr = 0, gen, link;
+	struct stack_map_frame *frame;
+	u64 val, tag;
+
+	val = atomic64_read(&smap->slots[id]);
+	gen = stack_map_gen(val);
+	if (!val || gen != stack_map_gen(atomic64_read(&smap->state)))
+		return -ENOENT;
+
+	link = (u32)val;
+	while (link) {
+		if (nr == depth || link > smap->n_frames)
+			return -ENOENT;
+		frame = &smap->frames[link - 1];
+		tag = atomic64_read_acquire(&frame->tag);
+		if (stack_map_gen(tag) != gen || (u32)tag == STACK_FRAME_BUSY)
+			return -ENOENT;
+		value[nr++] = READ_ONCE(frame->ip);
+		link = (u32)tag;
+	}
+
+	/* the frames may have been reused if all stacks were deleted */
+	smp_rmb();
+	if (gen != stack_map_gen(atomic64_read(&smap->state)))
+		return -ENOENT;
+
+	memset(value + nr, 0, smap->map.value_size - nr * sizeof(u64));
+	return 0;
+}
+
 /* Called from syscall */
 int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 {
@@ -584,6 +928,9 @@ int bpf_stackmap_copy(struct bpf_map *map, void *key, void *value)
 	if (unlikely(id >= smap->n_buckets))
 		return -ENOENT;
 
+	if (stack_map_use_dedup(map))
+		return stack_map_copy_dedup(smap, id, value);
+
 	bucket = xchg(&smap->buckets[id], NULL);
 	if (!bucket)
 		return -ENOENT;
@@ -607,6 +954,19 @@ static int stack_map_get_next_key(struct bpf_map *map, void *key,
 
 	WARN_ON_ONCE(!rcu_read_lock_held());
 
+	if (stack_map_use_dedup(map)) {
+		id = key ? *(u32 *)key : 0;
+		if (!key || id >= smap->n_buckets ||
+		    !stack_map_slot_live(smap, id))
+			id = 0;
+		else
+			id++;
+
+		while (id < smap->n_buckets && !stack_map_slot_live(smap, id))
+			id++;
+		goto out;
+	}
+
 	if (!key) {
 		id = 0;
 	} else {
@@ -619,7 +979,7 @@ static int stack_map_get_next_key(struct bpf_map *map, void *key,
 
 	while (id < smap->n_buckets && !smap->buckets[id])
 		id++;
-
+out:
 	if (id >= smap->n_buckets)
 		return -ENOENT;
 
@@ -643,6 +1003,18 @@ static long stack_map_delete_elem(struct bpf_map *map, void *key)
 	if (unlikely(id >= smap->n_buckets))
 		return -E2BIG;
 
+	if (stack_map_use_dedup(map)) {
+		s64 val = atomic64_read(&smap->slots[id]);
+
+		if (!val || stack_map_gen(val) !=
+			    stack_map_gen(atomic64_read(&smap->state)))
+			return -ENOENT;
+		if (!atomic64_try_cmpxchg(&smap->slots[id], &val, 0))
+			return -ENOENT;
+		stack_map_del_stack(smap);
+		return 0;
+	}
+
 	old_bucket = xchg(&smap->buckets[id], NULL);
 	if (old_bucket) {
 		pcpu_freelist_push(&smap->freelist, &old_bucket->fnode);
@@ -657,8 +1029,14 @@ static void stack_map_free(struct bpf_map *map)
 {
 	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
 
-	bpf_map_area_free(smap->elems);
-	pcpu_freelist_destroy(&smap->freelist);
+	if (stack_map_use_dedup(map)) {
+		bpf_map_area_free(smap->frames);
+		bpf_map_area_free(smap->slots);
+	} else {
+		bpf_map_area_free(smap->elems);
+		pcpu_freelist_destroy(&smap->freelist);
+	}
+	free_percpu(smap->stats);
 	bpf_map_area_free(smap);
 	put_callchain_buffers();
 }
@@ -671,11 +1049,40 @@ static u64 stack_map_mem_usage(const struct bpf_map *map)
 	u64 enties = map->max_entries;
 	u64 usage = sizeof(*smap);
 
+	usage += sizeof(struct stack_map_stats) * num_possible_cpus();
+	if (map->map_flags & BPF_F_STACK_DEDUP) {
+		usage += n_buckets * sizeof(u64);
+		usage += (u64)smap->n_frames * sizeof(struct stack_map_frame);
+		return usage;
+	}
 	usage += n_buckets * sizeof(struct stack_map_bucket *);
 	usage += enties * (sizeof(struct stack_map_bucket) + value_size);
 	return usage;
 }
 
+static void stack_map_show_fdinfo(const struct bpf_map *map,
+				  struct seq_file *m)
+{
+	struct bpf_stack_map *smap = container_of(map, struct bpf_stack_map, map);
+	u64 collisions = 0, hits = 0, misses = 0;
+	struct stack_map_stats *stats;
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		stats = per_cpu_ptr(smap->stats, cpu);
+		collisions += READ_ONCE(stats->collisions);
+		hits += READ_ONCE(stats->build_id_hits);
+		misses += READ_ONCE(stats->build_id_misses);
+	}
+
+	seq_printf(m, "stack_collisions:\t%llu\n", collisions);
+	if (map->map_flags & BPF_F_STACK_BUILD_ID)
+		seq_printf(m,
+			   "build_id_cache_hits:\t%llu\n"
+			   "build_id_cache_misses:\t%llu\n",
+			   hits, misses);
+}
+
 BTF_ID_LIST_SINGLE(stack_trace_map_btf_ids, struct, bpf_stack_map)
 const struct bpf_map_ops stack_trace_map_ops = {
 	.map_meta_equal = bpf_map_meta_equal,
@@ -685,7 +1092,11 @@ const struct bpf_map_ops stack_trace_map_ops = {
 	.map_lookup_elem = stack_map_lookup_elem,
 	.map_update_elem = stack_map_update_elem,
 	.map_delete_elem = stack_map_delete_elem,
+	.map_lookup_batch = generic_map_lookup_batch,
+	.map_lookup_and_delete_batch = generic_map_lookup_and_delete_batch,
+	.map_delete_batch = generic_map_delete_batch,
 	.map_check_btf = map_check_no_btf,
 	.map_mem_usage = stack_map_mem_usage,
+	.map_show_fdinfo = stack_map_show_fdinfo,
 	.map_btf_id = &stack_trace_map_btf_ids[0],
 };
@@ -455,6 +455,23 @@ void *bpf_map_kvcalloc(struct bpf_map *map, size_t n, size_t size,
 	return ptr;
 }
 
+/* bpf_map_area_alloc() for a map that exists already, like a table that
+ * the map grows into.  Charged to the memory cgroup of @map.
+ */
+void *bpf_map_area_alloc_charged(const struct bpf_map *map, u64 size)
+{
+	struct mem_cgroup *memcg, *old_memcg;
+	void *ptr;
+
+	memcg = bpf_map_get_memcg(map);
+	old_memcg = set_active_memcg(memcg);
+	ptr = bpf_map_area_alloc(size, map->numa_node);
+	set_active_memcg(old_memcg);
+	mem_cgroup_put(memcg);
+
+	return ptr;
+}
+
 void __percpu *bpf_map_alloc_percpu(const struct bpf_map *map, size_t size,
 				    size_t align, gfp_t flags)
 {
@@ -835,6 +852,8 @@ static void bpf_map_show_fdinfo(struct seq_file *m, struct file *filp)
 		seq_printf(m, "owner_prog_type:\t%u\n", type);
 		seq_printf(m, "owner_jited:\t%u\n", jited);
 	}
+	if (map->ops->map_show_fdinfo)
+		map->ops->map_show_fdinfo(map, m);
 }
 #endif
 
@@ -1209,6 +1228,7 @@ static int map_create(union bpf_attr *attr)
 	case BPF_MAP_TYPE_CGRP_STORAGE:
 	case BPF_MAP_TYPE_BLOOM_FILTER:
 	case BPF_MAP_TYPE_LPM_TRIE:
+	case BPF_MAP_TYPE_LPM_MULTIBIT:
 	case BPF_MAP_TYPE_REUSEPORT_SOCKARRAY:
 	case BPF_MAP_TYPE_STACK_TRACE:
 	case BPF_MAP_TYPE_QUEUE:
@@ -1800,9 +1820,25 @@ int generic_map_update_batch(struct bpf_map *map, struct file *map_file,
 
 #define MAP_LOOKUP_RETRIES 3
 
-int generic_map_lookup_batch(struct bpf_map *map,
-				    const union bpf_attr *attr,
-				    union bpf_attr __user *uattr)
+static int map_delete_elem_sys(struct bpf_map *map, void *key)
+{
+	int err;
+
+	if (bpf_map_is_offloaded(map))
+		return bpf_map_offload_delete_elem(map, key);
+
+	bpf_disable_instrumentation();
+	rcu_read_lock();
+	err = map->ops->map_delete_elem(map, key);
+	rcu_read_unlock();
+	bpf_enable_instrumentation();
+	return err;
+}
+
+static int __generic_map_lookup_batch(struct bpf_map *map,
+				      const union bpf_attr *attr,
+				      union bpf_attr __user *uattr,
+				      bool do_delete)
 {
 	void __user *uobatch = u64_to_user_ptr(attr->batch.out_batch);
 	void __user *ubatch = u64_to_user_ptr(attr->batch.in_batch);
@@ -1856,6 +1892,10 @@ int generic_map_lookup_batch(struct bpf_map *map,
 		err = bpf_map_copy_value(map, key, value,
 					 attr->batch.elem_flags);
 
+		/* an element deleted by someone else in between is skipped */
+		if (!err && do_delete)
+			err = map_delete_elem_sys(map, key);
+
 		if (err == -ENOENT) {
 			if (retry) {
 				retry--;
@@ -1897,9 +1937,29 @@ int generic_map_lookup_batch(struct bpf_map *map,
 free_buf:
 	kvfree(buf_prevkey);
 	kvfree(buf);
+	if (do_delete)
+		maybe_wait_bpf_programs(map);
 	return err;
 }
 
+int generic_map_lookup_batch(struct bpf_map *map,
+			     const union bpf_attr *attr,
+			     union bpf_attr __user *uattr)
+{
+	return __generic_map_lookup_batch(map, attr, uattr, false);
+}
+
+/* For maps without a lookup_and_delete_elem op: look up each key found by
+ * map_get_next_key() and delete it.  Deleted keys are gone from the map,
+ * so the next key after one of them is looked up from the start again.
+ */
+int generic_map_lookup_and_delete_batch(struct bpf_map *map,
+					const union bpf_attr *attr,
+					union bpf_attr __user *uattr)
+{
+	return __generic_map_lookup_batch(map, attr, uattr, true);
+}
+
 #define BPF_MAP_LOOKUP_AND_DELETE_ELEM_LAST_FIELD flags
 
 static int map_lookup_and_delete_elem(union bpf_attr *attr)
@@ -17,6 +17,7 @@
 #include <linux/vmalloc.h>
 #include <linux/stringify.h>
 #include <linux/bsearch.h>
+#include <linux/jhash.h>
 #include <linux/sort.h>
 #include <linux/perf_event.h>
 #include <linux/ctype.h>
@@ -15857,21 +15858,20 @@ static bool check_ids(u32 old_id, u32 cur_id, struct bpf_idmap *idmap)
 	if (old_id == 0) /* cur_id == 0 as well */
 		return true;
 
-	for (i = 0; i < BPF_ID_MAP_SIZE; i++) {
-		if (!map[i].old) {
-			/* Reached an empty slot; haven't seen this id before */
-			map[i].old = old_id;
-			map[i].cur = cur_id;
-			return true;
-		}
+	for (i = 0; i < idmap->cnt; i++) {
 		if (map[i].old == old_id)
 			return map[i].cur == cur_id;
 		if (map[i].cur == cur_id)
 			return false;
 	}
 	/* We ran out of idmap slots, which should be impossible */
-	WARN_ON_ONCE(1);
-	return false;
+	if (WARN_ON_ONCE(i == BPF_ID_MAP_SIZE))
+		return false;
+	/* Haven't seen this id before */
+	map[i].old = old_id;
+	map[i].cur = cur_id;
+	idmap->cnt++;
+	return true;
 }
 
 /* Similar to check_ids(), but allocate a unique temporary ID
@@ -16284,7 +16284,47 @@ static bool func_states_equal(struct bpf_verifier_env *env, struct bpf_func_stat
 static void reset_idmap_scratch(struct bpf_verifier_env *env)
 {
 	env->idmap_scratch.tmp_id_gen = env->id_gen;
-	memset(&env->idmap_scratch.map, 0, sizeof(env->idmap_scratch.map));
+	env->idmap_scratch.cnt = 0;
+}
+
+/* Hash of what states_equal() requires to be the same in both states:
+ * call chain, references held and locks.  Register and stack contents are
+ * left out, clean_live_states() turns dead ones of an explored state into
+ * NOT_INIT and STACK_INVALID, which then match anything.
+ */
+static u32 state_shape(struct bpf_verifier_state *st)
+{
+	struct bpf_func_state *frame;
+	u32 hash;
+	int i;
+
+	hash = jhash_3words(st->curframe, st->active_rcu_lock,
+			    !!st->active_lock.id, 0);
+	hash = jhash_1word((u32)(unsigned long)st->active_lock.ptr, hash);
+	for (i = 0; i <= st->curframe; i++) {
+		frame = st->frame[i];
+		hash = jhash_2words(frame->callsite, frame->acquired_refs, hash);
+	}
+	return hash;
+}
+
+/* Bytes allocated for an explored state */
+static u32 state_mem_size(struct bpf_verifier_state *st)
+{
+	struct bpf_func_state *frame;
+	u32 size;
+	int i;
+
+	size = sizeof(struct bpf_verifier_state_list);
+	size += st->jmp_history_cnt * sizeof(*st->jmp_history);
+	for (i = 0; i <= st->curframe; i++) {
+		frame = st->frame[i];
+		size += sizeof(*frame);
+		size += frame->allocated_stack / BPF_REG_SIZE *
+			sizeof(struct bpf_stack_state);
+		size += frame->acquired_refs * sizeof(struct bpf_reference_state);
+	}
+	return size;
 }
 
 static bool states_equal(struct bpf_verifier_env *env,
@@ -16294,6 +16334,7 @@ static bool states_equal(struct bpf_verifier_env *env,
 {
 	int i;
 
+	env->states_compared++;
 	if (old->curframe != cur->curframe)
 		return false;
 
@@ -16585,7 +16626,8 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 	int i, j, n, err, states_cnt = 0;
 	bool force_new_state = env->test_state_freq || is_force_checkpoint(env, insn_idx);
 	bool add_new_state = force_new_state;
-	bool force_exact;
+	u32 shape = state_shape(cur);
+	bool force_exact, same_shape;
 
 	/* bpf progs typically have pruning point every 4 instructions
 	 * http://vger.kernel.org/bpfconf2019.html#session-1
@@ -16609,6 +16651,11 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 		if (sl->state.insn_idx != insn_idx)
 			goto next;
 
+		/* states_equal() can't succeed, skip it and the idmap reset */
+		same_shape = sl->shape == shape;
+		if (!same_shape)
+			env->shape_misses++;
+
 		if (sl->state.branches) {
 			struct bpf_func_state *frame = sl->state.frame[sl->state.curframe];
 
@@ -16664,7 +16711,7 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 			 * => unsafe memory access at 11 would not be caught.
 			 */
 			if (is_iter_next_insn(env, insn_idx)) {
-				if (states_equal(env, &sl->state, cur, true)) {
+				if (same_shape && states_equal(env, &sl->state, cur, true)) {
 					struct bpf_func_state *cur_frame;
 					struct bpf_reg_state *iter_state, *iter_reg;
 					int spi;
@@ -16688,12 +16735,12 @@ static int is_state_visited(struct bpf_verifier_env *env, int insn_idx)
 				goto skip_inf_loop_check;
 			}
 			if (calls_callback(env, insn_idx)) {
-				if (states_equal(env, &sl->state, cur, true))
+				if (same_shape && states_equal(env, &sl->state, cur, true))
 					goto hit;
 				goto skip_inf_loop_check;
 			}
 			/* attempt to detect infinite loop to avoid unnecessary doomed work */
-			if (states_maybe_looping(&sl->state, cur) &&
+			if (same_shape && states_maybe_looping(&sl->state, cur) &&
 			    states_equal(env, &sl->state, cur, false) &&
 			    !iter_active_depths_differ(&sl->state, cur) &&
 			    sl->state.callback_unroll_depth == cur->callback_unroll_depth) {
@@ -16751,7 +16798,7 @@ skip_inf_loop_check:
 		 */
 		loop_entry = get_loop_entry(&sl->state);
 		force_exact = loop_entry && loop_entry->branches > 0;
-		if (states_equal(env, &sl->state, cur, force_exact)) {
+		if (same_shape && states_equal(env, &sl->state, cur, force_exact)) {
 			if (force_exact)
 				update_loop_entry(cur, loop_entry);
 hit:
@@ -16809,6 +16856,7 @@ miss:
 				WARN_ONCE(br,
 					  "BUG live_done but branches_to_explore %d\n",
 					  br);
+				env->states_mem -= sl->mem_size;
 				free_verifier_state(&sl->state, false);
 				kfree(sl);
 				env->peak_states--;
@@ -16869,6 +16917,11 @@ next:
 	new->insn_idx = insn_idx;
 	WARN_ONCE(new->branches != 1,
 		  "BUG is_state_visited:branches_to_explore=%d insn %d\n", new->branches, insn_idx);
+	new_sl->shape = shape;
+	new_sl->mem_size = state_mem_size(new);
+	env->states_mem += new_sl->mem_size;
+	if (env->peak_states_mem < env->states_mem)
+		env->peak_states_mem = env->states_mem;
 
 	cur->parent = new;
 	cur->first_insn_idx = insn_idx;
@@ -17017,7 +17070,11 @@ static int do_check(struct bpf_verifier_env *env)
 		state->last_insn_idx = env->prev_insn_idx;
 
 		if (is_prune_point(env, env->insn_idx)) {
+			u64 start = env->log.level & BPF_LOG_STATS ? ktime_get_ns() : 0;
+
 			err = is_state_visited(env, env->insn_idx);
+			if (start)
+				env->prune_time += ktime_get_ns() - start;
 			if (err < 0)
 				return err;
 			if (err == 1) {
@@ -19713,6 +19770,14 @@ static void print_verification_stats(struct bpf_verifier_env *env)
 	if (env->log.level & BPF_LOG_STATS) {
 		verbose(env, "verification time %lld usec\n",
 			div_u64(env->verification_time, 1000));
+		verbose(env, "setup %lld usec check %lld usec (pruning %lld usec) rewrite %lld usec\n",
+			div_u64(env->setup_time, 1000),
+			div_u64(env->check_time, 1000),
+			div_u64(env->prune_time, 1000),
+			div_u64(env->rewrite_time, 1000));
+		verbose(env, "states_equal %u shape_misses %u peak_states_mem %llu KiB\n",
+			env->states_compared, env->shape_misses,
+			DIV_ROUND_UP_ULL(env->peak_states_mem, 1024));
 		verbose(env, "stack depth ");
 		for (i = 0; i < env->subprog_cnt; i++) {
 			u32 depth = env->subprog_info[i].stack_depth;
@@ -20217,7 +20282,7 @@ struct btf *bpf_get_btf_vmlinux(void)
 
 int bpf_check(struct bpf_prog **prog, union bpf_attr *attr, bpfptr_t uattr, __u32 uattr_size)
 {
-	u64 start_time = ktime_get_ns();
+	u64 start_time = ktime_get_ns(), phase_start;
 	struct bpf_verifier_env *env;
 	int i, len, ret = -EINVAL, err;
 	u32 log_true_size;
@@ -20325,14 +20390,17 @@ int bpf_check(struct bpf_prog **prog, union bpf_attr *attr, bpfptr_t uattr, __u3
 	if (ret < 0)
 		goto skip_full_check;
 
+	env->setup_time = ktime_get_ns() - start_time;
 	ret = do_check_subprogs(env);
 	ret = ret ?: do_check_main(env);
+	env->check_time = ktime_get_ns() - start_time - env->setup_time;
 
 	if (ret == 0 && bpf_prog_is_offloaded(env->prog->aux))
 		ret = bpf_prog_offload_finalize(env);
 
 skip_full_check:
 	kvfree(env->explored_states);
+	phase_start = ktime_get_ns();
 
 	if (ret == 0)
 		ret = check_max_stack_depth(env);
@@ -20372,6 +20440,7 @@ skip_full_check:
 	if (ret == 0)
 		ret = fixup_call_args(env);
 
+	env->rewrite_time = ktime_get_ns() - phase_start;
 	env->verification_time = ktime_get_ns() - start_time;
 	print_verification_stats(env);
 	env->prog->aux->verified_insns = env->insn_processed;
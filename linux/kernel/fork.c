@@ -924,6 +924,7 @@ void __mmdrop(struct mm_struct *mm)
 	mm_pasid_drop(mm);
 	mm_destroy_cid(mm);
 	percpu_counter_destroy_many(mm->rss_stat, NR_MM_COUNTERS);
+	futex_hash_free(mm);
 
 	free_mm(mm);
 }
@@ -1254,6 +1255,10 @@ static void mm_init_uprobes_state(struct mm_struct *mm)
 #endif
 }
 
+#ifdef CONFIG_BPF_SYSCALL
+static atomic64_t bpf_vma_gen_base = ATOMIC64_INIT(0);
+#endif
+
 static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	struct user_namespace *user_ns)
 {
@@ -1266,6 +1271,10 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	INIT_LIST_HEAD(&mm->mmlist);
 #ifdef CONFIG_PER_VMA_LOCK
 	mm->mm_lock_seq = 0;
+#endif
+#ifdef CONFIG_BPF_SYSCALL
+	atomic64_set(&mm->bpf_vma_gen,
+		     atomic64_add_return(1ULL << 32, &bpf_vma_gen_base));
 #endif
 	mm_pgtables_bytes_init(mm);
 	mm->map_count = 0;
@@ -1285,6 +1294,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	mm->pmd_huge_pte = NULL;
 #endif
 	mm_init_uprobes_state(mm);
+	futex_mm_init(mm);
 	hugetlb_count_init(mm);
 
 	if (current->mm) {
@@ -2405,6 +2415,8 @@ __latent_entropy struct task_struct *copy_process(
 #ifdef CONFIG_IO_URING
 	p->io_uring = NULL;
 #endif
+	p->fd_cache = NULL;
+	p->poll_cache = NULL;
 
 #if defined(SPLIT_RSS_COUNTING)
 	memset(&p->rss_stat, 0, sizeof(p->rss_stat));
@@ -2912,6 +2924,9 @@ pid_t kernel_clone(struct kernel_clone_args *args)
 	if (IS_ERR(p))
 		return PTR_ERR(p);
 
+	if (clone_flags & CLONE_THREAD)
+		futex_hash_grow(p->mm);
+
 	/*
 	 * Do this prior waking up the new thread - the thread pointer
 	 * might get invalid after that point, if the thread exits quickly.
@@ -3366,6 +3381,8 @@ int unshare_fd(unsigned long unshare_flags, unsigned int max_fds,
 
 	if ((unshare_flags & CLONE_FILES) &&
 	    (fd && atomic_read(&fd->count) > 1)) {
+		/* Reserved descriptors must go back to the table we leave */
+		fd_cache_flush();
 		*new_fdp = dup_fd(fd, max_fds, &error);
 		if (!*new_fdp)
 			return error;
@@ -37,21 +37,27 @@
 #include <linux/memblock.h>
 #include <linux/fault-inject.h>
 #include <linux/slab.h>
+#include <linux/prctl.h>
+#include <linux/sched/signal.h>
+#include <linux/sched/coredump.h>
 
 #include "futex.h"
 #include "../locking/rtmutex_common.h"
 
 /*
- * The base of the bucket array and its size are always used together
- * (after initialization only in futex_hash()), so ensure that they
- * reside in the same cacheline.
+ * The global hash is split in one bucket array per node. The arrays and
+ * their size are always used together (after initialization only in
+ * futex_hash()), so ensure that the size and the first arrays reside in
+ * the same cacheline.
  */
 static struct {
-	struct futex_hash_bucket *queues;
 	unsigned long            hashsize;
+	unsigned int             hashshift;
+	struct futex_hash_bucket *queues[MAX_NUMNODES];
 } __futex_data __read_mostly __aligned(2*sizeof(long));
-#define futex_queues   (__futex_data.queues)
-#define futex_hashsize (__futex_data.hashsize)
+#define futex_queues    (__futex_data.queues)
+#define futex_hashsize  (__futex_data.hashsize)
+#define futex_hashshift (__futex_data.hashshift)
 
 
 /*
@@ -105,21 +111,270 @@ late_initcall(fail_futex_debugfs);
 
 #endif /* CONFIG_FAIL_FUTEX */
 
+static inline u32 __futex_hash(union futex_key *key)
+{
+	return jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
+		      key->both.offset);
+}
+
 /**
- * futex_hash - Return the hash bucket in the global hash
+ * futex_hash - Return the hash bucket of a futex key
  * @key:	Pointer to the futex key for which the hash is calculated
  *
  * We hash on the keys returned from get_futex_key (see below) and return the
- * corresponding hash bucket in the global hash.
+ * corresponding hash bucket in the global hash, or in the process-private
+ * hash of the key's mm for private futexes. Keys without a node go into
+ * the hash of a node picked by the upper hash bits.
  */
 struct futex_hash_bucket *futex_hash(union futex_key *key)
 {
-	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
-			  key->both.offset);
+	struct futex_private_hash *fph;
+	u32 hash = __futex_hash(key);
+	int node = key->both.node;
+
+	if (!(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))) {
+		/* Pairs with smp_store_release() in futex_hash_resize() */
+		fph = smp_load_acquire(&key->private.mm->futex_phash);
+		if (fph)
+			return &fph->queues[hash & fph->hash_mask];
+	}
+
+	if (node == FUTEX_NO_NODE) {
+		node = (hash >> futex_hashshift) % nr_node_ids;
+		if (!node_possible(node))
+			node = find_next_bit_wrap(node_possible_map.bits,
+						  nr_node_ids, node);
+	}
+
+	return &futex_queues[node][hash & (futex_hashsize - 1)];
+}
+
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+	hb->moved = false;
+}
+
+/*
+ * Move all waiters of @hb over to @fph, which isn't visible to anybody else
+ * yet. Waiters find their new bucket through q->lock_ptr, see
+ * futex_q_lockptr_lock(), like after a requeue.
+ */
+static void futex_rehash_bucket(struct futex_hash_bucket *hb,
+				struct futex_private_hash *fph)
+{
+	struct futex_hash_bucket *hb2;
+	struct futex_q *q, *next;
+
+	spin_lock(&hb->lock);
+	/*
+	 * Keep wakers from skipping the lock while the waiters go, they
+	 * need to see ->moved and look in the new hash instead.
+	 */
+	futex_hb_waiters_inc(hb);
+	plist_for_each_entry_safe(q, next, &hb->chain, list) {
+		hb2 = &fph->queues[__futex_hash(&q->key) & fph->hash_mask];
+
+		spin_lock_nested(&hb2->lock, SINGLE_DEPTH_NESTING);
+		plist_del(&q->list, &hb->chain);
+		plist_add(&q->list, &hb2->chain);
+		futex_hb_waiters_dec(hb);
+		futex_hb_waiters_inc(hb2);
+		q->lock_ptr = &hb2->lock;
+		spin_unlock(&hb2->lock);
+	}
+	hb->moved = true;
+	spin_unlock(&hb->lock);
+}
+
+static int futex_hash_resize(struct mm_struct *mm, unsigned int slots,
+			     bool auto_size)
+{
+	struct futex_private_hash *fph, *old = mm->futex_phash;
+	unsigned int i;
+
+	lockdep_assert_held(&mm->futex_hash_lock);
+
+	if (old && old->hash_mask + 1 == slots) {
+		old->auto_size = auto_size;
+		return 0;
+	}
+
+	fph = kvzalloc(struct_size(fph, queues, slots), GFP_KERNEL_ACCOUNT);
+	if (!fph)
+		return -ENOMEM;
+
+	fph->hash_mask = slots - 1;
+	fph->auto_size = auto_size;
+	for (i = 0; i < slots; i++)
+		futex_hash_bucket_init(&fph->queues[i]);
+
+	/*
+	 * Operations that hash into @old until @fph is published find the
+	 * bucket moved and retry, which only takes as long as the rehash.
+	 */
+	if (old) {
+		for (i = 0; i <= old->hash_mask; i++)
+			futex_rehash_bucket(&old->queues[i], fph);
+		fph->replaced = old;
+	}
+
+	smp_store_release(&mm->futex_phash, fph);
+	return 0;
+}
+
+/* Buckets for @nr_threads, at most as many as a node of the global hash has */
+static unsigned int futex_hash_auto_slots(unsigned int nr_threads)
+{
+	unsigned long slots = roundup_pow_of_two(4UL * max(nr_threads, 4U));
+
+	return min(slots, futex_hashsize);
+}
+
+/**
+ * futex_hash_grow - Grow an auto-sized private hash after a thread was created
+ * @mm:	the mm of the new thread
+ *
+ * Best effort, the hash stays as it is if the new one can't be allocated.
+ */
+void futex_hash_grow(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = READ_ONCE(mm->futex_phash);
+	unsigned int slots;
+
+	if (!fph || !fph->auto_size)
+		return;
+
+	slots = futex_hash_auto_slots(get_nr_threads(current));
+	if (slots <= fph->hash_mask + 1)
+		return;
+
+	mutex_lock(&mm->futex_hash_lock);
+	fph = mm->futex_phash;
+	if (fph->auto_size && slots > fph->hash_mask + 1)
+		futex_hash_resize(mm, slots, true);
+	mutex_unlock(&mm->futex_hash_lock);
+}
+
+/**
+ * futex_hash_wait_moved - Wait for the resize that moved a bucket
+ * @key:	the key that hashed to a ->moved bucket
+ *
+ * Retrying right away would spin until the resize is done, and never let a
+ * resizer that was preempted on the same CPU finish. Sleep on the mutex the
+ * resize holds from start to end instead. Called without locks held.
+ */
+void futex_hash_wait_moved(union futex_key *key)
+{
+	struct mm_struct *mm = key->private.mm;
+
+	/* only process-private hashes are resized */
+	if (key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED))
+		return;
+
+	mutex_lock(&mm->futex_hash_lock);
+	mutex_unlock(&mm->futex_hash_lock);
+}
+
+/*
+ * Whether a task other than current uses current's mm: another thread, a
+ * CLONE_VM child or the parent of a vfork() child. mm_users can't tell, it
+ * also counts transient references such as those of /proc readers.
+ */
+static bool futex_mm_shared(struct mm_struct *mm)
+{
+	struct task_struct *p;
+	bool ret = false;
+
+	if (get_nr_threads(current) != 1 || current->vfork_done)
+		return true;
+	if (!test_bit(MMF_MULTIPROCESS, &mm->flags))
+		return false;
+
+	rcu_read_lock();
+	for_each_process(p) {
+		if (same_thread_group(p, current) || (p->flags & PF_KTHREAD))
+			continue;
+		if (process_shares_mm(p, mm)) {
+			ret = true;
+			break;
+		}
+	}
+	rcu_read_unlock();
+
+	return ret;
+}
+
+static int futex_hash_set_slots(unsigned int slots)
+{
+	struct mm_struct *mm = current->mm;
+	bool auto_size = !slots;
+	int ret;
+
+	if (auto_size)
+		slots = futex_hash_auto_slots(get_nr_threads(current));
+	else if (slots < 2 || !is_power_of_2(slots) || slots > futex_hashsize)
+		return -EINVAL;
+
+	mutex_lock(&mm->futex_hash_lock);
+	/*
+	 * Waiters on private futexes in the global hash are not moved, so
+	 * only a process that does not share its mm can switch over. That
+	 * rules out CLONE_VM children as well as other threads.
+	 */
+	if (!mm->futex_phash && futex_mm_shared(mm))
+		ret = -EBUSY;
+	else
+		ret = futex_hash_resize(mm, slots, auto_size);
+	mutex_unlock(&mm->futex_hash_lock);
+
+	return ret;
+}
+
+static int futex_hash_get_slots(void)
+{
+	struct futex_private_hash *fph = READ_ONCE(current->mm->futex_phash);
 
-	return &futex_queues[hash & (futex_hashsize - 1)];
+	return fph ? fph->hash_mask + 1 : 0;
 }
 
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3,
+		     unsigned long arg4, unsigned long arg5)
+{
+	if (arg4 || arg5)
+		return -EINVAL;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg3 > UINT_MAX)
+			return -EINVAL;
+		return futex_hash_set_slots(arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		return futex_hash_get_slots();
+	default:
+		return -EINVAL;
+	}
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mm->futex_phash = NULL;
+	mutex_init(&mm->futex_hash_lock);
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	struct futex_private_hash *fph = mm->futex_phash, *next;
+
+	for (; fph; fph = next) {
+		next = fph->replaced;
+		kvfree(fph);
+	}
+}
 
 /**
  * futex_setup_timer - set up the sleeping hrtimer.
@@ -230,6 +485,7 @@ int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
 	 * The futex address must be "naturally" aligned.
 	 */
 	key->both.offset = address % PAGE_SIZE;
+	key->both.node = FUTEX_NO_NODE;
 	if (unlikely((address % sizeof(u32)) != 0))
 		return -EINVAL;
 	address -= key->both.offset;
@@ -404,6 +660,68 @@ out:
 	return err;
 }
 
+/*
+ * Read the node of a FUTEX2_NUMA futex. A futex without one yet is claimed
+ * for the node of the caller, the first to do so wins.
+ */
+static int futex_get_node(u32 __user *naddr, int *node)
+{
+	u32 val, cur;
+	int ret;
+
+	if (get_user(val, naddr))
+		return -EFAULT;
+
+	while ((int)val == FUTEX_NO_NODE) {
+		cur = numa_node_id();
+		ret = futex_cmpxchg_value_locked(&val, naddr, FUTEX_NO_NODE, cur);
+		if (!ret) {
+			if ((int)val == FUTEX_NO_NODE)
+				val = cur;
+			break;
+		}
+		if (ret == -EFAULT && fault_in_user_writeable(naddr))
+			return -EFAULT;
+		if (get_user(val, naddr))
+			return -EFAULT;
+		cond_resched();
+	}
+
+	if (val >= MAX_NUMNODES || !node_possible(val))
+		return -EINVAL;
+
+	*node = val;
+	return 0;
+}
+
+/**
+ * futex2_get_key() - Get the key of a futex2 futex
+ * @uaddr:	virtual address of the futex
+ * @flags:	FLAGS_SHARED, FLAGS_NUMA
+ * @key:	address where result is stored.
+ * @rw:		mapping needs to be read/write (values: FUTEX_READ,
+ *              FUTEX_WRITE)
+ *
+ * get_futex_key() which, with FLAGS_NUMA, also sets the node of the key
+ * from the u32 that follows the futex word.
+ *
+ * Return: a negative error code or 0
+ */
+int futex2_get_key(u32 __user *uaddr, unsigned int flags,
+		   union futex_key *key, enum futex_access rw)
+{
+	int ret;
+
+	if ((flags & FLAGS_NUMA) && ((unsigned long)uaddr % (2 * sizeof(u32))))
+		return -EINVAL;
+
+	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, key, rw);
+	if (ret || !(flags & FLAGS_NUMA))
+		return ret;
+
+	return futex_get_node(uaddr + 1, &key->both.node);
+}
+
 /**
  * fault_in_user_writeable() - Fault in user address and verify RW access
  * @uaddr:	pointer to faulting user space address
@@ -525,6 +843,7 @@ struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
 {
 	struct futex_hash_bucket *hb;
 
+retry:
 	hb = futex_hash(&q->key);
 
 	/*
@@ -540,6 +859,21 @@ struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
 	q->lock_ptr = &hb->lock;
 
 	spin_lock(&hb->lock);
+	if (futex_hb_moved(hb)) {
+		unsigned int state = READ_ONCE(current->__state);
+
+		futex_q_unlock(hb);
+		/*
+		 * futex_wait_multiple_setup() gets here already set to sleep,
+		 * which must not be the case on the mutex. Set the state again
+		 * after: wakeups of the futexes queued so far are seen by the
+		 * checks it makes before schedule(), behind the full barrier.
+		 */
+		__set_current_state(TASK_RUNNING);
+		futex_hash_wait_moved(&q->key);
+		set_current_state(state);
+		goto retry;
+	}
 	return hb;
 }
 
@@ -623,6 +957,26 @@ retry:
 	return ret;
 }
 
+/**
+ * futex_q_lockptr_lock() - Lock the hash bucket a queued futex_q is on
+ * @q:	The futex_q, which must be queued
+ *
+ * q->lock_ptr changes when a resize of the private hash moves @q, so it is
+ * rechecked under the lock as in futex_unqueue().
+ */
+void futex_q_lockptr_lock(struct futex_q *q)
+{
+	spinlock_t *lock_ptr;
+
+retry:
+	lock_ptr = READ_ONCE(q->lock_ptr);
+	spin_lock(lock_ptr);
+	if (unlikely(lock_ptr != q->lock_ptr)) {
+		spin_unlock(lock_ptr);
+		goto retry;
+	}
+}
+
 /*
  * PI futexes can not be requeued and must remove themselves from the
  * hash bucket. The hash bucket lock (i.e. lock_ptr) is held.
@@ -988,6 +1342,13 @@ static void exit_pi_state_list(struct task_struct *curr)
 		raw_spin_unlock_irq(&curr->pi_lock);
 
 		spin_lock(&hb->lock);
+		if (futex_hb_moved(hb)) {
+			spin_unlock(&hb->lock);
+			put_pi_state(pi_state);
+			futex_hash_wait_moved(&key);
+			raw_spin_lock_irq(&curr->pi_lock);
+			continue;
+		}
 		raw_spin_lock_irq(&pi_state->pi_mutex.wait_lock);
 		raw_spin_lock(&curr->pi_lock);
 		/*
@@ -1132,27 +1493,33 @@ void futex_exit_release(struct task_struct *tsk)
 
 static int __init futex_init(void)
 {
-	unsigned int futex_shift;
-	unsigned long i;
+	struct futex_hash_bucket *table;
+	unsigned long hashsize, i;
+	int node;
 
 #if CONFIG_BASE_SMALL
-	futex_hashsize = 16;
+	hashsize = 16;
 #else
-	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+	hashsize = 256 * num_possible_cpus() / num_possible_nodes();
+	hashsize = roundup_pow_of_two(max(hashsize, 16UL));
 #endif
-
-	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
-					       futex_hashsize, 0, 0,
-					       &futex_shift, NULL,
-					       futex_hashsize, futex_hashsize);
-	futex_hashsize = 1UL << futex_shift;
-
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
+	futex_hashsize = hashsize;
+	futex_hashshift = ilog2(hashsize);
+
+	for_each_node(node) {
+		table = kvmalloc_node(array_size(hashsize, sizeof(*table)),
+				      GFP_KERNEL, node);
+		if (!table)
+			panic("futex: Failed to allocate the hash of node %d\n",
+			      node);
+
+		for (i = 0; i < hashsize; i++)
+			futex_hash_bucket_init(&table[i]);
+		futex_queues[node] = table;
 	}
 
+	pr_info("futex hash table entries: %lu per node (%d nodes)\n",
+		hashsize, num_possible_nodes());
 	return 0;
 }
 core_initcall(futex_init);
@@ -27,6 +27,20 @@
 #endif
 #define FLAGS_CLOCKRT		0x02
 #define FLAGS_HAS_TIMEOUT	0x04
+#define FLAGS_NUMA		0x08
+
+/* Internal flags for the per futex flags of the futex2 syscalls */
+static inline unsigned int futex2_to_flags(unsigned int flags2)
+{
+	unsigned int flags = 0;
+
+	if (!(flags2 & FUTEX_PRIVATE_FLAG))
+		flags |= FLAGS_SHARED;
+	if (flags2 & FUTEX2_NUMA)
+		flags |= FLAGS_NUMA;
+
+	return flags;
+}
 
 #ifdef CONFIG_FAIL_FUTEX
 extern bool should_fail_futex(bool fshared);
@@ -46,8 +60,23 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+	/* waiters moved to the buckets of a resized process-private hash */
+	bool moved;
 } ____cacheline_aligned_in_smp;
 
+/*
+ * Process-private hash for the private futexes of an mm, see PR_FUTEX_HASH.
+ * Replaced tables stay around with all their buckets ->moved until the mm
+ * is freed, so that a stale bucket pointer is always safe to lock.
+ */
+struct futex_private_hash {
+	struct futex_private_hash	*replaced;
+	unsigned int			hash_mask;
+	/* sized by the number of threads, grows as threads are created */
+	bool				auto_size;
+	struct futex_hash_bucket	queues[];
+};
+
 /*
  * Priority Inheritance state:
  */
@@ -118,6 +147,8 @@ enum futex_access {
 
 extern int get_futex_key(u32 __user *uaddr, bool fshared, union futex_key *key,
 			 enum futex_access rw);
+extern int futex2_get_key(u32 __user *uaddr, unsigned int flags,
+			  union futex_key *key, enum futex_access rw);
 
 extern struct hrtimer_sleeper *
 futex_setup_timer(ktime_t *time, struct hrtimer_sleeper *timeout,
@@ -125,6 +156,26 @@ futex_setup_timer(ktime_t *time, struct hrtimer_sleeper *timeout,
 
 extern struct futex_hash_bucket *futex_hash(union futex_key *key);
 
+/*
+ * Whoever finds a bucket ->moved after taking its lock has to hash the key
+ * again, the bucket was left behind by a resize of the private hash. Drop
+ * the lock and futex_hash_wait_moved() first: the new hash is published
+ * once the whole resize is done.
+ */
+static inline bool futex_hb_moved(struct futex_hash_bucket *hb)
+{
+	lockdep_assert_held(&hb->lock);
+	return unlikely(hb->moved);
+}
+
+static inline bool futex_hb_moved2(struct futex_hash_bucket *hb1,
+				   struct futex_hash_bucket *hb2)
+{
+	return futex_hb_moved(hb1) || futex_hb_moved(hb2);
+}
+
+extern void futex_hash_wait_moved(union futex_key *key);
+
 /**
  * futex_match - Check whether two futex keys are equal
  * @key1:	Pointer to key1
@@ -152,6 +203,7 @@ extern int futex_get_value_locked(u32 *dest, u32 __user *from);
 extern struct futex_q *futex_top_waiter(struct futex_hash_bucket *hb, union futex_key *key);
 
 extern void __futex_unqueue(struct futex_q *q);
+extern void futex_q_lockptr_lock(struct futex_q *q);
 extern void __futex_queue(struct futex_q *q, struct futex_hash_bucket *hb);
 extern int futex_unqueue(struct futex_q *q);
 
@@ -260,9 +312,10 @@ extern int futex_wait_requeue_pi(u32 __user *uaddr, unsigned int flags, u32
 				 val, ktime_t *abs_time, u32 bitset, u32 __user
 				 *uaddr2);
 
-extern int futex_requeue(u32 __user *uaddr1, unsigned int flags,
-			 u32 __user *uaddr2, int nr_wake, int nr_requeue,
-			 u32 *cmpval, int requeue_pi);
+extern int futex_requeue(u32 __user *uaddr1, unsigned int flags1,
+			 u32 __user *uaddr2, unsigned int flags2,
+			 int nr_wake, int nr_requeue, u32 *cmpval,
+			 int requeue_pi);
 
 extern int futex_wait(u32 __user *uaddr, unsigned int flags, u32 val,
 		      ktime_t *abs_time, u32 bitset);
@@ -284,6 +337,8 @@ extern int futex_wait_multiple(struct futex_vector *vs, unsigned int count,
 
 extern int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset);
 
+extern int futex_wake_multiple(struct futex_waitv *ws, unsigned int count);
+
 extern int futex_wake_op(u32 __user *uaddr1, unsigned int flags,
 			 u32 __user *uaddr2, int nr_wake, int nr_wake2, int op);
 
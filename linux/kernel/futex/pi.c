@@ -818,7 +818,7 @@ handle_err:
 		break;
 	}
 
-	spin_lock(q->lock_ptr);
+	futex_q_lockptr_lock(q);
 	raw_spin_lock_irq(&pi_state->pi_mutex.wait_lock);
 
 	/*
@@ -1039,7 +1039,7 @@ retry_private:
 	ret = rt_mutex_wait_proxy_lock(&q.pi_state->pi_mutex, to, &rt_waiter);
 
 cleanup:
-	spin_lock(q.lock_ptr);
+	futex_q_lockptr_lock(&q);
 	/*
 	 * If we failed to acquire the lock (deadlock/signal/timeout), we must
 	 * first acquire the hb->lock before removing the lock from the
@@ -1123,6 +1123,11 @@ retry:
 
 	hb = futex_hash(&key);
 	spin_lock(&hb->lock);
+	if (futex_hb_moved(hb)) {
+		spin_unlock(&hb->lock);
+		futex_hash_wait_moved(&key);
+		goto retry;
+	}
 
 	/*
 	 * Check waiters first. We do not trust user space values at
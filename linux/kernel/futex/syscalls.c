@@ -82,6 +82,9 @@ err_unlock:
 	return ret;
 }
 
+static long futex_wakev(struct futex_waitv __user *waiters,
+			unsigned int nr_futexes, unsigned int flags);
+
 long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		u32 __user *uaddr2, u32 val2, u32 val3)
 {
@@ -110,9 +113,9 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 	case FUTEX_WAKE_BITSET:
 		return futex_wake(uaddr, flags, val, val3);
 	case FUTEX_REQUEUE:
-		return futex_requeue(uaddr, flags, uaddr2, val, val2, NULL, 0);
+		return futex_requeue(uaddr, flags, uaddr2, flags, val, val2, NULL, 0);
 	case FUTEX_CMP_REQUEUE:
-		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 0);
+		return futex_requeue(uaddr, flags, uaddr2, flags, val, val2, &val3, 0);
 	case FUTEX_WAKE_OP:
 		return futex_wake_op(uaddr, flags, uaddr2, val, val2, val3);
 	case FUTEX_LOCK_PI:
@@ -129,7 +132,12 @@ long do_futex(u32 __user *uaddr, int op, u32 val, ktime_t *timeout,
 		return futex_wait_requeue_pi(uaddr, flags, val, timeout, val3,
 					     uaddr2);
 	case FUTEX_CMP_REQUEUE_PI:
-		return futex_requeue(uaddr, flags, uaddr2, val, val2, &val3, 1);
+		return futex_requeue(uaddr, flags, uaddr2, flags, val, val2, &val3, 1);
+	case FUTEX_WAKEV:
+		/* each futex of the list has its own flags */
+		if (op & FUTEX_PRIVATE_FLAG)
+			return -EINVAL;
+		return futex_wakev((struct futex_waitv __user *)uaddr, val, val3);
 	}
 	return -ENOSYS;
 }
@@ -184,7 +192,23 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 }
 
 /* Mask of available flags for each futex in futex_waitv list */
-#define FUTEXV_WAITER_MASK (FUTEX_32 | FUTEX_PRIVATE_FLAG)
+#define FUTEXV_WAITER_MASK (FUTEX_32 | FUTEX_PRIVATE_FLAG | FUTEX2_NUMA)
+
+/* Copy one struct futex_waitv from userspace and check its flags */
+static int futex_copy_waitv(struct futex_waitv *w,
+			    struct futex_waitv __user *uw)
+{
+	if (copy_from_user(w, uw, sizeof(*w)))
+		return -EFAULT;
+
+	if ((w->flags & ~FUTEXV_WAITER_MASK) || w->__reserved)
+		return -EINVAL;
+
+	if (!(w->flags & FUTEX_32))
+		return -EINVAL;
+
+	return 0;
+}
 
 /**
  * futex_parse_waitv - Parse a waitv array from userspace
@@ -200,16 +224,12 @@ static int futex_parse_waitv(struct futex_vector *futexv,
 {
 	struct futex_waitv aux;
 	unsigned int i;
+	int ret;
 
 	for (i = 0; i < nr_futexes; i++) {
-		if (copy_from_user(&aux, &uwaitv[i], sizeof(aux)))
-			return -EFAULT;
-
-		if ((aux.flags & ~FUTEXV_WAITER_MASK) || aux.__reserved)
-			return -EINVAL;
-
-		if (!(aux.flags & FUTEX_32))
-			return -EINVAL;
+		ret = futex_copy_waitv(&aux, &uwaitv[i]);
+		if (ret)
+			return ret;
 
 		futexv[i].w.flags = aux.flags;
 		futexv[i].w.val = aux.val;
@@ -305,6 +325,100 @@ destroy_timer:
 	return ret;
 }
 
+/**
+ * futex_wakev - Wake waiters on a list of futexes
+ * @waiters:    List of futexes to wake
+ * @nr_futexes: Length of the list
+ * @flags:	Flags for the operation, must be 0 for now
+ *
+ * The counterpart of futex_waitv() for callers that have many futexes to
+ * wake at once. The val of each `struct futex_waitv` is the number of
+ * waiters to wake on its uaddr, 0 skips it. Each futex has individual flags
+ * as in futex_waitv(), and waiters only match futexes with the same flags.
+ *
+ * Returns the total number of woken waiters. If a futex fails, the list is
+ * not processed any further and its error is returned if nothing was woken
+ * before it.
+ *
+ * Reached through futex(@waiters, FUTEX_WAKEV, @nr_futexes, NULL, NULL,
+ * @flags), the timeout and second address are ignored. Unlike a syscall of
+ * its own, that needs no new syscall number on any architecture.
+ */
+static long futex_wakev(struct futex_waitv __user *waiters,
+			unsigned int nr_futexes, unsigned int flags)
+{
+	struct futex_waitv *futexv;
+	unsigned int i;
+	int ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!nr_futexes || nr_futexes > FUTEX_WAITV_MAX || !waiters)
+		return -EINVAL;
+
+	futexv = kcalloc(nr_futexes, sizeof(*futexv), GFP_KERNEL);
+	if (!futexv)
+		return -ENOMEM;
+
+	for (i = 0; i < nr_futexes; i++) {
+		ret = futex_copy_waitv(&futexv[i], &waiters[i]);
+		if (!ret && futexv[i].val > INT_MAX)
+			ret = -EINVAL;
+		if (ret)
+			goto out;
+	}
+
+	ret = futex_wake_multiple(futexv, nr_futexes);
+out:
+	kfree(futexv);
+	return ret;
+}
+
+/**
+ * sys_futex_requeue - Requeue waiters from one futex to another
+ * @waiters:	The source and the target futex
+ * @flags:	Flags for the syscall, must be 0 for now
+ * @nr_wake:	Number of waiters to wake on the source futex
+ * @nr_requeue:	Number of waiters to requeue to the target futex
+ *
+ * FUTEX_CMP_REQUEUE for futex2 futexes: @waiters[0] is the source futex, and
+ * its val is compared with the futex word as in FUTEX_CMP_REQUEUE.
+ * @waiters[1] is the target futex, its val is ignored. Both futexes have
+ * individual flags, so a futex can be requeued onto one of a different node.
+ *
+ * Returns the number of woken and requeued waiters.
+ */
+SYSCALL_DEFINE4(futex_requeue, struct futex_waitv __user *, waiters,
+		unsigned int, flags, int, nr_wake, int, nr_requeue)
+{
+	struct futex_waitv futexes[2];
+	u32 cmpval;
+	int ret;
+
+	if (flags)
+		return -EINVAL;
+
+	if (!waiters)
+		return -EINVAL;
+
+	ret = futex_copy_waitv(&futexes[0], &waiters[0]);
+	if (!ret)
+		ret = futex_copy_waitv(&futexes[1], &waiters[1]);
+	if (ret)
+		return ret;
+
+	if (futexes[0].val > U32_MAX)
+		return -EINVAL;
+	cmpval = futexes[0].val;
+
+	return futex_requeue(u64_to_user_ptr(futexes[0].uaddr),
+			     futex2_to_flags(futexes[0].flags),
+			     u64_to_user_ptr(futexes[1].uaddr),
+			     futex2_to_flags(futexes[1].flags),
+			     nr_wake, nr_requeue, &cmpval, 0);
+}
+
 #ifdef CONFIG_COMPAT
 COMPAT_SYSCALL_DEFINE2(set_robust_list,
 		struct compat_robust_list_head __user *, head,
@@ -138,23 +138,25 @@ void futex_wake_mark(struct wake_q_head *wake_q, struct futex_q *q)
 }
 
 /*
- * Wake up waiters matching bitset queued on this futex (uaddr).
+ * Mark waiters matching bitset queued on this futex (uaddr) for wakeup on
+ * @wake_q.
  */
-int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
+static int __futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake,
+			u32 bitset, struct wake_q_head *wake_q)
 {
 	struct futex_hash_bucket *hb;
 	struct futex_q *this, *next;
 	union futex_key key = FUTEX_KEY_INIT;
 	int ret;
-	DEFINE_WAKE_Q(wake_q);
 
 	if (!bitset)
 		return -EINVAL;
 
-	ret = get_futex_key(uaddr, flags & FLAGS_SHARED, &key, FUTEX_READ);
+	ret = futex2_get_key(uaddr, flags, &key, FUTEX_READ);
 	if (unlikely(ret != 0))
 		return ret;
 
+retry:
 	hb = futex_hash(&key);
 
 	/* Make sure we really have tasks to wakeup */
@@ -162,6 +164,11 @@ int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 		return ret;
 
 	spin_lock(&hb->lock);
+	if (futex_hb_moved(hb)) {
+		spin_unlock(&hb->lock);
+		futex_hash_wait_moved(&key);
+		goto retry;
+	}
 
 	plist_for_each_entry_safe(this, next, &hb->chain, list) {
 		if (futex_match (&this->key, &key)) {
@@ -174,17 +181,68 @@ int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
 			if (!(this->bitset & bitset))
 				continue;
 
-			futex_wake_mark(&wake_q, this);
+			futex_wake_mark(wake_q, this);
 			if (++ret >= nr_wake)
 				break;
 		}
 	}
 
 	spin_unlock(&hb->lock);
+	return ret;
+}
+
+/*
+ * Wake up waiters matching bitset queued on this futex (uaddr).
+ */
+int futex_wake(u32 __user *uaddr, unsigned int flags, int nr_wake, u32 bitset)
+{
+	DEFINE_WAKE_Q(wake_q);
+	int ret;
+
+	ret = __futex_wake(uaddr, flags, nr_wake, bitset, &wake_q);
 	wake_up_q(&wake_q);
 	return ret;
 }
 
+/**
+ * futex_wake_multiple - Wake up waiters on a list of futexes
+ * @ws:		The futexes, futex_waitv::val is the number of waiters to wake
+ * @count:	The size of the list
+ *
+ * Entry point for FUTEX_WAKEV. The woken tasks are collected over all
+ * futexes and only woken up once the last hash bucket lock is dropped, so a
+ * task waiting on several of the futexes is woken once.
+ *
+ * Return:
+ *  - >=0 - The number of woken waiters
+ *  - <0  - The error of the first futex that failed, if it failed before
+ *	    any waiter was woken
+ */
+int futex_wake_multiple(struct futex_waitv *ws, unsigned int count)
+{
+	int ret, woken = 0;
+	DEFINE_WAKE_Q(wake_q);
+	unsigned int i;
+
+	for (i = 0; i < count; i++) {
+		if (!ws[i].val)
+			continue;
+
+		ret = __futex_wake(u64_to_user_ptr(ws[i].uaddr),
+				   futex2_to_flags(ws[i].flags), ws[i].val,
+				   FUTEX_BITSET_MATCH_ANY, &wake_q);
+		if (ret < 0) {
+			if (!woken)
+				woken = ret;
+			break;
+		}
+		woken += ret;
+	}
+
+	wake_up_q(&wake_q);
+	return woken;
+}
+
 static int futex_atomic_op_inuser(unsigned int encoded_op, u32 __user *uaddr)
 {
 	unsigned int op =	  (encoded_op & 0x70000000) >> 28;
@@ -252,11 +310,17 @@ retry:
 	if (unlikely(ret != 0))
 		return ret;
 
+retry_private:
 	hb1 = futex_hash(&key1);
 	hb2 = futex_hash(&key2);
 
-retry_private:
 	double_lock_hb(hb1, hb2);
+	if (futex_hb_moved2(hb1, hb2)) {
+		double_unlock_hb(hb1, hb2);
+		futex_hash_wait_moved(&key1);
+		futex_hash_wait_moved(&key2);
+		goto retry_private;
+	}
 	op_ret = futex_atomic_op_inuser(op, uaddr2);
 	if (unlikely(op_ret < 0)) {
 		double_unlock_hb(hb1, hb2);
@@ -422,9 +486,9 @@ retry:
 		if ((vs[i].w.flags & FUTEX_PRIVATE_FLAG) && retry)
 			continue;
 
-		ret = get_futex_key(u64_to_user_ptr(vs[i].w.uaddr),
-				    !(vs[i].w.flags & FUTEX_PRIVATE_FLAG),
-				    &vs[i].q.key, FUTEX_READ);
+		ret = futex2_get_key(u64_to_user_ptr(vs[i].w.uaddr),
+				     futex2_to_flags(vs[i].w.flags),
+				     &vs[i].q.key, FUTEX_READ);
 
 		if (unlikely(ret))
 			return ret;
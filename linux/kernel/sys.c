@@ -39,6 +39,9 @@
 #include <linux/ptrace.h>
 #include <linux/fs_struct.h>
 #include <linux/file.h>
+#include <linux/fdtable.h>
+#include <linux/futex.h>
+#include <linux/poll.h>
 #include <linux/mount.h>
 #include <linux/gfp.h>
 #include <linux/syscore_ops.h>
@@ -2747,6 +2750,42 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 	case PR_RISCV_V_GET_CONTROL:
 		error = RISCV_V_GET_CONTROL();
 		break;
+	case PR_SET_FD_ALLOC:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = set_fd_alloc_mode(arg2);
+		break;
+	case PR_GET_FD_ALLOC:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = get_fd_alloc_mode();
+		break;
+	case PR_SET_EXEC_TEXT_PREFAULT:
+		if (arg2 > 1 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		if (arg2)
+			task_set_exec_text_prefault(current);
+		else
+			task_clear_exec_text_prefault(current);
+		break;
+	case PR_GET_EXEC_TEXT_PREFAULT:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = task_exec_text_prefault(current);
+		break;
+	case PR_SET_POLL_CACHE:
+		if (arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = set_poll_cache_mode(arg2);
+		break;
+	case PR_GET_POLL_CACHE:
+		if (arg2 || arg3 || arg4 || arg5)
+			return -EINVAL;
+		error = get_poll_cache_mode();
+		break;
+	case PR_FUTEX_HASH:
+		error = futex_hash_prctl(arg2, arg3, arg4, arg5);
+		break;
 	default:
 		error = -EINVAL;
 		break;
@@ -9,12 +9,14 @@
 #include <linux/ring_buffer.h>
 #include <linux/trace_clock.h>
 #include <linux/sched/clock.h>
+#include <linux/cacheflush.h>
 #include <linux/trace_seq.h>
 #include <linux/spinlock.h>
 #include <linux/irq_work.h>
 #include <linux/security.h>
 #include <linux/uaccess.h>
 #include <linux/hardirq.h>
+#include <linux/vmalloc.h>
 #include <linux/kthread.h>	/* for self test */
 #include <linux/module.h>
 #include <linux/percpu.h>
@@ -331,6 +333,7 @@ struct buffer_page {
 	unsigned	 read;		/* index for next read */
 	local_t		 entries;	/* entries on this page */
 	unsigned long	 real_end;	/* real end of data */
+	unsigned	 id;		/* ID for external mapping */
 	struct buffer_data_page *page;	/* Actual data page */
 };
 
@@ -536,6 +539,13 @@ struct ring_buffer_per_cpu {
 	struct completion		update_done;
 
 	struct rb_irq_work		irq_work;
+
+	/* protects the 0 <-> 1 transitions of mapped */
+	struct mutex			mapping_lock;
+	unsigned long			*subbuf_ids;	/* ID to subbuf addr */
+	struct trace_buffer_meta	*meta_page;
+	/* number of mappings, changes to and from 0 under reader_lock */
+	unsigned int			mapped;
 };
 
 struct trace_buffer {
@@ -1671,7 +1681,9 @@ static int __rb_allocate_pages(struct ring_buffer_per_cpu *cpu_buffer,
 
 		list_add(&bpage->list, pages);
 
-		page = alloc_pages_node(cpu_to_node(cpu_buffer->cpu), mflags, 0);
+		/* zeroed, as ring_buffer_map() hands the pages to user space */
+		page = alloc_pages_node(cpu_to_node(cpu_buffer->cpu),
+					mflags | __GFP_ZERO, 0);
 		if (!page)
 			goto free_pages;
 		bpage->page = page_address(page);
@@ -1741,6 +1753,7 @@ rb_allocate_cpu_buffer(struct trace_buffer *buffer, long nr_pages, int cpu)
 	cpu_buffer->lock = (arch_spinlock_t)__ARCH_SPIN_LOCK_UNLOCKED;
 	INIT_WORK(&cpu_buffer->update_pages_work, update_pages_handler);
 	init_completion(&cpu_buffer->update_done);
+	mutex_init(&cpu_buffer->mapping_lock);
 	init_irq_work(&cpu_buffer->irq_work.work, rb_wake_up_waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.waiters);
 	init_waitqueue_head(&cpu_buffer->irq_work.full_waiters);
@@ -1753,7 +1766,7 @@ rb_allocate_cpu_buffer(struct trace_buffer *buffer, long nr_pages, int cpu)
 	rb_check_bpage(cpu_buffer, bpage);
 
 	cpu_buffer->reader_page = bpage;
-	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL, 0);
+	page = alloc_pages_node(cpu_to_node(cpu), GFP_KERNEL | __GFP_ZERO, 0);
 	if (!page)
 		goto fail_free_reader;
 	bpage->page = page_address(page);
@@ -5255,6 +5268,8 @@ static void rb_clear_buffer_page(struct buffer_page *page)
 	page->read = 0;
 }
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer);
+
 static void
 rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 {
@@ -5301,6 +5316,9 @@ rb_reset_cpu(struct ring_buffer_per_cpu *cpu_buffer)
 
 	rb_head_page_activate(cpu_buffer);
 	cpu_buffer->pages_removed = 0;
+
+	if (cpu_buffer->mapped)
+		rb_update_meta_page(cpu_buffer);
 }
 
 /* Must have disabled the cpu buffer then done a synchronize_rcu */
@@ -5517,6 +5535,11 @@ int ring_buffer_swap_cpu(struct trace_buffer *buffer_a,
 	if (cpu_buffer_a->nr_pages != cpu_buffer_b->nr_pages)
 		goto out;
 
+	/* The pages of a mapped buffer must stay where user space sees them */
+	ret = -EBUSY;
+	if (cpu_buffer_a->mapped || cpu_buffer_b->mapped)
+		goto out;
+
 	ret = -EAGAIN;
 
 	if (atomic_read(&buffer_a->record_disabled))
@@ -5614,7 +5637,7 @@ void *ring_buffer_alloc_read_page(struct trace_buffer *buffer, int cpu)
 		goto out;
 
 	page = alloc_pages_node(cpu_to_node(cpu),
-				GFP_KERNEL | __GFP_NORETRY, 0);
+				GFP_KERNEL | __GFP_NORETRY | __GFP_ZERO, 0);
 	if (!page)
 		return ERR_PTR(-ENOMEM);
 
@@ -5750,12 +5773,14 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 	/*
 	 * If this page has been partially read or
 	 * if len is not big enough to read the rest of the page or
-	 * a writer is still on the page, then
+	 * a writer is still on the page or
+	 * the buffer is mapped to user space, then
 	 * we must copy the data from the page to the buffer.
 	 * Otherwise, we can simply swap the page with the one passed in.
 	 */
 	if (read || (len < (commit - read)) ||
-	    cpu_buffer->reader_page == cpu_buffer->commit_page) {
+	    cpu_buffer->reader_page == cpu_buffer->commit_page ||
+	    cpu_buffer->mapped) {
 		struct buffer_data_page *rpage = cpu_buffer->reader_page->page;
 		unsigned int rpos = read;
 		unsigned int pos = 0;
@@ -5768,7 +5793,7 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 		 * the reader page.
 		 */
 		if (full &&
-		    (!read || (len < (commit - read)) ||
+		    ((!read && !cpu_buffer->mapped) || (len < (commit - read)) ||
 		     cpu_buffer->reader_page == cpu_buffer->commit_page))
 			goto out_unlock;
 
@@ -5872,6 +5897,346 @@ int ring_buffer_read_page(struct trace_buffer *buffer,
 }
 EXPORT_SYMBOL_GPL(ring_buffer_read_page);
 
+static void rb_update_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+
+	meta->reader.read = cpu_buffer->reader_page->read;
+	meta->reader.id = cpu_buffer->reader_page->id;
+	meta->reader.lost_events = cpu_buffer->lost_events;
+
+	meta->entries = local_read(&cpu_buffer->entries);
+	meta->overrun = local_read(&cpu_buffer->overrun);
+	meta->read = cpu_buffer->read;
+
+	/* Some archs do not have data cache coherency between kernel and user-space */
+	flush_dcache_folio(virt_to_folio(cpu_buffer->meta_page));
+}
+
+/*
+ * Give every sub-buffer its place in the mapping: the reader page
+ * first, then the pages of the ring starting from any of them. The
+ * IDs stay attached to the buffer_page as it moves in and out of the
+ * reader slot.
+ */
+static void rb_setup_ids_meta_page(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer_meta *meta = cpu_buffer->meta_page;
+	unsigned long *subbuf_ids = cpu_buffer->subbuf_ids;
+	struct buffer_page *first_subbuf, *subbuf;
+	unsigned int id = 0;
+
+	subbuf_ids[id] = (unsigned long)cpu_buffer->reader_page->page;
+	cpu_buffer->reader_page->id = id++;
+
+	first_subbuf = subbuf = list_entry(cpu_buffer->pages,
+					   struct buffer_page, list);
+	do {
+		if (RB_WARN_ON(cpu_buffer, id > cpu_buffer->nr_pages))
+			break;
+
+		subbuf_ids[id] = (unsigned long)subbuf->page;
+		subbuf->id = id++;
+
+		rb_inc_page(&subbuf);
+	} while (subbuf != first_subbuf);
+
+	meta->meta_page_size = PAGE_SIZE;
+	meta->meta_struct_len = sizeof(*meta);
+	meta->subbuf_size = PAGE_SIZE;
+	meta->nr_subbufs = cpu_buffer->nr_pages + 1;
+
+	rb_update_meta_page(cpu_buffer);
+}
+
+static struct ring_buffer_per_cpu *
+rb_get_mapped_buffer(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long *subbuf_ids;
+	unsigned long flags;
+	void *meta;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return ERR_PTR(-EINVAL);
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (cpu_buffer->mapped) {
+		cpu_buffer->mapped++;
+		goto out;
+	}
+
+	/* The pages must not change while they are mapped */
+	mutex_lock(&buffer->mutex);
+	atomic_inc(&cpu_buffer->resize_disabled);
+	mutex_unlock(&buffer->mutex);
+
+	meta = (void *)get_zeroed_page(GFP_KERNEL);
+	subbuf_ids = kcalloc(cpu_buffer->nr_pages + 1, sizeof(*subbuf_ids),
+			     GFP_KERNEL);
+	if (!meta || !subbuf_ids) {
+		free_page((unsigned long)meta);
+		kfree(subbuf_ids);
+		atomic_dec(&cpu_buffer->resize_disabled);
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->meta_page = meta;
+	cpu_buffer->subbuf_ids = subbuf_ids;
+	rb_setup_ids_meta_page(cpu_buffer);
+	cpu_buffer->mapped = 1;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return ret ? ERR_PTR(ret) : cpu_buffer;
+}
+
+static int rb_put_mapped_buffer(struct ring_buffer_per_cpu *cpu_buffer)
+{
+	struct trace_buffer *buffer = cpu_buffer->buffer;
+	unsigned long flags;
+	int ret = 0;
+
+	mutex_lock(&cpu_buffer->mapping_lock);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out;
+	}
+
+	if (cpu_buffer->mapped > 1) {
+		cpu_buffer->mapped--;
+		goto out;
+	}
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+	cpu_buffer->mapped = 0;
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	free_page((unsigned long)cpu_buffer->meta_page);
+	cpu_buffer->meta_page = NULL;
+	kfree(cpu_buffer->subbuf_ids);
+	cpu_buffer->subbuf_ids = NULL;
+
+	mutex_lock(&buffer->mutex);
+	atomic_dec(&cpu_buffer->resize_disabled);
+	mutex_unlock(&buffer->mutex);
+ out:
+	mutex_unlock(&cpu_buffer->mapping_lock);
+
+	return ret;
+}
+
+/*
+ * Fill @pages with the pages of the mapping layout, starting at page
+ * @pgoff: the meta page first, then the sub-buffers in ID order.
+ */
+static int rb_get_map_pages(struct ring_buffer_per_cpu *cpu_buffer,
+			    struct page **pages, unsigned long pgoff,
+			    unsigned long nr_pages)
+{
+	unsigned long nr_subbufs = cpu_buffer->nr_pages + 1;
+	unsigned long p = 0;
+
+	if (!nr_pages || pgoff > nr_subbufs ||
+	    nr_pages > nr_subbufs + 1 - pgoff)
+		return -EINVAL;
+
+	if (!pgoff)
+		pages[p++] = virt_to_page(cpu_buffer->meta_page);
+	else
+		pgoff--;
+
+	for (; p < nr_pages; p++, pgoff++)
+		pages[p] = virt_to_page((void *)cpu_buffer->subbuf_ids[pgoff]);
+
+	return 0;
+}
+
+/**
+ * ring_buffer_map - map a per-CPU ring buffer into user space
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to map
+ * @vma: The read-only, shared mapping to populate
+ *
+ * Inserts the meta page and the sub-buffers of the @cpu buffer into
+ * @vma, following the layout described in struct trace_buffer_meta.
+ * As long as a buffer is mapped, it can't be resized or swapped and
+ * ring_buffer_read_page() copies the data instead of swapping pages,
+ * so that the mapped pages always remain those of the buffer.
+ *
+ * Returns 0 on success, or a negative error code.
+ */
+int ring_buffer_map(struct trace_buffer *buffer, int cpu,
+		    struct vm_area_struct *vma)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long nr_pages = vma_pages(vma);
+	struct page **pages;
+	int ret;
+
+	if (vma->vm_flags & VM_WRITE || vma->vm_flags & VM_EXEC ||
+	    !(vma->vm_flags & VM_MAYSHARE))
+		return -EPERM;
+
+	cpu_buffer = rb_get_mapped_buffer(buffer, cpu);
+	if (IS_ERR(cpu_buffer))
+		return PTR_ERR(cpu_buffer);
+
+	pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (!pages) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	ret = rb_get_map_pages(cpu_buffer, pages, vma->vm_pgoff, nr_pages);
+	if (ret)
+		goto out;
+
+	vm_flags_mod(vma, VM_DONTCOPY | VM_DONTDUMP | VM_DONTEXPAND,
+		     VM_MAYWRITE);
+
+	ret = vm_insert_pages(vma, vma->vm_start, pages, &nr_pages);
+ out:
+	kfree(pages);
+	if (ret)
+		rb_put_mapped_buffer(cpu_buffer);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map);
+
+/**
+ * ring_buffer_unmap - drop a mapping of a per-CPU ring buffer
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer that was mapped
+ *
+ * Undoes a successful ring_buffer_map(), once the mapping is gone.
+ *
+ * Returns 0 on success, -ENODEV if the buffer was not mapped.
+ */
+int ring_buffer_unmap(struct trace_buffer *buffer, int cpu)
+{
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	return rb_put_mapped_buffer(buffer->buffers[cpu]);
+}
+EXPORT_SYMBOL_GPL(ring_buffer_unmap);
+
+/**
+ * ring_buffer_vmap - map a per-CPU ring buffer into the kernel
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer to map
+ *
+ * Same as ring_buffer_map(), but for in-kernel readers: the returned
+ * read-only area has the layout of a user space mapping, and is
+ * released with ring_buffer_vunmap().
+ *
+ * Returns the address of the meta page, or NULL on failure.
+ */
+void *ring_buffer_vmap(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	unsigned long nr_pages;
+	struct page **pages;
+	void *addr = NULL;
+
+	cpu_buffer = rb_get_mapped_buffer(buffer, cpu);
+	if (IS_ERR(cpu_buffer))
+		return NULL;
+
+	nr_pages = cpu_buffer->nr_pages + 2;
+	pages = kcalloc(nr_pages, sizeof(*pages), GFP_KERNEL);
+	if (pages && !rb_get_map_pages(cpu_buffer, pages, 0, nr_pages))
+		addr = vmap(pages, nr_pages, VM_MAP, PAGE_KERNEL_RO);
+	kfree(pages);
+
+	if (!addr)
+		rb_put_mapped_buffer(cpu_buffer);
+
+	return addr;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_vmap);
+
+/**
+ * ring_buffer_vunmap - release a kernel mapping of a per-CPU ring buffer
+ * @buffer: The ring buffer
+ * @cpu: The CPU buffer that was mapped
+ * @addr: The address returned by ring_buffer_vmap()
+ */
+void ring_buffer_vunmap(struct trace_buffer *buffer, int cpu, void *addr)
+{
+	vunmap(addr);
+	WARN_ON(ring_buffer_unmap(buffer, cpu));
+}
+EXPORT_SYMBOL_GPL(ring_buffer_vunmap);
+
+/**
+ * ring_buffer_map_get_reader - hand the next data over to a mapped reader
+ * @buffer: The ring buffer
+ * @cpu: The mapped CPU buffer
+ *
+ * Accounts everything committed to the reader sub-buffer so far as
+ * read, swapping in the next sub-buffer first if the current one was
+ * already handed over in full, and publishes the new reader state in
+ * the meta page. The reader then consumes the reader sub-buffer up to
+ * meta->reader.read directly from the mapping.
+ *
+ * Returns 0 on success, -ENODEV if the buffer is not mapped.
+ */
+int ring_buffer_map_get_reader(struct trace_buffer *buffer, int cpu)
+{
+	struct ring_buffer_per_cpu *cpu_buffer;
+	struct buffer_page *reader;
+	unsigned long flags;
+	int ret = 0;
+
+	if (!cpumask_test_cpu(cpu, buffer->cpumask))
+		return -EINVAL;
+
+	cpu_buffer = buffer->buffers[cpu];
+
+	raw_spin_lock_irqsave(&cpu_buffer->reader_lock, flags);
+
+	if (!cpu_buffer->mapped) {
+		ret = -ENODEV;
+		goto out_unlock;
+	}
+
+	/* Only swaps if the current reader page has been fully read */
+	reader = rb_get_reader_page(cpu_buffer);
+	if (!reader)
+		goto out;
+
+	while (reader->read < rb_page_size(reader))
+		rb_advance_reader(cpu_buffer);
+
+	/* Some archs do not have data cache coherency between kernel and user-space */
+	flush_dcache_folio(virt_to_folio(reader->page));
+ out:
+	/*
+	 * The ring pages are shared with the writer, so unlike
+	 * ring_buffer_read_page() the lost events can't be stored at the
+	 * end of the page: they are only reported in the meta page.
+	 */
+	rb_update_meta_page(cpu_buffer);
+	cpu_buffer->lost_events = 0;
+ out_unlock:
+	raw_spin_unlock_irqrestore(&cpu_buffer->reader_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(ring_buffer_map_get_reader);
+
 /*
  * We only allocate new buffers, never free them if the CPU goes down.
  * If we were to free the buffer, then the user would lose any trace that was in
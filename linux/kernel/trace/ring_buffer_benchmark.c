@@ -60,7 +60,30 @@ MODULE_PARM_DESC(producer_fifo, "use fifo for producer: 0 - disabled, 1 - low pr
 module_param(consumer_fifo, int, 0644);
 MODULE_PARM_DESC(consumer_fifo, "use fifo for consumer: 0 - disabled, 1 - low prio, 2 - fifo");
 
-static int read_events;
+/* how the consumer reads, changes on every run */
+enum read_mode {
+	READ_EVENTS,
+	READ_PAGES,
+	READ_MAPPED,
+	NR_READ_MODES,
+};
+
+static const char * const read_mode_names[] = {
+	[READ_EVENTS]	= "events",
+	[READ_PAGES]	= "pages",
+	[READ_MAPPED]	= "mapped pages",
+};
+
+static int read_mode = NR_READ_MODES - 1;
+
+/* what a user space reader of a mapped trace_pipe_raw keeps per CPU */
+struct rb_mapped {
+	struct trace_buffer_meta	*meta;
+	unsigned int			id;
+	unsigned int			read;
+};
+
+static DEFINE_PER_CPU(struct rb_mapped, rb_mapped);
 
 static int test_error;
 
@@ -102,76 +125,83 @@ static enum event_status read_event(int cpu)
 	return EVENT_FOUND;
 }
 
-static enum event_status read_page(int cpu)
+static void read_page_data(struct rb_page *rpage, int cpu,
+			   unsigned long start, unsigned long commit)
 {
 	struct ring_buffer_event *event;
-	struct rb_page *rpage;
-	unsigned long commit;
-	void *bpage;
 	int *entry;
-	int ret;
 	int inc;
 	int i;
 
-	bpage = ring_buffer_alloc_read_page(buffer, cpu);
-	if (IS_ERR(bpage))
-		return EVENT_DROPPED;
+	for (i = start; i < commit && !test_error ; i += inc) {
 
-	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
-	if (ret >= 0) {
-		rpage = bpage;
-		/* The commit may have missed event flags set, clear them */
-		commit = local_read(&rpage->commit) & 0xfffff;
-		for (i = 0; i < commit && !test_error ; i += inc) {
+		if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+			TEST_ERROR();
+			break;
+		}
 
-			if (i >= (PAGE_SIZE - offsetof(struct rb_page, data))) {
+		inc = -1;
+		event = (void *)&rpage->data[i];
+		switch (event->type_len) {
+		case RINGBUF_TYPE_PADDING:
+			/* failed writes may be discarded events */
+			if (!event->time_delta)
+				TEST_ERROR();
+			inc = event->array[0] + 4;
+			break;
+		case RINGBUF_TYPE_TIME_EXTEND:
+			inc = 8;
+			break;
+		case 0:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				TEST_ERROR();
 				break;
 			}
-
-			inc = -1;
-			event = (void *)&rpage->data[i];
-			switch (event->type_len) {
-			case RINGBUF_TYPE_PADDING:
-				/* failed writes may be discarded events */
-				if (!event->time_delta)
-					TEST_ERROR();
-				inc = event->array[0] + 4;
-				break;
-			case RINGBUF_TYPE_TIME_EXTEND:
-				inc = 8;
-				break;
-			case 0:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					TEST_ERROR();
-					break;
-				}
-				read++;
-				if (!event->array[0]) {
-					TEST_ERROR();
-					break;
-				}
-				inc = event->array[0] + 4;
+			read++;
+			if (!event->array[0]) {
+				TEST_ERROR();
 				break;
-			default:
-				entry = ring_buffer_event_data(event);
-				if (*entry != cpu) {
-					TEST_ERROR();
-					break;
-				}
-				read++;
-				inc = ((event->type_len + 1) * 4);
 			}
-			if (test_error)
-				break;
-
-			if (inc <= 0) {
+			inc = event->array[0] + 4;
+			break;
+		default:
+			entry = ring_buffer_event_data(event);
+			if (*entry != cpu) {
 				TEST_ERROR();
 				break;
 			}
+			read++;
+			inc = ((event->type_len + 1) * 4);
+		}
+		if (test_error)
+			break;
+
+		if (inc <= 0) {
+			TEST_ERROR();
+			break;
 		}
 	}
+}
+
+static enum event_status read_page(int cpu)
+{
+	struct rb_page *rpage;
+	unsigned long commit;
+	void *bpage;
+	int ret;
+
+	bpage = ring_buffer_alloc_read_page(buffer, cpu);
+	if (IS_ERR(bpage))
+		return EVENT_DROPPED;
+
+	ret = ring_buffer_read_page(buffer, &bpage, PAGE_SIZE, cpu, 1);
+	if (ret >= 0) {
+		rpage = bpage;
+		/* The commit may have missed event flags set, clear them */
+		commit = local_read(&rpage->commit) & 0xfffff;
+		read_page_data(rpage, cpu, 0, commit);
+	}
 	ring_buffer_free_read_page(buffer, cpu, bpage);
 
 	if (ret < 0)
@@ -179,10 +209,71 @@ static enum event_status read_page(int cpu)
 	return EVENT_FOUND;
 }
 
+/* Read the sub-buffers in place, the way a reader of a mapping does */
+static enum event_status read_mapped(int cpu)
+{
+	struct rb_mapped *mapped = per_cpu_ptr(&rb_mapped, cpu);
+	struct trace_buffer_meta *meta = mapped->meta;
+	unsigned int start;
+	void *subbuf;
+
+	if (ring_buffer_map_get_reader(buffer, cpu)) {
+		TEST_ERROR();
+		return EVENT_DROPPED;
+	}
+
+	start = meta->reader.id == mapped->id ? mapped->read : 0;
+	mapped->id = meta->reader.id;
+	mapped->read = meta->reader.read;
+
+	if (start >= mapped->read)
+		return EVENT_DROPPED;
+
+	subbuf = (void *)meta + meta->meta_page_size +
+		 mapped->id * meta->subbuf_size;
+	read_page_data(subbuf, cpu, start, mapped->read);
+
+	return EVENT_FOUND;
+}
+
+static void map_buffers(void)
+{
+	struct rb_mapped *mapped;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		mapped = per_cpu_ptr(&rb_mapped, cpu);
+		mapped->meta = ring_buffer_vmap(buffer, cpu);
+		if (!mapped->meta) {
+			TEST_ERROR();
+			continue;
+		}
+		mapped->id = mapped->meta->reader.id;
+		mapped->read = mapped->meta->reader.read;
+	}
+}
+
+static void unmap_buffers(void)
+{
+	struct rb_mapped *mapped;
+	int cpu;
+
+	for_each_online_cpu(cpu) {
+		mapped = per_cpu_ptr(&rb_mapped, cpu);
+		if (!mapped->meta)
+			continue;
+		ring_buffer_vunmap(buffer, cpu, mapped->meta);
+		mapped->meta = NULL;
+	}
+}
+
 static void ring_buffer_consumer(void)
 {
-	/* toggle between reading pages and events */
-	read_events ^= 1;
+	/* rotate between reading events, pages and mapped pages */
+	read_mode = (read_mode + 1) % NR_READ_MODES;
+
+	if (read_mode == READ_MAPPED)
+		map_buffers();
 
 	read = 0;
 	/*
@@ -199,10 +290,12 @@ static void ring_buffer_consumer(void)
 			for_each_online_cpu(cpu) {
 				enum event_status stat;
 
-				if (read_events)
+				if (read_mode == READ_EVENTS)
 					stat = read_event(cpu);
-				else
+				else if (read_mode == READ_PAGES)
 					stat = read_page(cpu);
+				else
+					stat = read_mapped(cpu);
 
 				if (test_error)
 					break;
@@ -223,6 +316,10 @@ static void ring_buffer_consumer(void)
 		schedule();
 	}
 	__set_current_state(TASK_RUNNING);
+
+	if (read_mode == READ_MAPPED)
+		unmap_buffers();
+
 	reader_finish = 0;
 	complete(&read_done);
 }
@@ -328,7 +425,7 @@ static void ring_buffer_producer(void)
 		trace_printk("Read:     (reader disabled)\n");
 	else
 		trace_printk("Read:     %ld  (by %s)\n", read,
-			read_events ? "events" : "pages");
+			read_mode_names[read_mode]);
 	trace_printk("Entries:  %lld\n", entries);
 	trace_printk("Total:    %lld\n", entries + overruns + read);
 	trace_printk("Missed:   %ld\n", missed);
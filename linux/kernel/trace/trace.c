@@ -866,6 +866,12 @@ static struct tracer		*trace_types __read_mostly;
  */
 DEFINE_MUTEX(trace_types_lock);
 
+/*
+ * buffers_map_lock serializes mapping the trace_pipe_raw files of
+ * an instance against allocating its snapshot buffer.
+ */
+static DEFINE_MUTEX(buffers_map_lock);
+
 /*
  * serialize the access of the ring buffer
  *
@@ -1263,20 +1269,31 @@ static void set_buffer_entries(struct array_buffer *buf, unsigned long val);
 
 int tracing_alloc_snapshot_instance(struct trace_array *tr)
 {
-	int ret;
+	int ret = 0;
 
-	if (!tr->allocated_snapshot) {
+	if (tr->allocated_snapshot)
+		return 0;
 
-		/* allocate spare buffer */
-		ret = resize_buffer_duplicate_size(&tr->max_buffer,
-				   &tr->array_buffer, RING_BUFFER_ALL_CPUS);
-		if (ret < 0)
-			return ret;
+	mutex_lock(&buffers_map_lock);
 
-		tr->allocated_snapshot = true;
+	/* Taking a snapshot would swap mapped pages out of the buffer */
+	if (tr->mapped) {
+		ret = -EBUSY;
+		goto out;
 	}
 
-	return 0;
+	/* allocate spare buffer */
+	ret = resize_buffer_duplicate_size(&tr->max_buffer,
+			   &tr->array_buffer, RING_BUFFER_ALL_CPUS);
+	if (ret < 0)
+		goto out;
+
+	tr->allocated_snapshot = true;
+	ret = 0;
+ out:
+	mutex_unlock(&buffers_map_lock);
+
+	return ret;
 }
 
 static void free_snapshot(struct trace_array *tr)
@@ -5821,6 +5838,8 @@ static const char readme_msg[] =
 	"\t            [:pause][:continue][:clear]\n"
 	"\t            [:name=histname1]\n"
 	"\t            [:nohitcount]\n"
+	"\t            [:top=#entries]\n"
+	"\t            [:percpu][:drain]\n"
 	"\t            [:<handler>.<action>]\n"
 	"\t            [if <filter>]\n\n"
 	"\t    Note, special fields can be used as well:\n"
@@ -5879,6 +5898,16 @@ static const char readme_msg[] =
 	"\t    unchanged.\n\n"
 	"\t    The 'nohitcount' (or NOHC) parameter will suppress display of\n"
 	"\t    raw hitcount in the histogram.\n\n"
+	"\t    The 'top' parameter limits the display to the given number\n"
+	"\t    of entries that sort first.  .percent and .graph are then\n"
+	"\t    relative to the displayed entries.\n\n"
+	"\t    The 'percpu' parameter makes each CPU update its own hash\n"
+	"\t    table, which are summed up when the 'hist' file is read.\n"
+	"\t    This avoids contention between CPUs hitting the same keys,\n"
+	"\t    but uses one table of 'size' entries per CPU and can't be\n"
+	"\t    combined with variables or actions.  With 'drain', reading\n"
+	"\t    the 'hist' file also resets the counts, so that each read\n"
+	"\t    shows the events since the previous one.\n\n"
 	"\t    The enable_hist and disable_hist triggers can be used to\n"
 	"\t    have one event conditionally start and stop another event's\n"
 	"\t    already-attached hist trigger.  The syntax is analogous to\n"
@@ -7588,6 +7617,7 @@ struct ftrace_buffer_info {
 	void			*spare;
 	unsigned int		spare_cpu;
 	unsigned int		read;
+	unsigned int		mapped;
 };
 
 #ifdef CONFIG_TRACER_SNAPSHOT
@@ -8384,6 +8414,17 @@ static int tracing_buffers_release(struct inode *inode, struct file *file)
 
 	__trace_array_put(iter->tr);
 
+	/* The mappings hold a reference on the file, so they are all gone */
+	if (info->mapped) {
+		mutex_lock(&buffers_map_lock);
+		for (; info->mapped; info->mapped--) {
+			WARN_ON(ring_buffer_unmap(iter->array_buffer->buffer,
+						  iter->cpu_file));
+			iter->tr->mapped--;
+		}
+		mutex_unlock(&buffers_map_lock);
+	}
+
 	if (info->spare)
 		ring_buffer_free_read_page(iter->array_buffer->buffer,
 					   info->spare_cpu, info->spare);
@@ -8571,11 +8612,29 @@ out:
 	return ret;
 }
 
-/* An ioctl call with cmd 0 to the ring buffer file will wake up all waiters */
+/*
+ * An ioctl call with cmd 0 to the ring buffer file will wake up all waiters.
+ * TRACE_MMAP_IOCTL_GET_READER hands the next data over to a mapped reader.
+ */
 static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 {
 	struct ftrace_buffer_info *info = file->private_data;
 	struct trace_iterator *iter = &info->iter;
+	int ret;
+
+	if (cmd == TRACE_MMAP_IOCTL_GET_READER) {
+		if (!info->mapped)
+			return -ENODEV;
+
+		if (!(file->f_flags & O_NONBLOCK)) {
+			ret = wait_on_pipe(iter, iter->tr->buffer_percent);
+			if (ret)
+				return ret;
+		}
+
+		return ring_buffer_map_get_reader(iter->array_buffer->buffer,
+						  iter->cpu_file);
+	}
 
 	if (cmd)
 		return -ENOIOCTLCMD;
@@ -8592,6 +8651,39 @@ static long tracing_buffers_ioctl(struct file *file, unsigned int cmd, unsigned
 	return 0;
 }
 
+/*
+ * Map the meta page and the sub-buffers of the per-CPU buffer, read-only.
+ * The buffer stays mapped, which prevents resizing it or allocating the
+ * snapshot buffer, until the file is closed.
+ */
+static int tracing_buffers_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	struct ftrace_buffer_info *info = filp->private_data;
+	struct trace_iterator *iter = &info->iter;
+	struct trace_array *tr = iter->tr;
+	int ret = 0;
+
+	mutex_lock(&buffers_map_lock);
+
+#ifdef CONFIG_TRACER_MAX_TRACE
+	if (tr->allocated_snapshot) {
+		ret = -EBUSY;
+		goto out;
+	}
+#endif
+
+	ret = ring_buffer_map(iter->array_buffer->buffer, iter->cpu_file, vma);
+	if (ret)
+		goto out;
+
+	info->mapped++;
+	tr->mapped++;
+ out:
+	mutex_unlock(&buffers_map_lock);
+
+	return ret;
+}
+
 static const struct file_operations tracing_buffers_fops = {
 	.open		= tracing_buffers_open,
 	.read		= tracing_buffers_read,
@@ -8600,6 +8692,7 @@ static const struct file_operations tracing_buffers_fops = {
 	.flush		= tracing_buffers_flush,
 	.splice_read	= tracing_buffers_splice_read,
 	.unlocked_ioctl = tracing_buffers_ioctl,
+	.mmap		= tracing_buffers_mmap,
 	.llseek		= no_llseek,
 };
 
@@ -391,6 +391,8 @@ struct trace_array {
 	cpumask_var_t		pipe_cpumask;
 	int			ref;
 	int			trace_ref;
+	/* mapped trace_pipe_raw buffers, protected by buffers_map_lock */
+	int			mapped;
 #ifdef CONFIG_FUNCTION_TRACER
 	struct ftrace_ops	*ops;
 	struct trace_pid_list	__rcu *function_pids;
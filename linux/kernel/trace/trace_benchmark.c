@@ -1,4 +1,5 @@
 // SPDX-License-Identifier: GPL-2.0
+#include <linux/cpu.h>
 #include <linux/delay.h>
 #include <linux/module.h>
 #include <linux/kthread.h>
@@ -7,20 +8,34 @@
 #define CREATE_TRACE_POINTS
 #include "trace_benchmark.h"
 
-static struct task_struct *bm_event_thread;
+struct bm_stats {
+	struct task_struct	*thread;
+	char			str[BENCHMARK_EVENT_STRLEN];
+	u64			total;
+	u64			totalsq;
+	u64			last;
+	u64			max;
+	u64			min;
+	u64			first;
+	u64			cnt;
+	u64			stddev;
+	unsigned int		avg;
+	unsigned int		std;
+};
+
+static struct bm_stats bm_stats;
+static DEFINE_PER_CPU(struct bm_stats, bm_cpu_stats);
 
-static char bm_str[BENCHMARK_EVENT_STRLEN] = "START";
+/*
+ * Run one benchmark thread per online CPU instead of a single one,
+ * to measure what the tracepoint costs when all CPUs hit it at once
+ * (for instance with a hist trigger attached to it).
+ */
+static bool bm_per_cpu;
+module_param_named(per_cpu, bm_per_cpu, bool, 0644);
+MODULE_PARM_DESC(per_cpu, "Run a benchmark thread on every online CPU");
 
-static u64 bm_total;
-static u64 bm_totalsq;
-static u64 bm_last;
-static u64 bm_max;
-static u64 bm_min;
-static u64 bm_first;
-static u64 bm_cnt;
-static u64 bm_stddev;
-static unsigned int bm_avg;
-static unsigned int bm_std;
+static bool bm_running_per_cpu;
 
 static bool ok_to_run;
 
@@ -29,12 +44,12 @@ static bool ok_to_run;
  * the tracepoint. What it writes is the time statistics of the last
  * tracepoint write. As there is nothing to write the first time
  * it simply writes "START". As the first write is cold cache and
- * the rest is hot, we save off that time in bm_first and it is
+ * the rest is hot, we save off that time in bm->first and it is
  * reported as "first", which is shown in the second write to the
  * tracepoint. The "first" field is written within the statics from
  * then on but never changes.
  */
-static void trace_do_benchmark(void)
+static void trace_do_benchmark(struct bm_stats *bm)
 {
 	u64 start;
 	u64 stop;
@@ -51,11 +66,11 @@ static void trace_do_benchmark(void)
 
 	local_irq_disable();
 	start = trace_clock_local();
-	trace_benchmark_event(bm_str, bm_last);
+	trace_benchmark_event(bm->str, bm->last);
 	stop = trace_clock_local();
 	local_irq_enable();
 
-	bm_cnt++;
+	bm->cnt++;
 
 	delta = stop - start;
 
@@ -63,49 +78,50 @@ static void trace_do_benchmark(void)
 	 * The first read is cold cached, keep it separate from the
 	 * other calculations.
 	 */
-	if (bm_cnt == 1) {
-		bm_first = delta;
-		scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
-			  "first=%llu [COLD CACHED]", bm_first);
+	if (bm->cnt == 1) {
+		bm->first = delta;
+		scnprintf(bm->str, BENCHMARK_EVENT_STRLEN,
+			  "first=%llu [COLD CACHED]", bm->first);
 		return;
 	}
 
-	bm_last = delta;
+	bm->last = delta;
 
-	if (delta > bm_max)
-		bm_max = delta;
-	if (!bm_min || delta < bm_min)
-		bm_min = delta;
+	if (delta > bm->max)
+		bm->max = delta;
+	if (!bm->min || delta < bm->min)
+		bm->min = delta;
 
 	/*
-	 * When bm_cnt is greater than UINT_MAX, it breaks the statistics
+	 * When bm->cnt is greater than UINT_MAX, it breaks the statistics
 	 * accounting. Freeze the statistics when that happens.
 	 * We should have enough data for the avg and stddev anyway.
 	 */
-	if (bm_cnt > UINT_MAX) {
-		scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
+	if (bm->cnt > UINT_MAX) {
+		scnprintf(bm->str, BENCHMARK_EVENT_STRLEN,
 		    "last=%llu first=%llu max=%llu min=%llu ** avg=%u std=%d std^2=%lld",
-			  bm_last, bm_first, bm_max, bm_min, bm_avg, bm_std, bm_stddev);
+			  bm->last, bm->first, bm->max, bm->min, bm->avg,
+			  bm->std, bm->stddev);
 		return;
 	}
 
-	bm_total += delta;
-	bm_totalsq += delta * delta;
+	bm->total += delta;
+	bm->totalsq += delta * delta;
 
 
-	if (bm_cnt > 1) {
+	if (bm->cnt > 1) {
 		/*
 		 * Apply Welford's method to calculate standard deviation:
 		 * s^2 = 1 / (n * (n-1)) * (n * \Sum (x_i)^2 - (\Sum x_i)^2)
 		 */
-		stddev = (u64)bm_cnt * bm_totalsq - bm_total * bm_total;
-		do_div(stddev, (u32)bm_cnt);
-		do_div(stddev, (u32)bm_cnt - 1);
+		stddev = (u64)bm->cnt * bm->totalsq - bm->total * bm->total;
+		do_div(stddev, (u32)bm->cnt);
+		do_div(stddev, (u32)bm->cnt - 1);
 	} else
 		stddev = 0;
 
-	delta = bm_total;
-	do_div(delta, bm_cnt);
+	delta = bm->total;
+	do_div(delta, bm->cnt);
 	avg = delta;
 
 	if (stddev > 0) {
@@ -135,23 +151,25 @@ static void trace_do_benchmark(void)
 		std = seed;
 	}
 
-	scnprintf(bm_str, BENCHMARK_EVENT_STRLEN,
+	scnprintf(bm->str, BENCHMARK_EVENT_STRLEN,
 		  "last=%llu first=%llu max=%llu min=%llu avg=%u std=%d std^2=%lld",
-		  bm_last, bm_first, bm_max, bm_min, avg, std, stddev);
+		  bm->last, bm->first, bm->max, bm->min, avg, std, stddev);
 
-	bm_std = std;
-	bm_avg = avg;
-	bm_stddev = stddev;
+	bm->std = std;
+	bm->avg = avg;
+	bm->stddev = stddev;
 }
 
 static int benchmark_event_kthread(void *arg)
 {
+	struct bm_stats *bm = arg;
+
 	/* sleep a bit to make sure the tracepoint gets activated */
 	msleep(100);
 
 	while (!kthread_should_stop()) {
 
-		trace_do_benchmark();
+		trace_do_benchmark(bm);
 
 		/*
 		 * We don't go to sleep, but let others run as well.
@@ -171,22 +189,31 @@ static int benchmark_event_kthread(void *arg)
 	return 0;
 }
 
-/*
- * When the benchmark tracepoint is enabled, it calls this
- * function and the thread that calls the tracepoint is created.
- */
-int trace_benchmark_reg(void)
+static void bm_stop(struct bm_stats *bm)
 {
-	if (!ok_to_run) {
-		pr_warn("trace benchmark cannot be started via kernel command line\n");
-		return -EBUSY;
-	}
+	if (!bm->thread)
+		return;
 
-	bm_event_thread = kthread_run(benchmark_event_kthread,
-				      NULL, "event_benchmark");
-	if (IS_ERR(bm_event_thread)) {
-		pr_warn("trace benchmark failed to create kernel thread\n");
-		return PTR_ERR(bm_event_thread);
+	kthread_stop(bm->thread);
+	bm->thread = NULL;
+}
+
+static int bm_start(struct bm_stats *bm, int cpu)
+{
+	memset(bm, 0, sizeof(*bm));
+	strcpy(bm->str, "START");
+
+	if (cpu < 0)
+		bm->thread = kthread_run(benchmark_event_kthread, bm,
+					 "event_benchmark");
+	else
+		bm->thread = kthread_run_on_cpu(benchmark_event_kthread, bm,
+						cpu, "event_benchmark/%u");
+	if (IS_ERR(bm->thread)) {
+		int ret = PTR_ERR(bm->thread);
+
+		bm->thread = NULL;
+		return ret;
 	}
 
 	return 0;
@@ -194,29 +221,59 @@ int trace_benchmark_reg(void)
 
 /*
  * When the benchmark tracepoint is disabled, it calls this
- * function and the thread that calls the tracepoint is deleted
- * and all the numbers are reset.
+ * function and the threads that call the tracepoint are deleted.
  */
 void trace_benchmark_unreg(void)
 {
-	if (!bm_event_thread)
+	int cpu;
+
+	if (!bm_running_per_cpu) {
+		bm_stop(&bm_stats);
 		return;
+	}
+
+	for_each_possible_cpu(cpu)
+		bm_stop(per_cpu_ptr(&bm_cpu_stats, cpu));
+	bm_running_per_cpu = false;
+}
+
+/*
+ * When the benchmark tracepoint is enabled, it calls this
+ * function and the thread that calls the tracepoint is created,
+ * or one such thread per online CPU if per_cpu is set.  The
+ * numbers are reset on every start.
+ */
+int trace_benchmark_reg(void)
+{
+	int cpu, ret = 0;
+
+	if (!ok_to_run) {
+		pr_warn("trace benchmark cannot be started via kernel command line\n");
+		return -EBUSY;
+	}
+
+	if (!READ_ONCE(bm_per_cpu)) {
+		ret = bm_start(&bm_stats, -1);
+		goto out;
+	}
+
+	bm_running_per_cpu = true;
+
+	cpus_read_lock();
+	for_each_online_cpu(cpu) {
+		ret = bm_start(per_cpu_ptr(&bm_cpu_stats, cpu), cpu);
+		if (ret)
+			break;
+	}
+	cpus_read_unlock();
+
+	if (ret)
+		trace_benchmark_unreg();
+ out:
+	if (ret)
+		pr_warn("trace benchmark failed to create kernel thread\n");
 
-	kthread_stop(bm_event_thread);
-	bm_event_thread = NULL;
-
-	strcpy(bm_str, "START");
-	bm_total = 0;
-	bm_totalsq = 0;
-	bm_last = 0;
-	bm_max = 0;
-	bm_min = 0;
-	bm_cnt = 0;
-	/* These don't need to be reset but reset them anyway */
-	bm_first = 0;
-	bm_std = 0;
-	bm_avg = 0;
-	bm_stddev = 0;
+	return ret;
 }
 
 static __init int ok_to_run_trace_benchmark(void)
@@ -70,7 +70,10 @@
 	C(EXPECT_NUMBER,	"Expecting numeric literal"),		\
 	C(UNARY_MINUS_SUBEXPR,	"Unary minus not supported in sub-expressions"), \
 	C(DIVISION_BY_ZERO,	"Division by zero"),			\
-	C(NEED_NOHC_VAL,	"Non-hitcount value is required for 'nohitcount'"),
+	C(NEED_NOHC_VAL,	"Non-hitcount value is required for 'nohitcount'"), \
+	C(PERCPU_VARS,		"Variables and actions can't be used with 'percpu'"), \
+	C(DRAIN_NEEDS_PERCPU,	"'drain' requires 'percpu'"),		\
+	C(INVALID_TOP,		"Invalid top, must be > 0 and <= the largest map size"),
 
 #undef C
 #define C(a, b)		HIST_ERR_##a
@@ -525,7 +528,10 @@ struct hist_trigger_attrs {
 	bool		clear;
 	bool		ts_in_usecs;
 	bool		no_hitcount;
+	bool		percpu;
+	bool		drain;
 	unsigned int	map_bits;
+	unsigned int	top;
 
 	char		*assignment_str[TRACING_MAP_VARS_MAX];
 	unsigned int	n_assignments;
@@ -1512,6 +1518,13 @@ static int parse_assignment(struct trace_array *tr,
 			goto out;
 		}
 		attrs->map_bits = map_bits;
+	} else if ((len = str_has_prefix(str, "top="))) {
+		if (kstrtouint(str + len, 0, &attrs->top) || !attrs->top ||
+		    attrs->top > (1U << TRACING_MAP_BITS_MAX)) {
+			hist_err(tr, HIST_ERR_INVALID_TOP, errpos(str));
+			ret = -EINVAL;
+			goto out;
+		}
 	} else {
 		char *assignment;
 
@@ -1567,6 +1580,10 @@ parse_hist_trigger_attrs(struct trace_array *tr, char *trigger_str)
 			attrs->cont = true;
 		else if (strcmp(str, "clear") == 0)
 			attrs->clear = true;
+		else if (strcmp(str, "percpu") == 0)
+			attrs->percpu = true;
+		else if (strcmp(str, "drain") == 0)
+			attrs->drain = true;
 		else {
 			ret = parse_action(str, attrs);
 			if (ret)
@@ -1579,6 +1596,23 @@ parse_hist_trigger_attrs(struct trace_array *tr, char *trigger_str)
 		goto free;
 	}
 
+	/*
+	 * Variables are looked up in the map by other triggers, and
+	 * actions expect to see the element of the event's key: neither
+	 * works with one map per cpu.
+	 */
+	if (attrs->percpu && (attrs->n_assignments || attrs->n_actions)) {
+		hist_err(tr, HIST_ERR_PERCPU_VARS, 0);
+		ret = -EINVAL;
+		goto free;
+	}
+
+	if (attrs->drain && !attrs->percpu) {
+		hist_err(tr, HIST_ERR_DRAIN_NEEDS_PERCPU, 0);
+		ret = -EINVAL;
+		goto free;
+	}
+
 	if (!attrs->clock) {
 		attrs->clock = kstrdup("global", GFP_KERNEL);
 		if (!attrs->clock) {
@@ -1693,10 +1727,21 @@ static void hist_trigger_elt_data_init(struct tracing_map_elt *elt)
 		save_comm(elt_data->comm, current);
 }
 
+static void hist_trigger_elt_data_copy(struct tracing_map_elt *to,
+				       struct tracing_map_elt *from)
+{
+	struct hist_elt_data *to_data = to->private_data;
+	struct hist_elt_data *from_data = from->private_data;
+
+	if (to_data->comm)
+		memcpy(to_data->comm, from_data->comm, TASK_COMM_LEN);
+}
+
 static const struct tracing_map_ops hist_trigger_elt_data_ops = {
 	.elt_alloc	= hist_trigger_elt_data_alloc,
 	.elt_free	= hist_trigger_elt_data_free,
 	.elt_init	= hist_trigger_elt_data_init,
+	.elt_copy	= hist_trigger_elt_data_copy,
 };
 
 static const char *get_hist_field_flags(struct hist_field *hist_field)
@@ -5126,8 +5171,14 @@ create_hist_data(unsigned int map_bits,
 
 	map_ops = &hist_trigger_elt_data_ops;
 
-	hist_data->map = tracing_map_create(map_bits, hist_data->key_size,
-					    map_ops, hist_data);
+	if (attrs->percpu)
+		hist_data->map = tracing_map_create_percpu(map_bits,
+							   hist_data->key_size,
+							   map_ops, hist_data);
+	else
+		hist_data->map = tracing_map_create(map_bits,
+						    hist_data->key_size,
+						    map_ops, hist_data);
 	if (IS_ERR(hist_data->map)) {
 		ret = PTR_ERR(hist_data->map);
 		hist_data->map = NULL;
@@ -5537,9 +5588,16 @@ static int print_entries(struct seq_file *m,
 	struct hist_val_stat *stats = NULL;
 	u64 val;
 
-	n_entries = tracing_map_sort_entries(map, hist_data->sort_keys,
-					     hist_data->n_sort_keys,
-					     &sort_entries);
+	if (hist_data->attrs->percpu) {
+		n_entries = tracing_map_merge(map, hist_data->attrs->drain);
+		if (n_entries < 0)
+			return n_entries;
+	}
+
+	n_entries = tracing_map_sort_top_entries(map, hist_data->sort_keys,
+						 hist_data->n_sort_keys,
+						 hist_data->attrs->top,
+						 &sort_entries);
 	if (n_entries < 0)
 		return n_entries;
 
@@ -6061,6 +6119,12 @@ static int event_hist_trigger_print(struct seq_file *m,
 		seq_printf(m, ":clock=%s", hist_data->attrs->clock);
 	if (hist_data->attrs->no_hitcount)
 		seq_puts(m, ":nohitcount");
+	if (hist_data->attrs->top)
+		seq_printf(m, ":top=%u", hist_data->attrs->top);
+	if (hist_data->attrs->percpu)
+		seq_puts(m, ":percpu");
+	if (hist_data->attrs->drain)
+		seq_puts(m, ":drain");
 
 	print_actions_spec(m, hist_data);
 
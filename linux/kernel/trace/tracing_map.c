@@ -638,6 +638,13 @@ __tracing_map_insert(struct tracing_map *map, void *key, bool lookup_only)
  */
 struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
 {
+	/*
+	 * Callers run with preemption disabled; even if they didn't,
+	 * the sums are atomic so landing in another cpu's map is fine.
+	 */
+	if (map->cpu_maps)
+		map = map->cpu_maps[raw_smp_processor_id()];
+
 	return __tracing_map_insert(map, key, false);
 }
 
@@ -655,11 +662,17 @@ struct tracing_map_elt *tracing_map_insert(struct tracing_map *map, void *key)
  * is successfully retrieved, the 'hits' value is incremented.  The
  * 'drops' value is never updated by this function.
  *
+ * On a map created with tracing_map_create_percpu(), only the map of
+ * the current cpu is searched.
+ *
  * Return: the tracing_map_elt pointer val associated with the key.
  * If the key wasn't found, NULL is returned.
  */
 struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
 {
+	if (map->cpu_maps)
+		map = map->cpu_maps[raw_smp_processor_id()];
+
 	return __tracing_map_insert(map, key, true);
 }
 
@@ -668,45 +681,65 @@ struct tracing_map_elt *tracing_map_lookup(struct tracing_map *map, void *key)
  * @map: The tracing_map to destroy
  *
  * Frees a tracing_map along with its associated array of
- * tracing_map_elts.
+ * tracing_map_elts, and its per-cpu maps if it has any.
  *
  * Callers should make sure there are no readers or writers actively
  * reading or inserting into the map before calling this.
  */
 void tracing_map_destroy(struct tracing_map *map)
 {
+	unsigned int cpu;
+
 	if (!map)
 		return;
 
+	if (map->cpu_maps) {
+		for_each_possible_cpu(cpu)
+			tracing_map_destroy(map->cpu_maps[cpu]);
+		kfree(map->cpu_maps);
+	}
+
 	tracing_map_free_elts(map);
 
 	tracing_map_array_free(map->map);
 	kfree(map);
 }
 
+static void __tracing_map_clear(struct tracing_map *map)
+{
+	unsigned int i;
+
+	atomic_set(&map->next_elt, -1);
+	atomic64_set(&map->hits, 0);
+	atomic64_set(&map->drops, 0);
+
+	tracing_map_array_clear(map->map);
+
+	for (i = 0; i < map->max_elts; i++)
+		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
+}
+
 /**
  * tracing_map_clear - Clear a tracing_map
  * @map: The tracing_map to clear
  *
  * Resets the tracing map to a cleared or initial state.  The
  * tracing_map_elts are all cleared, and the array of struct
- * tracing_map_entry is reset to an initialized state.
+ * tracing_map_entry is reset to an initialized state.  The per-cpu
+ * maps of the map, if any, are cleared as well.
  *
  * Callers should make sure there are no writers actively inserting
  * into the map before calling this.
  */
 void tracing_map_clear(struct tracing_map *map)
 {
-	unsigned int i;
+	unsigned int cpu;
 
-	atomic_set(&map->next_elt, -1);
-	atomic64_set(&map->hits, 0);
-	atomic64_set(&map->drops, 0);
-
-	tracing_map_array_clear(map->map);
+	if (map->cpu_maps)
+		for_each_possible_cpu(cpu)
+			__tracing_map_clear(map->cpu_maps[cpu]);
 
-	for (i = 0; i < map->max_elts; i++)
-		tracing_map_elt_clear(*(TRACING_MAP_ELT(map->elts, i)));
+	__tracing_map_clear(map);
 }
 
 static void set_sort_key(struct tracing_map *map,
@@ -807,6 +840,58 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
 	goto out;
 }
 
+/**
+ * tracing_map_create_percpu - Create a tracing_map with per-cpu maps
+ * @map_bits: The size of the map and of each per-cpu map (2 ** map_bits)
+ * @key_size: The size of the key for the map in bytes
+ * @ops: Optional client-defined tracing_map_ops instance
+ * @private_data: Client data associated with the map
+ *
+ * Like tracing_map_create(), but the map also gets a complete map of
+ * the same size for every possible cpu, which tracing_map_insert()
+ * uses instead of the map itself.  This keeps concurrent writers on
+ * different cpus from bouncing the 'hits' counter and the elements
+ * of popular keys between their caches, at the price of one element
+ * pool per cpu and of having to call tracing_map_merge() before the
+ * map can be sorted.
+ *
+ * Fields are added to the returned map as usual;  tracing_map_init()
+ * propagates them to the per-cpu maps.
+ *
+ * Return: the tracing_map pointer if successful, ERR_PTR if not.
+ */
+struct tracing_map *tracing_map_create_percpu(unsigned int map_bits,
+					      unsigned int key_size,
+					      const struct tracing_map_ops *ops,
+					      void *private_data)
+{
+	struct tracing_map *map, *cpu_map;
+	unsigned int cpu;
+
+	map = tracing_map_create(map_bits, key_size, ops, private_data);
+	if (IS_ERR(map))
+		return map;
+
+	map->cpu_maps = kcalloc(nr_cpu_ids, sizeof(*map->cpu_maps),
+				GFP_KERNEL);
+	if (!map->cpu_maps)
+		goto free;
+
+	for_each_possible_cpu(cpu) {
+		cpu_map = tracing_map_create(map_bits, key_size, ops,
+					     private_data);
+		if (IS_ERR(cpu_map))
+			goto free;
+		map->cpu_maps[cpu] = cpu_map;
+	}
+
+	return map;
+ free:
+	tracing_map_destroy(map);
+
+	return ERR_PTR(-ENOMEM);
+}
+
 /**
  * tracing_map_init - Allocate and clear a map's tracing_map_elts
  * @map: The tracing_map to initialize
@@ -828,11 +913,31 @@ struct tracing_map *tracing_map_create(unsigned int map_bits,
  */
 int tracing_map_init(struct tracing_map *map)
 {
+	struct tracing_map *cpu_map;
+	unsigned int cpu;
 	int err;
 
 	if (map->n_fields < 2)
 		return -EINVAL; /* need at least 1 key and 1 val */
 
+	if (map->cpu_maps) {
+		for_each_possible_cpu(cpu) {
+			cpu_map = map->cpu_maps[cpu];
+
+			memcpy(cpu_map->fields, map->fields,
+			       sizeof(map->fields));
+			cpu_map->n_fields = map->n_fields;
+			memcpy(cpu_map->key_idx, map->key_idx,
+			       sizeof(map->key_idx));
+			cpu_map->n_keys = map->n_keys;
+			cpu_map->n_vars = map->n_vars;
+
+			err = tracing_map_init(cpu_map);
+			if (err)
+				return err;
+		}
+	}
+
 	err = tracing_map_alloc_elts(map);
 	if (err)
 		return err;
@@ -999,6 +1104,105 @@ static bool is_key(struct tracing_map *map, unsigned int field_idx)
 	return false;
 }
 
+/**
+ * tracing_map_merge - Fold the per-cpu maps of a tracing_map into it
+ * @map: The tracing_map, created by tracing_map_create_percpu()
+ * @drain: Reset the per-cpu sums and counters while reading them
+ *
+ * Clears @map and inserts into it every key found in its per-cpu
+ * maps, adding up the sums of all per-cpu elements with that key.
+ * The 'hits' and 'drops' of @map become the totals of the per-cpu
+ * maps.  Keys whose sums are all zero, as left behind by a previous
+ * drain, are skipped.
+ *
+ * Writers may keep inserting into the per-cpu maps meanwhile.  With
+ * @drain, each per-cpu sum is exchanged for zero as it is read, so
+ * an update is reported by exactly one merge; the sums of a key that
+ * does not fit into @map are left for the next one.  Per-cpu elements are
+ * never released by a drain though: a map that keeps seeing new keys
+ * still runs out of elements eventually and needs a
+ * tracing_map_clear().
+ *
+ * Callers must serialize merges against each other and against
+ * readers of @map.
+ *
+ * Return: 0 if successful, -EINVAL if @map has no per-cpu maps.
+ */
+int tracing_map_merge(struct tracing_map *map, bool drain)
+{
+	struct tracing_map_elt *elt, *cpu_elt;
+	struct tracing_map_entry *entry;
+	u64 sum;
+	struct tracing_map *cpu_map;
+	u64 hits = 0, drops = 0;
+	unsigned int cpu, i, j;
+	bool empty;
+
+	if (!map->cpu_maps)
+		return -EINVAL;
+
+	__tracing_map_clear(map);
+
+	for_each_possible_cpu(cpu) {
+		cpu_map = map->cpu_maps[cpu];
+
+		if (drain) {
+			hits += atomic64_xchg(&cpu_map->hits, 0);
+			drops += atomic64_xchg(&cpu_map->drops, 0);
+		} else {
+			hits += atomic64_read(&cpu_map->hits);
+			drops += atomic64_read(&cpu_map->drops);
+		}
+
+		for (i = 0; i < cpu_map->map_size; i++) {
+			entry = TRACING_MAP_ENTRY(cpu_map->map, i);
+			cpu_elt = READ_ONCE(entry->val);
+
+			if (!entry->key || !cpu_elt)
+				continue;
+
+			empty = true;
+			for (j = 0; j < map->n_fields; j++) {
+				if (!is_key(map, j) &&
+				    atomic64_read(&cpu_elt->fields[j].sum)) {
+					empty = false;
+					break;
+				}
+			}
+			if (empty)
+				continue;
+
+			/*
+			 * Only drain what made it into @map.  If it is full,
+			 * the sums stay for the next merge, and the insert
+			 * counted a drop.
+			 */
+			elt = __tracing_map_insert(map, cpu_elt->key, false);
+			if (!elt)
+				continue;
+
+			for (j = 0; j < map->n_fields; j++) {
+				if (is_key(map, j))
+					continue;
+				if (drain)
+					sum = atomic64_xchg(&cpu_elt->fields[j].sum, 0);
+				else
+					sum = atomic64_read(&cpu_elt->fields[j].sum);
+				tracing_map_update_sum(elt, j, sum);
+			}
+
+			if (map->ops && map->ops->elt_copy)
+				map->ops->elt_copy(elt, cpu_elt);
+		}
+	}
+
+	/* drops of the merge itself, if @map overflowed, stay counted */
+	atomic64_set(&map->hits, hits);
+	atomic64_add(drops, &map->drops);
+
+	return 0;
+}
+
 static void sort_secondary(struct tracing_map *map,
 			   const struct tracing_map_sort_entry **entries,
 			   unsigned int n_entries,
@@ -1137,3 +1341,169 @@ int tracing_map_sort_entries(struct tracing_map *map,
 
 	return ret;
 }
+
+struct tracing_map_sort_ctx {
+	struct tracing_map		*map;
+	struct tracing_map_sort_key	*sort_keys;
+	unsigned int			n_sort_keys;
+};
+
+static int cmp_entries_compound(const void *A, const void *B,
+				const void *priv)
+{
+	const struct tracing_map_sort_ctx *ctx = priv;
+	unsigned int i;
+	int ret = 0;
+
+	for (i = 0; i < ctx->n_sort_keys && !ret; i++) {
+		set_sort_key(ctx->map, &ctx->sort_keys[i]);
+
+		if (is_key(ctx->map, ctx->sort_keys[i].field_idx))
+			ret = cmp_entries_key(A, B);
+		else
+			ret = cmp_entries_sum(A, B);
+	}
+
+	return ret;
+}
+
+/*
+ * The top entries are kept in a heap whose root is the entry that
+ * would be sorted last, i.e. the first one to give up its place.
+ */
+static void top_entries_sift_up(struct tracing_map_sort_entry **heap,
+				unsigned int i,
+				const struct tracing_map_sort_ctx *ctx)
+{
+	unsigned int parent;
+
+	while (i) {
+		parent = (i - 1) / 2;
+		if (cmp_entries_compound(&heap[i], &heap[parent], ctx) <= 0)
+			break;
+		swap(heap[i], heap[parent]);
+		i = parent;
+	}
+}
+
+static void top_entries_sift_down(struct tracing_map_sort_entry **heap,
+				  unsigned int n, unsigned int i,
+				  const struct tracing_map_sort_ctx *ctx)
+{
+	unsigned int child;
+
+	while ((child = 2 * i + 1) < n) {
+		if (child + 1 < n &&
+		    cmp_entries_compound(&heap[child + 1], &heap[child], ctx) > 0)
+			child++;
+		if (cmp_entries_compound(&heap[child], &heap[i], ctx) <= 0)
+			break;
+		swap(heap[i], heap[child]);
+		i = child;
+	}
+}
+
+/**
+ * tracing_map_sort_top_entries - Sort the first entries of a map
+ * @map: The tracing_map
+ * @sort_keys: The sort key to use for sorting
+ * @n_sort_keys: hitcount, always have at least one
+ * @n_top: The number of entries to return, 0 for all of them
+ * @sort_entries: outval: pointer to allocated and sorted array of entries
+ *
+ * Like tracing_map_sort_entries(), but only returns the @n_top entries
+ * that would come first in the sorted array.  Instead of allocating a
+ * sort entry per element and sorting all of them, the map is scanned
+ * once while keeping the best @n_top elements in a heap, so that
+ * reading the top of a large map costs O(n log @n_top).
+ *
+ * The client should not hold on to the returned array but should use
+ * it and call tracing_map_destroy_sort_entries() when done.
+ *
+ * Return: the number of sort_entries in the struct tracing_map_sort_entry
+ * array, negative on error
+ */
+int tracing_map_sort_top_entries(struct tracing_map *map,
+				 struct tracing_map_sort_key *sort_keys,
+				 unsigned int n_sort_keys,
+				 unsigned int n_top,
+				 struct tracing_map_sort_entry ***sort_entries)
+{
+	struct tracing_map_sort_ctx ctx = {
+		.map		= map,
+		.sort_keys	= sort_keys,
+		.n_sort_keys	= n_sort_keys,
+	};
+	struct tracing_map_sort_entry *top, **entries, cand, *candp = &cand;
+	unsigned int i, n_entries = 0;
+	int ret = -ENOMEM;
+
+	/* There are never more entries, and it keeps the cast below safe */
+	n_top = min(n_top, map->max_elts);
+
+	/* next_elt is the index of the last element handed out */
+	if (!n_top || (int)n_top > atomic_read(&map->next_elt))
+		return tracing_map_sort_entries(map, sort_keys, n_sort_keys,
+						sort_entries);
+
+	top = vmalloc(array_size(sizeof(*top), n_top));
+	if (!top)
+		return -ENOMEM;
+
+	entries = vmalloc(array_size(sizeof(*entries), n_top));
+	if (!entries)
+		goto free_top;
+
+	memset(&cand, 0, sizeof(cand));
+
+	for (i = 0; i < map->map_size; i++) {
+		struct tracing_map_entry *entry;
+
+		entry = TRACING_MAP_ENTRY(map->map, i);
+
+		if (!entry->key || !entry->val)
+			continue;
+
+		cand.key = entry->val->key;
+		cand.elt = entry->val;
+
+		if (n_entries < n_top) {
+			top[n_entries] = cand;
+			entries[n_entries] = &top[n_entries];
+			top_entries_sift_up(entries, n_entries++, &ctx);
+			continue;
+		}
+
+		if (cmp_entries_compound(&candp, &entries[0], &ctx) >= 0)
+			continue;
+
+		*entries[0] = cand;
+		top_entries_sift_down(entries, n_entries, 0, &ctx);
+	}
+
+	sort_r(entries, n_entries, sizeof(*entries), cmp_entries_compound,
+	       NULL, &ctx);
+
+	for (i = 0; i < n_entries; i++) {
+		entries[i] = create_sort_entry(entries[i]->key, entries[i]->elt);
+		if (!entries[i])
+			goto free;
+	}
+
+	vfree(top);
+
+	if (n_entries == 0) {
+		vfree(entries);
+		return 0;
+	}
+
+	*sort_entries = entries;
+
+	return n_entries;
+ free:
+	tracing_map_destroy_sort_entries(entries, i);
+ free_top:
+	vfree(top);
+
+	return ret;
+}
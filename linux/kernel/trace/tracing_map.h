@@ -125,6 +125,14 @@ typedef int (*tracing_map_cmp_fn_t) (void *val_a, void *val_b);
  * user, tracing_map_sort_entry objects contain a number of additional
  * fields which are used for caching and internal purposes and can
  * safely be ignored.
+ *
+ * A map created with tracing_map_create_percpu() additionally owns
+ * one complete tracing_map per possible cpu, stored in the cpu_maps
+ * field.  tracing_map_insert() and tracing_map_lookup() on such a
+ * map operate on the map of the current cpu, so that the hot path
+ * never shares a cacheline with other cpus.  The outer map only
+ * receives entries when tracing_map_merge() folds the per-cpu maps
+ * into it, which must be done before sorting it.
 */
 
 struct tracing_map_field {
@@ -198,6 +206,7 @@ struct tracing_map {
 	unsigned int			n_vars;
 	atomic64_t			hits;
 	atomic64_t			drops;
+	struct tracing_map		**cpu_maps;
 };
 
 /**
@@ -229,12 +238,18 @@ struct tracing_map {
  *	be initialized when used i.e. when the element is actually
  *	claimed by tracing_map_insert() in the context of the map
  *	insertion.
+ *
+ * @elt_copy: Called by tracing_map_merge() when the sums of a per-cpu
+ *	element are folded into the element of the merged map, so that
+ *	client-defined data set at insertion time can be carried over.
  */
 struct tracing_map_ops {
 	int			(*elt_alloc)(struct tracing_map_elt *elt);
 	void			(*elt_free)(struct tracing_map_elt *elt);
 	void			(*elt_clear)(struct tracing_map_elt *elt);
 	void			(*elt_init)(struct tracing_map_elt *elt);
+	void			(*elt_copy)(struct tracing_map_elt *to,
+					    struct tracing_map_elt *from);
 };
 
 extern struct tracing_map *
@@ -242,7 +257,13 @@ tracing_map_create(unsigned int map_bits,
 		   unsigned int key_size,
 		   const struct tracing_map_ops *ops,
 		   void *private_data);
+extern struct tracing_map *
+tracing_map_create_percpu(unsigned int map_bits,
+			  unsigned int key_size,
+			  const struct tracing_map_ops *ops,
+			  void *private_data);
 extern int tracing_map_init(struct tracing_map *map);
+extern int tracing_map_merge(struct tracing_map *map, bool drain);
 
 extern int tracing_map_add_sum_field(struct tracing_map *map);
 extern int tracing_map_add_var(struct tracing_map *map);
@@ -277,6 +298,12 @@ tracing_map_sort_entries(struct tracing_map *map,
 			 struct tracing_map_sort_key *sort_keys,
 			 unsigned int n_sort_keys,
 			 struct tracing_map_sort_entry ***sort_entries);
+extern int
+tracing_map_sort_top_entries(struct tracing_map *map,
+			     struct tracing_map_sort_key *sort_keys,
+			     unsigned int n_sort_keys,
+			     unsigned int n_top,
+			     struct tracing_map_sort_entry ***sort_entries);
 
 extern void
 tracing_map_destroy_sort_entries(struct tracing_map_sort_entry **entries,
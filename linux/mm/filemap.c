@@ -2842,7 +2842,8 @@ generic_file_read_iter(struct kiocb *iocb, struct iov_iter *iter)
 EXPORT_SYMBOL(generic_file_read_iter);
 
 /*
- * Splice subpages from a folio into a pipe.
+ * Splice subpages from a folio into a pipe.  If the pipe takes folio sized
+ * buffers, the whole range goes into a single buffer.
  */
 size_t splice_folio_into_pipe(struct pipe_inode_info *pipe,
 			      struct folio *folio, loff_t fpos, size_t size)
@@ -2857,7 +2858,10 @@ size_t splice_folio_into_pipe(struct pipe_inode_info *pipe,
 	while (spliced < size &&
 	       !pipe_full(pipe->head, pipe->tail, pipe->max_usage)) {
 		struct pipe_buffer *buf = pipe_head_buf(pipe);
-		size_t part = min_t(size_t, PAGE_SIZE - offset, size - spliced);
+		size_t part = size - spliced;
+
+		if (!pipe->folio_bufs)
+			part = min_t(size_t, PAGE_SIZE - offset, part);
 
 		*buf = (struct pipe_buffer) {
 			.ops	= &page_cache_pipe_buf_ops,
@@ -2911,10 +2915,17 @@ ssize_t filemap_splice_read(struct file *in, loff_t *ppos,
 	init_sync_kiocb(&iocb, in);
 	iocb.ki_pos = *ppos;
 
-	/* Work out how much data we can actually add into the pipe */
+	/*
+	 * Work out how much data we can actually add into the pipe.  A pipe
+	 * taking folio sized buffers is only bounded by its number of slots,
+	 * which the loop below checks.
+	 */
 	used = pipe_occupancy(pipe->head, pipe->tail);
 	npages = max_t(ssize_t, pipe->max_usage - used, 0);
-	len = min_t(size_t, len, npages * PAGE_SIZE);
+	if (!pipe->folio_bufs)
+		len = min_t(size_t, len, npages * PAGE_SIZE);
+	else if (!npages)
+		len = 0;
 
 	folio_batch_init(&fbatch);
 
@@ -2311,6 +2311,10 @@ static inline void remove_mt(struct mm_struct *mm, struct ma_state *mas)
 
 	/* Update high watermark before we lower total_vm */
 	update_hiwater_vm(mm);
+#ifdef CONFIG_BPF_SYSCALL
+	/* Before remove_vma() drops the files, see mm->bpf_vma_gen */
+	atomic64_inc(&mm->bpf_vma_gen);
+#endif
 	mas_for_each(mas, vma, ULONG_MAX) {
 		long nrpages = vma_pages(vma);
 
@@ -550,6 +550,49 @@ fallback:
 	do_page_cache_ra(ractl, ra->size, ra->async_size);
 }
 
+/**
+ * page_cache_ra_range - Start reading a whole range of a file.
+ * @file: The file to read.
+ * @index: Index of the first page.
+ * @nr_to_read: The number of pages to read.
+ * @order: Preferred folio order.
+ *
+ * Unlike force_page_cache_ra(), this is not limited to the readahead window.
+ * I/O for the whole range is submitted in 2 megabyte chunks, but not waited
+ * for.  Where the filesystem supports large folios, the range is read into
+ * folios of up to @order pages.  Used for executable text at execve(), see
+ * PR_SET_EXEC_TEXT_PREFAULT.
+ */
+void page_cache_ra_range(struct file *file, pgoff_t index,
+		unsigned long nr_to_read, unsigned int order)
+{
+	struct address_space *mapping = file->f_mapping;
+	unsigned long chunk = max_t(unsigned long, (2 * 1024 * 1024) / PAGE_SIZE,
+				    1UL << order);
+	struct file_ra_state ra;
+
+	if (unlikely(!mapping->a_ops->read_folio && !mapping->a_ops->readahead))
+		return;
+
+	/* Leave the readahead state of @file to the faults that follow */
+	file_ra_state_init(&ra, mapping);
+	order = min_t(unsigned int, order, MAX_PAGECACHE_ORDER);
+
+	while (nr_to_read) {
+		DEFINE_READAHEAD(ractl, file, &ra, mapping, index);
+		unsigned long this_chunk = min(chunk, nr_to_read);
+
+		ra.start = index;
+		ra.size = this_chunk;
+		ra.async_size = 0;
+		page_cache_ra_order(&ractl, &ra, order);
+
+		index += this_chunk;
+		nr_to_read -= this_chunk;
+		cond_resched();
+	}
+}
+
 /*
  * A minimal readahead algorithm for trivial sequential/random reads.
  */
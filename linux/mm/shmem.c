@@ -2949,7 +2949,10 @@ static ssize_t shmem_file_splice_read(struct file *in, loff_t *ppos,
 	/* Work out how much data we can actually add into the pipe */
 	used = pipe_occupancy(pipe->head, pipe->tail);
 	npages = max_t(ssize_t, pipe->max_usage - used, 0);
-	len = min_t(size_t, len, npages * PAGE_SIZE);
+	if (!pipe->folio_bufs)
+		len = min_t(size_t, len, npages * PAGE_SIZE);
+	else if (!npages)
+		len = 0;
 
 	do {
 		if (*ppos >= i_size_read(inode))
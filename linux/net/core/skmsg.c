@@ -512,7 +512,8 @@ static struct sk_msg *alloc_sk_msg(gfp_t gfp)
 }
 
 static struct sk_msg *sk_psock_create_ingress_msg(struct sock *sk,
-						  struct sk_buff *skb)
+						  struct sk_buff *skb,
+						  gfp_t gfp)
 {
 	if (atomic_read(&sk->sk_rmem_alloc) > sk->sk_rcvbuf)
 		return NULL;
@@ -520,7 +521,7 @@ static struct sk_msg *sk_psock_create_ingress_msg(struct sock *sk,
 	if (!sk_rmem_schedule(sk, skb, skb->truesize))
 		return NULL;
 
-	return alloc_sk_msg(GFP_KERNEL);
+	return alloc_sk_msg(gfp);
 }
 
 static int sk_psock_skb_ingress_enqueue(struct sk_buff *skb,
@@ -552,8 +553,8 @@ static int sk_psock_skb_ingress_enqueue(struct sk_buff *skb,
 	msg->sg.end = num_sge;
 	msg->skb = skb;
 
+	/* callers wake up the reader, once for a batch of skbs */
 	sk_psock_queue_msg(psock, msg);
-	sk_psock_data_ready(sk, psock);
 	return copied;
 }
 
@@ -561,7 +562,7 @@ static int sk_psock_skb_ingress_self(struct sk_psock *psock, struct sk_buff *skb
 				     u32 off, u32 len);
 
 static int sk_psock_skb_ingress(struct sk_psock *psock, struct sk_buff *skb,
-				u32 off, u32 len)
+				u32 off, u32 len, gfp_t gfp)
 {
 	struct sock *sk = psock->sk;
 	struct sk_msg *msg;
@@ -573,7 +574,7 @@ static int sk_psock_skb_ingress(struct sk_psock *psock, struct sk_buff *skb,
 	 */
 	if (unlikely(skb->sk == sk))
 		return sk_psock_skb_ingress_self(psock, skb, off, len);
-	msg = sk_psock_create_ingress_msg(sk, skb);
+	msg = sk_psock_create_ingress_msg(sk, skb, gfp);
 	if (!msg)
 		return -EAGAIN;
 
@@ -621,7 +622,7 @@ static int sk_psock_handle_skb(struct sk_psock *psock, struct sk_buff *skb,
 		return skb_send_sock(psock->sk, skb, off, len);
 	}
 	skb_get(skb);
-	err = sk_psock_skb_ingress(psock, skb, off, len);
+	err = sk_psock_skb_ingress(psock, skb, off, len, GFP_KERNEL);
 	if (err < 0)
 		kfree_skb(skb);
 	return err;
@@ -644,12 +645,21 @@ static void sk_psock_backlog(struct work_struct *work)
 	struct delayed_work *dwork = to_delayed_work(work);
 	struct sk_psock *psock = container_of(dwork, struct sk_psock, work);
 	struct sk_psock_work_state *state = &psock->work_state;
+	bool ingress, delivered = false;
 	struct sk_buff *skb = NULL;
 	u32 len = 0, off = 0;
-	bool ingress;
+	u64 queued;
 	int ret;
 
 	mutex_lock(&psock->work_mutex);
+	atomic_long_inc(&psock->stats.backlog_runs);
+	queued = READ_ONCE(psock->backlog_queued_ns);
+	if (queued) {
+		atomic_long_add(ktime_get_ns() - queued,
+				&psock->stats.backlog_wait_ns);
+		WRITE_ONCE(psock->backlog_queued_ns, 0);
+	}
+
 	if (unlikely(state->len)) {
 		len = state->len;
 		off = state->off;
@@ -689,12 +699,16 @@ static void sk_psock_backlog(struct work_struct *work)
 			}
 			off += ret;
 			len -= ret;
+			delivered |= ingress;
 		} while (len);
 
 		skb = skb_dequeue(&psock->ingress_skb);
 		kfree_skb(skb);
 	}
 end:
+	/* one wakeup for everything delivered in this run */
+	if (delivered)
+		sk_psock_data_ready(psock->sk, psock);
 	mutex_unlock(&psock->work_mutex);
 }
 
@@ -901,6 +915,65 @@ out:
 }
 EXPORT_SYMBOL_GPL(sk_psock_msg_verdict);
 
+/* Called with psock->ingress_lock held */
+static void sk_psock_queue_backlog(struct sk_psock *psock, struct sk_buff *skb)
+{
+	if (skb_queue_empty(&psock->ingress_skb) &&
+	    !READ_ONCE(psock->backlog_queued_ns))
+		WRITE_ONCE(psock->backlog_queued_ns, ktime_get_ns());
+	skb_queue_tail(&psock->ingress_skb, skb);
+	atomic_long_inc(&psock->stats.backlog_skbs);
+	schedule_delayed_work(&psock->work, 0);
+}
+
+/* Fast path of an ingress redirect: put the skb on the ingress queue of
+ * @psock right away, instead of handing it to the backlog work.  Only done
+ * when nothing is waiting in the backlog, which would be reordered, the
+ * socket has receive space and its lock can be taken without waiting.
+ * On failure the skb is left as it was, for the backlog to deal with.
+ */
+static int sk_psock_skb_redirect_ingress(struct sk_psock *psock,
+					 struct sk_buff *skb)
+{
+	unsigned long redir = skb->_sk_redir;
+	struct sock *sk = psock->sk;
+	u32 off = 0, len = skb->len;
+	int err = -EAGAIN;
+
+	if (!skb_queue_empty_lockless(&psock->ingress_skb) ||
+	    atomic_read(&sk->sk_rmem_alloc) + skb->truesize > sk->sk_rcvbuf)
+		return -EAGAIN;
+
+	if (skb_bpf_strparser(skb)) {
+		struct strp_msg *stm = strp_msg(skb);
+
+		off = stm->offset;
+		len = stm->full_len;
+	}
+
+	/* the other socket may be redirecting to ours under its lock, and
+	 * __release_sock() gets here with BHs enabled
+	 */
+	if (!spin_trylock_bh(&sk->sk_lock.slock))
+		return -EAGAIN;
+	if (!sock_owned_by_user(sk)) {
+		/* _sk_redir shares space with the dst, clear it before the
+		 * skb is visible on the ingress queue
+		 */
+		skb_bpf_redirect_clear(skb);
+		err = sk_psock_skb_ingress(psock, skb, off, len, GFP_ATOMIC);
+		if (err < 0)
+			skb->_sk_redir = redir;
+	}
+	spin_unlock_bh(&sk->sk_lock.slock);
+	if (err < 0)
+		return err;
+
+	atomic_long_inc(&psock->stats.redir_direct);
+	sk_psock_data_ready(sk, psock);
+	return 0;
+}
+
 static int sk_psock_skb_redirect(struct sk_psock *from, struct sk_buff *skb)
 {
 	struct sk_psock *psock_other;
@@ -925,6 +998,11 @@ static int sk_psock_skb_redirect(struct sk_psock *from, struct sk_buff *skb)
 		sock_drop(from->sk, skb);
 		return -EIO;
 	}
+	if (skb_bpf_ingress(skb) &&
+	    sk_psock_test_state(psock_other, SK_PSOCK_TX_ENABLED) &&
+	    !sk_psock_skb_redirect_ingress(psock_other, skb))
+		return 0;
+
 	spin_lock_bh(&psock_other->ingress_lock);
 	if (!sk_psock_test_state(psock_other, SK_PSOCK_TX_ENABLED)) {
 		spin_unlock_bh(&psock_other->ingress_lock);
@@ -933,8 +1011,7 @@ static int sk_psock_skb_redirect(struct sk_psock *from, struct sk_buff *skb)
 		return -EIO;
 	}
 
-	skb_queue_tail(&psock_other->ingress_skb, skb);
-	schedule_delayed_work(&psock_other->work, 0);
+	sk_psock_queue_backlog(psock_other, skb);
 	spin_unlock_bh(&psock_other->ingress_lock);
 	return 0;
 }
@@ -1007,12 +1084,13 @@ static int sk_psock_verdict_apply(struct sk_psock *psock, struct sk_buff *skb,
 				len = stm->full_len;
 			}
 			err = sk_psock_skb_ingress_self(psock, skb, off, len);
+			if (err >= 0)
+				sk_psock_data_ready(sk_other, psock);
 		}
 		if (err < 0) {
 			spin_lock_bh(&psock->ingress_lock);
 			if (sk_psock_test_state(psock, SK_PSOCK_TX_ENABLED)) {
-				skb_queue_tail(&psock->ingress_skb, skb);
-				schedule_delayed_work(&psock->work, 0);
+				sk_psock_queue_backlog(psock, skb);
 				err = 0;
 			}
 			spin_unlock_bh(&psock->ingress_lock);
@@ -12,6 +12,7 @@
 #include <linux/list.h>
 #include <linux/jhash.h>
 #include <linux/sock_diag.h>
+#include <linux/seq_file.h>
 #include <net/udp.h>
 
 struct bpf_stab {
@@ -21,6 +22,35 @@ struct bpf_stab {
 	spinlock_t lock;
 };
 
+struct sock_map_stats {
+	u64 redir_direct;
+	u64 backlog_skbs;
+	u64 backlog_runs;
+	u64 backlog_wait_ns;
+};
+
+/* Called under rcu_read_lock */
+static void sock_map_stats_add(struct sock_map_stats *stats, struct sock *sk)
+{
+	struct sk_psock *psock = sk ? sk_psock(sk) : NULL;
+
+	if (!psock)
+		return;
+	stats->redir_direct += atomic_long_read(&psock->stats.redir_direct);
+	stats->backlog_skbs += atomic_long_read(&psock->stats.backlog_skbs);
+	stats->backlog_runs += atomic_long_read(&psock->stats.backlog_runs);
+	stats->backlog_wait_ns += atomic_long_read(&psock->stats.backlog_wait_ns);
+}
+
+static void sock_map_stats_show(const struct sock_map_stats *stats,
+				struct seq_file *m)
+{
+	seq_printf(m, "psock_redir_direct:\t%llu\n", stats->redir_direct);
+	seq_printf(m, "psock_backlog_skbs:\t%llu\n", stats->backlog_skbs);
+	seq_printf(m, "psock_backlog_runs:\t%llu\n", stats->backlog_runs);
+	seq_printf(m, "psock_backlog_wait_ns:\t%llu\n", stats->backlog_wait_ns);
+}
+
 #define SOCK_CREATE_FLAG_MASK				\
 	(BPF_F_NUMA_NODE | BPF_F_RDONLY | BPF_F_WRONLY)
 
@@ -808,6 +838,19 @@ static u64 sock_map_mem_usage(const struct bpf_map *map)
 	return usage;
 }
 
+static void sock_map_show_fdinfo(const struct bpf_map *map, struct seq_file *m)
+{
+	struct bpf_stab *stab = container_of(map, struct bpf_stab, map);
+	struct sock_map_stats stats = {};
+	u32 i;
+
+	rcu_read_lock();
+	for (i = 0; i < map->max_entries; i++)
+		sock_map_stats_add(&stats, READ_ONCE(stab->sks[i]));
+	rcu_read_unlock();
+	sock_map_stats_show(&stats, m);
+}
+
 static const struct bpf_iter_seq_info sock_map_iter_seq_info = {
 	.seq_ops		= &sock_map_seq_ops,
 	.init_seq_private	= sock_map_init_seq_private,
@@ -828,6 +871,7 @@ const struct bpf_map_ops sock_map_ops = {
 	.map_release_uref	= sock_map_release_progs,
 	.map_check_btf		= map_check_no_btf,
 	.map_mem_usage		= sock_map_mem_usage,
+	.map_show_fdinfo	= sock_map_show_fdinfo,
 	.map_btf_id		= &sock_map_btf_ids[0],
 	.iter_seq_info		= &sock_map_iter_seq_info,
 };
@@ -1422,6 +1466,21 @@ static u64 sock_hash_mem_usage(const struct bpf_map *map)
 	return usage;
 }
 
+static void sock_hash_show_fdinfo(const struct bpf_map *map, struct seq_file *m)
+{
+	struct bpf_shtab *htab = container_of(map, struct bpf_shtab, map);
+	struct sock_map_stats stats = {};
+	struct bpf_shtab_elem *elem;
+	u32 i;
+
+	rcu_read_lock();
+	for (i = 0; i < htab->buckets_num; i++)
+		hlist_for_each_entry_rcu(elem, &htab->buckets[i].head, node)
+			sock_map_stats_add(&stats, elem->sk);
+	rcu_read_unlock();
+	sock_map_stats_show(&stats, m);
+}
+
 static const struct bpf_iter_seq_info sock_hash_iter_seq_info = {
 	.seq_ops		= &sock_hash_seq_ops,
 	.init_seq_private	= sock_hash_init_seq_private,
@@ -1442,6 +1501,7 @@ const struct bpf_map_ops sock_hash_ops = {
 	.map_release_uref	= sock_hash_release_progs,
 	.map_check_btf		= map_check_no_btf,
 	.map_mem_usage		= sock_hash_mem_usage,
+	.map_show_fdinfo	= sock_hash_show_fdinfo,
 	.map_btf_id		= &sock_hash_map_btf_ids[0],
 	.iter_seq_info		= &sock_hash_iter_seq_info,
 };
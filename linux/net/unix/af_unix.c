@@ -116,6 +116,8 @@
 #include <linux/freezer.h>
 #include <linux/file.h>
 #include <linux/btf_ids.h>
+#include <linux/seq_bin.h>
+#include <linux/unix_diag.h>
 
 #include "scm.h"
 
@@ -3368,6 +3370,50 @@ static const struct seq_operations unix_seq_ops = {
 	.show   = unix_seq_show,
 };
 
+/* /proc/net/unix_bin: the same table as fixed size struct unix_seq_bin */
+static int unix_seq_show_bin(struct seq_file *seq, void *v)
+{
+	struct unix_seq_bin rec = {};
+	struct unix_sock *u;
+	struct sock *s = v;
+
+	if (v == SEQ_START_TOKEN) {
+		seq_bin_header(seq, SEQ_BIN_TYPE_UNIX, UNIX_SEQ_BIN_VERSION,
+			       sizeof(rec));
+		return 0;
+	}
+
+	u = unix_sk(s);
+	unix_state_lock(s);
+	rec.ino = sock_i_ino(s);
+	rec.refcnt = refcount_read(&s->sk_refcnt);
+	rec.flags = s->sk_state == TCP_LISTEN ? __SO_ACCEPTCON : 0;
+	rec.type = s->sk_type;
+	rec.state = s->sk_socket ?
+		(s->sk_state == TCP_ESTABLISHED ? SS_CONNECTED : SS_UNCONNECTED) :
+		(s->sk_state == TCP_ESTABLISHED ? SS_CONNECTING : SS_DISCONNECTING);
+
+	if (u->addr) {	// under a hash table lock here
+		int len = u->addr->len - offsetof(struct sockaddr_un, sun_path);
+
+		if (u->addr->name->sun_path[0])
+			len--;
+		memcpy(rec.path, u->addr->name->sun_path, len);
+		rec.path_len = len;
+	}
+	unix_state_unlock(s);
+
+	seq_write(seq, &rec, sizeof(rec));
+	return 0;
+}
+
+static const struct seq_operations unix_seq_bin_ops = {
+	.start  = unix_seq_start,
+	.next   = unix_seq_next,
+	.stop   = unix_seq_stop,
+	.show   = unix_seq_show_bin,
+};
+
 #if IS_BUILTIN(CONFIG_UNIX) && defined(CONFIG_BPF_SYSCALL)
 struct bpf_unix_iter_state {
 	struct seq_net_private p;
@@ -3575,6 +3621,9 @@ static const struct net_proto_family unix_family_ops = {
 
 static int __net_init unix_net_init(struct net *net)
 {
+#ifdef CONFIG_PROC_FS
+	struct proc_dir_entry *pde;
+#endif
 	int i;
 
 	net->unx.sysctl_max_dgram_qlen = 10;
@@ -3585,6 +3634,13 @@ static int __net_init unix_net_init(struct net *net)
 	if (!proc_create_net("unix", 0, net->proc_net, &unix_seq_ops,
 			     sizeof(struct seq_net_private)))
 		goto err_sysctl;
+
+	pde = proc_create_net("unix_bin", 0, net->proc_net, &unix_seq_bin_ops,
+			      sizeof(struct seq_net_private));
+	if (!pde)
+		goto err_proc_unix;
+	/* monitoring agents read the whole table at once */
+	proc_set_seq_snapshot(pde);
 #endif
 
 	net->unx.table.locks = kvmalloc_array(UNIX_HASH_SIZE,
@@ -3609,6 +3665,8 @@ free_locks:
 	kvfree(net->unx.table.locks);
 err_proc:
 #ifdef CONFIG_PROC_FS
+	remove_proc_entry("unix_bin", net->proc_net);
+err_proc_unix:
 	remove_proc_entry("unix", net->proc_net);
 err_sysctl:
 #endif
@@ -3622,6 +3680,7 @@ static void __net_exit unix_net_exit(struct net *net)
 	kvfree(net->unx.table.buckets);
 	kvfree(net->unx.table.locks);
 	unix_sysctl_unregister(net);
+	remove_proc_entry("unix_bin", net->proc_net);
 	remove_proc_entry("unix", net->proc_net);
 }
 
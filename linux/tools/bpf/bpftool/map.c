@@ -510,6 +510,21 @@ static int show_map_close_json(int fd, struct bpf_map_info *info)
 		free(owner_prog_type);
 		free(owner_jited);
 	}
+	if (info->type == BPF_MAP_TYPE_LRU_HASH ||
+	    info->type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+		char *evictions = get_fdinfo(fd, "lru_evictions");
+		char *steals = get_fdinfo(fd, "lru_steals");
+
+		if (evictions)
+			jsonw_uint_field(json_wtr, "lru_evictions",
+					 strtoull(evictions, NULL, 10));
+		if (steals)
+			jsonw_uint_field(json_wtr, "lru_steals",
+					 strtoull(steals, NULL, 10));
+
+		free(evictions);
+		free(steals);
+	}
 	close(fd);
 
 	if (frozen_str) {
@@ -597,6 +612,18 @@ static int show_map_close_plain(int fd, struct bpf_map_info *info)
 		free(owner_prog_type);
 		free(owner_jited);
 	}
+	if (info->type == BPF_MAP_TYPE_LRU_HASH ||
+	    info->type == BPF_MAP_TYPE_LRU_PERCPU_HASH) {
+		char *evictions = get_fdinfo(fd, "lru_evictions");
+		char *steals = get_fdinfo(fd, "lru_steals");
+
+		if (evictions && steals)
+			printf("\n\tlru_evictions %s  lru_steals %s",
+			       evictions, steals);
+
+		free(evictions);
+		free(steals);
+	}
 	close(fd);
 
 	if (!hashmap__empty(map_table)) {
@@ -77,7 +77,7 @@ struct bpf_insn {
 	__s32	imm;		/* signed immediate constant */
 };
 
-/* Key of an a BPF_MAP_TYPE_LPM_TRIE entry */
+/* Key of an a BPF_MAP_TYPE_LPM_TRIE or BPF_MAP_TYPE_LPM_MULTIBIT entry */
 struct bpf_lpm_trie_key {
 	__u32	prefixlen;	/* up to 32 for AF_INET, 128 for AF_INET6 */
 	__u8	data[0];	/* Arbitrary size */
@@ -944,6 +944,8 @@ enum bpf_map_type {
 	BPF_MAP_TYPE_BLOOM_FILTER,
 	BPF_MAP_TYPE_USER_RINGBUF,
 	BPF_MAP_TYPE_CGRP_STORAGE,
+	/* Numbered apart from the types above to leave their sequence free */
+	BPF_MAP_TYPE_LPM_MULTIBIT = 64,
 };
 
 /* Note that tracing related programs such as
@@ -1310,6 +1312,41 @@ enum {
 
 /* Get path from provided FD in BPF_OBJ_PIN/BPF_OBJ_GET commands */
 	BPF_F_PATH_FD		= (1U << 14),
+
+/* BPF_MAP_TYPE_RINGBUF with one ring of max_entries bytes per possible CPU.
+ * The rings are mmap()'ed one after the other in CPU order, each taking the
+ * consumer page, the producer page and twice the data pages.  Records carry
+ * a u64 CLOCK_MONOTONIC timestamp ahead of their header, which lets the
+ * consumer merge the rings in order.
+ */
+	BPF_F_PERCPU_RINGBUF	= (1U << 24),
+
+/* BPF_MAP_TYPE_HASH or BPF_MAP_TYPE_PERCPU_HASH created with
+ * BPF_F_NO_PREALLOC: the bucket table starts small and grows and shrinks
+ * with the number of elements, up to the size max_entries would give it.
+ */
+	BPF_F_RESIZABLE		= (1U << 25),
+
+/* BPF_MAP_TYPE_LRU_HASH or BPF_MAP_TYPE_LRU_PERCPU_HASH without
+ * BPF_F_NO_COMMON_LRU: each CPU evicts from the elements it inserted with a
+ * CLOCK sweep and only takes a batch from another CPU when it runs dry,
+ * instead of all CPUs rotating one global LRU list.
+ */
+	BPF_F_LRU_CLOCK		= (1U << 26),
+
+/* BPF_MAP_TYPE_STACK_TRACE without BPF_F_STACK_BUILD_ID: store each stack
+ * as a path in a table of frames shared by all stacks, so that common
+ * outer frames are kept once.  A stack id only collides after several
+ * slots have been tried.  Frames are reclaimed once all stack ids have
+ * been deleted.
+ */
+	BPF_F_STACK_DEDUP	= (1U << 27),
+
+/* BPF_MAP_TYPE_BLOOM_FILTER: keep all the bits of a value in one 64 byte
+ * block, so that a lookup touches a single cache line.  The false positive
+ * rate is a little higher than with the bits spread over the whole bitset.
+ */
+	BPF_F_BLOOM_BLOCKED	= (1U << 28),
 };
 
 /* Flags for BPF_PROG_QUERY. */
@@ -4423,6 +4460,9 @@ union bpf_attr {
  *		* **BPF_RB_CONS_POS**: Consumer position (can wrap around).
  *		* **BPF_RB_PROD_POS**: Producer(s) position (can wrap around).
  *
+ *		For **BPF_F_PERCPU_RINGBUF** maps, these are the values of
+ *		the ring of the current CPU.
+ *
  *		Data returned is just a momentary snapshot of actual values
  *		and could be inaccurate, so this facility should be used to
  *		power heuristics and for reporting, not to make 100% correct
@@ -6023,6 +6063,8 @@ enum {
 	BPF_RINGBUF_BUSY_BIT		= (1U << 31),
 	BPF_RINGBUF_DISCARD_BIT		= (1U << 30),
 	BPF_RINGBUF_HDR_SZ		= 8,
+	/* timestamp before the header, BPF_F_PERCPU_RINGBUF only */
+	BPF_RINGBUF_TS_SZ		= 8,
 };
 
 /* BPF_FUNC_sk_assign flags in bpf_sk_lookup context. */
@@ -0,0 +1,90 @@
+/* SPDX-License-Identifier: GPL-2.0 WITH Linux-syscall-note */
+#ifndef _UAPI_LINUX_SEQ_BIN_H
+#define _UAPI_LINUX_SEQ_BIN_H
+
+#include <linux/types.h>
+
+/*
+ * Binary /proc tables.
+ *
+ * A binary table starts with a struct seq_bin_header, followed by records
+ * of header.record_size bytes each.  New fields are only ever appended to a
+ * record, so readers must step through the table by record_size rather than
+ * by the size of the structure they were compiled against.  The version is
+ * bumped only if an existing field changes meaning.
+ */
+struct seq_bin_header {
+	__u32	magic;		/* SEQ_BIN_MAGIC */
+	__u16	type;		/* SEQ_BIN_TYPE_* */
+	__u16	version;	/* version of the record layout */
+	__u32	header_size;	/* offset of the first record */
+	__u32	record_size;	/* size of each record */
+};
+
+#define SEQ_BIN_MAGIC		0x42515350	/* "PSQB" */
+
+#define SEQ_BIN_TYPE_PID_STAT	1	/* /proc/<pid>/stat_bin */
+#define SEQ_BIN_TYPE_UNIX	2	/* /proc/net/unix_bin */
+
+/*
+ * /proc/<pid>/stat_bin: the fields of /proc/<pid>/stat, in the same order.
+ * Times are in nanoseconds rather than clock ticks, and start_time is in
+ * nanoseconds since boot.  Fields that /proc/<pid>/stat hides from
+ * unprivileged readers are zero here as well.
+ */
+struct proc_pid_stat_bin {
+	__s32	pid;
+	__s32	ppid;
+	__s32	pgrp;
+	__s32	session;
+	__s32	tty_nr;
+	__s32	tpgid;
+	__u32	flags;
+	__s8	state;
+	__u8	pad[3];
+	char	comm[16];
+	__s32	priority;
+	__s32	nice;
+	__s32	num_threads;
+	__s32	exit_signal;
+	__s32	processor;
+	__u32	rt_priority;
+	__u32	policy;
+	__s32	exit_code;
+	__u64	minflt;
+	__u64	cminflt;
+	__u64	majflt;
+	__u64	cmajflt;
+	__u64	utime;
+	__u64	stime;
+	__u64	cutime;
+	__u64	cstime;
+	__u64	start_time;
+	__u64	vsize;
+	__u64	rss;		/* in pages */
+	__u64	rsslim;
+	__u64	startcode;
+	__u64	endcode;
+	__u64	startstack;
+	__u64	kstkesp;
+	__u64	kstkeip;
+	__u64	signal;
+	__u64	blocked;
+	__u64	sigignore;
+	__u64	sigcatch;
+	__u64	wchan;
+	__u64	delayacct_blkio_ticks;
+	__u64	guest_time;
+	__u64	cguest_time;
+	__u64	start_data;
+	__u64	end_data;
+	__u64	start_brk;
+	__u64	arg_start;
+	__u64	arg_end;
+	__u64	env_start;
+	__u64	env_end;
+};
+
+#define PROC_PID_STAT_BIN_VERSION	1
+
+#endif /* _UAPI_LINUX_SEQ_BIN_H */
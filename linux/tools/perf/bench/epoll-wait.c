@@ -44,6 +44,12 @@
  * not stress scenarios where multiple tasks are awoken per ready IO; ie:
  * EPOLLEXCLUSIVE semantics.
  *
+ * The --writers option spreads the writes over several producer threads,
+ * each bound to its own CPU and writing to its own slice of every fdmap,
+ * so that wakeups hit the epoll instance from many CPUs at once. Running
+ * it with 1 to N writers, with and without --percpu (EPOLL_PERCPU_READY),
+ * shows how the ready list scales with the number of producer CPUs.
+ *
  * The end result/metric is throughput: number of ops/second where an
  * operation consists of:
  *
@@ -88,7 +94,12 @@
 #define printinfo(fmt, arg...) \
 	do { if (__verbose) { printf(fmt, ## arg); fflush(stdout); } } while (0)
 
+#ifndef EPOLL_PERCPU_READY
+#define EPOLL_PERCPU_READY 0x00000001
+#endif
+
 static unsigned int nthreads = 0;
+static unsigned int nwriters = 1;
 static unsigned int nsecs    = 8;
 static bool wdone, done, __verbose, randomize, nonblocking;
 
@@ -106,6 +117,7 @@ static unsigned int nested = 0;
 static bool et; /* edge-trigger */
 static bool oneshot;
 static bool multiq; /* use an epoll instance per thread */
+static bool percpu; /* use per-CPU ready lists */
 
 /* amount of fds to monitor, per thread */
 static unsigned int nfds = 64;
@@ -123,6 +135,12 @@ struct worker {
 	int *fdmap;
 };
 
+struct writer {
+	unsigned int id;
+	pthread_t thread;
+	struct worker *worker;
+};
+
 static const struct option options[] = {
 	/* general benchmark options */
 	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
@@ -130,6 +148,7 @@ static const struct option options[] = {
 	OPT_UINTEGER('f', "nfds",    &nfds,  "Specify amount of file descriptors to monitor for each thread"),
 	OPT_BOOLEAN( 'n', "noaffinity",  &noaffinity,   "Disables CPU affinity"),
 	OPT_BOOLEAN('R', "randomize", &randomize,   "Enable random write behaviour (default is lineal)"),
+	OPT_UINTEGER('w', "writers", &nwriters, "Specify amount of writer (producer) threads, one per CPU"),
 	OPT_BOOLEAN( 'v', "verbose", &__verbose, "Verbose mode"),
 
 	/* epoll specific options */
@@ -138,6 +157,7 @@ static const struct option options[] = {
 	OPT_UINTEGER( 'N', "nested",  &nested,   "Nesting level epoll hierarchy (default is 0, no nesting)"),
 	OPT_BOOLEAN( 'S', "oneshot",  &oneshot,   "Use EPOLLONESHOT semantics"),
 	OPT_BOOLEAN( 'E', "edge",  &et,   "Use Edge-triggered interface (default is LT)"),
+	OPT_BOOLEAN( 'P', "percpu",  &percpu,   "Use per-CPU ready lists (EPOLL_PERCPU_READY)"),
 
 	OPT_END()
 };
@@ -318,9 +338,9 @@ static int do_threads(struct worker *worker, struct perf_cpu_map *cpu)
 		struct worker *w = &worker[i];
 
 		if (multiq) {
-			w->epollfd = epoll_create(1);
+			w->epollfd = epoll_create1(percpu ? EPOLL_PERCPU_READY : 0);
 			if (w->epollfd < 0)
-				err(EXIT_FAILURE, "epoll_create");
+				err(EXIT_FAILURE, "epoll_create1");
 
 			if (nested)
 				nest_epollfd(w);
@@ -379,15 +399,16 @@ static int do_threads(struct worker *worker, struct perf_cpu_map *cpu)
 
 static void *writerfn(void *p)
 {
-	struct worker *worker = p;
+	struct writer *wr = p;
+	struct worker *worker = wr->worker;
 	size_t i, j, iter;
 	const uint64_t val = 1;
 	ssize_t sz;
 	struct timespec ts = { .tv_sec = 0,
 			       .tv_nsec = 500 };
 
-	printinfo("starting writer-thread: doing %s writes ...\n",
-		  randomize? "random":"lineal");
+	printinfo("starting writer-thread %u: doing %s writes ...\n",
+		  wr->id, randomize? "random":"lineal");
 
 	for (iter = 0; !wdone; iter++) {
 		if (randomize) {
@@ -401,7 +422,8 @@ static void *writerfn(void *p)
 				shuffle((void *)w->fdmap, nfds, sizeof(int));
 			}
 
-			for (j = 0; j < nfds; j++) {
+			/* each writer owns every nwriters-th fd */
+			for (j = wr->id; j < nfds; j += nwriters) {
 				do {
 					sz = write(w->fdmap[j], &val, sizeof(val));
 				} while (!wdone && (sz < 0 && errno == EAGAIN));
@@ -411,10 +433,61 @@ static void *writerfn(void *p)
 		nanosleep(&ts, NULL);
 	}
 
-	printinfo("exiting writer-thread (total full-loops: %zd)\n", iter);
+	printinfo("exiting writer-thread %u (total full-loops: %zd)\n",
+		  wr->id, iter);
 	return NULL;
 }
 
+static void start_writers(struct writer *writer, struct worker *worker,
+			  struct perf_cpu_map *cpu)
+{
+	pthread_attr_t thread_attr, *attrp = NULL;
+	int nrcpus = perf_cpu_map__nr(cpu);
+	cpu_set_t *cpuset;
+	unsigned int i;
+	size_t size;
+	int ret;
+
+	cpuset = CPU_ALLOC(nrcpus);
+	BUG_ON(!cpuset);
+	size = CPU_ALLOC_SIZE(nrcpus);
+
+	if (!noaffinity)
+		pthread_attr_init(&thread_attr);
+
+	for (i = 0; i < nwriters; i++) {
+		struct writer *wr = &writer[i];
+
+		wr->id = i;
+		wr->worker = worker;
+
+		/* producers count down from the last CPU, away from the workers */
+		if (!noaffinity) {
+			CPU_ZERO_S(size, cpuset);
+			CPU_SET_S(perf_cpu_map__cpu(cpu, nrcpus - 1 - (i % nrcpus)).cpu,
+				  size, cpuset);
+
+			ret = pthread_attr_setaffinity_np(&thread_attr, size, cpuset);
+			if (ret) {
+				CPU_FREE(cpuset);
+				err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+			}
+
+			attrp = &thread_attr;
+		}
+
+		ret = pthread_create(&wr->thread, attrp, writerfn, wr);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+
+	CPU_FREE(cpuset);
+	if (!noaffinity)
+		pthread_attr_destroy(&thread_attr);
+}
+
 static int cmpworker(const void *p1, const void *p2)
 {
 
@@ -429,8 +502,8 @@ int bench_epoll_wait(int argc, const char **argv)
 	struct sigaction act;
 	unsigned int i;
 	struct worker *worker = NULL;
+	struct writer *writer = NULL;
 	struct perf_cpu_map *cpu;
-	pthread_t wthread;
 	struct rlimit rl, prevrl;
 
 	argc = parse_options(argc, argv, options, bench_epoll_wait_usage, 0);
@@ -444,15 +517,22 @@ int bench_epoll_wait(int argc, const char **argv)
 	act.sa_sigaction = toggle_done;
 	sigaction(SIGINT, &act, NULL);
 
+	if (!nwriters)
+		nwriters = 1;
+	if (randomize && nwriters > 1)
+		errx(EXIT_FAILURE, "--randomize needs a single writer");
+	if (nwriters > nfds)
+		nwriters = nfds;
+
 	cpu = perf_cpu_map__new(NULL);
 	if (!cpu)
 		goto errmem;
 
 	/* a single, main epoll instance */
 	if (!multiq) {
-		epollfd = epoll_create(1);
+		epollfd = epoll_create1(percpu ? EPOLL_PERCPU_READY : 0);
 		if (epollfd < 0)
-			err(EXIT_FAILURE, "epoll_create");
+			err(EXIT_FAILURE, "epoll_create1");
 
 		/*
 		 * Deal with nested epolls, if any.
@@ -461,7 +541,8 @@ int bench_epoll_wait(int argc, const char **argv)
 			nest_epollfd(NULL);
 	}
 
-	printinfo("Using %s queue model\n", multiq ? "multi" : "single");
+	printinfo("Using %s queue model%s\n", multiq ? "multi" : "single",
+		  percpu ? " with per-CPU ready lists" : "");
 	printinfo("Nesting level(s): %d\n", nested);
 
 	/* default to the number of CPUs and leave one for the writer pthread */
@@ -473,6 +554,10 @@ int bench_epoll_wait(int argc, const char **argv)
 		goto errmem;
 	}
 
+	writer = calloc(nwriters, sizeof(*writer));
+	if (!writer)
+		goto errmem;
+
 	if (getrlimit(RLIMIT_NOFILE, &prevrl))
 		err(EXIT_FAILURE, "getrlimit");
 	rl.rlim_cur = rl.rlim_max = nfds * nthreads * 2 + 50;
@@ -482,8 +567,9 @@ int bench_epoll_wait(int argc, const char **argv)
 		err(EXIT_FAILURE, "setrlimit");
 
 	printf("Run summary [PID %d]: %d threads monitoring%s on "
-	       "%d file-descriptors for %d secs.\n\n",
-	       getpid(), nthreads, oneshot ? " (EPOLLONESHOT semantics)": "", nfds, nsecs);
+	       "%d file-descriptors, fed by %d writers, for %d secs.\n\n",
+	       getpid(), nthreads, oneshot ? " (EPOLLONESHOT semantics)": "", nfds,
+	       nwriters, nsecs);
 
 	init_stats(&throughput_stats);
 	mutex_init(&thread_lock);
@@ -504,13 +590,10 @@ int bench_epoll_wait(int argc, const char **argv)
 
 	/*
 	 * At this point the workers should be blocked waiting for read events
-	 * to become ready. Launch the writer which will constantly be writing
+	 * to become ready. Launch the writers which will constantly be writing
 	 * to each thread's fdmap.
 	 */
-	ret = pthread_create(&wthread, NULL, writerfn,
-			     (void *)(struct worker *) worker);
-	if (ret)
-		err(EXIT_FAILURE, "pthread_create");
+	start_writers(writer, worker, cpu);
 
 	sleep(nsecs);
 	toggle_done(0, NULL, NULL);
@@ -518,9 +601,11 @@ int bench_epoll_wait(int argc, const char **argv)
 
 	sleep(1); /* meh */
 	wdone = true;
-	ret = pthread_join(wthread, NULL);
-	if (ret)
-		err(EXIT_FAILURE, "pthread_join");
+	for (i = 0; i < nwriters; i++) {
+		ret = pthread_join(writer[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
 
 	/* cleanup & report results */
 	cond_destroy(&thread_parent);
@@ -554,6 +639,7 @@ int bench_epoll_wait(int argc, const char **argv)
 		free(worker[i].fdmap);
 
 	free(worker);
+	free(writer);
 	return ret;
 errmem:
 	err(EXIT_FAILURE, "calloc");
@@ -0,0 +1,257 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * fd-alloc: Stress file descriptor allocation in a shared descriptor table.
+ *
+ * Every thread repeatedly creates a batch of sockets (or pipes) and closes
+ * them again, the way a server accepting short lived connections does.  All
+ * threads share one files_struct, so with the default POSIX lowest-fd policy
+ * they serialize on its file_lock.  --any switches the process to
+ * PR_FD_ALLOC_ANY, where threads hand out descriptors from per-thread
+ * reservations instead.
+ */
+
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <perf/cpumap.h>
+
+#include "../util/mutex.h"
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <err.h>
+
+#ifndef PR_SET_FD_ALLOC
+#define PR_SET_FD_ALLOC		100
+#define PR_FD_ALLOC_ANY		1
+#endif
+
+static bool done;
+static unsigned int nthreads;
+static unsigned int runtime = 10;
+static unsigned int nfds = 16;
+static bool any_fd;
+static bool use_pipes;
+static bool silent;
+
+static struct mutex thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static struct cond thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	int *fds;
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &runtime, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('n', "nfds", &nfds, "Descriptors each thread holds open at a time"),
+	OPT_BOOLEAN( 'a', "any", &any_fd, "Allow any free descriptor (PR_FD_ALLOC_ANY)"),
+	OPT_BOOLEAN( 'p', "pipes", &use_pipes, "Create pipes instead of sockets"),
+	OPT_BOOLEAN( 's', "silent", &silent, "Silent mode: do not display data/details"),
+	OPT_END()
+};
+
+static const char * const bench_fd_alloc_usage[] = {
+	"perf bench syscall fd-alloc <options>",
+	NULL
+};
+
+/* Returns the number of descriptors created, each one counts as an op */
+static unsigned int open_one(int *fds)
+{
+	if (use_pipes) {
+		if (pipe2(fds, O_CLOEXEC))
+			err(EXIT_FAILURE, "pipe2");
+		return 2;
+	}
+
+	fds[0] = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fds[0] < 0)
+		err(EXIT_FAILURE, "socket");
+	return 1;
+}
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = 0;
+	unsigned int i, n;
+
+	mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		cond_signal(&thread_parent);
+	cond_wait(&thread_worker, &thread_lock);
+	mutex_unlock(&thread_lock);
+
+	do {
+		for (i = 0, n = 0; i < nfds; i++)
+			n += open_one(&w->fds[n]);
+		for (i = 0; i < n; i++)
+			close(w->fds[i]);
+		ops += n;
+	} while (!done);
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld fd allocations/sec per thread (+- %.2f%%), total secs = %d\n",
+	       !silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int)bench__runtime.tv_sec);
+}
+
+int bench_fd_alloc(int argc, const char **argv)
+{
+	int ret = 0;
+	cpu_set_t *cpuset;
+	struct sigaction act;
+	unsigned int i;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+	int nrcpus;
+	size_t size;
+
+	argc = parse_options(argc, argv, options, bench_fd_alloc_usage, 0);
+	if (argc) {
+		usage_with_options(bench_fd_alloc_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (!nfds)
+		nfds = 1;
+
+	cpu = perf_cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (any_fd && prctl(PR_SET_FD_ALLOC, PR_FD_ALLOC_ANY, 0, 0, 0))
+		err(EXIT_FAILURE, "prctl(PR_SET_FD_ALLOC)");
+
+	if (!nthreads) /* default to the number of CPUs */
+		nthreads = perf_cpu_map__nr(cpu);
+
+	worker = calloc(nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	printf("Run summary [PID %d]: %d threads, each cycling %d %s (%s) for %d secs.\n\n",
+	       getpid(), nthreads, nfds, use_pipes ? "pipes" : "sockets",
+	       any_fd ? "any fd" : "lowest fd", runtime);
+
+	init_stats(&throughput_stats);
+	mutex_init(&thread_lock);
+	cond_init(&thread_parent);
+	cond_init(&thread_worker);
+
+	threads_starting = nthreads;
+	pthread_attr_init(&thread_attr);
+	gettimeofday(&bench__start, NULL);
+
+	nrcpus = perf_cpu_map__nr(cpu);
+	cpuset = CPU_ALLOC(nrcpus);
+	BUG_ON(!cpuset);
+	size = CPU_ALLOC_SIZE(nrcpus);
+
+	for (i = 0; i < nthreads; i++) {
+		worker[i].tid = i;
+		/* pipes need two slots per entry */
+		worker[i].fds = calloc(nfds * 2, sizeof(*worker[i].fds));
+		if (!worker[i].fds)
+			goto errmem;
+
+		CPU_ZERO_S(size, cpuset);
+
+		CPU_SET_S(perf_cpu_map__cpu(cpu, i % perf_cpu_map__nr(cpu)).cpu, size, cpuset);
+		ret = pthread_attr_setaffinity_np(&thread_attr, size, cpuset);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+		}
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+	CPU_FREE(cpuset);
+	pthread_attr_destroy(&thread_attr);
+
+	mutex_lock(&thread_lock);
+	while (threads_starting)
+		cond_wait(&thread_parent, &thread_lock);
+	cond_broadcast(&thread_worker);
+	mutex_unlock(&thread_lock);
+
+	sleep(runtime);
+	toggle_done(0, NULL, NULL);
+
+	for (i = 0; i < nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	cond_destroy(&thread_parent);
+	cond_destroy(&thread_worker);
+	mutex_destroy(&thread_lock);
+
+	for (i = 0; i < nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+		update_stats(&throughput_stats, t);
+		if (!silent)
+			printf("[thread %2d] %ld fd allocations/sec\n",
+			       worker[i].tid, t);
+
+		zfree(&worker[i].fds);
+	}
+
+	print_summary();
+
+	free(worker);
+	free(cpu);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
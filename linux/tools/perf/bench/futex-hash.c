@@ -50,6 +50,7 @@ struct worker {
 static struct bench_futex_parameters params = {
 	.nfutexes = 1024,
 	.runtime  = 10,
+	.nbuckets = -1,
 };
 
 static const struct option options[] = {
@@ -59,6 +60,7 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_INTEGER( 'b', "buckets", &params.nbuckets, "Use a private futex hash of this many buckets, 0 to size it by threads"),
 	OPT_END()
 };
 
@@ -162,8 +164,11 @@ int bench_futex_hash(int argc, const char **argv)
 	if (!params.fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
-	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
-	       getpid(), params.nthreads, params.nfutexes, params.fshared ? "shared":"private", params.runtime);
+	futex_set_nbuckets_param(&params);
+
+	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs, %s.\n\n",
+	       getpid(), params.nthreads, params.nfutexes, params.fshared ? "shared":"private", params.runtime,
+	       futex_hash_str());
 
 	init_stats(&throughput_stats);
 	mutex_init(&thread_lock);
@@ -31,7 +31,7 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 
-static u_int32_t futex1 = 0, futex2 = 0;
+static struct futex2_futex futex1, futex2;
 
 static pthread_t *worker;
 static bool done = false;
@@ -40,6 +40,7 @@ static struct cond thread_parent, thread_worker;
 static struct stats requeuetime_stats, requeued_stats;
 static unsigned int threads_starting;
 static int futex_flag = 0;
+static struct futex_waitv requeue_waiters[2];
 
 static struct bench_futex_parameters params = {
 	/*
@@ -57,6 +58,8 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
 	OPT_BOOLEAN( 'B', "broadcast", &params.broadcast, "Requeue all threads at once"),
 	OPT_BOOLEAN( 'p', "pi", &params.pi, "Use PI-aware variants of FUTEX_CMP_REQUEUE"),
+	OPT_BOOLEAN( '2', "futex2", &params.futex2, "Wait with futex_waitv() and requeue with futex_requeue()"),
+	OPT_BOOLEAN( 'n', "numa", &params.numa, "Use FUTEX2_NUMA futexes (implies --futex2)"),
 
 	OPT_END()
 };
@@ -81,6 +84,7 @@ static void print_summary(void)
 
 static void *workerfn(void *arg __maybe_unused)
 {
+	struct futex_waitv waiter;
 	int ret;
 
 	mutex_lock(&thread_lock);
@@ -90,9 +94,20 @@ static void *workerfn(void *arg __maybe_unused)
 	cond_wait(&thread_worker, &thread_lock);
 	mutex_unlock(&thread_lock);
 
+	futex2_waiter(&waiter, &futex1, 0, futex_flag, params.numa);
 	while (1) {
-		if (!params.pi) {
-			ret = futex_wait(&futex1, 0, NULL, futex_flag);
+		if (params.futex2) {
+			ret = futex2_waitv(&waiter, 1);
+			if (ret >= 0)
+				break;
+
+			if (errno != EAGAIN) {
+				if (!params.silent)
+					warnx("futex_waitv");
+				break;
+			}
+		} else if (!params.pi) {
+			ret = futex_wait(&futex1.val, 0, NULL, futex_flag);
 			if (!ret)
 				break;
 
@@ -102,11 +117,11 @@ static void *workerfn(void *arg __maybe_unused)
 				break;
 			}
 		} else {
-			ret = futex_wait_requeue_pi(&futex1, 0, &futex2,
+			ret = futex_wait_requeue_pi(&futex1.val, 0, &futex2.val,
 						    NULL, futex_flag);
 			if (!ret) {
 				/* got the lock at futex2 */
-				futex_unlock_pi(&futex2, futex_flag);
+				futex_unlock_pi(&futex2.val, futex_flag);
 				break;
 			}
 
@@ -204,10 +219,25 @@ int bench_futex_requeue(int argc, const char **argv)
 	if (params.broadcast)
 		params.nrequeue = params.nthreads;
 
-	printf("Run summary [PID %d]: Requeuing %d threads (from [%s] %p to %s%p), "
-	       "%d at a time.\n\n",  getpid(), params.nthreads,
-	       params.fshared ? "shared":"private", &futex1,
-	       params.pi ? "PI ": "", &futex2, params.nrequeue);
+	if (params.numa)
+		params.futex2 = true;
+#ifndef __NR_futex_requeue
+	if (params.futex2)
+		errx(EXIT_FAILURE, "futex_requeue() has no syscall number on this architecture");
+#endif
+	if (params.futex2 && params.pi)
+		errx(EXIT_FAILURE, "futex_requeue() does not requeue to PI futexes");
+
+	futex2_init(&futex1);
+	futex2_init(&futex2);
+	futex2_waiter(&requeue_waiters[0], &futex1, 0, futex_flag, params.numa);
+	futex2_waiter(&requeue_waiters[1], &futex2, 0, futex_flag, params.numa);
+
+	printf("Run summary [PID %d]: Requeuing %d threads (from [%s%s] %p to %s%p), "
+	       "%d at a time%s.\n\n",  getpid(), params.nthreads,
+	       params.fshared ? "shared":"private", params.numa ? " numa" : "",
+	       &futex1, params.pi ? "PI ": "", &futex2, params.nrequeue,
+	       params.futex2 ? " with futex_requeue()" : "");
 
 	init_stats(&requeued_stats);
 	init_stats(&requeuetime_stats);
@@ -242,12 +272,15 @@ int bench_futex_requeue(int argc, const char **argv)
 			 * futex_wait functionality. For the PI case the first
 			 * waiter is always awoken.
 			 */
-			if (!params.pi) {
-				r = futex_cmp_requeue(&futex1, 0, &futex2, 0,
+			if (params.futex2) {
+				r = futex2_requeue(requeue_waiters, 0,
+						   params.nrequeue);
+			} else if (!params.pi) {
+				r = futex_cmp_requeue(&futex1.val, 0, &futex2.val, 0,
 						      params.nrequeue,
 						      futex_flag);
 			} else {
-				r = futex_cmp_requeue_pi(&futex1, 0, &futex2,
+				r = futex_cmp_requeue_pi(&futex1.val, 0, &futex2.val,
 							 params.nrequeue,
 							 futex_flag);
 				wakeups++; /* assume no error */
@@ -285,7 +318,11 @@ int bench_futex_requeue(int argc, const char **argv)
 
 		if (!params.pi) {
 			/* everybody should be blocked on futex2, wake'em up */
-			nrequeued = futex_wake(&futex2, nrequeued, futex_flag);
+			if (params.futex2) {
+				requeue_waiters[1].val = nrequeued;
+				nrequeued = futex2_wakev(&requeue_waiters[1], 1);
+			} else
+				nrequeued = futex_wake(&futex2.val, nrequeued, futex_flag);
 			if (params.nthreads != nrequeued)
 				warnx("couldn't wakeup all tasks (%d/%d)",
 				      nrequeued, params.nthreads);
@@ -57,7 +57,9 @@ static struct stats waketime_stats, wakeup_stats;
 static unsigned int threads_starting;
 static int futex_flag = 0;
 
-static struct bench_futex_parameters params;
+static struct bench_futex_parameters params = {
+	.nbuckets = -1,
+};
 
 static const struct option options[] = {
 	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"),
@@ -65,6 +67,7 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_INTEGER( 'b', "buckets", &params.nbuckets, "Use a private futex hash of this many buckets, 0 to size it by threads"),
 
 	OPT_END()
 };
@@ -291,10 +294,12 @@ int bench_futex_wake_parallel(int argc, const char **argv)
 	if (!params.fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
+	futex_set_nbuckets_param(&params);
+
 	printf("Run summary [PID %d]: blocking on %d threads (at [%s] "
-	       "futex %p), %d threads waking up %d at a time.\n\n",
+	       "futex %p), %d threads waking up %d at a time, %s.\n\n",
 	       getpid(), params.nthreads, params.fshared ? "shared":"private",
-	       &futex, params.nwakes, nwakes);
+	       &futex, params.nwakes, nwakes, futex_hash_str());
 
 	init_stats(&wakeup_stats);
 	init_stats(&waketime_stats);
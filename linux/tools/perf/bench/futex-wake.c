@@ -30,8 +30,8 @@
 #include <sys/time.h>
 #include <sys/mman.h>
 
-/* all threads will block on the same futex */
-static u_int32_t futex1 = 0;
+/* threads block on one of params.nfutexes futexes, all on the first by default */
+static struct futex2_futex *futexes;
 
 static pthread_t *worker;
 static bool done = false;
@@ -47,6 +47,7 @@ static struct bench_futex_parameters params = {
 	 * Default to 1 in order to make the kernel work more.
 	 */
 	.nwakes  = 1,
+	.nfutexes = 1,
 };
 
 static const struct option options[] = {
@@ -55,6 +56,9 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_UINTEGER('F', "futexes", &params.nfutexes, "Specify amount of futexes to spread the threads over"),
+	OPT_BOOLEAN( '2', "futex2",  &params.futex2, "Wait with futex_waitv() and wake all futexes with one FUTEX_WAKEV"),
+	OPT_BOOLEAN( 'n', "numa",    &params.numa, "Use FUTEX2_NUMA futexes (implies --futex2)"),
 
 	OPT_END()
 };
@@ -64,8 +68,11 @@ static const char * const bench_futex_wake_usage[] = {
 	NULL
 };
 
-static void *workerfn(void *arg __maybe_unused)
+static void *workerfn(void *arg)
 {
+	struct futex2_futex *f = arg;
+	struct futex_waitv waiter;
+
 	mutex_lock(&thread_lock);
 	threads_starting--;
 	if (!threads_starting)
@@ -73,8 +80,12 @@ static void *workerfn(void *arg __maybe_unused)
 	cond_wait(&thread_worker, &thread_lock);
 	mutex_unlock(&thread_lock);
 
+	futex2_waiter(&waiter, f, 0, futex_flag, params.numa);
 	while (1) {
-		if (futex_wait(&futex1, 0, NULL, futex_flag) != EINTR)
+		if (params.futex2) {
+			if (futex2_waitv(&waiter, 1) >= 0 || errno != EINTR)
+				break;
+		} else if (futex_wait(&f->val, 0, NULL, futex_flag) != EINTR)
 			break;
 	}
 
@@ -120,7 +131,8 @@ static void block_threads(pthread_t *w, struct perf_cpu_map *cpu)
 			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
 		}
 
-		if (pthread_create(&w[i], &thread_attr, workerfn, NULL)) {
+		if (pthread_create(&w[i], &thread_attr, workerfn,
+				   &futexes[i % params.nfutexes])) {
 			CPU_FREE(cpuset);
 			err(EXIT_FAILURE, "pthread_create");
 		}
@@ -142,6 +154,7 @@ int bench_futex_wake(int argc, const char **argv)
 	unsigned int i, j;
 	struct sigaction act;
 	struct perf_cpu_map *cpu;
+	struct futex_waitv *wakers;
 
 	argc = parse_options(argc, argv, options, bench_futex_wake_usage, 0);
 	if (argc) {
@@ -173,10 +186,30 @@ int bench_futex_wake(int argc, const char **argv)
 	if (!params.fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
-	printf("Run summary [PID %d]: blocking on %d threads (at [%s] futex %p), "
-	       "waking up %d at a time.\n\n",
-	       getpid(), params.nthreads, params.fshared ? "shared":"private",
-	       &futex1, params.nwakes);
+	if (params.numa)
+		params.futex2 = true;
+	if (!params.nfutexes || params.nfutexes > params.nthreads)
+		params.nfutexes = params.nthreads;
+	if (params.futex2 && params.nfutexes > FUTEX_WAITV_MAX)
+		errx(EXIT_FAILURE, "FUTEX_WAKEV takes at most %d futexes",
+		     FUTEX_WAITV_MAX);
+
+	futexes = calloc(params.nfutexes, sizeof(*futexes));
+	wakers = calloc(params.nfutexes, sizeof(*wakers));
+	if (!futexes || !wakers)
+		err(EXIT_FAILURE, "calloc");
+	for (i = 0; i < params.nfutexes; i++) {
+		futex2_init(&futexes[i]);
+		futex2_waiter(&wakers[i], &futexes[i], params.nwakes,
+			      futex_flag, params.numa);
+	}
+
+	printf("Run summary [PID %d]: blocking on %d threads (at %d [%s%s] futexes from %p), "
+	       "waking up %d at a time per futex%s.\n\n",
+	       getpid(), params.nthreads, params.nfutexes,
+	       params.fshared ? "shared":"private", params.numa ? " numa" : "",
+	       futexes, params.nwakes,
+	       params.futex2 ? " with FUTEX_WAKEV" : "");
 
 	init_stats(&wakeup_stats);
 	init_stats(&waketime_stats);
@@ -202,9 +235,19 @@ int bench_futex_wake(int argc, const char **argv)
 
 		/* Ok, all threads are patiently blocked, start waking folks up */
 		gettimeofday(&start, NULL);
-		while (nwoken != params.nthreads)
-			nwoken += futex_wake(&futex1,
-					     params.nwakes, futex_flag);
+		while (nwoken != params.nthreads) {
+			if (params.futex2) {
+				ret = futex2_wakev(wakers, params.nfutexes);
+				if (ret < 0)
+					err(EXIT_FAILURE, "FUTEX_WAKEV");
+				nwoken += ret;
+				continue;
+			}
+			for (i = 0; i < params.nfutexes; i++)
+				nwoken += futex_wake(&futexes[i].val,
+						     params.nwakes, futex_flag);
+		}
+		ret = 0;
 		gettimeofday(&end, NULL);
 		timersub(&end, &start, &runtime);
 
@@ -232,6 +275,8 @@ int bench_futex_wake(int argc, const char **argv)
 
 	print_summary();
 
+	free(wakers);
+	free(futexes);
 	free(worker);
 	perf_cpu_map__put(cpu);
 	return ret;
@@ -8,11 +8,40 @@
 #ifndef _FUTEX_H
 #define _FUTEX_H
 
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <sys/prctl.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <linux/futex.h>
 
+#ifndef FUTEX2_NUMA
+#define FUTEX2_NUMA		4
+#endif
+
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv	449
+#endif
+#ifndef FUTEX_WAKEV
+#define FUTEX_WAKEV		14
+#endif
+/*
+ * futex_requeue() has the number upstream gave it, but only the arm compat
+ * table of this kernel wires it up.
+ */
+#if !defined(__NR_futex_requeue) && defined(__arm__)
+#define __NR_futex_requeue	456
+#endif
+
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			78
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
 struct bench_futex_parameters {
 	bool silent;
 	bool fshared;
@@ -20,11 +49,14 @@ struct bench_futex_parameters {
 	bool multi; /* lock-pi */
 	bool pi; /* requeue-pi */
 	bool broadcast; /* requeue */
+	bool futex2; /* wake, requeue */
+	bool numa; /* wake, requeue */
 	unsigned int runtime; /* seconds*/
 	unsigned int nthreads;
 	unsigned int nfutexes;
 	unsigned int nwakes;
 	unsigned int nrequeue;
+	int nbuckets; /* private hash, -1 for the global one */
 };
 
 /**
@@ -143,4 +175,94 @@ futex_cmp_requeue_pi(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2,
 					val, opflags);
 }
 
+/*
+ * A futex for the futex2 syscalls, with room for the node FUTEX2_NUMA
+ * expects after the futex word.
+ */
+struct futex2_futex {
+	u_int32_t val;
+	u_int32_t node;
+} __attribute__((aligned(8)));
+
+static inline void
+futex2_init(struct futex2_futex *f)
+{
+	f->val = 0;
+	f->node = -1;	/* claimed by the first waiter */
+}
+
+/**
+ * futex2_waiter() - fill in the struct futex_waitv of a futex2 futex
+ * @val:	expected value for futex_waitv(), number of tasks to wake for
+ *		FUTEX_WAKEV
+ * @opflags:	FUTEX_PRIVATE_FLAG or 0
+ */
+static inline void
+futex2_waiter(struct futex_waitv *w, struct futex2_futex *f, u_int64_t val,
+	      int opflags, bool numa)
+{
+	w->val = val;
+	w->uaddr = (unsigned long)&f->val;
+	w->flags = FUTEX_32 | opflags | (numa ? FUTEX2_NUMA : 0);
+	w->__reserved = 0;
+}
+
+/**
+ * futex2_waitv() - block on a list of futexes until one is woken
+ */
+static inline int
+futex2_waitv(struct futex_waitv *waiters, unsigned int nr)
+{
+	return syscall(__NR_futex_waitv, waiters, nr, 0, NULL, 0);
+}
+
+/**
+ * futex2_wakev() - wake tasks blocked on a list of futexes
+ */
+static inline int
+futex2_wakev(struct futex_waitv *waiters, unsigned int nr)
+{
+	return syscall(SYS_futex, waiters, FUTEX_WAKEV, nr, NULL, NULL, 0);
+}
+
+/**
+ * futex2_requeue() - requeue tasks from waiters[0] to waiters[1]
+ * @nr_wake:	wake up to this many tasks
+ * @nr_requeue:	requeue up to this many tasks
+ */
+static inline int
+futex2_requeue(struct futex_waitv *waiters, int nr_wake, int nr_requeue)
+{
+#ifdef __NR_futex_requeue
+	return syscall(__NR_futex_requeue, waiters, 0, nr_wake, nr_requeue);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * Switch to a process-private futex hash of params->nbuckets slots, 0 sizing
+ * it by thread count. Must run before the benchmark creates its threads.
+ */
+static inline void futex_set_nbuckets_param(struct bench_futex_parameters *params)
+{
+	if (params->nbuckets < 0)
+		return;
+
+	if (prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, params->nbuckets, 0, 0))
+		err(EXIT_FAILURE, "prctl(PR_FUTEX_HASH)");
+}
+
+static inline const char *futex_hash_str(void)
+{
+	static char buf[32];
+	int slots = prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+
+	if (slots <= 0)
+		return "global hash";
+	snprintf(buf, sizeof(buf), "private hash of %d buckets", slots);
+	return buf;
+}
+
 #endif /* _FUTEX_H */
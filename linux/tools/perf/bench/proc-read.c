@@ -0,0 +1,228 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Benchmark of reading /proc tables as text and in binary form.
+ *
+ * Monitoring agents scan /proc/<pid>/stat for every task and the socket
+ * tables under /proc/net every few seconds.  This times one such scan using
+ * the text files against their binary *_bin counterparts, including the
+ * parsing an agent would have to do.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <err.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include "bench.h"
+#include "../util/stat.h"
+#include <linux/time64.h>
+#include <linux/seq_bin.h>
+#include <subcmd/parse-options.h>
+
+static unsigned int iterations = 100;
+static unsigned int nr_sockets = 1000;
+static unsigned int buf_size = 1 << 20;
+
+static const struct option options[] = {
+	OPT_UINTEGER('i', "iterations", &iterations,
+		"Number of iterations used to compute average"),
+	OPT_UINTEGER('s', "sockets", &nr_sockets,
+		"Number of unix socket pairs to create before the unix scans"),
+	OPT_UINTEGER('b', "buf-size", &buf_size,
+		"Size of the read() buffer in bytes"),
+	OPT_END()
+};
+
+static const char *const bench_usage[] = {
+	"perf bench internals proc-read <options>",
+	NULL
+};
+
+static char *buf;
+
+/* Read all of @path into buf, returns the number of bytes or -1 */
+static ssize_t read_file(const char *path)
+{
+	ssize_t ret, len = 0;
+	int fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+
+	/* wrap around if the file is larger than the buffer */
+	while ((ret = read(fd, buf + len % buf_size,
+			   buf_size - len % buf_size)) > 0)
+		len += ret;
+
+	close(fd);
+	return ret < 0 ? -1 : len;
+}
+
+static unsigned long long parse_stat_text(ssize_t len)
+{
+	unsigned long long utime, stime;
+	char *p;
+
+	buf[len < buf_size ? len : buf_size - 1] = '\0';
+	/* comm may contain spaces and parentheses, skip to the last ')' */
+	p = strrchr(buf, ')');
+	if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu",
+			 &utime, &stime) != 2)
+		return 0;
+	return utime + stime;
+}
+
+static unsigned long long parse_stat_bin(ssize_t len)
+{
+	struct seq_bin_header *h = (void *)buf;
+	struct proc_pid_stat_bin *st;
+
+	if (len < (ssize_t)sizeof(*h) || h->magic != SEQ_BIN_MAGIC ||
+	    h->type != SEQ_BIN_TYPE_PID_STAT ||
+	    (size_t)len < h->header_size + sizeof(*st))
+		return 0;
+	st = (void *)(buf + h->header_size);
+	return st->utime + st->stime;
+}
+
+/* One pass over /proc/<pid>/stat or stat_bin of every task */
+static int scan_pids(bool bin, unsigned int *nr)
+{
+	struct dirent *d;
+	char path[64];
+	DIR *proc;
+
+	proc = opendir("/proc");
+	if (!proc)
+		return -1;
+
+	*nr = 0;
+	while ((d = readdir(proc)) != NULL) {
+		ssize_t len;
+
+		if (!isdigit(d->d_name[0]))
+			continue;
+
+		snprintf(path, sizeof(path), "/proc/%s/%s", d->d_name,
+			 bin ? "stat_bin" : "stat");
+		len = read_file(path);
+		if (len <= 0)	/* raced with exit */
+			continue;
+		if (bin)
+			parse_stat_bin(len);
+		else
+			parse_stat_text(len);
+		(*nr)++;
+	}
+
+	closedir(proc);
+	return 0;
+}
+
+/* One pass over /proc/net/unix or unix_bin, counting the sockets */
+static int scan_unix(bool bin, unsigned int *nr)
+{
+	ssize_t len;
+	char *p;
+
+	len = read_file(bin ? "/proc/net/unix_bin" : "/proc/net/unix");
+	if (len < 0)
+		return -1;
+	if (len > buf_size) {
+		fprintf(stderr, "table larger than the buffer, use a larger --buf-size\n");
+		return -1;
+	}
+
+	*nr = 0;
+	if (bin) {
+		struct seq_bin_header *h = (void *)buf;
+
+		if (len < (ssize_t)sizeof(*h) || h->magic != SEQ_BIN_MAGIC ||
+		    h->type != SEQ_BIN_TYPE_UNIX || !h->record_size)
+			return -1;
+		*nr = (len - h->header_size) / h->record_size;
+		return 0;
+	}
+
+	/* the first line is the header */
+	for (p = buf; (p = memchr(p, '\n', buf + len - p)) != NULL; p++)
+		(*nr)++;
+	if (*nr)
+		(*nr)--;
+	return 0;
+}
+
+static int do_scan(const char *name, int (*scan)(bool, unsigned int *), bool bin)
+{
+	struct timeval start, end, diff;
+	struct stats time_stats;
+	unsigned int i, nr = 0;
+	u64 runtime_us;
+
+	init_stats(&time_stats);
+
+	for (i = 0; i < iterations; i++) {
+		gettimeofday(&start, NULL);
+		if (scan(bin, &nr))
+			return -1;
+		gettimeofday(&end, NULL);
+		timersub(&end, &start, &diff);
+		runtime_us = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+		update_stats(&time_stats, runtime_us);
+	}
+
+	printf("  %-20s %-6s %6u entries: %9.3f ms (+- %.3f ms)\n",
+	       name, bin ? "binary" : "text", nr,
+	       avg_stats(&time_stats) / USEC_PER_MSEC,
+	       stddev_stats(&time_stats) / USEC_PER_MSEC);
+	return 0;
+}
+
+int bench_proc_read(int argc, const char **argv)
+{
+	int *fds = NULL;
+	unsigned int i;
+	int ret = 0;
+
+	argc = parse_options(argc, argv, options, bench_usage, 0);
+	if (argc) {
+		usage_with_options(bench_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	if (buf_size < 4096)
+		buf_size = 4096;
+	buf = malloc(buf_size);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+
+	if (nr_sockets) {
+		fds = calloc(nr_sockets * 2, sizeof(*fds));
+		if (!fds)
+			err(EXIT_FAILURE, "calloc");
+		for (i = 0; i < nr_sockets; i++) {
+			if (socketpair(AF_UNIX, SOCK_STREAM, 0, &fds[2 * i]))
+				err(EXIT_FAILURE, "socketpair (raise ulimit -n?)");
+		}
+	}
+
+	if (do_scan("/proc/<pid>/stat", scan_pids, false) ||
+	    do_scan("/proc/<pid>/stat", scan_pids, true))
+		ret = -1;
+	if (do_scan("/proc/net/unix", scan_unix, false) ||
+	    do_scan("/proc/net/unix", scan_unix, true))
+		ret = -1;
+	if (ret)
+		fprintf(stderr, "binary tables not supported by this kernel?\n");
+
+	for (i = 0; fds && i < nr_sockets * 2; i++)
+		close(fds[i]);
+	free(fds);
+	free(buf);
+	return ret;
+}
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-pipe-bw.c
+ *
+ * pipe-bw: Bulk data throughput through a pipe
+ *
+ * Where 'perf bench sched pipe' measures the wakeup latency of a ping-pong
+ * of tiny messages, this streams a fixed amount of data from a writer to a
+ * reader and reports the bandwidth.  The pipe size, the size of the
+ * individual pipe buffers (F_SETPIPE_BUF_SZ) and vmsplice() on the writer
+ * side can be varied to see how each of them affects bulk transfers.
+ */
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/uio.h>
+#include <string.h>
+#include <err.h>
+#include <assert.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <linux/time64.h>
+
+#include <pthread.h>
+
+#ifndef F_SETPIPE_BUF_SZ
+#define F_SETPIPE_BUF_SZ	(1024 + 15)
+#endif
+
+static unsigned int	block_size = 64 * 1024;
+static unsigned int	total_mb = 4096;
+static unsigned int	pipe_size;
+static unsigned int	buf_size;
+static bool		use_vmsplice;
+
+/* Use processes by default: */
+static bool		threaded;
+
+static const struct option options[] = {
+	OPT_UINTEGER('b', "block",	&block_size,	"Bytes per write()/read() call"),
+	OPT_UINTEGER('s', "size",	&total_mb,	"Total amount of data to transfer, in MB"),
+	OPT_UINTEGER('p', "pipe-size",	&pipe_size,	"Pipe capacity in bytes (F_SETPIPE_SZ)"),
+	OPT_UINTEGER('B', "buf-size",	&buf_size,	"Size of the individual pipe buffers (F_SETPIPE_BUF_SZ)"),
+	OPT_BOOLEAN('V', "vmsplice",	&use_vmsplice,	"Feed the pipe with vmsplice() instead of write()"),
+	OPT_BOOLEAN('T', "threaded",	&threaded,	"Specify threads/process based task setup"),
+	OPT_END()
+};
+
+static const char * const bench_sched_pipe_bw_usage[] = {
+	"perf bench sched pipe-bw <options>",
+	NULL
+};
+
+struct pipe_bw_data {
+	int			fd;
+	unsigned long long	total;
+	pthread_t		pthread;
+};
+
+static void *writer_thread(void *arg)
+{
+	struct pipe_bw_data *td = arg;
+	unsigned long long done = 0;
+	char *buf;
+
+	buf = aligned_alloc(sysconf(_SC_PAGESIZE), block_size);
+	if (!buf)
+		err(EXIT_FAILURE, "aligned_alloc");
+	memset(buf, 0x5a, block_size);
+
+	while (done < td->total) {
+		size_t len = block_size;
+		ssize_t ret;
+
+		if (len > td->total - done)
+			len = td->total - done;
+
+		/*
+		 * Without SPLICE_F_GIFT the pages stay shared with the pipe
+		 * reader; the buffer is never modified after the memset
+		 * above, so reusing it for the next call is fine here.
+		 */
+		if (use_vmsplice) {
+			struct iovec iov = {
+				.iov_base = buf,
+				.iov_len  = len,
+			};
+
+			ret = vmsplice(td->fd, &iov, 1, 0);
+		} else {
+			ret = write(td->fd, buf, len);
+		}
+		if (ret <= 0)
+			err(EXIT_FAILURE, use_vmsplice ? "vmsplice" : "write");
+		done += ret;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct pipe_bw_data *td = arg;
+	unsigned long long done = 0;
+	char *buf;
+
+	buf = aligned_alloc(sysconf(_SC_PAGESIZE), block_size);
+	if (!buf)
+		err(EXIT_FAILURE, "aligned_alloc");
+
+	while (done < td->total) {
+		ssize_t ret = read(td->fd, buf, block_size);
+
+		if (ret <= 0)
+			err(EXIT_FAILURE, "read");
+		done += ret;
+	}
+
+	free(buf);
+	return NULL;
+}
+
+int bench_sched_pipe_bw(int argc, const char **argv)
+{
+	struct pipe_bw_data reader, writer;
+	struct timeval start, stop, diff;
+	unsigned long long total, result_usec;
+	int pipefd[2], wait_stat;
+	pid_t pid, retpid __maybe_unused;
+	int ret;
+
+	argc = parse_options(argc, argv, options, bench_sched_pipe_bw_usage, 0);
+	if (argc)
+		usage_with_options(bench_sched_pipe_bw_usage, options);
+
+	if (!block_size || !total_mb) {
+		fprintf(stderr, "block and total size must be non-zero\n");
+		exit(EXIT_FAILURE);
+	}
+
+	BUG_ON(pipe(pipefd));
+
+	/* Set the buffer size first: it caps how many slots a pipe size gives */
+	if (buf_size && fcntl(pipefd[1], F_SETPIPE_BUF_SZ, buf_size) < 0)
+		err(EXIT_FAILURE, "F_SETPIPE_BUF_SZ");
+	if (pipe_size && fcntl(pipefd[1], F_SETPIPE_SZ, pipe_size) < 0)
+		err(EXIT_FAILURE, "F_SETPIPE_SZ");
+	pipe_size = fcntl(pipefd[1], F_GETPIPE_SZ);
+
+	total = (unsigned long long)total_mb << 20;
+	reader.fd = pipefd[0];
+	reader.total = total;
+	writer.fd = pipefd[1];
+	writer.total = total;
+
+	gettimeofday(&start, NULL);
+
+	if (threaded) {
+		ret = pthread_create(&reader.pthread, NULL, reader_thread, &reader);
+		BUG_ON(ret);
+		ret = pthread_create(&writer.pthread, NULL, writer_thread, &writer);
+		BUG_ON(ret);
+
+		ret = pthread_join(writer.pthread, NULL);
+		BUG_ON(ret);
+		ret = pthread_join(reader.pthread, NULL);
+		BUG_ON(ret);
+	} else {
+		pid = fork();
+		assert(pid >= 0);
+
+		if (!pid) {
+			close(pipefd[1]);
+			reader_thread(&reader);
+			exit(0);
+		}
+		close(pipefd[0]);
+		writer_thread(&writer);
+
+		retpid = waitpid(pid, &wait_stat, 0);
+		assert((retpid == pid) && WIFEXITED(wait_stat));
+	}
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Transferred %u MB in %u byte %s between two %s\n",
+		       total_mb, block_size,
+		       use_vmsplice ? "vmsplice()s" : "write()s",
+		       threaded ? "threads" : "processes");
+		printf("# Pipe size %u bytes, buffer size %u bytes\n\n",
+		       pipe_size, buf_size ? buf_size : (unsigned int)sysconf(_SC_PAGESIZE));
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       (unsigned long) diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+
+		printf(" %14lf MB/sec\n",
+		       (double)total / (1 << 20) /
+		       ((double)result_usec / (double)USEC_PER_SEC));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n",
+		       (double)total / (1 << 20) /
+		       ((double)result_usec / (double)USEC_PER_SEC));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	if (threaded)
+		close(pipefd[0]);
+	close(pipefd[1]);
+	return 0;
+}
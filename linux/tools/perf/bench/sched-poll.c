@@ -0,0 +1,163 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-poll.c
+ *
+ * poll: poll() over a large, unchanging set of pipes
+ *
+ * Each round makes one of many pipes readable, then poll()s the whole set
+ * and drains the ready pipe, the way an event loop built on poll() spends
+ * its time when only a few of its many connections are active.  The cost
+ * is dominated by setting up and tearing down the wait queue entries of
+ * every descriptor, which PR_SET_POLL_CACHE (--cache) keeps across calls.
+ */
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <err.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <linux/time64.h>
+
+#ifndef PR_SET_POLL_CACHE
+#define PR_SET_POLL_CACHE	104
+#define PR_GET_POLL_CACHE	105
+#define PR_POLL_CACHE_OFF	0
+#define PR_POLL_CACHE_ON	1
+#endif
+
+static unsigned int	nr_fds = 10000;
+static unsigned int	loops = 100000;
+static bool		use_cache;
+
+static const struct option options[] = {
+	OPT_UINTEGER('n', "nr-fds",	&nr_fds,	"Number of pipes polled"),
+	OPT_UINTEGER('l', "loops",	&loops,		"Number of poll() calls"),
+	OPT_BOOLEAN('c', "cache",	&use_cache,	"Keep poll registrations across calls (PR_SET_POLL_CACHE)"),
+	OPT_END()
+};
+
+static const char * const bench_sched_poll_usage[] = {
+	"perf bench sched poll <options>",
+	NULL
+};
+
+/* Make room for two descriptors per pipe */
+static void raise_nofile(void)
+{
+	struct rlimit rl;
+	rlim_t need = 2 * (rlim_t)nr_fds + 16;
+
+	if (getrlimit(RLIMIT_NOFILE, &rl))
+		err(EXIT_FAILURE, "getrlimit");
+	if (rl.rlim_cur >= need)
+		return;
+	rl.rlim_cur = need;
+	if (rl.rlim_max < need)
+		rl.rlim_max = need;
+	if (setrlimit(RLIMIT_NOFILE, &rl))
+		err(EXIT_FAILURE, "setrlimit to %llu descriptors",
+		    (unsigned long long)need);
+}
+
+int bench_sched_poll(int argc, const char **argv)
+{
+	struct timeval start, stop, diff;
+	unsigned long long result_usec;
+	struct pollfd *pfds;
+	int *wfds;
+	unsigned int i;
+	char c = 0;
+
+	argc = parse_options(argc, argv, options, bench_sched_poll_usage, 0);
+	if (argc)
+		usage_with_options(bench_sched_poll_usage, options);
+
+	if (!nr_fds || !loops) {
+		fprintf(stderr, "nr-fds and loops must be non-zero\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (use_cache &&
+	    prctl(PR_SET_POLL_CACHE, PR_POLL_CACHE_ON, 0, 0, 0))
+		err(EXIT_FAILURE, "PR_SET_POLL_CACHE");
+
+	raise_nofile();
+	pfds = calloc(nr_fds, sizeof(*pfds));
+	wfds = calloc(nr_fds, sizeof(*wfds));
+	if (!pfds || !wfds)
+		err(EXIT_FAILURE, "calloc");
+
+	for (i = 0; i < nr_fds; i++) {
+		int fds[2];
+
+		if (pipe(fds))
+			err(EXIT_FAILURE, "pipe");
+		pfds[i].fd = fds[0];
+		pfds[i].events = POLLIN;
+		wfds[i] = fds[1];
+	}
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++) {
+		/* spread the activity over the set */
+		unsigned int k = (i * 7919u) % nr_fds;
+		int ret;
+
+		if (write(wfds[k], &c, 1) != 1)
+			err(EXIT_FAILURE, "write");
+		ret = poll(pfds, nr_fds, -1);
+		if (ret != 1 || !(pfds[k].revents & POLLIN))
+			errx(EXIT_FAILURE, "poll returned %d, expected pipe %u", ret, k);
+		if (read(pfds[k].fd, &c, 1) != 1)
+			err(EXIT_FAILURE, "read");
+	}
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Executed %u poll() calls on %u pipes%s\n\n",
+		       loops, nr_fds, use_cache ? " with PR_SET_POLL_CACHE" : "");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       (unsigned long) diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+
+		printf(" %14lf usecs/op\n",
+		       (double)result_usec / (double)loops);
+		printf(" %14d ops/sec\n",
+		       (int)((double)loops /
+			     ((double)result_usec / (double)USEC_PER_SEC)));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lu.%03lu\n",
+		       (unsigned long) diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	for (i = 0; i < nr_fds; i++) {
+		close(pfds[i].fd);
+		close(wfds[i]);
+	}
+	free(pfds);
+	free(wfds);
+	return 0;
+}
@@ -0,0 +1,346 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sched-sendfile.c
+ *
+ * sendfile: File to TCP socket throughput over loopback
+ *
+ * Serves a file over a loopback TCP connection the way a static file server
+ * would and reports the bandwidth.  The sender can use read()+write(),
+ * sendfile() or splice() through a pipe; the receiver either discards the
+ * data with read() or stores it to a file with splice(), which covers the
+ * socket to file direction.  Put the source file on a filesystem with large
+ * folios to see how they affect the zero-copy paths.
+ */
+#include <subcmd/parse-options.h>
+#include "bench.h"
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <string.h>
+#include <err.h>
+#include <assert.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <linux/time64.h>
+
+static const char	*file_name;
+static const char	*out_name;
+static const char	*mode_str = "sendfile";
+static unsigned int	file_mb = 1024;
+static unsigned int	loops = 4;
+static unsigned int	block_size = 1 << 20;
+
+enum sendfile_mode {
+	MODE_RW,
+	MODE_SENDFILE,
+	MODE_SPLICE,
+};
+
+static const struct option options[] = {
+	OPT_STRING('f', "file",		&file_name,	"path",	"File to send (default: a temporary file of --size MB)"),
+	OPT_UINTEGER('s', "size",	&file_mb,	"Size of the temporary file, in MB"),
+	OPT_UINTEGER('l', "loops",	&loops,		"Number of times the file is sent"),
+	OPT_UINTEGER('b', "block",	&block_size,	"Bytes per read()/write()/sendfile()/splice() call"),
+	OPT_STRING('m', "mode",		&mode_str,	"mode",	"How the file is sent: rw, sendfile or splice"),
+	OPT_STRING('o', "output",	&out_name,	"path",	"Splice the received data into this file instead of discarding it"),
+	OPT_END()
+};
+
+static const char * const bench_sched_sendfile_usage[] = {
+	"perf bench sched sendfile <options>",
+	NULL
+};
+
+static enum sendfile_mode parse_mode(void)
+{
+	if (!strcmp(mode_str, "rw"))
+		return MODE_RW;
+	if (!strcmp(mode_str, "sendfile"))
+		return MODE_SENDFILE;
+	if (!strcmp(mode_str, "splice"))
+		return MODE_SPLICE;
+
+	fprintf(stderr, "unknown mode '%s'\n", mode_str);
+	usage_with_options(bench_sched_sendfile_usage, options);
+	return MODE_SENDFILE;
+}
+
+/* Create and populate the temporary file, returns it opened for reading */
+static int create_file(unsigned long long size)
+{
+	char path[] = "/tmp/perf-bench-sendfile-XXXXXX";
+	unsigned long long done = 0;
+	char *buf;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		err(EXIT_FAILURE, "mkstemp");
+	unlink(path);
+
+	buf = malloc(block_size);
+	if (!buf)
+		err(EXIT_FAILURE, "malloc");
+	memset(buf, 0x5a, block_size);
+
+	while (done < size) {
+		size_t len = block_size;
+		ssize_t ret;
+
+		if (len > size - done)
+			len = size - done;
+		ret = write(fd, buf, len);
+		if (ret <= 0)
+			err(EXIT_FAILURE, "write");
+		done += ret;
+	}
+
+	free(buf);
+	return fd;
+}
+
+static void send_file(int sock, int fd, unsigned long long size,
+		      enum sendfile_mode mode)
+{
+	unsigned long long done = 0;
+	int pipefd[2] = { -1, -1 };
+	char *buf = NULL;
+	off_t off = 0;
+
+	if (mode == MODE_RW) {
+		buf = malloc(block_size);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc");
+	} else if (mode == MODE_SPLICE) {
+		if (pipe(pipefd))
+			err(EXIT_FAILURE, "pipe");
+		/* let one splice() move a whole block if the user allows it */
+		fcntl(pipefd[1], F_SETPIPE_SZ, block_size);
+	}
+
+	while (done < size) {
+		size_t len = block_size;
+		ssize_t ret;
+
+		if (len > size - done)
+			len = size - done;
+
+		switch (mode) {
+		case MODE_RW:
+			ret = pread(fd, buf, len, done);
+			if (ret <= 0)
+				err(EXIT_FAILURE, "pread");
+			ret = write(sock, buf, ret);
+			if (ret <= 0)
+				err(EXIT_FAILURE, "write");
+			break;
+		case MODE_SENDFILE:
+			ret = sendfile(sock, fd, &off, len);
+			if (ret <= 0)
+				err(EXIT_FAILURE, "sendfile");
+			break;
+		case MODE_SPLICE:
+		default:
+			ret = splice(fd, &off, pipefd[1], NULL, len, SPLICE_F_MORE);
+			if (ret <= 0)
+				err(EXIT_FAILURE, "splice from file");
+			len = ret;
+			while (len) {
+				ret = splice(pipefd[0], NULL, sock, NULL, len,
+					     SPLICE_F_MORE);
+				if (ret <= 0)
+					err(EXIT_FAILURE, "splice to socket");
+				len -= ret;
+			}
+			ret = off - done;
+			break;
+		}
+		done += ret;
+	}
+
+	if (pipefd[0] >= 0) {
+		close(pipefd[0]);
+		close(pipefd[1]);
+	}
+	free(buf);
+}
+
+static void receive(int sock, unsigned long long total)
+{
+	unsigned long long done = 0;
+	int pipefd[2], out = -1;
+	char *buf = NULL;
+
+	if (out_name) {
+		out = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+		if (out < 0)
+			err(EXIT_FAILURE, "open %s", out_name);
+		if (pipe(pipefd))
+			err(EXIT_FAILURE, "pipe");
+		fcntl(pipefd[1], F_SETPIPE_SZ, block_size);
+	} else {
+		buf = malloc(block_size);
+		if (!buf)
+			err(EXIT_FAILURE, "malloc");
+	}
+
+	while (done < total) {
+		ssize_t ret;
+
+		if (out < 0) {
+			ret = read(sock, buf, block_size);
+			if (ret <= 0)
+				err(EXIT_FAILURE, "read");
+			done += ret;
+			continue;
+		}
+
+		ret = splice(sock, NULL, pipefd[1], NULL, block_size,
+			     SPLICE_F_MORE);
+		if (ret <= 0)
+			err(EXIT_FAILURE, "splice from socket");
+		done += ret;
+		while (ret) {
+			ssize_t n = splice(pipefd[0], NULL, out, NULL, ret, 0);
+
+			if (n <= 0)
+				err(EXIT_FAILURE, "splice to file");
+			ret -= n;
+		}
+	}
+
+	if (out >= 0) {
+		close(pipefd[0]);
+		close(pipefd[1]);
+		close(out);
+	}
+	free(buf);
+}
+
+int bench_sched_sendfile(int argc, const char **argv)
+{
+	struct sockaddr_in addr = {
+		.sin_family	 = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t addrlen = sizeof(addr);
+	struct timeval start, stop, diff;
+	unsigned long long size, total, result_usec;
+	enum sendfile_mode mode;
+	int lsock, sock, fd, devnull, wait_stat;
+	pid_t pid, retpid __maybe_unused;
+	unsigned int i;
+	struct stat st;
+
+	argc = parse_options(argc, argv, options, bench_sched_sendfile_usage, 0);
+	if (argc)
+		usage_with_options(bench_sched_sendfile_usage, options);
+	mode = parse_mode();
+
+	if (!block_size || !loops || (!file_name && !file_mb)) {
+		fprintf(stderr, "block, loops and size must be non-zero\n");
+		exit(EXIT_FAILURE);
+	}
+
+	if (file_name) {
+		fd = open(file_name, O_RDONLY);
+		if (fd < 0 || fstat(fd, &st))
+			err(EXIT_FAILURE, "%s", file_name);
+		size = st.st_size;
+		if (!size) {
+			fprintf(stderr, "%s is empty\n", file_name);
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		size = (unsigned long long)file_mb << 20;
+		fd = create_file(size);
+	}
+	total = size * loops;
+
+	lsock = socket(AF_INET, SOCK_STREAM, 0);
+	if (lsock < 0)
+		err(EXIT_FAILURE, "socket");
+	if (bind(lsock, (struct sockaddr *)&addr, sizeof(addr)) ||
+	    getsockname(lsock, (struct sockaddr *)&addr, &addrlen) ||
+	    listen(lsock, 1))
+		err(EXIT_FAILURE, "bind/listen");
+
+	pid = fork();
+	assert(pid >= 0);
+
+	if (!pid) {
+		close(lsock);
+		sock = socket(AF_INET, SOCK_STREAM, 0);
+		if (sock < 0 ||
+		    connect(sock, (struct sockaddr *)&addr, sizeof(addr)))
+			err(EXIT_FAILURE, "connect");
+		receive(sock, total);
+		exit(0);
+	}
+
+	sock = accept(lsock, NULL, NULL);
+	if (sock < 0)
+		err(EXIT_FAILURE, "accept");
+
+	/* read the file once so that only the transfer itself is timed */
+	devnull = open("/dev/null", O_WRONLY);
+	if (devnull < 0)
+		err(EXIT_FAILURE, "/dev/null");
+	send_file(devnull, fd, size, MODE_RW);
+	close(devnull);
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < loops; i++)
+		send_file(sock, fd, size, mode);
+	close(sock);
+
+	retpid = waitpid(pid, &wait_stat, 0);
+	assert((retpid == pid) && WIFEXITED(wait_stat));
+
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	result_usec = diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+	if (!result_usec)
+		result_usec = 1;
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Sent %llu MB file %u times over loopback TCP with %s, %u byte blocks\n",
+		       size >> 20, loops, mode_str, block_size);
+		printf("# Receiver %s\n\n",
+		       out_name ? "splices into a file" : "discards with read()");
+
+		printf(" %14s: %lu.%03lu [sec]\n\n", "Total time",
+		       (unsigned long) diff.tv_sec,
+		       (unsigned long) (diff.tv_usec / USEC_PER_MSEC));
+
+		printf(" %14lf MB/sec\n",
+		       (double)total / (1 << 20) /
+		       ((double)result_usec / (double)USEC_PER_SEC));
+		break;
+
+	case BENCH_FORMAT_SIMPLE:
+		printf("%lf\n",
+		       (double)total / (1 << 20) /
+		       ((double)result_usec / (double)USEC_PER_SEC));
+		break;
+
+	default:
+		/* reaching here is something disaster */
+		fprintf(stderr, "Unknown format:%d\n", bench_format);
+		exit(1);
+		break;
+	}
+
+	close(lsock);
+	close(fd);
+	return 0;
+}
@@ -14,8 +14,11 @@
 #include <linux/compiler.h>
 #include <linux/time64.h>
 
+#include <errno.h>
 #include <inttypes.h>
+#include <pthread.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <time.h>
@@ -24,6 +27,7 @@
 
 #define LOOPS_DEFAULT 1000
 static int loops = LOOPS_DEFAULT;
+static unsigned int nthreads = 1;
 
 enum bench_uprobe {
         BENCH_UPROBE__BASELINE,
@@ -33,6 +37,7 @@ enum bench_uprobe {
 
 static const struct option options[] = {
 	OPT_INTEGER('l', "loop",	&loops,		"Specify number of loops"),
+	OPT_UINTEGER('t', "threads",	&nthreads,	"Specify number of threads, each running the loops"),
 	OPT_END()
 };
 
@@ -109,7 +114,13 @@ static int bench_uprobe_format__default_fprintf(const char *name, const char *un
 	static u64 baseline, previous;
 	s64 diff_to_baseline = diff - baseline,
 	    diff_to_previous = diff - previous;
-	int printed = fprintf(fp, "# Executed %'d %s calls\n", loops, name);
+	int printed;
+
+	if (nthreads > 1)
+		printed = fprintf(fp, "# Executed %'d %s calls in each of %u threads\n",
+				  loops, name, nthreads);
+	else
+		printed = fprintf(fp, "# Executed %'d %s calls\n", loops, name);
 
 	printed += fprintf(fp, " %14s: %'" PRIu64 " %ss", "Total time", diff, unit);
 
@@ -138,22 +149,66 @@ static int bench_uprobe_format__default_fprintf(const char *name, const char *un
 	return printed + 1;
 }
 
+static void *bench_uprobe__loop(void *arg __maybe_unused)
+{
+	int i;
+
+	for (i = 0; i < loops; i++) {
+		usleep(USEC_PER_MSEC);
+	}
+
+	return NULL;
+}
+
+/*
+ * With several threads all of them hit the probe at once, which is what
+ * shows contention in the breakpoint hit path.
+ */
+static int bench_uprobe__run_threads(void)
+{
+	pthread_t *threads = calloc(nthreads, sizeof(*threads));
+	unsigned int i, started;
+	int err = 0;
+
+	if (!threads)
+		return -ENOMEM;
+
+	for (started = 0; started < nthreads; started++) {
+		err = pthread_create(&threads[started], NULL, bench_uprobe__loop, NULL);
+		if (err) {
+			fprintf(stderr, "Failed to create thread %u: %s\n", started, strerror(err));
+			break;
+		}
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	free(threads);
+	return err ? -err : 0;
+}
+
 static int bench_uprobe(int argc, const char **argv, enum bench_uprobe bench)
 {
 	const char *name = "usleep(1000)", *unit = "usec";
 	struct timespec start, end;
 	u64 diff;
-	int i;
 
 	argc = parse_options(argc, argv, options, bench_uprobe_usage, 0);
 
+	if (!nthreads)
+		nthreads = 1;
+
 	if (bench != BENCH_UPROBE__BASELINE && bench_uprobe__setup_bpf_skel(bench) < 0)
 		return 0;
 
         clock_gettime(CLOCK_REALTIME, &start);
 
-	for (i = 0; i < loops; i++) {
-		usleep(USEC_PER_MSEC);
+	if (nthreads > 1) {
+		if (bench_uprobe__run_threads() < 0)
+			goto out;
+	} else {
+		bench_uprobe__loop(NULL);
 	}
 
 	clock_gettime(CLOCK_REALTIME, &end);
@@ -176,6 +231,7 @@ static int bench_uprobe(int argc, const char **argv, enum bench_uprobe bench)
 		exit(1);
 	}
 
+out:
 	if (bench != BENCH_UPROBE__BASELINE)
 		bench_uprobe__teardown_bpf_skel();
 
@@ -0,0 +1,107 @@
+// SPDX-License-Identifier: GPL-2.0
+/* Helpers shared by the map_tests of test_maps */
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+void pin_to_cpu(int cpu)
+{
+	cpu_set_t set;
+
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	CHECK(sched_setaffinity(0, sizeof(set), &set), "sched_setaffinity",
+	      "cpu %d: %s\n", cpu, strerror(errno));
+}
+
+long long fdinfo_value(int fd, const char *key)
+{
+	char path[64], line[256];
+	long long val = -1;
+	size_t len = strlen(key);
+	FILE *f;
+
+	snprintf(path, sizeof(path), "/proc/self/fdinfo/%d", fd);
+	f = fopen(path, "r");
+	CHECK(!f, "fopen", "%s: %s\n", path, strerror(errno));
+	while (fgets(line, sizeof(line), f)) {
+		if (!strncmp(line, key, len) && line[len] == ':') {
+			val = strtoll(line + len + 1, NULL, 10);
+			break;
+		}
+	}
+	fclose(f);
+	return val;
+}
+
+int load_lookup_prog(int map_fd, __u32 nr, const struct bpf_insn *key_insns,
+		     __u32 nr_key_insns, int key_off)
+{
+	struct bpf_insn head[] = {
+		BPF_MOV64_IMM(BPF_REG_1, nr),
+		BPF_RAW_INSN(BPF_LD | BPF_IMM | BPF_DW, BPF_REG_2,
+			     BPF_PSEUDO_FUNC, 0, 6),
+		BPF_RAW_INSN(0, 0, 0, 0, 0),
+		BPF_MOV64_IMM(BPF_REG_3, 0),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_loop),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+		/* callback(index, ctx): the key instructions go here */
+	};
+	struct bpf_insn tail[] = {
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -key_off),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	LIBBPF_OPTS(bpf_prog_load_opts, opts, .prog_flags = BPF_F_SLEEPABLE);
+	__u32 cnt = ARRAY_SIZE(head) + nr_key_insns + ARRAY_SIZE(tail);
+	struct bpf_insn *insns;
+	int fd;
+
+	insns = calloc(cnt, sizeof(*insns));
+	CHECK(!insns, "calloc", "out of memory\n");
+	memcpy(insns, head, sizeof(head));
+	memcpy(insns + ARRAY_SIZE(head), key_insns,
+	       nr_key_insns * sizeof(*insns));
+	memcpy(insns + ARRAY_SIZE(head) + nr_key_insns, tail, sizeof(tail));
+
+	fd = bpf_prog_load(BPF_PROG_TYPE_SYSCALL, NULL, "GPL", insns, cnt,
+			   &opts);
+	CHECK(fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+	free(insns);
+	return fd;
+}
+
+double time_lookups(int map_fd, __u32 nr, const struct bpf_insn *key_insns,
+		    __u32 nr_key_insns, int key_off)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, topts);
+	struct timespec t0, t1;
+	int prog_fd, err;
+
+	prog_fd = load_lookup_prog(map_fd, nr, key_insns, nr_key_insns,
+				   key_off);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	err = bpf_prog_test_run_opts(prog_fd, &topts);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	CHECK(err, "bpf_prog_test_run", "error: %s\n", strerror(errno));
+	close(prog_fd);
+
+	return ((t1.tv_sec - t0.tv_sec) * 1e9 + (t1.tv_nsec - t0.tv_nsec)) / nr;
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: GPL-2.0 */
+#ifndef __MAP_HELPERS_H
+#define __MAP_HELPERS_H
+
+#include <linux/types.h>
+
+struct bpf_insn;
+
+/* Pin the calling thread to @cpu */
+void pin_to_cpu(int cpu);
+
+/* Value of "@key:" in the fdinfo of @fd, -1 if it is not there */
+long long fdinfo_value(int fd, const char *key);
+
+/* Syscall program doing @nr lookups in @map_fd.  The @nr_key_insns
+ * instructions of @key_insns build each key at fp - @key_off from the
+ * loop index in r1.
+ */
+int load_lookup_prog(int map_fd, __u32 nr, const struct bpf_insn *key_insns,
+		     __u32 nr_key_insns, int key_off);
+
+/* Average time of one lookup of a load_lookup_prog() program, in ns */
+double time_lookups(int map_fd, __u32 nr, const struct bpf_insn *key_insns,
+		    __u32 nr_key_insns, int key_off);
+
+#endif /* __MAP_HELPERS_H */
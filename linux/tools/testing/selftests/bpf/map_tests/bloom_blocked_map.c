@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_F_BLOOM_BLOCKED bloom filters: flag checks, no false negatives, and
+ * the false positive rate and lookup time against the default layout.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+static int create_bloom(__u32 flags, __u32 value_size, __u32 max_entries,
+			__u64 nr_hash_funcs)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = flags,
+		    .map_extra = nr_hash_funcs);
+
+	return bpf_map_create(BPF_MAP_TYPE_BLOOM_FILTER, NULL, 0, value_size,
+			      max_entries, &opts);
+}
+
+static void test_bloom_blocked_flags(void)
+{
+	__u32 value = 0;
+	int fd, err;
+
+	fd = create_bloom(BPF_F_BLOOM_BLOCKED, sizeof(value), 1, 15);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	err = bpf_map_lookup_elem(fd, NULL, &value);
+	CHECK(!err || errno != ENOENT, "empty", "err %d errno %d\n", err, errno);
+	err = bpf_map_update_elem(fd, NULL, &value, BPF_ANY);
+	CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	err = bpf_map_lookup_elem(fd, NULL, &value);
+	CHECK(err, "bpf_map_lookup_elem", "error: %s\n", strerror(errno));
+	close(fd);
+
+	fd = create_bloom(BPF_F_BLOOM_BLOCKED, sizeof(value), 1, 16);
+	CHECK(fd >= 0 || errno != EINVAL, "16 hash funcs", "fd %d errno %d\n",
+	      fd, errno);
+
+	printf("%s:PASS\n", __func__);
+}
+
+/* Push @nr values, check all of them are found and return the share of
+ * @nr other values that are reported too, in percent
+ */
+static double bloom_fp_rate(__u32 flags, __u32 nr, __u64 *ns)
+{
+	struct timespec t0, t1;
+	__u32 fp = 0;
+	__u64 value;
+	int fd, err;
+	__u32 i;
+
+	fd = create_bloom(flags | BPF_F_ZERO_SEED, sizeof(value), nr, 0);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	for (i = 0; i < nr; i++) {
+		value = (__u64)i * 2654435761U;
+		err = bpf_map_update_elem(fd, NULL, &value, BPF_ANY);
+		CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	}
+
+	for (i = 0; i < nr; i++) {
+		value = (__u64)i * 2654435761U;
+		err = bpf_map_lookup_elem(fd, NULL, &value);
+		CHECK(err, "false negative", "value %u\n", i);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nr; i++) {
+		value = (__u64)i * 2654435761U + 1;
+		if (!bpf_map_lookup_elem(fd, NULL, &value))
+			fp++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	*ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+	      (t1.tv_nsec - t0.tv_nsec);
+
+	close(fd);
+	return 100.0 * fp / nr;
+}
+
+static void test_bloom_blocked_fp(__u32 nr)
+{
+	double rate, blocked_rate;
+	__u64 ns, blocked_ns;
+
+	rate = bloom_fp_rate(0, nr, &ns);
+	blocked_rate = bloom_fp_rate(BPF_F_BLOOM_BLOCKED, nr, &blocked_ns);
+	printf("%s: %u values, %.3lf%% false positives in %llu us (default), %.3lf%% in %llu us (BPF_F_BLOOM_BLOCKED)\n",
+	       __func__, nr, rate, (unsigned long long)ns / 1000,
+	       blocked_rate, (unsigned long long)blocked_ns / 1000);
+	/* 5 hash funcs at 7 bits per value: about 4% */
+	CHECK(blocked_rate > 10, "false positives", "%.3lf%%\n", blocked_rate);
+
+	printf("%s:PASS\n", __func__);
+}
+
+void test_bloom_blocked_map(void)
+{
+	test_bloom_blocked_flags();
+	test_bloom_blocked_fp(1 << 20);
+}
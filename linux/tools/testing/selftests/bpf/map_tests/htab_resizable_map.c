@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * A BPF_F_RESIZABLE hash map must hold and iterate the same elements as a
+ * fixed size one while its table grows and shrinks underneath.  Fill and
+ * drain one through every kind of access, then time lookups from a BPF
+ * program against a map sized for max_entries up front.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+static int create_htab(enum bpf_map_type type, __u32 flags, __u32 max_entries)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = flags);
+
+	return bpf_map_create(type, NULL, sizeof(__u32), sizeof(__u64),
+			      max_entries, &opts);
+}
+
+static void test_htab_resizable_flags(void)
+{
+	int fd;
+
+	/* preallocated and LRU maps do not resize */
+	fd = create_htab(BPF_MAP_TYPE_HASH, BPF_F_RESIZABLE, 1024);
+	CHECK(fd >= 0 || errno != EINVAL, "prealloc", "fd %d errno %d\n",
+	      fd, errno);
+	fd = create_htab(BPF_MAP_TYPE_LRU_HASH,
+			 BPF_F_NO_PREALLOC | BPF_F_RESIZABLE, 1024);
+	CHECK(fd >= 0, "LRU", "fd %d errno %d\n", fd, errno);
+	fd = create_htab(BPF_MAP_TYPE_HASH_OF_MAPS,
+			 BPF_F_NO_PREALLOC | BPF_F_RESIZABLE, 1024);
+	CHECK(fd >= 0, "HASH_OF_MAPS", "fd %d errno %d\n", fd, errno);
+
+	printf("%s:PASS\n", __func__);
+}
+
+static __u32 count_keys(int fd)
+{
+	__u32 key, next, n = 0;
+	void *prev = NULL;
+
+	while (!bpf_map_get_next_key(fd, prev, &next)) {
+		key = next;
+		prev = &key;
+		n++;
+		CHECK(n > 10000000, "get_next_key", "does not terminate\n");
+	}
+	return n;
+}
+
+static __u32 count_batch(int fd, __u32 nr)
+{
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u32 batch, count, total = 0;
+	__u64 *values;
+	__u32 *keys;
+	void *in = NULL;
+	int err;
+
+	/* room for a full bucket, percpu values included */
+	keys = calloc(nr, sizeof(*keys));
+	values = calloc(nr, sizeof(*values) * sysconf(_SC_NPROCESSORS_CONF));
+	CHECK(!keys || !values, "calloc", "out of memory\n");
+
+	do {
+		count = nr;
+		err = bpf_map_lookup_batch(fd, in, &batch, keys, values,
+					   &count, &opts);
+		CHECK(err && errno != ENOENT, "bpf_map_lookup_batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+		in = &batch;
+	} while (!err);
+
+	free(keys);
+	free(values);
+	return total;
+}
+
+static void test_htab_resizable(enum bpf_map_type type, __u32 nr)
+{
+	__u64 *value;
+	__u32 i, n;
+	int fd, err;
+
+	fd = create_htab(type, BPF_F_NO_PREALLOC | BPF_F_RESIZABLE, nr);
+	CHECK(fd < 0, "bpf_map_create", "type %d: %s\n", type, strerror(errno));
+
+	value = calloc(sysconf(_SC_NPROCESSORS_CONF), sizeof(*value));
+	CHECK(!value, "calloc", "out of memory\n");
+
+	/* the table grows in the background while this runs */
+	for (i = 0; i < nr; i++) {
+		value[0] = i;
+		err = bpf_map_update_elem(fd, &i, value, BPF_NOEXIST);
+		CHECK(err, "bpf_map_update_elem", "key %u: %s\n", i,
+		      strerror(errno));
+	}
+	err = bpf_map_update_elem(fd, &i, value, BPF_NOEXIST);
+	CHECK(!err || errno != E2BIG, "max_entries", "err %d errno %d\n",
+	      err, errno);
+
+	for (i = 0; i < nr; i++) {
+		err = bpf_map_lookup_elem(fd, &i, value);
+		CHECK(err || value[0] != i, "bpf_map_lookup_elem",
+		      "key %u: err %d value %llu\n", i, err,
+		      (unsigned long long)value[0]);
+	}
+
+	n = count_keys(fd);
+	CHECK(n != nr, "get_next_key", "%u keys, expected %u\n", n, nr);
+	n = count_batch(fd, nr);
+	CHECK(n != nr, "lookup_batch", "%u keys, expected %u\n", n, nr);
+
+	/* and shrinks again while they are deleted */
+	for (i = 0; i < nr; i += 2) {
+		err = bpf_map_delete_elem(fd, &i);
+		CHECK(err, "bpf_map_delete_elem", "key %u: %s\n", i,
+		      strerror(errno));
+	}
+	for (i = 0; i < nr; i++) {
+		err = bpf_map_lookup_elem(fd, &i, value);
+		CHECK((err == 0) != (i & 1), "lookup after delete", "key %u: err %d\n",
+		      i, err);
+	}
+	/* exact even while the table shrinks under get_next_key */
+	n = count_keys(fd);
+	CHECK(n != nr / 2, "get_next_key after delete", "%u keys, expected %u\n",
+	      n, nr / 2);
+
+	for (i = 1; i < nr; i += 2)
+		bpf_map_delete_elem(fd, &i);
+	CHECK(count_keys(fd), "delete all", "keys left\n");
+
+	free(value);
+	close(fd);
+
+	printf("%s(type %d):PASS\n", __func__, type);
+}
+
+/* Drain a map with lookup_and_delete_batch, which shrinks the table under
+ * the batch cursor.  Every key must come back, and only once.
+ */
+static void test_htab_resizable_drain(enum bpf_map_type type, __u32 nr)
+{
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	/* values of percpu maps come one per possible CPU */
+	long stride = type == BPF_MAP_TYPE_PERCPU_HASH ?
+		      sysconf(_SC_NPROCESSORS_CONF) : 1;
+	__u32 i, count, total = 0, batch, calls = 0;
+	__u32 *keys, *seen, next;
+	__u64 *values;
+	void *in = NULL;
+	int fd, err;
+
+	fd = create_htab(type, BPF_F_NO_PREALLOC | BPF_F_RESIZABLE, nr);
+	CHECK(fd < 0, "bpf_map_create", "type %d: %s\n", type, strerror(errno));
+
+	keys = calloc(nr, sizeof(*keys));
+	seen = calloc(nr, sizeof(*seen));
+	values = calloc((size_t)nr * stride, sizeof(*values));
+	CHECK(!keys || !seen || !values, "calloc", "out of memory\n");
+
+	for (i = 0; i < nr; i++) {
+		values[0] = i;
+		err = bpf_map_update_elem(fd, &i, values, BPF_NOEXIST);
+		CHECK(err, "bpf_map_update_elem", "key %u: %s\n", i,
+		      strerror(errno));
+	}
+
+	do {
+		count = nr - total < 64 ? nr - total : 64;
+		err = bpf_map_lookup_and_delete_batch(fd, in, &batch,
+						      keys + total,
+						      values + (size_t)total * stride,
+						      &count, &opts);
+		CHECK(err && errno != ENOENT, "lookup_and_delete_batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+		in = &batch;
+		/* let the shrink run between batches now and then */
+		if (!(++calls % 32))
+			usleep(1000);
+	} while (!err && total < nr);
+	CHECK(total != nr, "lookup_and_delete_batch", "%u keys, expected %u\n",
+	      total, nr);
+
+	for (i = 0; i < nr; i++) {
+		CHECK(keys[i] >= nr || seen[keys[i]]++, "keys",
+		      "key %u returned twice or out of range\n", keys[i]);
+		CHECK(values[i * stride] != keys[i], "values",
+		      "key %u has value %llu\n", keys[i],
+		      (unsigned long long)values[i * stride]);
+	}
+	err = bpf_map_get_next_key(fd, NULL, &next);
+	CHECK(!err || errno != ENOENT, "empty", "err %d errno %d\n", err, errno);
+
+	free(values);
+	free(seen);
+	free(keys);
+	close(fd);
+
+	printf("%s(type %d):PASS\n", __func__, type);
+}
+
+/* look up the loop index */
+static const struct bpf_insn key_insns[] = {
+	BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -4),
+};
+
+/* Lookup times of @nr keys in a map created for @max_entries */
+static void bench_htab_resizable(__u32 nr, __u32 max_entries)
+{
+	__u64 value = 0;
+	int fixed_fd, rs_fd;
+	double fixed_ns, rs_ns;
+	__u32 i;
+
+	fixed_fd = create_htab(BPF_MAP_TYPE_HASH, BPF_F_NO_PREALLOC,
+			       max_entries);
+	CHECK(fixed_fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	rs_fd = create_htab(BPF_MAP_TYPE_HASH,
+			    BPF_F_NO_PREALLOC | BPF_F_RESIZABLE, max_entries);
+	CHECK(rs_fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+
+	for (i = 0; i < nr; i++) {
+		CHECK(bpf_map_update_elem(fixed_fd, &i, &value, BPF_ANY),
+		      "bpf_map_update_elem", "error: %s\n", strerror(errno));
+		CHECK(bpf_map_update_elem(rs_fd, &i, &value, BPF_ANY),
+		      "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	}
+	/* let a resize that is still running finish */
+	usleep(100000);
+
+	fixed_ns = time_lookups(fixed_fd, nr, key_insns,
+				ARRAY_SIZE(key_insns), 4);
+	rs_ns = time_lookups(rs_fd, nr, key_insns, ARRAY_SIZE(key_insns), 4);
+	printf("%s: %u of %u keys, lookup %.1lf ns (fixed), %.1lf ns (resizable)\n",
+	       __func__, nr, max_entries, fixed_ns, rs_ns);
+
+	close(fixed_fd);
+	close(rs_fd);
+}
+
+void test_htab_resizable_map(void)
+{
+	test_htab_resizable_flags();
+	test_htab_resizable(BPF_MAP_TYPE_HASH, 100000);
+	test_htab_resizable(BPF_MAP_TYPE_PERCPU_HASH, 20000);
+	test_htab_resizable_drain(BPF_MAP_TYPE_HASH, 100000);
+	test_htab_resizable_drain(BPF_MAP_TYPE_PERCPU_HASH, 20000);
+	bench_htab_resizable(1000, 1 << 20);
+	bench_htab_resizable(1 << 20, 1 << 20);
+}
@@ -0,0 +1,232 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_MAP_TYPE_LPM_MULTIBIT must give the same answers as
+ * BPF_MAP_TYPE_LPM_TRIE.  Fill both with the same random prefixes, compare
+ * lookups and iteration, then time lookups from a BPF program on each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+struct lpm_key4 {
+	__u32 prefixlen;
+	__u8 data[4];
+};
+
+struct lpm_key6 {
+	__u32 prefixlen;
+	__u8 data[16];
+};
+
+static int create_lpm(enum bpf_map_type type, __u32 key_size, __u32 max_entries)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = BPF_F_NO_PREALLOC);
+	int fd;
+
+	fd = bpf_map_create(type, NULL, key_size, sizeof(__u32), max_entries,
+			    &opts);
+	CHECK(fd < 0, "bpf_map_create", "type %d: %s\n", type, strerror(errno));
+	return fd;
+}
+
+/* Mostly /24 and /16 like a routing table, with some of every length */
+static __u32 random_prefixlen(__u32 max)
+{
+	__u32 r = rand() % 100;
+
+	if (max == 32 && r < 50)
+		return 24;
+	if (max == 32 && r < 70)
+		return 16;
+	return rand() % (max + 1);
+}
+
+static void random_key(__u32 *prefixlen, __u8 *data, __u32 size)
+{
+	__u32 i;
+
+	*prefixlen = random_prefixlen(size * 8);
+	for (i = 0; i < size; i++)
+		data[i] = rand();
+}
+
+static void update_both(int trie_fd, int mb_fd, void *keys, __u32 *values,
+			__u32 count)
+{
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u32 n;
+	int err;
+
+	n = count;
+	err = bpf_map_update_batch(trie_fd, keys, values, &n, &opts);
+	CHECK(err, "bpf_map_update_batch(LPM_TRIE)", "error: %s\n", strerror(errno));
+	n = count;
+	err = bpf_map_update_batch(mb_fd, keys, values, &n, &opts);
+	CHECK(err, "bpf_map_update_batch(LPM_MULTIBIT)", "error: %s\n",
+	      strerror(errno));
+}
+
+static void compare_lookups(int trie_fd, int mb_fd, __u32 data_size,
+			    __u32 nr_lookups)
+{
+	__u8 key[sizeof(__u32) + 16];
+	__u32 v1, v2, i;
+	int e1, e2;
+
+	for (i = 0; i < nr_lookups; i++) {
+		random_key((__u32 *)key, key + sizeof(__u32), data_size);
+		/* mostly full length addresses, as from a packet */
+		if (i % 4)
+			*(__u32 *)key = data_size * 8;
+
+		e1 = bpf_map_lookup_elem(trie_fd, key, &v1);
+		e2 = bpf_map_lookup_elem(mb_fd, key, &v2);
+		CHECK(!e1 != !e2 || (!e1 && v1 != v2), "lookup mismatch",
+		      "prefixlen %u: LPM_TRIE %d/%u LPM_MULTIBIT %d/%u\n",
+		      *(__u32 *)key, e1, e1 ? 0 : v1, e2, e2 ? 0 : v2);
+	}
+}
+
+static __u32 count_keys(int fd, __u32 key_size)
+{
+	__u8 key[sizeof(__u32) + 16], next[sizeof(__u32) + 16];
+	void *prev = NULL;
+	__u32 n = 0;
+
+	while (!bpf_map_get_next_key(fd, prev, next)) {
+		memcpy(key, next, key_size);
+		prev = key;
+		n++;
+		CHECK(n > 10000000, "get_next_key", "does not terminate\n");
+	}
+	return n;
+}
+
+static void test_lpm_multibit_compare(__u32 data_size, __u32 nr)
+{
+	__u32 key_size = sizeof(__u32) + data_size;
+	int trie_fd, mb_fd;
+	__u32 *values, i, n1, n2;
+	__u8 *keys;
+
+	trie_fd = create_lpm(BPF_MAP_TYPE_LPM_TRIE, key_size, nr);
+	mb_fd = create_lpm(BPF_MAP_TYPE_LPM_MULTIBIT, key_size, nr);
+
+	keys = calloc(nr, key_size);
+	values = calloc(nr, sizeof(*values));
+	CHECK(!keys || !values, "calloc", "out of memory\n");
+	for (i = 0; i < nr; i++) {
+		random_key((__u32 *)(keys + i * key_size),
+			   keys + i * key_size + sizeof(__u32), data_size);
+		values[i] = i;
+	}
+
+	update_both(trie_fd, mb_fd, keys, values, nr);
+	compare_lookups(trie_fd, mb_fd, data_size, 100000);
+
+	n1 = count_keys(trie_fd, key_size);
+	n2 = count_keys(mb_fd, key_size);
+	CHECK(n1 != n2, "get_next_key", "LPM_TRIE %u keys, LPM_MULTIBIT %u\n",
+	      n1, n2);
+
+	/* delete every other prefix, duplicates may already be gone */
+	for (i = 0; i < nr; i += 2) {
+		bpf_map_delete_elem(trie_fd, keys + i * key_size);
+		bpf_map_delete_elem(mb_fd, keys + i * key_size);
+	}
+	compare_lookups(trie_fd, mb_fd, data_size, 100000);
+	n1 = count_keys(trie_fd, key_size);
+	n2 = count_keys(mb_fd, key_size);
+	CHECK(n1 != n2, "get_next_key after delete",
+	      "LPM_TRIE %u keys, LPM_MULTIBIT %u\n", n1, n2);
+
+	/* and the rest, which must leave both empty */
+	for (i = 1; i < nr; i += 2) {
+		bpf_map_delete_elem(trie_fd, keys + i * key_size);
+		bpf_map_delete_elem(mb_fd, keys + i * key_size);
+	}
+	CHECK(count_keys(mb_fd, key_size), "delete all", "keys left\n");
+
+	free(keys);
+	free(values);
+	close(trie_fd);
+	close(mb_fd);
+
+	printf("%s(%u bytes):PASS\n", __func__, data_size);
+}
+
+/* look up the pseudo-random IPv4 address { 32, index * golden ratio } */
+static const struct bpf_insn key_insns[] = {
+	BPF_ALU32_IMM(BPF_MUL, BPF_REG_1, 0x9e3779b1),
+	BPF_ST_MEM(BPF_W, BPF_REG_10, -8, 32),
+	BPF_STX_MEM(BPF_W, BPF_REG_10, BPF_REG_1, -4),
+};
+
+/* Lookup and bulk load times with a table of @nr IPv4 prefixes */
+static void bench_lpm_multibit(__u32 nr)
+{
+	const __u32 nr_lookups = 1 << 22;
+	__u32 key_size = sizeof(struct lpm_key4);
+	struct timespec t0, t1, t2;
+	double trie_ns, mb_ns;
+	struct lpm_key4 *keys;
+	int trie_fd, mb_fd;
+	__u32 *values, i, n;
+
+	trie_fd = create_lpm(BPF_MAP_TYPE_LPM_TRIE, key_size, nr);
+	mb_fd = create_lpm(BPF_MAP_TYPE_LPM_MULTIBIT, key_size, nr);
+
+	keys = calloc(nr, sizeof(*keys));
+	values = calloc(nr, sizeof(*values));
+	CHECK(!keys || !values, "calloc", "out of memory\n");
+	for (i = 0; i < nr; i++) {
+		random_key(&keys[i].prefixlen, keys[i].data, 4);
+		values[i] = i;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	n = nr;
+	CHECK(bpf_map_update_batch(trie_fd, keys, values, &n, NULL),
+	      "bpf_map_update_batch(LPM_TRIE)", "error: %s\n", strerror(errno));
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	n = nr;
+	CHECK(bpf_map_update_batch(mb_fd, keys, values, &n, NULL),
+	      "bpf_map_update_batch(LPM_MULTIBIT)", "error: %s\n", strerror(errno));
+	clock_gettime(CLOCK_MONOTONIC, &t2);
+
+	printf("%s: %u prefixes loaded in %.1lf ms (LPM_TRIE), %.1lf ms (LPM_MULTIBIT)\n",
+	       __func__, nr,
+	       (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+	       (t2.tv_sec - t1.tv_sec) * 1e3 + (t2.tv_nsec - t1.tv_nsec) / 1e6);
+
+	trie_ns = time_lookups(trie_fd, nr_lookups, key_insns,
+			       ARRAY_SIZE(key_insns), 8);
+	mb_ns = time_lookups(mb_fd, nr_lookups, key_insns,
+			     ARRAY_SIZE(key_insns), 8);
+	printf("%s: lookup %.1lf ns (LPM_TRIE), %.1lf ns (LPM_MULTIBIT)\n",
+	       __func__, trie_ns, mb_ns);
+
+	free(keys);
+	free(values);
+	close(trie_fd);
+	close(mb_fd);
+}
+
+void test_lpm_multibit_map(void)
+{
+	srand(time(NULL));
+
+	test_lpm_multibit_compare(sizeof(((struct lpm_key4 *)0)->data), 50000);
+	test_lpm_multibit_compare(sizeof(((struct lpm_key6 *)0)->data), 20000);
+	bench_lpm_multibit(500000);
+}
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_F_LRU_CLOCK LRU hash maps: flag checks, second chance for elements
+ * a program keeps using, the fdinfo counters, and insert throughput of a
+ * full map from all CPUs against the common LRU.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+#define HOT_KEY		0xffffffff
+
+static int create_lru(enum bpf_map_type type, __u32 flags, __u32 max_entries)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = flags);
+
+	return bpf_map_create(type, NULL, sizeof(__u32), sizeof(__u64),
+			      max_entries, &opts);
+}
+
+static void test_lru_clock_flags(void)
+{
+	int fd;
+
+	fd = create_lru(BPF_MAP_TYPE_HASH, BPF_F_LRU_CLOCK, 1024);
+	CHECK(fd >= 0 || errno != EINVAL, "HASH", "fd %d errno %d\n", fd, errno);
+	fd = create_lru(BPF_MAP_TYPE_LRU_HASH,
+			BPF_F_LRU_CLOCK | BPF_F_NO_COMMON_LRU, 1024);
+	CHECK(fd >= 0 || errno != EINVAL, "NO_COMMON_LRU", "fd %d errno %d\n",
+	      fd, errno);
+
+	fd = create_lru(BPF_MAP_TYPE_LRU_PERCPU_HASH, BPF_F_LRU_CLOCK, 1024);
+	CHECK(fd < 0, "LRU_PERCPU_HASH", "error: %s\n", strerror(errno));
+	close(fd);
+
+	/* the counters are only there in clock mode */
+	fd = create_lru(BPF_MAP_TYPE_LRU_HASH, 0, 1024);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	CHECK(fdinfo_value(fd, "lru_evictions") != -1, "fdinfo",
+	      "lru_evictions without BPF_F_LRU_CLOCK\n");
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+/* Syscall program looking up HOT_KEY, which sets its ref bit */
+static int load_touch_prog(int map_fd)
+{
+	struct bpf_insn insns[] = {
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -4, HOT_KEY),
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -4),
+		BPF_EMIT_CALL(BPF_FUNC_map_lookup_elem),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	LIBBPF_OPTS(bpf_prog_load_opts, opts, .prog_flags = BPF_F_SLEEPABLE);
+	int fd;
+
+	fd = bpf_prog_load(BPF_PROG_TYPE_SYSCALL, NULL, "GPL", insns,
+			   ARRAY_SIZE(insns), &opts);
+	CHECK(fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+	return fd;
+}
+
+/* Stream 4 * @nr new keys through a map of @nr while a program keeps
+ * touching HOT_KEY, which the sweeps must keep giving a second chance.
+ */
+static void test_lru_clock_evict(__u32 nr)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, topts);
+	__u32 key, next, n = 0, hot = HOT_KEY;
+	int fd, prog_fd, err;
+	__u64 value = 0;
+	void *prev = NULL;
+
+	pin_to_cpu(0);
+
+	fd = create_lru(BPF_MAP_TYPE_LRU_HASH, BPF_F_LRU_CLOCK, nr);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	prog_fd = load_touch_prog(fd);
+
+	err = bpf_map_update_elem(fd, &hot, &value, BPF_NOEXIST);
+	CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+
+	for (key = 0; key < 4 * nr; key++) {
+		err = bpf_map_update_elem(fd, &key, &value, BPF_NOEXIST);
+		CHECK(err, "bpf_map_update_elem", "key %u: %s\n", key,
+		      strerror(errno));
+		if (!(key % 64)) {
+			err = bpf_prog_test_run_opts(prog_fd, &topts);
+			CHECK(err, "bpf_prog_test_run", "error: %s\n",
+			      strerror(errno));
+		}
+	}
+
+	CHECK(bpf_map_lookup_elem(fd, &hot, &value), "hot key",
+	      "evicted although in use\n");
+	key = 0;
+	CHECK(!bpf_map_lookup_elem(fd, &key, &value), "cold key",
+	      "first key still there\n");
+
+	while (!bpf_map_get_next_key(fd, prev, &next)) {
+		key = next;
+		prev = &key;
+		n++;
+	}
+	CHECK(n > nr, "get_next_key", "%u keys in a map of %u\n", n, nr);
+	CHECK(fdinfo_value(fd, "lru_evictions") < 3 * nr, "lru_evictions",
+	      "%lld after %u inserts into %u\n",
+	      fdinfo_value(fd, "lru_evictions"), 4 * nr, nr);
+
+	close(prog_fd);
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+struct insert_ctx {
+	int fd;
+	int cpu;
+	__u32 first_key;
+	__u32 nr;
+	__u64 ns;
+};
+
+static void *insert_thread(void *arg)
+{
+	struct insert_ctx *ctx = arg;
+	struct timespec t0, t1;
+	__u64 value = 0;
+	__u32 i, key;
+
+	pin_to_cpu(ctx->cpu);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < ctx->nr; i++) {
+		key = ctx->first_key + i;
+		bpf_map_update_elem(ctx->fd, &key, &value, BPF_ANY);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ctx->ns = (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+		  (t1.tv_nsec - t0.tv_nsec);
+	return NULL;
+}
+
+/* Insert rate of all CPUs into a map that is full from the start */
+static double bench_inserts(__u32 flags, __u32 max_entries, __u32 per_cpu)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	struct insert_ctx *ctx;
+	pthread_t *threads;
+	__u64 value = 0, ns = 0;
+	int fd, cpu, err;
+	__u32 key;
+
+	fd = create_lru(BPF_MAP_TYPE_LRU_HASH, flags, max_entries);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	for (key = 0; key < max_entries; key++)
+		bpf_map_update_elem(fd, &key, &value, BPF_ANY);
+
+	ctx = calloc(nr_cpus, sizeof(*ctx));
+	threads = calloc(nr_cpus, sizeof(*threads));
+	CHECK(!ctx || !threads, "calloc", "out of memory\n");
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		ctx[cpu].fd = fd;
+		ctx[cpu].cpu = cpu;
+		ctx[cpu].first_key = max_entries + cpu * per_cpu;
+		ctx[cpu].nr = per_cpu;
+		err = pthread_create(&threads[cpu], NULL, insert_thread,
+				     &ctx[cpu]);
+		CHECK(err, "pthread_create", "error: %s\n", strerror(err));
+	}
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		pthread_join(threads[cpu], NULL);
+		ns = ctx[cpu].ns > ns ? ctx[cpu].ns : ns;
+	}
+
+	if (flags & BPF_F_LRU_CLOCK)
+		printf("%s: lru_evictions %lld lru_steals %lld\n", __func__,
+		       fdinfo_value(fd, "lru_evictions"),
+		       fdinfo_value(fd, "lru_steals"));
+
+	free(ctx);
+	free(threads);
+	close(fd);
+
+	return (double)nr_cpus * per_cpu * 1000 / ns;
+}
+
+static void bench_lru_clock(__u32 max_entries)
+{
+	double common, clock;
+
+	common = bench_inserts(0, max_entries, 200000);
+	clock = bench_inserts(BPF_F_LRU_CLOCK, max_entries, 200000);
+	printf("%s: %u entries, %.2lf M inserts/s (common LRU), %.2lf M inserts/s (BPF_F_LRU_CLOCK)\n",
+	       __func__, max_entries, common, clock);
+}
+
+void test_lru_clock_map(void)
+{
+	test_lru_clock_flags();
+	test_lru_clock_evict(4096);
+	bench_lru_clock(1 << 20);
+}
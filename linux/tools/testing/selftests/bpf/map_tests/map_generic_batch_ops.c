@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Batch ops of maps without a specialised implementation: lookup and
+ * delete batches of queue, stack and LPM trie maps, and array lookups
+ * spanning several copy chunks.
+ */
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+
+struct lpm_key {
+	__u32 prefix;
+	__u32 addr;
+};
+
+static void test_queue_stack_batch(enum bpf_map_type type)
+{
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	const __u32 max_entries = 1000;
+	__u32 i, count, total = 0;
+	__u64 *values, v;
+	int fd, err;
+
+	fd = bpf_map_create(type, NULL, 0, sizeof(__u64), max_entries, NULL);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	for (v = 0; v < max_entries; v++) {
+		err = bpf_map_update_elem(fd, NULL, &v, 0);
+		CHECK(err, "push", "error: %s\n", strerror(errno));
+	}
+
+	values = calloc(max_entries, sizeof(*values));
+	CHECK(!values, "calloc", "out of memory\n");
+
+	/* odd steps, so the last batch comes back short with ENOENT */
+	do {
+		count = 37;
+		err = bpf_map_lookup_and_delete_batch(fd, NULL, NULL, NULL,
+						      values + total, &count,
+						      &opts);
+		CHECK(err && errno != ENOENT, "lookup_and_delete_batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+	} while (!err);
+	CHECK(total != max_entries, "lookup_and_delete_batch",
+	      "%u values, expected %u\n", total, max_entries);
+
+	for (i = 0; i < max_entries; i++) {
+		v = type == BPF_MAP_TYPE_QUEUE ? i : max_entries - 1 - i;
+		CHECK(values[i] != v, "pop order", "value %u is %llu\n", i,
+		      (unsigned long long)values[i]);
+	}
+	err = bpf_map_lookup_and_delete_elem(fd, NULL, &v);
+	CHECK(!err || errno != ENOENT, "empty", "err %d errno %d\n", err, errno);
+
+	free(values);
+	close(fd);
+
+	printf("%s(type %d):PASS\n", __func__, type);
+}
+
+static void test_lpm_lookup_and_delete_batch(void)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, create_opts,
+		    .map_flags = BPF_F_NO_PREALLOC);
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	const __u32 max_entries = 100;
+	struct lpm_key *keys, key, batch;
+	__u32 i, count, total = 0;
+	int fd, err, *values, *seen;
+
+	fd = bpf_map_create(BPF_MAP_TYPE_LPM_TRIE, NULL, sizeof(key),
+			    sizeof(int), max_entries, &create_opts);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+
+	keys = calloc(max_entries, sizeof(*keys));
+	values = calloc(max_entries, sizeof(*values));
+	seen = calloc(max_entries, sizeof(*seen));
+	CHECK(!keys || !values || !seen, "calloc", "out of memory\n");
+
+	for (i = 0; i < max_entries; i++) {
+		key.prefix = 24 + i % 9;
+		key.addr = htonl(0x0a000000 | i << 8);
+		err = bpf_map_update_elem(fd, &key, &i, BPF_NOEXIST);
+		CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	}
+
+	do {
+		count = 7;
+		err = bpf_map_lookup_and_delete_batch(fd, total ? &batch : NULL,
+						      &batch, keys + total,
+						      values + total, &count,
+						      &opts);
+		CHECK(err && errno != ENOENT, "lookup_and_delete_batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+	} while (!err && total < max_entries);
+	CHECK(total != max_entries, "lookup_and_delete_batch",
+	      "%u elements, expected %u\n", total, max_entries);
+
+	for (i = 0; i < total; i++) {
+		CHECK(values[i] >= max_entries || seen[values[i]]++,
+		      "values", "value %d returned twice\n", values[i]);
+		CHECK(keys[i].prefix != 24 + values[i] % 9, "keys",
+		      "prefix %u for value %d\n", keys[i].prefix, values[i]);
+	}
+	err = bpf_map_get_next_key(fd, NULL, &key);
+	CHECK(!err || errno != ENOENT, "empty", "err %d errno %d\n", err, errno);
+
+	free(keys);
+	free(values);
+	free(seen);
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+/* Read all of a map in batches of @step, returns the time it took in ns */
+static __u64 lookup_all(int fd, __u32 max_entries, __u32 step, __u32 *keys,
+			void *values, size_t value_size)
+{
+	LIBBPF_OPTS(bpf_map_batch_opts, opts);
+	__u32 count, total = 0, batch;
+	struct timespec t0, t1;
+	int err;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		count = step;
+		err = bpf_map_lookup_batch(fd, total ? &batch : NULL, &batch,
+					   keys + total,
+					   values + total * value_size,
+					   &count, &opts);
+		CHECK(err && errno != ENOENT, "bpf_map_lookup_batch",
+		      "error: %s\n", strerror(errno));
+		total += count;
+	} while (!err);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	CHECK(total != max_entries, "bpf_map_lookup_batch",
+	      "%u elements, expected %u\n", total, max_entries);
+
+	return (t1.tv_sec - t0.tv_sec) * 1000000000ULL +
+	       (t1.tv_nsec - t0.tv_nsec);
+}
+
+/* Large enough for a batch to take several copy chunks */
+static void test_array_batch_chunks(enum bpf_map_type type)
+{
+	int nr_cpus = type == BPF_MAP_TYPE_PERCPU_ARRAY ?
+		      libbpf_num_possible_cpus() : 1;
+	const __u32 max_entries = 100000;
+	size_t value_size = sizeof(__u64) * nr_cpus;
+	__u32 i, *keys;
+	__u64 *values, ns;
+	int fd, cpu, err;
+
+	fd = bpf_map_create(type, NULL, sizeof(__u32), sizeof(__u64),
+			    max_entries, NULL);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+
+	keys = calloc(max_entries, sizeof(*keys));
+	values = calloc(max_entries, value_size);
+	CHECK(!keys || !values, "calloc", "out of memory\n");
+
+	for (i = 0; i < max_entries; i++) {
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			values[cpu] = (__u64)i << 16 | cpu;
+		err = bpf_map_update_elem(fd, &i, values, BPF_ANY);
+		CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	}
+
+	memset(values, 0, max_entries * value_size);
+	ns = lookup_all(fd, max_entries, 4099, keys, values, value_size);
+	for (i = 0; i < max_entries; i++) {
+		CHECK(keys[i] != i, "keys", "key %u is %u\n", i, keys[i]);
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			CHECK(values[i * nr_cpus + cpu] != ((__u64)i << 16 | cpu),
+			      "values", "key %u cpu %d\n", i, cpu);
+	}
+	printf("%s(type %d): %u elements in %llu us\n", __func__, type,
+	       max_entries, (unsigned long long)ns / 1000);
+
+	free(keys);
+	free(values);
+	close(fd);
+
+	printf("%s(type %d):PASS\n", __func__, type);
+}
+
+void test_map_generic_batch_ops(void)
+{
+	test_queue_stack_batch(BPF_MAP_TYPE_QUEUE);
+	test_queue_stack_batch(BPF_MAP_TYPE_STACK);
+	test_lpm_lookup_and_delete_batch();
+	test_array_batch_chunks(BPF_MAP_TYPE_ARRAY);
+	test_array_batch_chunks(BPF_MAP_TYPE_PERCPU_ARRAY);
+}
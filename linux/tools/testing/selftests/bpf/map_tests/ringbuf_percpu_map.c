@@ -0,0 +1,425 @@
+// SPDX-License-Identifier: GPL-2.0
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+#define RING_SIZE	(256 * 1024)
+
+/* One per-CPU ring as seen by the consumer */
+struct rb_cpu {
+	unsigned long *consumer_pos;
+	unsigned long *producer_pos;
+	void *data;
+	unsigned long mask;
+	size_t page_size;
+};
+
+/* A record as handed out by the merged view, idx is its first 8 bytes */
+struct rec {
+	__u64 ts;
+	__u64 idx;
+	int cpu;
+};
+
+/* Bytes a record of @len takes in a per-CPU ring */
+static unsigned long rec_size(__u32 len)
+{
+	return (len + BPF_RINGBUF_TS_SZ + BPF_RINGBUF_HDR_SZ + 7) & ~7UL;
+}
+
+static int create_percpu_ringbuf(__u32 size)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = BPF_F_PERCPU_RINGBUF);
+
+	return bpf_map_create(BPF_MAP_TYPE_RINGBUF, NULL, 0, 0, size, &opts);
+}
+
+/*
+ * Syscall program writing the indexes 0..nr-1 as 8-byte records with
+ * bpf_loop() and bpf_ringbuf_output().
+ */
+static int load_output_prog(int map_fd, __u32 nr)
+{
+	struct bpf_insn insns[] = {
+		BPF_MOV64_IMM(BPF_REG_1, nr),
+		BPF_RAW_INSN(BPF_LD | BPF_IMM | BPF_DW, BPF_REG_2,
+			     BPF_PSEUDO_FUNC, 0, 6),
+		BPF_RAW_INSN(0, 0, 0, 0, 0),
+		BPF_MOV64_IMM(BPF_REG_3, 0),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_loop),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+		/* callback(index, ctx) */
+		BPF_STX_MEM(BPF_DW, BPF_REG_10, BPF_REG_1, -8),
+		BPF_LD_MAP_FD(BPF_REG_1, map_fd),
+		BPF_MOV64_REG(BPF_REG_2, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_2, -8),
+		BPF_MOV64_IMM(BPF_REG_3, 8),
+		BPF_MOV64_IMM(BPF_REG_4, 0),
+		BPF_EMIT_CALL(BPF_FUNC_ringbuf_output),
+		BPF_MOV64_IMM(BPF_REG_0, 0),
+		BPF_EXIT_INSN(),
+	};
+	LIBBPF_OPTS(bpf_prog_load_opts, opts, .prog_flags = BPF_F_SLEEPABLE);
+
+	return bpf_prog_load(BPF_PROG_TYPE_SYSCALL, NULL, "GPL", insns,
+			     ARRAY_SIZE(insns), &opts);
+}
+
+static void rb_cpu_map(struct rb_cpu *r, int map_fd, int cpu, __u32 size)
+{
+	size_t page_size = sysconf(_SC_PAGESIZE);
+	off_t base = (off_t)cpu * (2 * page_size + 2 * size);
+	void *p;
+
+	r->page_size = page_size;
+	r->mask = size - 1;
+
+	p = mmap(NULL, page_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		 map_fd, base);
+	CHECK(p == MAP_FAILED, "mmap consumer page", "cpu %d: %s\n", cpu,
+	      strerror(errno));
+	r->consumer_pos = p;
+
+	p = mmap(NULL, page_size + 2 * size, PROT_READ, MAP_SHARED, map_fd,
+		 base + page_size);
+	CHECK(p == MAP_FAILED, "mmap data pages", "cpu %d: %s\n", cpu,
+	      strerror(errno));
+	r->producer_pos = p;
+	r->data = p + page_size;
+}
+
+static void rb_cpu_unmap(struct rb_cpu *r)
+{
+	munmap(r->consumer_pos, r->page_size);
+	munmap(r->producer_pos, r->page_size + 2 * (r->mask + 1));
+}
+
+/*
+ * Return the timestamp of the oldest committed record of @r, skipping over
+ * discarded ones, or false if there is none yet.
+ */
+static bool rb_cpu_peek(struct rb_cpu *r, __u64 *ts, __u32 *len)
+{
+	unsigned long cons, prod;
+	void *rec;
+	__u32 hdr;
+
+	cons = *r->consumer_pos;
+	for (;;) {
+		prod = __atomic_load_n(r->producer_pos, __ATOMIC_ACQUIRE);
+		if (cons >= prod)
+			return false;
+
+		rec = r->data + (cons & r->mask);
+		hdr = __atomic_load_n((__u32 *)(rec + BPF_RINGBUF_TS_SZ),
+				      __ATOMIC_ACQUIRE);
+		if (hdr & BPF_RINGBUF_BUSY_BIT)
+			return false;
+		if (!(hdr & BPF_RINGBUF_DISCARD_BIT))
+			break;
+
+		cons += rec_size(hdr & ~BPF_RINGBUF_DISCARD_BIT);
+		__atomic_store_n(r->consumer_pos, cons, __ATOMIC_RELEASE);
+	}
+
+	*ts = *(__u64 *)rec;
+	*len = hdr;
+	return true;
+}
+
+/*
+ * Merged view of all rings: hand out records in timestamp order until every
+ * ring is drained.  Returns the number of records consumed.
+ */
+static long rb_merge_consume(struct rb_cpu *rings, int nr_rings,
+			     void (*fn)(const struct rec *rec, void *ctx),
+			     void *ctx)
+{
+	long cnt = 0;
+
+	for (;;) {
+		__u64 ts, best_ts = 0;
+		__u32 len, best_len = 0;
+		int i, best = -1;
+		struct rec rec;
+		unsigned long cons;
+		void *sample;
+
+		for (i = 0; i < nr_rings; i++) {
+			if (!rb_cpu_peek(&rings[i], &ts, &len))
+				continue;
+			if (best < 0 || ts < best_ts) {
+				best = i;
+				best_ts = ts;
+				best_len = len;
+			}
+		}
+		if (best < 0)
+			return cnt;
+
+		cons = *rings[best].consumer_pos;
+		sample = rings[best].data + (cons & rings[best].mask) +
+			 BPF_RINGBUF_TS_SZ + BPF_RINGBUF_HDR_SZ;
+		rec.ts = best_ts;
+		rec.idx = best_len >= 8 ? *(__u64 *)sample : 0;
+		rec.cpu = best;
+		if (fn)
+			fn(&rec, ctx);
+		cnt++;
+
+		cons += rec_size(best_len);
+		__atomic_store_n(rings[best].consumer_pos, cons, __ATOMIC_RELEASE);
+	}
+}
+
+static int run_prog(int prog_fd)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, topts);
+
+	return bpf_prog_test_run_opts(prog_fd, &topts);
+}
+
+static void test_ringbuf_percpu_create(void)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts);
+	int fd;
+
+	opts.map_flags = BPF_F_PERCPU_RINGBUF;
+	fd = bpf_map_create(BPF_MAP_TYPE_USER_RINGBUF, NULL, 0, 0, RING_SIZE,
+			    &opts);
+	CHECK(fd >= 0 || errno != EINVAL, "user ringbuf",
+	      "BPF_F_PERCPU_RINGBUF accepted\n");
+
+	opts.map_flags = BPF_F_PERCPU_RINGBUF | BPF_F_NUMA_NODE;
+	fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, NULL, 0, 0, RING_SIZE, &opts);
+	CHECK(fd >= 0 || errno != EINVAL, "numa node",
+	      "BPF_F_NUMA_NODE accepted\n");
+
+	fd = create_percpu_ringbuf(RING_SIZE);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+struct order_ctx {
+	__u64 last_ts;
+	__u64 *next_idx;
+	bool ok;
+};
+
+static void check_order(const struct rec *rec, void *arg)
+{
+	struct order_ctx *ctx = arg;
+
+	if (rec->ts < ctx->last_ts || rec->idx != ctx->next_idx[rec->cpu])
+		ctx->ok = false;
+	ctx->last_ts = rec->ts;
+	ctx->next_idx[rec->cpu]++;
+}
+
+/* Produce on every CPU in turn, then read back one ordered stream */
+static void test_ringbuf_percpu_order(void)
+{
+	int nr_cpus = libbpf_num_possible_cpus();
+	int map_fd, prog_fd, epfd, cpu, nr_used = 0;
+	struct epoll_event ev = { .events = EPOLLIN };
+	struct order_ctx ctx = { .ok = true };
+	const __u32 nr = 1000;
+	struct rb_cpu *rings;
+	cpu_set_t old;
+	long cnt;
+
+	map_fd = create_percpu_ringbuf(RING_SIZE);
+	CHECK(map_fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	prog_fd = load_output_prog(map_fd, nr);
+	CHECK(prog_fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+
+	rings = calloc(nr_cpus, sizeof(*rings));
+	ctx.next_idx = calloc(nr_cpus, sizeof(*ctx.next_idx));
+	CHECK(!rings || !ctx.next_idx, "calloc", "out of memory\n");
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		rb_cpu_map(&rings[cpu], map_fd, cpu, RING_SIZE);
+
+	epfd = epoll_create1(0);
+	CHECK(epfd < 0 || epoll_ctl(epfd, EPOLL_CTL_ADD, map_fd, &ev),
+	      "epoll", "error: %s\n", strerror(errno));
+	CHECK(epoll_wait(epfd, &ev, 1, 0) != 0, "epoll_wait",
+	      "ready before any record\n");
+
+	CHECK(sched_getaffinity(0, sizeof(old), &old), "sched_getaffinity",
+	      "error: %s\n", strerror(errno));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		if (!CPU_ISSET(cpu, &old))
+			continue;
+		pin_to_cpu(cpu);
+		CHECK(run_prog(prog_fd), "bpf_prog_test_run", "cpu %d: %s\n",
+		      cpu, strerror(errno));
+		nr_used++;
+	}
+	sched_setaffinity(0, sizeof(old), &old);
+
+	/* one notification for all the rings */
+	CHECK(epoll_wait(epfd, &ev, 1, 1000) != 1, "epoll_wait",
+	      "no notification\n");
+
+	cnt = rb_merge_consume(rings, nr_cpus, check_order, &ctx);
+	CHECK(cnt != (long)nr * nr_used, "record count", "%ld, expected %ld\n",
+	      cnt, (long)nr * nr_used);
+	CHECK(!ctx.ok, "record order", "out of order or missing records\n");
+
+	for (cpu = 0; cpu < nr_cpus; cpu++)
+		rb_cpu_unmap(&rings[cpu]);
+	free(ctx.next_idx);
+	free(rings);
+	close(epfd);
+	close(prog_fd);
+	close(map_fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+struct bench_ctx {
+	int prog_fd;
+	int cpu;
+	volatile bool *start;
+};
+
+static void *producer_fn(void *arg)
+{
+	struct bench_ctx *ctx = arg;
+
+	pin_to_cpu(ctx->cpu);
+	while (!*ctx->start)
+		;
+	run_prog(ctx->prog_fd);
+	return NULL;
+}
+
+static int drop_sample(void *ctx, void *data, size_t size)
+{
+	return 0;
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Producers on every CPU at once into one shared ring or into per-CPU
+ * rings, with the consumer draining on the side.  Reports the records
+ * that made it to the consumer per second; the rest were dropped because
+ * the ring was full.
+ */
+static void bench_ringbuf(bool percpu)
+{
+	int nr_cpus = libbpf_num_possible_cpus(), nr_used = 0;
+	const __u32 nr = 1 << 18;
+	volatile bool start = false;
+	struct bench_ctx *ctxs;
+	LIBBPF_OPTS(bpf_map_create_opts, opts);
+	struct ring_buffer *shared = NULL;
+	struct rb_cpu *rings = NULL;
+	int map_fd, prog_fd, cpu;
+	pthread_t *tids;
+	long cnt = 0;
+	double t;
+	cpu_set_t old;
+
+	opts.map_flags = percpu ? BPF_F_PERCPU_RINGBUF : 0;
+	/* same total size either way */
+	map_fd = bpf_map_create(BPF_MAP_TYPE_RINGBUF, NULL, 0, 0,
+				percpu ? RING_SIZE : RING_SIZE * nr_cpus, &opts);
+	CHECK(map_fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	prog_fd = load_output_prog(map_fd, nr);
+	CHECK(prog_fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+
+	if (percpu) {
+		rings = calloc(nr_cpus, sizeof(*rings));
+		CHECK(!rings, "calloc", "out of memory\n");
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			rb_cpu_map(&rings[cpu], map_fd, cpu, RING_SIZE);
+	} else {
+		shared = ring_buffer__new(map_fd, drop_sample, NULL, NULL);
+		CHECK(!shared, "ring_buffer__new", "error: %s\n", strerror(errno));
+	}
+
+	ctxs = calloc(nr_cpus, sizeof(*ctxs));
+	tids = calloc(nr_cpus, sizeof(*tids));
+	CHECK(!ctxs || !tids, "calloc", "out of memory\n");
+	CHECK(sched_getaffinity(0, sizeof(old), &old), "sched_getaffinity",
+	      "error: %s\n", strerror(errno));
+	for (cpu = 0; cpu < nr_cpus; cpu++) {
+		if (!CPU_ISSET(cpu, &old))
+			continue;
+		ctxs[nr_used] = (struct bench_ctx) {
+			.prog_fd = prog_fd,
+			.cpu = cpu,
+			.start = &start,
+		};
+		CHECK(pthread_create(&tids[nr_used], NULL, producer_fn,
+				     &ctxs[nr_used]),
+		      "pthread_create", "error: %s\n", strerror(errno));
+		nr_used++;
+	}
+
+	t = now_sec();
+	start = true;
+	for (cpu = 0; cpu < nr_used; cpu++) {
+		while (pthread_tryjoin_np(tids[cpu], NULL)) {
+			if (percpu)
+				cnt += rb_merge_consume(rings, nr_cpus, NULL, NULL);
+			else
+				cnt += ring_buffer__consume(shared);
+		}
+	}
+	if (percpu)
+		cnt += rb_merge_consume(rings, nr_cpus, NULL, NULL);
+	else
+		cnt += ring_buffer__consume(shared);
+	t = now_sec() - t;
+
+	printf("%s: %s ringbuf, %d producers: %.3lf M records/s consumed, %ld of %ld dropped\n",
+	       __func__, percpu ? "per-CPU" : "shared", nr_used,
+	       cnt / t / 1e6, (long)nr * nr_used - cnt, (long)nr * nr_used);
+
+	if (percpu) {
+		for (cpu = 0; cpu < nr_cpus; cpu++)
+			rb_cpu_unmap(&rings[cpu]);
+		free(rings);
+	} else {
+		ring_buffer__free(shared);
+	}
+	free(tids);
+	free(ctxs);
+	close(prog_fd);
+	close(map_fd);
+}
+
+void test_ringbuf_percpu_map(void)
+{
+	test_ringbuf_percpu_create();
+	test_ringbuf_percpu_order();
+	bench_ringbuf(false);
+	bench_ringbuf(true);
+}
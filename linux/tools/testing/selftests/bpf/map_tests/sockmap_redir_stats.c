@@ -0,0 +1,169 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Redirect path counters of sockmap and sockhash sockets, as totals in the
+ * fdinfo of the map, and the bytes delivered through those paths.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+static const char * const stats_keys[] = {
+	"psock_redir_direct",
+	"psock_backlog_skbs",
+	"psock_backlog_runs",
+	"psock_backlog_wait_ns",
+};
+
+/* Connected loopback TCP pair in @fds */
+static void tcp_pair(int fds[2])
+{
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+	};
+	socklen_t len = sizeof(addr);
+	int srv, err;
+
+	srv = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(srv < 0, "socket", "error: %s\n", strerror(errno));
+	err = bind(srv, (struct sockaddr *)&addr, len) ||
+	      listen(srv, 1) ||
+	      getsockname(srv, (struct sockaddr *)&addr, &len);
+	CHECK(err, "listen", "error: %s\n", strerror(errno));
+
+	fds[0] = socket(AF_INET, SOCK_STREAM, 0);
+	CHECK(fds[0] < 0, "socket", "error: %s\n", strerror(errno));
+	err = connect(fds[0], (struct sockaddr *)&addr, len);
+	CHECK(err, "connect", "error: %s\n", strerror(errno));
+	fds[1] = accept(srv, NULL, NULL);
+	CHECK(fds[1] < 0, "accept", "error: %s\n", strerror(errno));
+	close(srv);
+}
+
+/* Stream verdict program redirecting every skb to the ingress of key 1 */
+static int load_verdict_prog(enum bpf_map_type type, int map_fd)
+{
+	struct bpf_insn map_insns[] = {
+		BPF_LD_MAP_FD(BPF_REG_2, map_fd),
+		BPF_MOV64_IMM(BPF_REG_3, 1),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_F_INGRESS),
+		BPF_EMIT_CALL(BPF_FUNC_sk_redirect_map),
+		BPF_EXIT_INSN(),
+	};
+	struct bpf_insn hash_insns[] = {
+		BPF_ST_MEM(BPF_W, BPF_REG_10, -4, 1),
+		BPF_LD_MAP_FD(BPF_REG_2, map_fd),
+		BPF_MOV64_REG(BPF_REG_3, BPF_REG_10),
+		BPF_ALU64_IMM(BPF_ADD, BPF_REG_3, -4),
+		BPF_MOV64_IMM(BPF_REG_4, BPF_F_INGRESS),
+		BPF_EMIT_CALL(BPF_FUNC_sk_redirect_hash),
+		BPF_EXIT_INSN(),
+	};
+
+	if (type == BPF_MAP_TYPE_SOCKMAP)
+		return bpf_prog_load(BPF_PROG_TYPE_SK_SKB, NULL, "GPL", map_insns,
+				     ARRAY_SIZE(map_insns), NULL);
+	return bpf_prog_load(BPF_PROG_TYPE_SK_SKB, NULL, "GPL", hash_insns,
+			     ARRAY_SIZE(hash_insns), NULL);
+}
+
+#define NR_SENDS	64
+#define SEND_SIZE	1000
+
+/*
+ * Two TCP pairs, the receiving end of the first in the map at key 0 and
+ * that of the second at key 1.  Everything sent into the first pair is
+ * redirected by the verdict program to the ingress of the second, where
+ * it is read back.
+ */
+static void test_redir_stats(enum bpf_map_type type)
+{
+	struct timeval tv = { .tv_sec = 1 };
+	long long direct, skbs, runs, wait;
+	char buf[SEND_SIZE] = {};
+	int fd, prog_fd, err, i;
+	int src[2], dst[2];
+	ssize_t n, total;
+	__u32 key;
+	__u64 sk;
+
+	fd = bpf_map_create(type, NULL, sizeof(key), sizeof(sk), 2, NULL);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+
+	/* programs only apply to sockets added after them */
+	prog_fd = load_verdict_prog(type, fd);
+	CHECK(prog_fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+	err = bpf_prog_attach(prog_fd, fd, BPF_SK_SKB_STREAM_VERDICT, 0);
+	CHECK(err, "bpf_prog_attach", "error: %s\n", strerror(errno));
+
+	tcp_pair(src);
+	tcp_pair(dst);
+	for (key = 0; key < 2; key++) {
+		sk = key ? dst[1] : src[1];
+		err = bpf_map_update_elem(fd, &key, &sk, BPF_NOEXIST);
+		CHECK(err, "bpf_map_update_elem", "error: %s\n", strerror(errno));
+	}
+
+	/* nothing sent yet, so nothing went through either path */
+	for (i = 0; i < ARRAY_SIZE(stats_keys); i++)
+		CHECK(fdinfo_value(fd, stats_keys[i]), "fdinfo",
+		      "%s is %lld\n", stats_keys[i],
+		      fdinfo_value(fd, stats_keys[i]));
+
+	for (i = 0; i < NR_SENDS; i++) {
+		n = send(src[0], buf, sizeof(buf), 0);
+		CHECK(n != sizeof(buf), "send", "sent %zd: %s\n", n,
+		      strerror(errno));
+	}
+
+	err = setsockopt(dst[1], SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	CHECK(err, "setsockopt", "error: %s\n", strerror(errno));
+	for (total = 0; total < NR_SENDS * SEND_SIZE; total += n) {
+		n = recv(dst[1], buf, sizeof(buf), 0);
+		CHECK(n <= 0, "recv", "got %zd of %d bytes: %s\n", total,
+		      NR_SENDS * SEND_SIZE, n ? strerror(errno) : "EOF");
+	}
+
+	/* every redirected skb took exactly one of the two paths */
+	direct = fdinfo_value(fd, "psock_redir_direct");
+	skbs = fdinfo_value(fd, "psock_backlog_skbs");
+	runs = fdinfo_value(fd, "psock_backlog_runs");
+	wait = fdinfo_value(fd, "psock_backlog_wait_ns");
+	CHECK(direct < 0 || skbs < 0 || runs < 0 || wait < 0, "fdinfo",
+	      "missing redirect counters\n");
+	CHECK(direct + skbs < 1 || direct + skbs > NR_SENDS, "redirects",
+	      "%lld direct and %lld backlogged for %d sends\n", direct, skbs,
+	      NR_SENDS);
+	CHECK(skbs && !runs, "backlog", "%lld skbs but no backlog run\n", skbs);
+	CHECK(!skbs && (runs || wait), "backlog",
+	      "%lld runs and %lld ns waited without backlogged skbs\n", runs,
+	      wait);
+
+	close(src[0]);
+	close(src[1]);
+	close(dst[0]);
+	close(dst[1]);
+	close(prog_fd);
+	close(fd);
+
+	printf("%s(type %d):PASS\n", __func__, type);
+}
+
+void test_sockmap_redir_stats(void)
+{
+	test_redir_stats(BPF_MAP_TYPE_SOCKMAP);
+	test_redir_stats(BPF_MAP_TYPE_SOCKHASH);
+}
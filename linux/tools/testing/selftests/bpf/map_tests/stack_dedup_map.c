@@ -0,0 +1,214 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * BPF_F_STACK_DEDUP stack maps: flag checks, the syscall side of an empty
+ * map, storing, looking up and deleting stacks, and the fdinfo counters of
+ * stack maps.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <linux/filter.h>
+#include <bpf/bpf.h>
+#include <bpf/libbpf.h>
+
+#include <test_maps.h>
+#include "map_helpers.h"
+
+#define STACK_DEPTH	127
+
+static int create_stack(__u32 flags, __u32 value_size, __u32 max_entries)
+{
+	LIBBPF_OPTS(bpf_map_create_opts, opts, .map_flags = flags);
+
+	return bpf_map_create(BPF_MAP_TYPE_STACK_TRACE, NULL, sizeof(__u32),
+			      value_size, max_entries, &opts);
+}
+
+static void test_stack_dedup_flags(void)
+{
+	__u32 build_id_size = sizeof(struct bpf_stack_build_id);
+	int fd;
+
+	fd = create_stack(BPF_F_STACK_DEDUP | BPF_F_STACK_BUILD_ID,
+			  STACK_DEPTH * build_id_size, 1024);
+	CHECK(fd >= 0 || errno != EINVAL, "DEDUP | BUILD_ID", "fd %d errno %d\n",
+	      fd, errno);
+
+	fd = create_stack(BPF_F_STACK_DEDUP, STACK_DEPTH * sizeof(__u64), 1024);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	CHECK(fdinfo_value(fd, "stack_collisions"), "fdinfo",
+	      "stack_collisions %lld\n", fdinfo_value(fd, "stack_collisions"));
+	CHECK(fdinfo_value(fd, "build_id_cache_hits") != -1, "fdinfo",
+	      "build_id_cache_hits without BPF_F_STACK_BUILD_ID\n");
+	close(fd);
+
+	fd = create_stack(BPF_F_STACK_BUILD_ID, STACK_DEPTH * build_id_size,
+			  1024);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	CHECK(fdinfo_value(fd, "build_id_cache_hits") ||
+	      fdinfo_value(fd, "build_id_cache_misses"), "fdinfo",
+	      "build_id cache counters missing or not zero\n");
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+static void test_stack_dedup_empty(void)
+{
+	__u64 *value;
+	__u32 key = 0, next;
+	int fd, err;
+
+	fd = create_stack(BPF_F_STACK_DEDUP, STACK_DEPTH * sizeof(__u64), 1024);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	value = calloc(STACK_DEPTH, sizeof(*value));
+	CHECK(!value, "calloc", "out of memory\n");
+
+	err = bpf_map_get_next_key(fd, NULL, &next);
+	CHECK(!err || errno != ENOENT, "get_next_key", "err %d errno %d\n",
+	      err, errno);
+	err = bpf_map_lookup_elem(fd, &key, value);
+	CHECK(!err || errno != ENOENT, "bpf_map_lookup_elem",
+	      "err %d errno %d\n", err, errno);
+	err = bpf_map_delete_elem(fd, &key);
+	CHECK(!err || errno != ENOENT, "bpf_map_delete_elem",
+	      "err %d errno %d\n", err, errno);
+	key = 1024;
+	err = bpf_map_delete_elem(fd, &key);
+	CHECK(!err || errno != E2BIG, "delete past max_entries",
+	      "err %d errno %d\n", err, errno);
+	err = bpf_map_update_elem(fd, &key, value, BPF_ANY);
+	CHECK(!err || errno != EINVAL, "bpf_map_update_elem",
+	      "err %d errno %d\n", err, errno);
+
+	free(value);
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+/* Raw tracepoint program storing its kernel stack, minus as many frames
+ * as its first argument says
+ */
+static int load_stackid_prog(int map_fd)
+{
+	struct bpf_insn insns[] = {
+		BPF_LDX_MEM(BPF_DW, BPF_REG_3, BPF_REG_1, 0),
+		BPF_ALU64_IMM(BPF_AND, BPF_REG_3, BPF_F_SKIP_FIELD_MASK),
+		BPF_LD_MAP_FD(BPF_REG_2, map_fd),
+		BPF_EMIT_CALL(BPF_FUNC_get_stackid),
+		BPF_EXIT_INSN(),
+	};
+	int fd;
+
+	fd = bpf_prog_load(BPF_PROG_TYPE_RAW_TRACEPOINT, NULL, "GPL", insns,
+			   ARRAY_SIZE(insns), NULL);
+	CHECK(fd < 0, "bpf_prog_load", "error: %s\n", strerror(errno));
+	return fd;
+}
+
+/* Stack id stored by @prog_fd, skipping @skip frames */
+static int store_stack(int prog_fd, __u64 skip)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, topts,
+		    .ctx_in = &skip,
+		    .ctx_size_in = sizeof(skip));
+	int err;
+
+	err = bpf_prog_test_run_opts(prog_fd, &topts);
+	CHECK(err, "bpf_prog_test_run", "error: %s\n", strerror(errno));
+	CHECK((int)topts.retval < 0, "bpf_get_stackid", "error %d\n",
+	      (int)topts.retval);
+	return topts.retval;
+}
+
+static __u32 stack_depth(const __u64 *ips)
+{
+	__u32 nr = 0;
+
+	while (nr < STACK_DEPTH && ips[nr])
+		nr++;
+	return nr;
+}
+
+static void test_stack_dedup_store(void)
+{
+	__u64 *stack, *short_stack;
+	int fd, prog_fd, err;
+	__u32 id, short_id, next, nr, i;
+
+	fd = create_stack(BPF_F_STACK_DEDUP, STACK_DEPTH * sizeof(__u64), 1024);
+	CHECK(fd < 0, "bpf_map_create", "error: %s\n", strerror(errno));
+	stack = calloc(STACK_DEPTH, sizeof(*stack));
+	short_stack = calloc(STACK_DEPTH, sizeof(*short_stack));
+	CHECK(!stack || !short_stack, "calloc", "out of memory\n");
+	prog_fd = load_stackid_prog(fd);
+
+	/* the same call path gives the same stack, and the same id */
+	id = store_stack(prog_fd, 0);
+	CHECK(store_stack(prog_fd, 0) != id, "dedup", "second id differs\n");
+	err = bpf_map_get_next_key(fd, NULL, &next);
+	CHECK(err || next != id, "get_next_key", "err %d id %u, expected %u\n",
+	      err, next, id);
+	err = bpf_map_lookup_elem(fd, &id, stack);
+	CHECK(err, "bpf_map_lookup_elem", "error: %s\n", strerror(errno));
+	nr = stack_depth(stack);
+	CHECK(nr < 2, "stack depth", "%u frames\n", nr);
+
+	/* skipping the innermost frame shares all the others */
+	short_id = store_stack(prog_fd, 1);
+	CHECK(short_id == id, "skip", "same id %u\n", id);
+	err = bpf_map_lookup_elem(fd, &short_id, short_stack);
+	CHECK(err, "bpf_map_lookup_elem", "error: %s\n", strerror(errno));
+	CHECK(stack_depth(short_stack) != nr - 1, "skip",
+	      "%u frames, expected %u\n", stack_depth(short_stack), nr - 1);
+	for (i = 0; i < nr - 1; i++)
+		CHECK(short_stack[i] != stack[i + 1], "skip",
+		      "frame %u is %llx, expected %llx\n", i,
+		      (unsigned long long)short_stack[i],
+		      (unsigned long long)stack[i + 1]);
+
+	err = bpf_map_delete_elem(fd, &id);
+	CHECK(err, "bpf_map_delete_elem", "error: %s\n", strerror(errno));
+	err = bpf_map_lookup_elem(fd, &id, stack);
+	CHECK(!err || errno != ENOENT, "lookup after delete",
+	      "err %d errno %d\n", err, errno);
+	err = bpf_map_delete_elem(fd, &id);
+	CHECK(!err || errno != ENOENT, "delete twice", "err %d errno %d\n",
+	      err, errno);
+	/* the other stack keeps its frames */
+	err = bpf_map_lookup_elem(fd, &short_id, short_stack);
+	CHECK(err || short_stack[0] != stack[1], "lookup other stack",
+	      "err %d\n", err);
+
+	/* deleting the last stack reclaims everything, storing starts over */
+	err = bpf_map_delete_elem(fd, &short_id);
+	CHECK(err, "bpf_map_delete_elem", "error: %s\n", strerror(errno));
+	err = bpf_map_get_next_key(fd, NULL, &next);
+	CHECK(!err || errno != ENOENT, "get_next_key", "err %d errno %d\n",
+	      err, errno);
+	id = store_stack(prog_fd, 0);
+	err = bpf_map_lookup_elem(fd, &id, short_stack);
+	CHECK(err, "bpf_map_lookup_elem", "error: %s\n", strerror(errno));
+	CHECK(memcmp(stack, short_stack, STACK_DEPTH * sizeof(*stack)),
+	      "store after reclaim", "stack differs\n");
+	CHECK(fdinfo_value(fd, "stack_collisions"), "fdinfo",
+	      "stack_collisions %lld\n", fdinfo_value(fd, "stack_collisions"));
+
+	close(prog_fd);
+	free(short_stack);
+	free(stack);
+	close(fd);
+
+	printf("%s:PASS\n", __func__);
+}
+
+void test_stack_dedup_map(void)
+{
+	test_stack_dedup_flags();
+	test_stack_dedup_empty();
+	test_stack_dedup_store();
+}
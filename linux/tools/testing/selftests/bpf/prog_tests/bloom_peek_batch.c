@@ -0,0 +1,59 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <test_progs.h>
+#include <network_helpers.h>
+
+#include "bloom_peek_batch.skel.h"
+
+#define NR_VALUES	64
+
+void test_bloom_peek_batch(void)
+{
+	LIBBPF_OPTS(bpf_test_run_opts, topts,
+		.data_in = &pkt_v4,
+		.data_size_in = sizeof(pkt_v4),
+		.repeat = 1,
+	);
+	struct bloom_peek_batch *skel;
+	__u64 expect = 0;
+	int bloom_fd, err, i;
+	__u32 value;
+
+	skel = bloom_peek_batch__open_and_load();
+	if (!ASSERT_OK_PTR(skel, "bloom_peek_batch__open_and_load"))
+		return;
+
+	/* Every other value goes into the filter */
+	bloom_fd = bpf_map__fd(skel->maps.bloom);
+	for (i = 0; i < NR_VALUES; i += 2) {
+		value = i;
+		err = bpf_map_update_elem(bloom_fd, NULL, &value, BPF_ANY);
+		if (!ASSERT_OK(err, "bpf_map_update_elem"))
+			goto out;
+	}
+
+	/* The batch must agree with single lookups, false positives included */
+	for (i = 0; i <= NR_VALUES; i++) {
+		value = i;
+		skel->bss->values[i] = value;
+		if (i < NR_VALUES && !bpf_map_lookup_elem(bloom_fd, NULL, &value))
+			expect |= 1ULL << i;
+	}
+
+	err = bpf_prog_test_run_opts(bpf_program__fd(skel->progs.peek_batch),
+				     &topts);
+	if (!ASSERT_OK(err, "bpf_prog_test_run_opts"))
+		goto out;
+	ASSERT_EQ(topts.retval, XDP_PASS, "retval");
+
+	ASSERT_EQ(skel->bss->hits, expect, "hits");
+	ASSERT_EQ(skel->bss->batch_ret, __builtin_popcountll(expect), "batch_ret");
+	ASSERT_EQ(skel->bss->hits & 0x5555555555555555ULL,
+		  0x5555555555555555ULL, "no false negatives");
+
+	ASSERT_EQ(skel->bss->not_bloom_ret, -EINVAL, "not_bloom_ret");
+	ASSERT_EQ(skel->bss->empty_ret, -EINVAL, "empty_ret");
+	ASSERT_EQ(skel->bss->too_many_ret, -EINVAL, "too_many_ret");
+	ASSERT_EQ(skel->bss->partial_ret, -EINVAL, "partial_ret");
+out:
+	bloom_peek_batch__destroy(skel);
+}
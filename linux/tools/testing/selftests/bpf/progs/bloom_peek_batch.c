@@ -0,0 +1,53 @@
+// SPDX-License-Identifier: GPL-2.0
+#include <vmlinux.h>
+#include <bpf/bpf_helpers.h>
+
+#define NR_VALUES	64
+
+struct {
+	__uint(type, BPF_MAP_TYPE_BLOOM_FILTER);
+	__uint(max_entries, 1000);
+	__type(value, __u32);
+	__uint(map_flags, BPF_F_BLOOM_BLOCKED);
+} bloom SEC(".maps");
+
+struct {
+	__uint(type, BPF_MAP_TYPE_ARRAY);
+	__uint(max_entries, 1);
+	__type(key, __u32);
+	__type(value, __u32);
+} array SEC(".maps");
+
+int bpf_bloom_map_peek_batch(struct bpf_map *map, const void *values,
+			     u32 values__sz, u64 *hits) __ksym;
+
+/* Filled in by user space, one more than a batch can take */
+__u32 values[NR_VALUES + 1];
+
+__u64 hits;
+int batch_ret;
+int not_bloom_ret;
+int empty_ret;
+int too_many_ret;
+int partial_ret;
+
+SEC("xdp")
+int peek_batch(struct xdp_md *ctx)
+{
+	__u64 scratch = 0;
+
+	batch_ret = bpf_bloom_map_peek_batch((struct bpf_map *)&bloom, values,
+					     NR_VALUES * sizeof(__u32), &hits);
+	not_bloom_ret = bpf_bloom_map_peek_batch((struct bpf_map *)&array,
+						 values, sizeof(__u32), &scratch);
+	empty_ret = bpf_bloom_map_peek_batch((struct bpf_map *)&bloom, values,
+					     0, &scratch);
+	too_many_ret = bpf_bloom_map_peek_batch((struct bpf_map *)&bloom, values,
+						(NR_VALUES + 1) * sizeof(__u32),
+						&scratch);
+	partial_ret = bpf_bloom_map_peek_batch((struct bpf_map *)&bloom, values,
+					       sizeof(__u32) + 1, &scratch);
+	return XDP_PASS;
+}
+
+char _license[] SEC("license") = "GPL";
@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * PR_FD_ALLOC_ANY lets threads reserve descriptors ahead of time.  Check
+ * that such reservations never get in the way: dup2() onto a descriptor
+ * another thread reserved works, and switching back to PR_FD_ALLOC_LOWEST
+ * makes the lowest descriptor available again right away.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+
+#include "../kselftest.h"
+
+#ifndef PR_SET_FD_ALLOC
+#define PR_SET_FD_ALLOC			100
+#define PR_GET_FD_ALLOC			101
+# define PR_FD_ALLOC_LOWEST		0
+# define PR_FD_ALLOC_ANY		1
+#endif
+
+struct opener {
+	pthread_t thread;
+	int fd;
+	int release[2];		/* the thread exits once this is readable */
+};
+
+/* Open /dev/null in a thread, which then stays around with its cache */
+static void *opener_fn(void *arg)
+{
+	struct opener *o = arg;
+	char c;
+
+	__atomic_store_n(&o->fd, open("/dev/null", O_RDONLY),
+			 __ATOMIC_RELEASE);
+	return read(o->release[0], &c, 1) < 0 ? (void *)-1 : NULL;
+}
+
+static void opener_stop(struct opener *o)
+{
+	close(o->release[1]);
+	pthread_join(o->thread, NULL);
+	close(o->release[0]);
+	close(o->fd);
+}
+
+static int opener_start(struct opener *o)
+{
+	o->fd = -2;
+	if (pipe(o->release))
+		return -1;
+	if (pthread_create(&o->thread, NULL, opener_fn, o))
+		return -1;
+	/* Wait for the open, the thread keeps blocking on ->release */
+	while (__atomic_load_n(&o->fd, __ATOMIC_ACQUIRE) == -2)
+		usleep(1000);
+	if (o->fd < 0) {
+		opener_stop(o);
+		return -1;
+	}
+	return 0;
+}
+
+static void test_dup2_reserved(void)
+{
+	struct opener o;
+	int fd;
+
+	if (opener_start(&o)) {
+		ksft_test_result_fail("dup2: starting a thread failed\n");
+		return;
+	}
+
+	/* o.fd + 1 is reserved by the thread if the kernel caches at all */
+	fd = dup2(STDIN_FILENO, o.fd + 1);
+	if (fd == o.fd + 1)
+		ksft_test_result_pass("dup2 onto a reserved descriptor\n");
+	else
+		ksft_test_result_fail("dup2 onto a reserved descriptor: %s\n",
+				      strerror(errno));
+	if (fd >= 0)
+		close(fd);
+	opener_stop(&o);
+}
+
+static void test_switch_to_lowest(void)
+{
+	struct opener o;
+	int low, fd;
+
+	if (opener_start(&o)) {
+		ksft_test_result_fail("switch: starting a thread failed\n");
+		return;
+	}
+
+	/*
+	 * The thread got the lowest free descriptor and still holds its
+	 * reservations above it.
+	 */
+	low = o.fd + 1;
+	if (prctl(PR_SET_FD_ALLOC, PR_FD_ALLOC_LOWEST, 0, 0, 0)) {
+		ksft_test_result_fail("PR_SET_FD_ALLOC: %s\n", strerror(errno));
+		opener_stop(&o);
+		return;
+	}
+
+	fd = open("/dev/null", O_RDONLY);
+	if (fd == low)
+		ksft_test_result_pass("lowest fd after PR_FD_ALLOC_LOWEST\n");
+	else
+		ksft_test_result_fail("got fd %d after PR_FD_ALLOC_LOWEST, lowest free is %d\n",
+				      fd, low);
+	if (fd >= 0)
+		close(fd);
+	opener_stop(&o);
+
+	prctl(PR_SET_FD_ALLOC, PR_FD_ALLOC_ANY, 0, 0, 0);
+}
+
+static void test_mixed_cloexec(void)
+{
+	int fds[32], i, flags, bad = 0;
+
+	for (i = 0; i < 32; i++) {
+		fds[i] = open("/dev/null", O_RDONLY | (i & 1 ? O_CLOEXEC : 0));
+		if (fds[i] < 0) {
+			ksft_test_result_fail("open: %s\n", strerror(errno));
+			return;
+		}
+	}
+	for (i = 0; i < 32; i++) {
+		flags = fcntl(fds[i], F_GETFD);
+		if (!!(flags & FD_CLOEXEC) != (i & 1))
+			bad++;
+		close(fds[i]);
+	}
+
+	if (!bad)
+		ksft_test_result_pass("close-on-exec of mixed opens\n");
+	else
+		ksft_test_result_fail("%d descriptors with the wrong close-on-exec\n",
+				      bad);
+}
+
+int main(void)
+{
+	ksft_print_header();
+
+	if (prctl(PR_SET_FD_ALLOC, PR_FD_ALLOC_ANY, 0, 0, 0))
+		ksft_exit_skip("PR_SET_FD_ALLOC: %s\n", strerror(errno));
+
+	ksft_set_plan(3);
+
+	test_dup2_reserved();
+	test_switch_to_lowest();
+	test_mixed_cloexec();
+
+	ksft_finished();
+}
@@ -0,0 +1,210 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Check that PR_SET_EXEC_TEXT_PREFAULT reads in a large text segment at
+ * execve(): right after exec, mincore() has to find most of it in the page
+ * cache already.  Also count the page faults taken to touch all of it, with
+ * and without the prctl.
+ *
+ * The test re-executes a fresh copy of itself for each run, so that the
+ * text starts out of the page cache both times.  The binary is linked with
+ * a 2M max-page-size, which lets the kernel map the text with PMDs when the
+ * filesystem supports large folios.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "../kselftest.h"
+
+#ifndef PR_SET_EXEC_TEXT_PREFAULT
+#define PR_SET_EXEC_TEXT_PREFAULT	102
+#define PR_GET_EXEC_TEXT_PREFAULT	103
+#endif
+
+#define __str(x)	#x
+#define str(x)		__str(x)
+
+#define TEXT_PAD_SIZE	0x2000000	/* 32M */
+
+/* Never executed, only there to make the text segment large */
+asm(".pushsection .text\n"
+    ".balign 4096\n"
+    "text_pad:\n"
+    ".fill " str(TEXT_PAD_SIZE) ", 1, 0\n"
+    ".popsection\n");
+extern const char text_pad[];
+
+struct result {
+	long resident;		/* pages of text_pad in the page cache at start */
+	long pages;
+	long faults;		/* faults taken to touch all of text_pad */
+};
+
+/* Pages of text_pad that are in the page cache, -1 on error */
+static long text_resident(long *pages)
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	unsigned long start = (unsigned long)text_pad & ~(page_size - 1);
+	unsigned long end = (unsigned long)text_pad + TEXT_PAD_SIZE;
+	unsigned char *vec;
+	long i, resident = 0;
+
+	*pages = (end - start + page_size - 1) / page_size;
+	vec = malloc(*pages);
+	if (!vec || mincore((void *)start, end - start, vec)) {
+		free(vec);
+		return -1;
+	}
+	for (i = 0; i < *pages; i++)
+		resident += vec[i] & 1;
+	free(vec);
+	return resident;
+}
+
+static long child(void)
+{
+	struct rusage before, after;
+	unsigned long sum = 0;
+	long resident, pages;
+	size_t i;
+
+	/* Before anything touches the text */
+	resident = text_resident(&pages);
+
+	getrusage(RUSAGE_SELF, &before);
+	for (i = 0; i < TEXT_PAD_SIZE; i += 4096)
+		sum += ((volatile const char *)text_pad)[i];
+	getrusage(RUSAGE_SELF, &after);
+
+	/* sum is always 0, it only keeps the loads */
+	printf("%ld %ld %ld\n", resident, pages,
+	       after.ru_minflt - before.ru_minflt +
+	       after.ru_majflt - before.ru_majflt + (long)sum);
+	return 0;
+}
+
+/* Copy this binary to a new file and drop the copy from the page cache */
+static int copy_self(char *path)
+{
+	char buf[65536];
+	int in, out;
+	ssize_t n;
+
+	in = open("/proc/self/exe", O_RDONLY);
+	if (in < 0)
+		return -1;
+	out = mkstemp(path);
+	if (out < 0) {
+		close(in);
+		return -1;
+	}
+
+	while ((n = read(in, buf, sizeof(buf))) > 0) {
+		if (write(out, buf, n) != n) {
+			n = -1;
+			break;
+		}
+	}
+	close(in);
+
+	if (n < 0 || fchmod(out, 0700) || fsync(out) ||
+	    posix_fadvise(out, 0, 0, POSIX_FADV_DONTNEED)) {
+		close(out);
+		unlink(path);
+		return -1;
+	}
+	close(out);
+	return 0;
+}
+
+/* Exec a copy of ourselves and collect what it measured, -1 on error */
+static int run(bool prefault, struct result *res)
+{
+	char path[] = "./text_prefault.XXXXXX";
+	char line[64] = "";
+	int fds[2], status, ret = -1;
+	pid_t pid;
+
+	if (copy_self(path)) {
+		ksft_print_msg("copying /proc/self/exe: %s\n", strerror(errno));
+		return -1;
+	}
+	if (pipe(fds)) {
+		unlink(path);
+		return -1;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		dup2(fds[1], STDOUT_FILENO);
+		close(fds[0]);
+		close(fds[1]);
+		if (prctl(PR_SET_EXEC_TEXT_PREFAULT, prefault, 0, 0, 0))
+			_exit(1);
+		execl(path, path, "child", (char *)NULL);
+		_exit(1);
+	}
+	close(fds[1]);
+
+	if (pid > 0 && read(fds[0], line, sizeof(line) - 1) > 0 &&
+	    waitpid(pid, &status, 0) == pid &&
+	    WIFEXITED(status) && !WEXITSTATUS(status) &&
+	    sscanf(line, "%ld %ld %ld", &res->resident, &res->pages,
+		   &res->faults) == 3 && res->resident >= 0)
+		ret = 0;
+
+	close(fds[0]);
+	unlink(path);
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	struct result without, with;
+
+	if (argc == 2 && !strcmp(argv[1], "child"))
+		return child();
+
+	ksft_print_header();
+
+	if (prctl(PR_GET_EXEC_TEXT_PREFAULT, 0, 0, 0, 0) < 0)
+		ksft_exit_skip("PR_GET_EXEC_TEXT_PREFAULT: %s\n", strerror(errno));
+
+	ksft_set_plan(2);
+
+	if (run(false, &without) || run(true, &with))
+		ksft_exit_fail_msg("running a copy of the test failed\n");
+
+	ksft_print_msg("text pages cached at exec: %ld without, %ld with PR_SET_EXEC_TEXT_PREFAULT, of %ld\n",
+		       without.resident, with.resident, with.pages);
+	ksft_print_msg("faults touching %d MB of text: %ld without, %ld with PR_SET_EXEC_TEXT_PREFAULT\n",
+		       TEXT_PAD_SIZE >> 20, without.faults, with.faults);
+
+	/*
+	 * Readahead is submitted at exec without waiting for it, but the
+	 * pages are in the page cache from then on.  Allow for some of it
+	 * being skipped under memory pressure.
+	 */
+	if (with.resident * 4 >= with.pages * 3 &&
+	    with.resident > without.resident)
+		ksft_test_result_pass("text is read in at exec\n");
+	else
+		ksft_test_result_fail("text is not read in at exec\n");
+
+	/* How far the count drops depends on large folio support of the fs */
+	if (with.faults <= without.faults)
+		ksft_test_result_pass("text prefault does not add faults\n");
+	else
+		ksft_test_result_fail("text prefault adds faults\n");
+
+	ksft_finished();
+}
@@ -0,0 +1,151 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * FUTEX_WAKEV test: wake the waiters of a list of futexes with one call
+ */
+
+#include <errno.h>
+#include <error.h>
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdint.h>
+#include "futextest.h"
+#include "logging.h"
+
+#ifndef FUTEX_WAKEV
+#define FUTEX_WAKEV		14
+#endif
+
+#define TEST_NAME "futex-wakev"
+#define WAKE_WAIT_US 10000
+#define NR_FUTEXES 8
+
+static struct futex_waitv wakev[NR_FUTEXES];
+static futex_t futexes[NR_FUTEXES];
+
+static int futex_wakev(struct futex_waitv *waiters, unsigned int nr,
+		       unsigned int flags, int opflags)
+{
+	return syscall(SYS_futex, waiters, FUTEX_WAKEV | opflags, nr, NULL,
+		       NULL, flags);
+}
+
+void usage(char *prog)
+{
+	printf("Usage: %s\n", prog);
+	printf("  -c	Use color\n");
+	printf("  -h	Display this help message\n");
+	printf("  -v L	Verbosity level: %d=QUIET %d=CRITICAL %d=INFO\n",
+	       VQUIET, VCRITICAL, VINFO);
+}
+
+void *waiterfn(void *arg)
+{
+	futex_t *f = arg;
+	struct timespec to = { .tv_sec = 1 };
+	int res;
+
+	res = futex_wait(f, 0, &to, FUTEX_PRIVATE_FLAG);
+	if (res)
+		ksft_test_result_fail("futex_wait returned: %d %s\n",
+				      errno, strerror(errno));
+	return NULL;
+}
+
+static void check_einval(const char *what, int res, int *ret)
+{
+	if (res != -1 || errno != EINVAL) {
+		ksft_test_result_fail("%s returned: %d %s, expecting EINVAL\n",
+				      what, res, res < 0 ? strerror(errno) : "");
+		*ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("%s\n", what);
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	pthread_t waiters[NR_FUTEXES];
+	int res, ret = RET_PASS;
+	int c, i;
+
+	while ((c = getopt(argc, argv, "chv:")) != -1) {
+		switch (c) {
+		case 'c':
+			log_color(1);
+			break;
+		case 'h':
+			usage(basename(argv[0]));
+			exit(0);
+		case 'v':
+			log_verbosity(atoi(optarg));
+			break;
+		default:
+			usage(basename(argv[0]));
+			exit(1);
+		}
+	}
+
+	ksft_print_header();
+	ksft_set_plan(6);
+	ksft_print_msg("%s: Test FUTEX_WAKEV\n", basename(argv[0]));
+
+	for (i = 0; i < NR_FUTEXES; i++) {
+		wakev[i].uaddr = (uintptr_t)&futexes[i];
+		wakev[i].flags = FUTEX_32 | FUTEX_PRIVATE_FLAG;
+		wakev[i].val = 1;
+		wakev[i].__reserved = 0;
+	}
+
+	/* One waiter per futex, all woken by a single call */
+	for (i = 0; i < NR_FUTEXES; i++) {
+		if (pthread_create(&waiters[i], NULL, waiterfn,
+				   (void *)&futexes[i]))
+			error(1, errno, "pthread_create failed\n");
+	}
+
+	usleep(WAKE_WAIT_US);
+
+	res = futex_wakev(wakev, NR_FUTEXES, 0, 0);
+	if (res != NR_FUTEXES) {
+		ksft_test_result_fail("futex_wakev returned: %d %s, expecting %d\n",
+				      res, res < 0 ? strerror(errno) : "",
+				      NR_FUTEXES);
+		ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("futex_wakev wakes every futex\n");
+	}
+
+	for (i = 0; i < NR_FUTEXES; i++)
+		pthread_join(waiters[i], NULL);
+
+	/* Nothing left to wake */
+	res = futex_wakev(wakev, NR_FUTEXES, 0, 0);
+	if (res) {
+		ksft_test_result_fail("futex_wakev returned: %d %s, expecting 0\n",
+				      res, res < 0 ? strerror(errno) : "");
+		ret = RET_FAIL;
+	} else {
+		ksft_test_result_pass("futex_wakev without waiters\n");
+	}
+
+	/* The flags are per futex, not in the op */
+	res = futex_wakev(wakev, NR_FUTEXES, 0, FUTEX_PRIVATE_FLAG);
+	check_einval("futex_wakev with FUTEX_PRIVATE_FLAG", res, &ret);
+
+	res = futex_wakev(wakev, NR_FUTEXES, 1, 0);
+	check_einval("futex_wakev with unknown flags", res, &ret);
+
+	res = futex_wakev(wakev, 0, 0, 0);
+	check_einval("futex_wakev of an empty list", res, &ret);
+
+	wakev[0].flags = FUTEX_PRIVATE_FLAG;
+	res = futex_wakev(wakev, NR_FUTEXES, 0, 0);
+	check_einval("futex_wakev without FUTEX_32", res, &ret);
+
+	ksft_print_cnts();
+	return ret;
+}